@@ -1,5 +1,6 @@
 #include "ImGuiApp.hpp"
 #include "ren/baking/mesh.hpp"
+#include "ren/core/Chrono.hpp"
 #include "ren/core/CmdLine.hpp"
 #include "ren/core/Format.hpp"
 #include "ren/core/GLTF.hpp"
@@ -20,8 +21,14 @@ struct DemoScene {
   Span<Handle<Mesh>> meshes;
 };
 
-DemoScene load_scene(ren::NotNull<ren::Arena *> frame_arena,
-                     ren::NotNull<ren::Scene *> scene, ren::Path path) {
+// Scene with baked meshes that haven't been added to a renderer scene yet.
+struct BakedScene {
+  Span<ren::Blob> meshes;
+  Span<glm::mat4x3> transforms;
+  Span<usize> mesh_indices;
+};
+
+BakedScene bake_scene(ren::NotNull<ren::Arena *> arena, ren::Path path) {
   ren::ScratchArena scratch;
 
   ren::Result<ren::Gltf, ren::GltfErrorInfo> gltf = ren::load_gltf(
@@ -58,21 +65,20 @@ DemoScene load_scene(ren::NotNull<ren::Arena *> frame_arena,
     num_primitives += mesh.primitives.size();
   }
 
-  Span<Handle<Mesh>> primitive_handles =
-      Span<Handle<Mesh>>::allocate(scratch, num_primitives);
+  Span<ren::Blob> primitive_blobs =
+      Span<ren::Blob>::allocate(arena, num_primitives);
   for (usize mesh_index : range(gltf->meshes.size())) {
     const GltfMesh &mesh = gltf->meshes[mesh_index];
     for (usize primitive_index : range(mesh.primitives.size())) {
       ren::MeshInfo mesh_info = ren::gltf_primitive_to_mesh_info(
           gltf->buffers[0].bytes, *gltf, mesh.primitives[primitive_index]);
-      ren::Blob blob = ren::bake_mesh_to_memory(scratch, mesh_info);
-      primitive_handles[primitive_offsets[mesh_index] + primitive_index] =
-          ren::create_mesh(frame_arena, scene, blob.data, blob.size);
+      primitive_blobs[primitive_offsets[mesh_index] + primitive_index] =
+          ren::bake_mesh_to_memory(arena, mesh_info);
     }
   }
 
   DynamicArray<glm::mat4x3> scene_transforms;
-  DynamicArray<Handle<Mesh>> scene_meshes;
+  DynamicArray<usize> scene_meshes;
   for (i32 node_index : gltf->scenes[0].nodes) {
     const GltfNode &node = gltf->nodes[node_index];
     if (node.mesh == -1) {
@@ -84,18 +90,49 @@ DemoScene load_scene(ren::NotNull<ren::Arena *> frame_arena,
     const GltfMesh &mesh = gltf->meshes[node.mesh];
     for (usize primitive_index : range(mesh.primitives.size())) {
       scene_transforms.push(scratch, node.matrix);
-      scene_meshes.push(
-          scratch,
-          primitive_handles[primitive_offsets[node.mesh] + primitive_index]);
+      scene_meshes.push(scratch,
+                        primitive_offsets[node.mesh] + primitive_index);
     }
   }
 
   return {
-      .transforms = Span(scene_transforms).copy(frame_arena),
-      .meshes = Span(scene_meshes).copy(frame_arena),
+      .meshes = primitive_blobs,
+      .transforms = Span(scene_transforms).copy(arena),
+      .mesh_indices = Span(scene_meshes).copy(arena),
   };
 }
 
+DemoScene create_demo_scene(ren::NotNull<ren::Arena *> frame_arena,
+                            ren::NotNull<ren::Scene *> scene,
+                            const BakedScene &baked_scene) {
+  ren::ScratchArena scratch;
+  auto mesh_handles =
+      Span<Handle<Mesh>>::allocate(scratch, baked_scene.meshes.size());
+  for (usize i : range(baked_scene.meshes.size())) {
+    const ren::Blob &blob = baked_scene.meshes[i];
+    mesh_handles[i] =
+        ren::create_mesh(frame_arena, scene, blob.data, blob.size);
+  }
+  auto meshes = Span<Handle<Mesh>>::allocate(frame_arena,
+                                             baked_scene.mesh_indices.size());
+  for (usize i : range(meshes.size())) {
+    meshes[i] = mesh_handles[baked_scene.mesh_indices[i]];
+  }
+  return {
+      .transforms = baked_scene.transforms,
+      .meshes = meshes,
+  };
+}
+
+DemoScene load_scene(ren::NotNull<ren::Arena *> frame_arena,
+                     ren::NotNull<ren::Scene *> scene, ren::Path path) {
+  ren::ScratchArena scratch;
+  BakedScene baked_scene = bake_scene(scratch, path);
+  DemoScene demo_scene = create_demo_scene(frame_arena, scene, baked_scene);
+  demo_scene.transforms = demo_scene.transforms.copy(frame_arena);
+  return demo_scene;
+}
+
 glm::vec2 get_scene_bounds(unsigned num_entities) {
   float s = std::cbrt(num_entities);
   return {-s, s};
@@ -127,7 +164,7 @@ auto random_transform(float i, float min_trans, float max_trans,
   return transform;
 }
 
-void place_entities(
+ren::u64 place_entities(
     ren::NotNull<ren::Arena *> arena, ren::NotNull<ren::Arena *> frame_arena,
     ren::Scene *scene, DemoScene demo_scene,
     ren::Handle<ren::Material> material, unsigned num_entities,
@@ -157,11 +194,14 @@ void place_entities(
           scene_transform * glm::mat4(demo_scene.transforms[scene_index]);
     }
   }
+  ren::u64 start = ren::clock();
   ren::create_mesh_instances(frame_arena, scene,
                              {create_info, num_entities * scene_size},
                              {entities, num_entities * scene_size});
+  ren::u64 create_time = ren::clock() - start;
   *out_entities = entities;
   *out_transforms = transforms;
+  return create_time;
 }
 
 void place_light(ren::Scene *scene) {
@@ -222,9 +262,112 @@ public:
   }
 };
 
+// Measure mesh instance creation throughput without a window or swap chain.
+int run_benchmark(ren::Path mesh_path, unsigned num_entities) {
+  ren::Arena arena = ren::Arena::init();
+  ren::Arena frame_arena = ren::Arena::init();
+
+  ren::Renderer *renderer =
+      ren::create_renderer(&arena, {.type = ren::RendererType::Headless});
+  if (!renderer) {
+    return EXIT_FAILURE;
+  }
+  ren::Scene *scene = ren::create_scene(&arena, renderer, nullptr);
+  if (!scene) {
+    fmt::println(stderr, "Scene initialization failed");
+    return EXIT_FAILURE;
+  }
+
+  // Parse and bake meshes once so that they don't count towards any of the
+  // measured times.
+  BakedScene baked_scene = bake_scene(&arena, mesh_path);
+
+  DemoScene demo_scene = create_demo_scene(&frame_arena, scene, baked_scene);
+  ren::Handle<ren::Material> material =
+      ren::create_material(&frame_arena, scene, {.metallic_factor = 0.0f});
+
+  ren::Handle<ren::MeshInstance> *entities = nullptr;
+  glm::mat4x3 *transforms = nullptr;
+  ren::u64 time =
+      place_entities(&arena, &frame_arena, scene, demo_scene, material,
+                     num_entities, &entities, &transforms);
+  usize num_instances = num_entities * demo_scene.transforms.size();
+  fmt::println("Created {} mesh instances in {:.3f} ms ({:.3f} M/s)",
+               num_instances, time / 1e6, num_instances * 1e3 / time);
+
+  ren::destroy_scene(scene);
+  scene = ren::create_scene(&arena, renderer, nullptr);
+  demo_scene = create_demo_scene(&frame_arena, scene, baked_scene);
+  material =
+      ren::create_material(&frame_arena, scene, {.metallic_factor = 0.0f});
+
+  auto *meshes = arena.allocate<ren::Handle<ren::Mesh>>(num_instances);
+  for (usize i : range(num_instances)) {
+    meshes[i] = demo_scene.meshes[i % demo_scene.meshes.size()];
+  }
+  ren::u64 start = ren::clock();
+  ren::create_mesh_instances_bulk(&frame_arena, scene,
+                                  {
+                                      .meshes = {meshes, num_instances},
+                                      .materials = {&material, 1},
+                                      .transforms = {transforms, num_instances},
+                                  },
+                                  {entities, num_instances});
+  time = ren::clock() - start;
+  fmt::println("Created {} mesh instances in bulk with transforms in {:.3f} ms "
+               "({:.3f} M/s)",
+               num_instances, time / 1e6, num_instances * 1e3 / time);
+
+  Span<std::byte> snapshot = ren::save_scene_snapshot(&arena, scene);
+
+  // Rebuild the same scene with the regular API. Neither this nor loading the
+  // snapshot waits for GPU uploads, which only happen on the next draw.
+  ren::destroy_scene(scene);
+  scene = ren::create_scene(&arena, renderer, nullptr);
+  auto *create_info =
+      arena.allocate<ren::MeshInstanceCreateInfo>(num_instances);
+  start = ren::clock();
+  demo_scene = create_demo_scene(&frame_arena, scene, baked_scene);
+  material =
+      ren::create_material(&frame_arena, scene, {.metallic_factor = 0.0f});
+  for (usize i : range(num_instances)) {
+    create_info[i] = {
+        .mesh = demo_scene.meshes[i % demo_scene.meshes.size()],
+        .material = material,
+    };
+  }
+  ren::create_mesh_instances(&frame_arena, scene, {create_info, num_instances},
+                             {entities, num_instances});
+  ren::set_mesh_instance_transforms(&frame_arena, scene,
+                                    {entities, num_instances},
+                                    {transforms, num_instances});
+  ren::u64 replay_time = ren::clock() - start;
+
+  ren::destroy_scene(scene);
+  scene = ren::create_scene(&arena, renderer, nullptr);
+  start = ren::clock();
+  if (!ren::load_scene_snapshot(&frame_arena, scene, snapshot)) {
+    fmt::println(stderr, "Failed to load scene snapshot");
+    ren::destroy_scene(scene);
+    return EXIT_FAILURE;
+  }
+  time = ren::clock() - start;
+  fmt::println("Loaded {} MiB scene snapshot in {:.3f} ms, replay took {:.3f} "
+               "ms",
+               snapshot.size_bytes() >> 20, time / 1e6, replay_time / 1e6);
+
+  ren::destroy_scene(scene);
+  ren::destroy_renderer(renderer);
+  frame_arena.destroy();
+  arena.destroy();
+
+  return EXIT_SUCCESS;
+}
+
 enum EntityStressTestOptions {
   OPTION_FILE,
   OPTION_NUM_ENTITIES,
+  OPTION_BENCHMARK,
   OPTION_HELP,
   OPTION_COUNT,
 };
@@ -238,6 +381,7 @@ int main(int argc, const char *argv[]) {
   ren::CmdLineOption options[] = {
     {OPTION_FILE, ren::CmdLinePath, "file", 'f', "Path to mesh", ren::CmdLinePositional},
     {OPTION_NUM_ENTITIES, ren::CmdLineUInt, "num-entities", 'n', "Number of entities to draw"},
+    {OPTION_BENCHMARK, ren::CmdLineFlag, "benchmark", 0, "Measure entity creation time without opening a window"},
     {OPTION_HELP, ren::CmdLineFlag, "help", 'h', "Show this message"},
   };
   // clang-format on
@@ -250,10 +394,15 @@ int main(int argc, const char *argv[]) {
   }
 
   ren::Path mesh_path = parsed[OPTION_FILE].as_path;
-  ren::u32 num_entities = 100'000;
+  bool benchmark = parsed[OPTION_BENCHMARK].is_set;
+  ren::u32 num_entities = benchmark ? 1'000'000 : 100'000;
   if (parsed[OPTION_NUM_ENTITIES].is_set) {
     num_entities = parsed[OPTION_NUM_ENTITIES].as_uint;
   }
 
+  if (benchmark) {
+    return run_benchmark(mesh_path, num_entities);
+  }
+
   EntityStressTestApp::run(mesh_path, num_entities);
 }
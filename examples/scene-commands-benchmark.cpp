@@ -0,0 +1,168 @@
+#include "ren/baking/mesh.hpp"
+#include "ren/core/Algorithm.hpp"
+#include "ren/core/Chrono.hpp"
+#include "ren/core/CmdLine.hpp"
+#include "ren/core/Job.hpp"
+#include "ren/ren.hpp"
+
+#include <cstdlib>
+#include <fmt/base.h>
+
+namespace {
+
+using namespace ren;
+
+Handle<Mesh> create_triangle(NotNull<Arena *> frame_arena, Scene *scene) {
+  ScratchArena scratch;
+  glm::vec3 positions[] = {
+      {0.0f, 0.0f, 0.0f},
+      {1.0f, 0.0f, 0.0f},
+      {0.0f, 1.0f, 0.0f},
+  };
+  glm::vec3 normals[] = {
+      {0.0f, 0.0f, 1.0f},
+      {0.0f, 0.0f, 1.0f},
+      {0.0f, 0.0f, 1.0f},
+  };
+  u32 indices[] = {0, 1, 2};
+  Blob blob = bake_mesh_to_memory(scratch, {
+                                               .num_vertices = 3,
+                                               .positions = positions,
+                                               .normals = normals,
+                                               .indices = indices,
+                                           });
+  return create_mesh(frame_arena, scene, blob.data, blob.size);
+}
+
+// Record updates of all mesh instances from num_producers jobs in chunks of
+// CHUNK_SIZE, as gameplay systems would, and apply them.
+void run_benchmark(NotNull<Arena *> frame_arena, Scene *scene,
+                   Span<SceneCommandRecorder *const> recorders,
+                   Span<const Handle<MeshInstance>> mesh_instances,
+                   usize num_producers) {
+  constexpr usize CHUNK_SIZE = 1024;
+
+  ScratchArena scratch;
+
+  usize num_mesh_instances = mesh_instances.m_size;
+  auto transforms = Span<glm::mat4x3>::allocate(scratch, num_mesh_instances);
+  for (usize i : range(num_mesh_instances)) {
+    transforms[i] = glm::mat4x3(1.0f);
+    transforms[i][3] = {float(i), 0.0f, 0.0f};
+  }
+
+  auto jobs = Span<JobDesc>::allocate(scratch, num_producers);
+  usize per_producer = (num_mesh_instances + num_producers - 1) / num_producers;
+  for (usize p : range(num_producers)) {
+    usize begin = min(p * per_producer, num_mesh_instances);
+    usize end = min(begin + per_producer, num_mesh_instances);
+    SceneCommandRecorder *recorder = recorders[p];
+    jobs[p] = JobDesc::init(
+        scratch, "Record transforms",
+        [recorder, mesh_instances, transforms, begin, end] {
+          for (usize chunk = begin; chunk < end; chunk += CHUNK_SIZE) {
+            usize count = min(CHUNK_SIZE, end - chunk);
+            record_mesh_instance_transforms(
+                recorder, mesh_instances.subspan(chunk, count),
+                Span<const glm::mat4x3>(transforms).subspan(chunk, count));
+          }
+        });
+  }
+
+  u64 start = ren::clock();
+  job_dispatch_and_wait(jobs);
+  u64 record_time = ren::clock() - start;
+
+  start = ren::clock();
+  apply_scene_commands(frame_arena, scene);
+  u64 apply_time = ren::clock() - start;
+
+  fmt::println("{:3} producers: record {:10.3f} ms ({:8.3f} M/s), apply "
+               "{:10.3f} ms",
+               num_producers, record_time / 1e6,
+               num_mesh_instances * 1e3 / record_time, apply_time / 1e6);
+}
+
+enum SceneCommandsBenchmarkOptions {
+  OPTION_NUM_MESH_INSTANCES,
+  OPTION_MAX_PRODUCERS,
+  OPTION_HELP,
+  OPTION_COUNT,
+};
+
+} // namespace
+
+int main(int argc, const char *argv[]) {
+  ren::ScratchArena::init_for_thread();
+  ren::launch_job_server();
+  ren::ScratchArena scratch;
+
+  // clang-format off
+  ren::CmdLineOption options[] = {
+    {OPTION_NUM_MESH_INSTANCES, ren::CmdLineUInt, "num-mesh-instances", 'n', "Number of mesh instances to update"},
+    {OPTION_MAX_PRODUCERS, ren::CmdLineUInt, "max-producers", 'p', "Maximum number of producer jobs"},
+    {OPTION_HELP, ren::CmdLineFlag, "help", 'h', "Show this message"},
+  };
+  // clang-format on
+  ren::ParsedCmdLineOption parsed[OPTION_COUNT];
+  bool success = ren::parse_cmd_line(scratch, argv, options, parsed);
+  if (!success or parsed[OPTION_HELP].is_set) {
+    ren::ScratchArena scratch;
+    fmt::print("{}", ren::cmd_line_help(scratch, argv[0], options));
+    return EXIT_FAILURE;
+  }
+
+  ren::usize num_mesh_instances = 1'000'000;
+  if (parsed[OPTION_NUM_MESH_INSTANCES].is_set) {
+    num_mesh_instances = parsed[OPTION_NUM_MESH_INSTANCES].as_uint;
+  }
+  ren::usize max_producers = 16;
+  if (parsed[OPTION_MAX_PRODUCERS].is_set) {
+    max_producers = max<ren::usize>(parsed[OPTION_MAX_PRODUCERS].as_uint, 1);
+  }
+
+  ren::Arena arena = ren::Arena::init();
+  ren::Arena frame_arena = ren::Arena::init();
+  ren::Renderer *renderer =
+      ren::create_renderer(&arena, {.type = ren::RendererType::Headless});
+  if (!renderer) {
+    return EXIT_FAILURE;
+  }
+  ren::Scene *scene = ren::create_scene(&arena, renderer, nullptr);
+  if (!scene) {
+    fmt::println(stderr, "Scene initialization failed");
+    return EXIT_FAILURE;
+  }
+
+  ren::Handle<ren::Mesh> mesh = create_triangle(&frame_arena, scene);
+  ren::Handle<ren::Material> material =
+      ren::create_material(&frame_arena, scene, {});
+  auto meshes =
+      ren::Span<ren::Handle<ren::Mesh>>::allocate(&arena, num_mesh_instances);
+  ren::fill(meshes, mesh);
+  auto mesh_instances = ren::Span<ren::Handle<ren::MeshInstance>>::allocate(
+      &arena, num_mesh_instances);
+  ren::create_mesh_instances_bulk(&frame_arena, scene,
+                                  {
+                                      .meshes = meshes,
+                                      .materials = {&material, 1},
+                                  },
+                                  mesh_instances);
+
+  auto recorders =
+      ren::Span<ren::SceneCommandRecorder *>::allocate(&arena, max_producers);
+  for (ren::SceneCommandRecorder *&recorder : recorders) {
+    recorder = ren::create_scene_command_recorder(scene);
+  }
+
+  for (ren::usize num_producers = 1; num_producers <= max_producers;
+       num_producers *= 2) {
+    run_benchmark(&frame_arena, scene, recorders, mesh_instances,
+                  num_producers);
+  }
+
+  ren::destroy_scene(scene);
+  ren::destroy_renderer(renderer);
+  frame_arena.destroy();
+  arena.destroy();
+}
@@ -0,0 +1,194 @@
+#include "ren/baking/mesh.hpp"
+#include "ren/core/Algorithm.hpp"
+#include "ren/core/Chrono.hpp"
+#include "ren/core/CmdLine.hpp"
+#include "ren/core/Job.hpp"
+#include "ren/ren.hpp"
+
+#include <cstdlib>
+#include <fmt/base.h>
+
+namespace {
+
+using namespace ren;
+
+// Every MESH_INSTANCE_STRIDE-th node drives a mesh instance, so that updates
+// also upload new mesh instance transforms.
+constexpr usize MESH_INSTANCE_STRIDE = 4;
+
+Handle<Mesh> create_triangle(NotNull<Arena *> frame_arena, Scene *scene) {
+  ScratchArena scratch;
+  glm::vec3 positions[] = {
+      {0.0f, 0.0f, 0.0f},
+      {1.0f, 0.0f, 0.0f},
+      {0.0f, 1.0f, 0.0f},
+  };
+  glm::vec3 normals[] = {
+      {0.0f, 0.0f, 1.0f},
+      {0.0f, 0.0f, 1.0f},
+      {0.0f, 0.0f, 1.0f},
+  };
+  u32 indices[] = {0, 1, 2};
+  Blob blob = bake_mesh_to_memory(scratch, {
+                                               .num_vertices = 3,
+                                               .positions = positions,
+                                               .normals = normals,
+                                               .indices = indices,
+                                           });
+  return create_mesh(frame_arena, scene, blob.data, blob.size);
+}
+
+// Create a tree of num_nodes transform nodes in breadth-first order where
+// each node has up to fanout children.
+Span<Handle<TransformNode>>
+create_tree(NotNull<Arena *> arena, Scene *scene, usize num_nodes, usize fanout,
+            Span<const Handle<MeshInstance>> mesh_instances) {
+  ScratchArena scratch;
+  auto nodes = Span<Handle<TransformNode>>::allocate(arena, num_nodes);
+  auto create_info =
+      Span<TransformNodeCreateInfo>::allocate(scratch, num_nodes);
+  usize begin = 0;
+  while (begin < num_nodes) {
+    // Parents must exist before their children are created.
+    usize end = min(num_nodes, max(begin + 1, begin * fanout + 1));
+    for (usize i : range(begin, end)) {
+      create_info[i] = {
+          .parent = i > 0 ? nodes[(i - 1) / fanout] : Handle<TransformNode>(),
+          .mesh_instance = i % MESH_INSTANCE_STRIDE == 0
+                               ? mesh_instances[i / MESH_INSTANCE_STRIDE]
+                               : Handle<MeshInstance>(),
+          .transform = {.translation = {1.0f, 0.0f, 0.0f}},
+      };
+    }
+    create_transform_nodes(scene, create_info.subspan(begin, end - begin),
+                           nodes.subspan(begin, end - begin));
+    begin = end;
+  }
+  return nodes;
+}
+
+void run_benchmark(NotNull<Arena *> frame_arena, Scene *scene,
+                   Handle<Mesh> mesh, Handle<Material> material,
+                   const char *name, usize num_nodes, usize fanout) {
+  ScratchArena scratch;
+
+  usize num_mesh_instances =
+      (num_nodes + MESH_INSTANCE_STRIDE - 1) / MESH_INSTANCE_STRIDE;
+  auto meshes = Span<Handle<Mesh>>::allocate(scratch, num_mesh_instances);
+  fill(meshes, mesh);
+  auto mesh_instances =
+      Span<Handle<MeshInstance>>::allocate(scratch, num_mesh_instances);
+  create_mesh_instances_bulk(frame_arena, scene,
+                             {
+                                 .meshes = meshes,
+                                 .materials = {&material, 1},
+                             },
+                             mesh_instances);
+
+  u64 start = ren::clock();
+  Span<Handle<TransformNode>> nodes =
+      create_tree(scratch, scene, num_nodes, fanout, mesh_instances);
+  u64 create_time = ren::clock() - start;
+
+  start = ren::clock();
+  update_transform_nodes(frame_arena, scene);
+  u64 first_update_time = ren::clock() - start;
+
+  // Changing the root dirties the whole tree.
+  LocalTransform root_transform = {.translation = {0.0f, 1.0f, 0.0f}};
+  set_transform_node_transforms(scene, {&nodes[0], 1}, {&root_transform, 1});
+  start = ren::clock();
+  update_transform_nodes(frame_arena, scene);
+  u64 root_update_time = ren::clock() - start;
+
+  // Change the last 1% of nodes. With a fanout greater than 1 these are
+  // leaves, and with a fanout of 1 they are the end of the chain, so about 1%
+  // of the tree has to be updated either way.
+  usize num_changed = max<usize>(num_nodes / 100, 1);
+  auto transforms = Span<LocalTransform>::allocate(scratch, num_changed);
+  for (LocalTransform &transform : transforms) {
+    transform = {.translation = {0.0f, 0.0f, 1.0f}};
+  }
+  set_transform_node_transforms(
+      scene, nodes.subspan(num_nodes - num_changed, num_changed), transforms);
+  start = ren::clock();
+  update_transform_nodes(frame_arena, scene);
+  u64 leaf_update_time = ren::clock() - start;
+
+  start = ren::clock();
+  for (isize i = isize(num_nodes) - 1; i >= 0; --i) {
+    destroy_transform_nodes(scene, {&nodes[i], 1});
+  }
+  update_transform_nodes(frame_arena, scene);
+  u64 destroy_time = ren::clock() - start;
+
+  destroy_mesh_instances(frame_arena, scene, mesh_instances);
+
+  fmt::println("{}: {} nodes, fanout {}, {} mesh instances", name, num_nodes,
+               fanout, num_mesh_instances);
+  fmt::println("  create:        {:10.3f} ms", create_time / 1e6);
+  fmt::println("  first update:  {:10.3f} ms", first_update_time / 1e6);
+  fmt::println("  root update:   {:10.3f} ms", root_update_time / 1e6);
+  fmt::println("  leaf update:   {:10.3f} ms", leaf_update_time / 1e6);
+  fmt::println("  destroy:       {:10.3f} ms", destroy_time / 1e6);
+}
+
+enum TransformBenchmarkOptions {
+  OPTION_NUM_NODES,
+  OPTION_HELP,
+  OPTION_COUNT,
+};
+
+} // namespace
+
+int main(int argc, const char *argv[]) {
+  ren::ScratchArena::init_for_thread();
+  ren::launch_job_server();
+  ren::ScratchArena scratch;
+
+  // clang-format off
+  ren::CmdLineOption options[] = {
+    {OPTION_NUM_NODES, ren::CmdLineUInt, "num-nodes", 'n', "Number of nodes in each hierarchy"},
+    {OPTION_HELP, ren::CmdLineFlag, "help", 'h', "Show this message"},
+  };
+  // clang-format on
+  ren::ParsedCmdLineOption parsed[OPTION_COUNT];
+  bool success = ren::parse_cmd_line(scratch, argv, options, parsed);
+  if (!success or parsed[OPTION_HELP].is_set) {
+    ren::ScratchArena scratch;
+    fmt::print("{}", ren::cmd_line_help(scratch, argv[0], options));
+    return EXIT_FAILURE;
+  }
+
+  ren::usize num_nodes = 1'000'000;
+  if (parsed[OPTION_NUM_NODES].is_set) {
+    num_nodes = parsed[OPTION_NUM_NODES].as_uint;
+  }
+
+  ren::Arena arena = ren::Arena::init();
+  ren::Arena frame_arena = ren::Arena::init();
+  ren::Renderer *renderer =
+      ren::create_renderer(&arena, {.type = ren::RendererType::Headless});
+  if (!renderer) {
+    return EXIT_FAILURE;
+  }
+  ren::Scene *scene = ren::create_scene(&arena, renderer, nullptr);
+  if (!scene) {
+    fmt::println(stderr, "Scene initialization failed");
+    return EXIT_FAILURE;
+  }
+
+  ren::Handle<ren::Mesh> mesh = create_triangle(&frame_arena, scene);
+  ren::Handle<ren::Material> material =
+      ren::create_material(&frame_arena, scene, {});
+
+  run_benchmark(&frame_arena, scene, mesh, material, "Wide", num_nodes,
+                num_nodes);
+  run_benchmark(&frame_arena, scene, mesh, material, "Balanced", num_nodes, 8);
+  run_benchmark(&frame_arena, scene, mesh, material, "Deep", num_nodes, 1);
+
+  ren::destroy_scene(scene);
+  ren::destroy_renderer(renderer);
+  frame_arena.destroy();
+  arena.destroy();
+}
@@ -140,15 +140,11 @@ struct MeshCacheItem {
   ren::Handle<ren::Mesh> handle;
 };
 
-struct ImageCacheItem {
-  int id = -1;
-  ren::Handle<ren::Image> handle;
-};
-
-struct OrmImageCacheItem {
-  int rm_id = -1;
-  int o_id = -1;
-  ren::Handle<ren::Image> handle;
+// Indices of a material's textures in the texture bake batch.
+struct MaterialTextures {
+  int base_color = -1;
+  int orm = -1;
+  int normal = -1;
 };
 
 template <typename T>
@@ -192,7 +188,18 @@ public:
     m_default_material =
         ren::create_material(m_frame_arena, m_scene, MaterialCreateInfo{});
 
+    create_materials(m_gltf.scenes[scene]);
     walk_scene(m_gltf.scenes[scene]);
+
+    const ren::MeshletStats &stats = m_meshlet_stats;
+    if (stats.num_meshlets > 0) {
+      log("Baked {} meshlets with {} triangles: {:.1f}% usable normal cones, "
+          "{:.1f} deg average cone angle, {:.3f} average sphere tightness",
+          stats.num_meshlets, stats.num_triangles,
+          100.0f * stats.num_cones / stats.num_meshlets,
+          stats.num_cones > 0 ? m_cone_angle_sum / stats.num_cones : 0.0,
+          m_sphere_tightness_sum / stats.num_meshlets);
+    }
   }
 
 private:
@@ -236,16 +243,25 @@ private:
         get_accessor_data<glm::vec4>(colors ? colors->accessor : -1);
     Span<const u32> indices_data = get_accessor_data<u32>(primitive.indices);
 
+    ren::MeshletStats stats;
     ren::Blob blob = ren::bake_mesh_to_memory(
-        scratch, {
-                     .num_vertices = positions_data.m_size,
-                     .positions = positions_data.m_data,
-                     .normals = normals_data.m_data,
-                     .tangents = tangents_data.m_data,
-                     .uvs = uv_data.m_data,
-                     .colors = colors_data.m_data,
-                     .indices = indices_data,
-                 });
+        scratch,
+        {
+            .num_vertices = positions_data.m_size,
+            .positions = positions_data.m_data,
+            .normals = normals_data.m_data,
+            .tangents = tangents_data.m_data,
+            .uvs = uv_data.m_data,
+            .colors = colors_data.m_data,
+            .indices = indices_data,
+        },
+        {.stats = &stats});
+    m_meshlet_stats.num_meshlets += stats.num_meshlets;
+    m_meshlet_stats.num_triangles += stats.num_triangles;
+    m_meshlet_stats.num_cones += stats.num_cones;
+    m_cone_angle_sum += double(stats.avg_cone_angle) * stats.num_cones;
+    m_sphere_tightness_sum +=
+        double(stats.avg_sphere_tightness) * stats.num_meshlets;
     return ren::create_mesh(m_frame_arena, m_scene, blob.data, blob.size);
   }
 
@@ -300,11 +316,16 @@ private:
     return get_sampler(m_gltf.samplers[sampler]);
   }
 
-  ren::Handle<ren::Material> create_material(int index) {
+  bool get_material_create_info(
+      int index, ren::NotNull<ren::Arena *> arena,
+      ren::NotNull<ren::MaterialCreateInfo *> desc,
+      ren::NotNull<MaterialTextures *> textures,
+      ren::NotNull<ren::DynamicArray<ren::TextureBakeInfo> *> bake_infos) {
     const GltfMaterial &material = m_gltf.materials[index];
-    ren::MaterialCreateInfo desc = {};
+    *desc = {};
+    *textures = {};
 
-    desc.base_color_factor = material.pbr_metallic_roughness.base_color_factor;
+    desc->base_color_factor = material.pbr_metallic_roughness.base_color_factor;
 
     {
       const GltfTextureInfo &base_color_texture =
@@ -314,30 +335,21 @@ private:
           fmt::println(stderr,
                        "Unsupported base color texture coordinate set {}",
                        base_color_texture.tex_coord);
-          return ren::NullHandle;
+          return false;
         }
         int src = m_gltf.textures[base_color_texture.index].source;
-        const ImageCacheItem *cached = ren::find_if(
-            ren::Span(m_color_image_cache),
-            [&](const ImageCacheItem &item) { return item.id == src; });
-        if (cached) {
-          desc.base_color_texture.image = cached->handle;
-        } else {
-          ren::ScratchArena scratch;
-          ren::TextureInfo texture_info = get_image_info(src, true);
-          auto blob = ren::bake_color_map_to_memory(scratch, texture_info);
-          ren::Handle<ren::Image> image =
-              create_image(m_frame_arena, m_scene, blob.data, blob.size);
-          m_color_image_cache.push(m_load_arena, {src, image});
-          desc.base_color_texture.image = image;
-        }
-        desc.base_color_texture.sampler =
+        textures->base_color = bake_infos->m_size;
+        bake_infos->push(arena, {
+                                    .type = ren::TextureBakeType::Color,
+                                    .info = get_image_info(src, true),
+                                });
+        desc->base_color_texture.sampler =
             get_texture_sampler(base_color_texture.index);
       }
     }
 
-    desc.metallic_factor = material.pbr_metallic_roughness.metallic_factor;
-    desc.roughness_factor = material.pbr_metallic_roughness.roughness_factor;
+    desc->metallic_factor = material.pbr_metallic_roughness.metallic_factor;
+    desc->roughness_factor = material.pbr_metallic_roughness.roughness_factor;
 
     {
       const GltfTextureInfo &metallic_roughness_texture =
@@ -350,48 +362,29 @@ private:
               stderr,
               "Unsupported metallic-roughness texture coordinate set {}",
               metallic_roughness_texture.tex_coord);
-          return ren::NullHandle;
+          return false;
         }
         int roughness_metallic_src =
             m_gltf.textures[metallic_roughness_texture.index].source;
-        int occlusion_src = -1;
+        ren::TextureInfo occlusion_info;
         if (occlusion_texture.index >= 0) {
           if (occlusion_texture.tex_coord > 0) {
             fmt::println(stderr,
                          "Unsupported occlusion texture coordinate set {}",
                          occlusion_texture.tex_coord);
-            return ren::NullHandle;
-          }
-          occlusion_src = m_gltf.textures[occlusion_texture.index].source;
-        }
-        const OrmImageCacheItem *cached = ren::find_if(
-            ren::Span(m_orm_image_cache), [&](const OrmImageCacheItem &item) {
-              return item.rm_id == roughness_metallic_src and
-                     item.o_id == occlusion_src;
-            });
-        if (cached) {
-          desc.orm_texture.image = cached->handle;
-        } else {
-          ren::ScratchArena scratch;
-          ren::TextureInfo roughness_metallic_info =
-              get_image_info(roughness_metallic_src);
-          ren::TextureInfo occlusion_info;
-          if (occlusion_src >= 0) {
-            occlusion_info = get_image_info(occlusion_src);
+            return false;
           }
-          auto blob = ren::bake_orm_map_to_memory(
-              scratch, roughness_metallic_info, occlusion_info);
-          ren::Handle<ren::Image> image =
-              create_image(m_frame_arena, m_scene, blob.data, blob.size);
-          m_orm_image_cache.push(m_load_arena,
-                                 {
-                                     .rm_id = roughness_metallic_src,
-                                     .o_id = occlusion_src,
-                                     .handle = image,
-                                 });
-          desc.orm_texture.image = image;
+          occlusion_info = get_image_info(
+              m_gltf.textures[occlusion_texture.index].source);
         }
-        desc.orm_texture.sampler =
+        textures->orm = bake_infos->m_size;
+        bake_infos->push(arena,
+                         {
+                             .type = ren::TextureBakeType::Orm,
+                             .info = get_image_info(roughness_metallic_src),
+                             .occlusion_info = occlusion_info,
+                         });
+        desc->orm_texture.sampler =
             get_texture_sampler(metallic_roughness_texture.index);
       } else if (occlusion_texture.index >= 0) {
         warn("Occlusion textures without a metallic-roughness texture are not "
@@ -405,26 +398,17 @@ private:
         if (normal_texture.tex_coord > 0) {
           fmt::println(stderr, "Unsupported normal texture coordinate set {}",
                        normal_texture.tex_coord);
-          return ren::NullHandle;
+          return false;
         }
         int src = m_gltf.textures[normal_texture.index].source;
-        const ImageCacheItem *cached = ren::find_if(
-            ren::Span(m_normal_image_cache),
-            [&](const ImageCacheItem &item) { return item.id == src; });
-        if (cached) {
-          desc.normal_texture.image = cached->handle;
-        } else {
-          ren::ScratchArena scratch;
-          ren::TextureInfo texture_info = get_image_info(src);
-          auto blob = ren::bake_normal_map_to_memory(scratch, texture_info);
-          ren::Handle<ren::Image> image =
-              create_image(m_frame_arena, m_scene, blob.data, blob.size);
-          m_normal_image_cache.push(m_load_arena, {src, image});
-          desc.normal_texture.image = image;
-        }
-
-        desc.normal_texture.sampler = get_texture_sampler(normal_texture.index);
-        desc.normal_texture.scale = normal_texture.scale;
+        textures->normal = bake_infos->m_size;
+        bake_infos->push(arena, {
+                                    .type = ren::TextureBakeType::Normal,
+                                    .info = get_image_info(src),
+                                });
+        desc->normal_texture.sampler =
+            get_texture_sampler(normal_texture.index);
+        desc->normal_texture.scale = normal_texture.scale;
       }
     }
 
@@ -442,28 +426,102 @@ private:
       warn("Double sided materials not implemented");
     }
 
-    return ren::create_material(m_frame_arena, m_scene, desc);
+    return true;
   }
 
-  ren::Handle<ren::Material> get_or_create_material(int index) {
-    if (index == -1) {
-      return m_default_material;
+  void collect_node_materials(const GltfNode &node,
+                              ren::Span<bool> used_materials) {
+    if (node.mesh >= 0) {
+      const GltfMesh &mesh = m_gltf.meshes[node.mesh];
+      for (const GltfPrimitive &primitive : mesh.primitives) {
+        if (primitive.material >= 0) {
+          used_materials[primitive.material] = true;
+        }
+      }
     }
-    while ((ren::u32)index >= m_material_cache.m_size) {
+    for (int child : node.children) {
+      collect_node_materials(m_gltf.nodes[child], used_materials);
+    }
+  }
+
+  // Bake all textures used by the scene in one batch, then create images and
+  // materials.
+  void create_materials(const GltfScene &scene) {
+    ren::ScratchArena scratch;
+
+    auto used_materials =
+        ren::Span<bool>::allocate(scratch, m_gltf.materials.size());
+    ren::fill(used_materials, false);
+    for (int node : scene.nodes) {
+      collect_node_materials(m_gltf.nodes[node], used_materials);
+    }
+
+    struct MaterialItem {
+      int index = -1;
+      ren::MaterialCreateInfo desc;
+      MaterialTextures textures;
+    };
+
+    ren::DynamicArray<MaterialItem> materials;
+    ren::DynamicArray<ren::TextureBakeInfo> bake_infos;
+    for (int index : ren::range<int>(m_gltf.materials.size())) {
+      if (!used_materials[index]) {
+        continue;
+      }
+      MaterialItem item = {.index = index};
+      u32 num_bake_infos = bake_infos.m_size;
+      if (!get_material_create_info(index, scratch, &item.desc, &item.textures,
+                                    &bake_infos)) {
+        bake_infos.m_size = num_bake_infos;
+        continue;
+      }
+      materials.push(scratch, item);
+    }
+
+    auto start = ren::clock();
+    ren::BakedTextures baked =
+        ren::bake_textures_to_memory(scratch, bake_infos);
+    auto end = ren::clock();
+    log("Baked {} textures in {:.3f}s", baked.blobs.m_size,
+        (end - start) / 1e9);
+
+    auto images = ren::Span<ren::Handle<ren::Image>>::allocate(
+        scratch, baked.blobs.m_size);
+    for (usize i : ren::range(baked.blobs.m_size)) {
+      images[i] = ren::create_image(m_frame_arena, m_scene, baked.blobs[i].data,
+                                    baked.blobs[i].size);
+    }
+    auto get_image = [&](int texture) -> ren::Handle<ren::Image> {
+      if (texture < 0) {
+        return ren::NullHandle;
+      }
+      return images[baked.indices[texture]];
+    };
+
+    m_material_cache.reserve(m_load_arena, m_gltf.materials.size());
+    while (m_material_cache.m_size < m_gltf.materials.size()) {
       m_material_cache.push(m_load_arena);
     }
-    ren::Handle<ren::Material> &material = m_material_cache[index];
-    if (!material) {
-      material = create_material(index);
+    for (MaterialItem &item : materials) {
+      item.desc.base_color_texture.image = get_image(item.textures.base_color);
+      item.desc.orm_texture.image = get_image(item.textures.orm);
+      item.desc.normal_texture.image = get_image(item.textures.normal);
+      m_material_cache[item.index] =
+          ren::create_material(m_frame_arena, m_scene, item.desc);
+    }
+  }
+
+  ren::Handle<ren::Material> get_material(int index) {
+    if (index == -1) {
+      return m_default_material;
     }
-    return material;
+    return m_material_cache[index];
   }
 
   ren::Handle<ren::MeshInstance>
   create_mesh_instance(const GltfPrimitive &primitive,
                        const glm::mat4 &transform) {
-    ren::Handle<ren::Material> material =
-        get_or_create_material(primitive.material);
+    ren::Handle<ren::Material> material = get_material(primitive.material);
     ren::Handle<ren::Mesh> mesh = get_or_create_mesh(primitive);
     ren::Handle<ren::MeshInstance> mesh_instance =
         ren::create_mesh_instance(m_frame_arena, m_scene,
@@ -519,9 +577,10 @@ private:
   ren::Arena *m_frame_arena = nullptr;
   ren::Scene *m_scene = nullptr;
   ren::DynamicArray<MeshCacheItem> m_mesh_cache;
-  ren::DynamicArray<ImageCacheItem> m_color_image_cache;
-  ren::DynamicArray<OrmImageCacheItem> m_orm_image_cache;
-  ren::DynamicArray<ImageCacheItem> m_normal_image_cache;
+  // Culling efficiency of all baked meshes' meshlets.
+  ren::MeshletStats m_meshlet_stats;
+  double m_cone_angle_sum = 0.0;
+  double m_sphere_tightness_sum = 0.0;
   Handle<Material> m_default_material;
   ren::DynamicArray<ren::Handle<ren::Material>> m_material_cache;
 };
@@ -15,20 +15,68 @@ struct TextureInfo {
   const void *data = nullptr;
 };
 
-IoResult<void> bake_color_map_to_file(File file, const TextureInfo &info);
+/// Block compression quality. Encoding is split into block rows and runs on
+/// the job server, so the job server must be running.
+enum class TextureCompression {
+  /// Store uncompressed mip chain.
+  None,
+  Fast,
+  Normal,
+  High,
+};
+
+/// Color maps are compressed to BC7, normal maps to BC5 and ORM maps to BC7.
+struct TextureBakeOptions {
+  TextureCompression compression = TextureCompression::Normal;
+};
+
+enum class TextureBakeType {
+  Color,
+  Normal,
+  Orm,
+};
+
+struct TextureBakeInfo {
+  TextureBakeType type = TextureBakeType::Color;
+  TextureInfo info;
+  /// Optional occlusion map for ORM textures.
+  TextureInfo occlusion_info;
+};
+
+struct BakedTextures {
+  /// Unique baked textures, in order of first occurrence.
+  Span<Blob> blobs;
+  /// Index into blobs for each input texture.
+  Span<u32> indices;
+};
+
+/// Bake a batch of textures in parallel on the job server. Textures with the
+/// same type and source data are baked only once.
+[[nodiscard]] BakedTextures
+bake_textures_to_memory(NotNull<Arena *> arena,
+                        Span<const TextureBakeInfo> textures,
+                        const TextureBakeOptions &opts = {});
+
+IoResult<void> bake_color_map_to_file(File file, const TextureInfo &info,
+                                      const TextureBakeOptions &opts = {});
 
-Blob bake_color_map_to_memory(NotNull<Arena *> arena, const TextureInfo &info);
+Blob bake_color_map_to_memory(NotNull<Arena *> arena, const TextureInfo &info,
+                              const TextureBakeOptions &opts = {});
 
-IoResult<void> bake_normal_map_to_file(File file, const TextureInfo &info);
+IoResult<void> bake_normal_map_to_file(File file, const TextureInfo &info,
+                                       const TextureBakeOptions &opts = {});
 
-Blob bake_normal_map_to_memory(NotNull<Arena *> arena, const TextureInfo &info);
+Blob bake_normal_map_to_memory(NotNull<Arena *> arena, const TextureInfo &info,
+                               const TextureBakeOptions &opts = {});
 
 IoResult<void> bake_orm_map_to_file(File file,
                                     const TextureInfo &roughness_metallic_info,
-                                    const TextureInfo &occlusion_info);
+                                    const TextureInfo &occlusion_info,
+                                    const TextureBakeOptions &opts = {});
 
 Blob bake_orm_map_to_memory(NotNull<Arena *> arena,
                             const TextureInfo &roughness_metallic_info,
-                            const TextureInfo &occlusion_info = {});
+                            const TextureInfo &occlusion_info = {},
+                            const TextureBakeOptions &opts = {});
 
 } // namespace ren
@@ -18,10 +18,53 @@ struct MeshInfo {
   Span<const u32> indices;
 };
 
-[[nodiscard]] IoResult<void> bake_mesh_to_file(const MeshInfo &info, File file);
+enum class MeshletAlgorithm {
+  /// Greedily grow meshlets along the mesh topology, trading off meshlet size
+  /// for normal cone quality.
+  Greedy,
+  /// Split meshlets spatially for tighter bounds. Falls back to Greedy if
+  /// meshoptimizer doesn't support it.
+  Spatial,
+};
+
+/// Meshlet culling efficiency statistics, accumulated over all LODs.
+struct MeshletStats {
+  u32 num_meshlets = 0;
+  u32 num_triangles = 0;
+  /// Number of meshlets whose normal cone can be used for culling.
+  u32 num_cones = 0;
+  /// Fraction of meshlets whose normal cone can be used for culling.
+  float cone_coverage = 0.0f;
+  /// Average normal cone half-angle in degrees for meshlets with a usable
+  /// cone. Smaller is better.
+  float avg_cone_angle = 0.0f;
+  /// Average ratio of meshlet triangle area to bounding sphere cross section
+  /// area. Larger is better.
+  float avg_sphere_tightness = 0.0f;
+};
+
+struct MeshBakeOptions {
+  MeshletAlgorithm meshlet_algorithm = MeshletAlgorithm::Greedy;
+  /// Normal cone weight in [0, 1] for the greedy builder.
+  float cone_weight = 1.0f;
+  /// Triangle fill weight for the spatial builder. Zero produces the best
+  /// spatial bounds, larger values produce fuller meshlets.
+  float fill_weight = 0.5f;
+  /// Optional output for culling efficiency statistics.
+  MeshletStats *stats = nullptr;
+  /// Approximate peak memory budget in bytes. Meshes that are estimated to
+  /// exceed it are split into spatial chunks that are baked one at a time
+  /// with locked borders and merged into a single package. 0 means unlimited.
+  usize memory_budget = 0;
+};
+
+[[nodiscard]] IoResult<void>
+bake_mesh_to_file(const MeshInfo &info, File file,
+                  const MeshBakeOptions &opts = {});
 
 [[nodiscard]] Blob bake_mesh_to_memory(NotNull<Arena *> arena,
-                                       const MeshInfo &info);
+                                       const MeshInfo &info,
+                                       const MeshBakeOptions &opts = {});
 
 [[nodiscard]] MeshInfo gltf_primitive_to_mesh_info(Span<const std::byte> blob,
                                      const Gltf &gltf,
@@ -9,6 +9,7 @@ namespace ren {
 enum class ArenaNamedTag {
   None,
   GltfLoadImages,
+  BakeTextures,
   FrameData0,
   FrameData1,
   FrameDataLast = FrameData1,
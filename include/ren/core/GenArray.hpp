@@ -99,6 +99,39 @@ public:
     return key;
   }
 
+  /// Insert count values with consecutive indices. Returns the key of the
+  /// first value, the others have the same generation.
+  K insert_range(NotNull<Arena *> arena, usize count, T value = {})
+    requires std::is_trivially_destructible_v<T>
+  {
+    usize old_capacity = m_indices.m_generations.m_capacity;
+    K key = m_indices.generate_range(arena, count);
+    usize new_capacity = m_indices.m_generations.m_capacity;
+
+    [[unlikely]] if (new_capacity > old_capacity) {
+      if (!arena->expand<T>(m_values, old_capacity, new_capacity)) {
+        auto *new_values = arena->allocate<T>(new_capacity);
+        std::memcpy(new_values, m_values, sizeof(T) * old_capacity);
+        m_values = new_values;
+      }
+    }
+    for (usize i = 0; i < count; ++i) {
+      m_values[key.index + i] = value;
+    }
+
+    return key;
+  }
+
+  /// Replace all keys, for example with ones that were saved to disk. Values
+  /// of active keys must be written afterwards.
+  void restore(NotNull<Arena *> arena, Span<const GenIndex> generations,
+               u32 free_list, u32 num_free)
+    requires std::is_trivially_destructible_v<T>
+  {
+    m_indices.restore(arena, generations, free_list, num_free);
+    m_values = arena->allocate<T>(m_indices.m_generations.m_capacity);
+  }
+
   void erase(const_iterator it) {
     ren_assert(it != end());
     erase(*it);
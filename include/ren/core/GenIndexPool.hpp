@@ -1,4 +1,5 @@
 #pragma once
+#include "Algorithm.hpp"
 #include "Array.hpp"
 #include "Assert.hpp"
 #include "GenIndex.hpp"
@@ -102,6 +103,34 @@ public:
     return key;
   }
 
+  /// Generate count keys with consecutive indices past the end of the pool,
+  /// bypassing the free list. Returns the first key, the others have the same
+  /// generation.
+  auto generate_range(NotNull<Arena *> arena, usize count) -> K {
+    u32 index = m_generations.m_size;
+    [[unlikely]] if (index + count > m_generations.m_capacity) {
+      m_generations.reserve(
+          arena, max<usize>(index + count, 2 * m_generations.m_capacity));
+    }
+    for (usize i = 0; i < count; ++i) {
+      m_generations.push(GenIndex{0, ACTIVE});
+    }
+    K key;
+    key.gen = 0;
+    key.index = index;
+    return key;
+  }
+
+  /// Replace all keys, for example with ones that were saved to disk.
+  void restore(NotNull<Arena *> arena, Span<const GenIndex> generations,
+               u32 free_list, u32 num_free) {
+    ren_assert(generations.m_size > 0);
+    m_generations.clear();
+    m_generations.push(arena, generations);
+    m_free_list = free_list;
+    m_num_free = num_free;
+  }
+
   void erase(const_iterator it) {
     ren_assert(it != end());
     erase(*it);
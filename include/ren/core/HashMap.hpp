@@ -0,0 +1,167 @@
+#pragma once
+#include "Algorithm.hpp"
+#include "Arena.hpp"
+#include "Assert.hpp"
+#include "NotNull.hpp"
+#include "StdDef.hpp"
+
+#include <concepts>
+#include <type_traits>
+
+namespace ren {
+
+inline u64 hash_mix(u64 h) {
+  // splitmix64 finalizer.
+  h ^= h >> 30;
+  h *= 0xbf58476d1ce4e5b9;
+  h ^= h >> 27;
+  h *= 0x94d049bb133111eb;
+  h ^= h >> 31;
+  return h;
+}
+
+inline u64 hash_bytes(const void *data, usize size) {
+  // FNV-1a.
+  u64 h = 0xcbf29ce484222325;
+  for (usize i = 0; i < size; ++i) {
+    h ^= ((const u8 *)data)[i];
+    h *= 0x100000001b3;
+  }
+  return hash_mix(h);
+}
+
+template <std::integral T> u64 hash(T value) { return hash_mix(u64(value)); }
+
+template <typename K>
+concept Hashable = requires(const K &key) {
+  { hash(key) } -> std::convertible_to<u64>;
+};
+
+/// Open addressing hash map with linear probing. Memory is allocated from an
+/// arena and is not reused when the map grows, so keys and values must be
+/// trivially copyable. Keys are hashed with hash(), which is looked up by
+/// ADL.
+template <Hashable K, typename V>
+  requires std::is_trivially_copyable_v<K> and std::is_trivially_copyable_v<V>
+struct HashMap {
+  // Hash of the key in each slot, 0 for empty slots.
+  u64 *m_hashes = nullptr;
+  K *m_keys = nullptr;
+  V *m_values = nullptr;
+  u32 m_size = 0;
+  u32 m_capacity = 0;
+
+public:
+  [[nodiscard]] static HashMap init(NotNull<Arena *> arena, usize capacity) {
+    HashMap map;
+    map.reserve(arena, capacity);
+    return map;
+  }
+
+  usize size() const { return m_size; }
+
+  bool is_empty() const { return m_size == 0; }
+
+  V *try_get(const K &key) {
+    if (m_size == 0) {
+      return nullptr;
+    }
+    u64 h = get_hash(key);
+    for (usize i = h & (m_capacity - 1);; i = (i + 1) & (m_capacity - 1)) {
+      if (m_hashes[i] == 0) {
+        return nullptr;
+      }
+      if (m_hashes[i] == h and m_keys[i] == key) {
+        return &m_values[i];
+      }
+    }
+  }
+
+  const V *try_get(const K &key) const {
+    return const_cast<HashMap *>(this)->try_get(key);
+  }
+
+  V &get(const K &key) {
+    V *value = try_get(key);
+    ren_assert(value);
+    return *value;
+  }
+
+  const V &get(const K &key) const {
+    const V *value = try_get(key);
+    ren_assert(value);
+    return *value;
+  }
+
+  /// Insert a new value or overwrite an existing one.
+  V &insert(NotNull<Arena *> arena, const K &key, V value) {
+    [[unlikely]] if (4 * (m_size + 1) > 3 * m_capacity) {
+      reserve(arena, max<usize>(2 * m_capacity, 16));
+    }
+    u64 h = get_hash(key);
+    usize i = h & (m_capacity - 1);
+    while (m_hashes[i] != 0) {
+      if (m_hashes[i] == h and m_keys[i] == key) {
+        m_values[i] = value;
+        return m_values[i];
+      }
+      i = (i + 1) & (m_capacity - 1);
+    }
+    m_hashes[i] = h;
+    m_keys[i] = key;
+    m_values[i] = value;
+    m_size++;
+    return m_values[i];
+  }
+
+  void reserve(NotNull<Arena *> arena, usize capacity) {
+    usize new_capacity = max<usize>(m_capacity, 16);
+    while (3 * new_capacity < 4 * capacity) {
+      new_capacity *= 2;
+    }
+    if (new_capacity == m_capacity) {
+      return;
+    }
+
+    u64 *hashes = m_hashes;
+    K *keys = m_keys;
+    V *values = m_values;
+    usize capacity_old = m_capacity;
+
+    m_hashes = arena->allocate<u64>(new_capacity);
+    m_keys = (K *)arena->allocate(new_capacity * sizeof(K), alignof(K));
+    m_values = (V *)arena->allocate(new_capacity * sizeof(V), alignof(V));
+    m_capacity = new_capacity;
+    for (usize i = 0; i < new_capacity; ++i) {
+      m_hashes[i] = 0;
+    }
+
+    for (usize i = 0; i < capacity_old; ++i) {
+      if (hashes[i] == 0) {
+        continue;
+      }
+      usize j = hashes[i] & (m_capacity - 1);
+      while (m_hashes[j] != 0) {
+        j = (j + 1) & (m_capacity - 1);
+      }
+      m_hashes[j] = hashes[i];
+      m_keys[j] = keys[i];
+      m_values[j] = values[i];
+    }
+  }
+
+  void clear() {
+    for (usize i = 0; i < m_capacity; ++i) {
+      m_hashes[i] = 0;
+    }
+    m_size = 0;
+  }
+
+private:
+  static u64 get_hash(const K &key) {
+    u64 h = hash(key);
+    return h != 0 ? h : 1;
+  }
+};
+
+} // namespace ren
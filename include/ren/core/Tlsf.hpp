@@ -13,13 +13,7 @@ constexpr usize MIN_TLSF_ALLOCATION_SIZE = 8;
 struct TlsfAllocation {
   usize size = 0;
   usize offset = 0;
-  union {
-    ListNode<TlsfAllocation> physical_list = {};
-    struct {
-      TlsfAllocation *prev;
-      TlsfAllocation *next;
-    };
-  };
+  ListNode<TlsfAllocation> physical_list = {};
   union {
     ListNode<TlsfAllocation> free_list = {};
     TlsfAllocation *next_free;
@@ -39,9 +33,37 @@ struct TlsfAllocator {
                                             NotNull<TlsfAllocator *> allocator,
                                             usize size);
 
+// Allocate size bytes at offset, which must be part of a free block. Used to
+// restore a previously saved allocator state. Returns null on failure.
+[[nodiscard]] TlsfAllocation *
+tlsf_allocate_at(NotNull<Arena *> arena, NotNull<TlsfAllocator *> allocator,
+                 usize offset, usize size);
+
 void tlsf_free(NotNull<TlsfAllocator *> allocator, TlsfAllocation *allocation);
 
 void tlsf_expand(NotNull<Arena *> arena, NotNull<TlsfAllocator *> allocator,
                  usize new_size);
 
+struct TlsfStats {
+  usize num_allocations = 0;
+  usize allocated_size = 0;
+  usize num_free_blocks = 0;
+  usize free_size = 0;
+  usize largest_free_block = 0;
+};
+
+// Walk all blocks of the allocator. Takes time linear in the number of
+// blocks.
+[[nodiscard]] TlsfStats
+tlsf_get_stats(NotNull<const TlsfAllocator *> allocator);
+
+// Fraction of free space that can't be used for an allocation the size of all
+// free space.
+inline float tlsf_fragmentation(const TlsfStats &stats) {
+  if (stats.free_size == 0) {
+    return 0.0f;
+  }
+  return 1.0f - float(stats.largest_free_block) / float(stats.free_size);
+}
+
 } // namespace ren
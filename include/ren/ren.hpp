@@ -5,6 +5,7 @@
 #include "ren/core/Span.hpp"
 
 #include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
 
 struct SDL_Window;
 struct ImGuiContext;
@@ -36,6 +37,8 @@ struct MeshInstance;
 struct Material;
 struct Image;
 struct DirectionalLight;
+struct TransformNode;
+struct SceneCommandRecorder;
 
 constexpr unsigned DEFAULT_ADAPTER = -1;
 
@@ -146,6 +149,31 @@ struct MeshInstanceCreateInfo {
   Handle<Material> material;
 };
 
+/// Structure-of-arrays input for creating many mesh instances at once
+struct MeshInstanceBulkCreateInfo {
+  /// The mesh of each mesh instance
+  Span<const Handle<Mesh>> meshes;
+  /// The material of each mesh instance, or a single material for all of them
+  Span<const Handle<Material>> materials;
+  /// Optional: the transform of each mesh instance
+  Span<const glm::mat4x3> transforms;
+};
+
+/// Transform of a transform node relative to its parent
+struct LocalTransform {
+  glm::vec3 translation = {0.0f, 0.0f, 0.0f};
+  glm::quat rotation = {1.0f, 0.0f, 0.0f, 0.0f};
+  glm::vec3 scale = {1.0f, 1.0f, 1.0f};
+};
+
+struct TransformNodeCreateInfo {
+  /// Optional: the parent of this transform node
+  Handle<TransformNode> parent;
+  /// Optional: the mesh instance whose transform is driven by this node
+  Handle<MeshInstance> mesh_instance;
+  LocalTransform transform;
+};
+
 /// Directional light descriptor
 struct DirectionalLightDesc {
   /// This light's color. Must be between 0 and 1.
@@ -219,14 +247,94 @@ void create_mesh_instances(NotNull<Arena *> frame_arena, Scene *scene,
                            Span<const MeshInstanceCreateInfo> create_info,
                            Span<Handle<MeshInstance>> out);
 
+/// Create mesh instances with consecutive handles. Their GPU data is written
+/// to upload memory directly and is uploaded with a single copy per buffer.
+/// Runs of mesh instances with the same mesh and material are the cheapest to
+/// create. Falls back to create_mesh_instances if there are not enough unused
+/// consecutive handles left.
+void create_mesh_instances_bulk(NotNull<Arena *> frame_arena, Scene *scene,
+                                const MeshInstanceBulkCreateInfo &create_info,
+                                Span<Handle<MeshInstance>> out);
+
 void destroy_mesh_instances(NotNull<Arena *> frame_arena, Scene *scene,
                             Span<const Handle<MeshInstance>> mesh_instances);
 
+/// If a mesh instance appears more than once, its last transform is used.
 void set_mesh_instance_transforms(
     NotNull<Arena *> frame_arena, Scene *scene,
     Span<const Handle<MeshInstance>> mesh_instances,
     Span<const glm::mat4x3> transforms);
 
+void create_transform_nodes(Scene *scene,
+                            Span<const TransformNodeCreateInfo> create_info,
+                            Span<Handle<TransformNode>> out);
+
+/// Children must be destroyed before or together with their parent, in which
+/// case they must come first.
+void destroy_transform_nodes(Scene *scene,
+                             Span<const Handle<TransformNode>> nodes);
+
+void set_transform_node_transforms(Scene *scene,
+                                   Span<const Handle<TransformNode>> nodes,
+                                   Span<const LocalTransform> transforms);
+
+/// Propagate changed local transforms to the world transforms of attached mesh
+/// instances. Called automatically by draw().
+void update_transform_nodes(NotNull<Arena *> frame_arena, Scene *scene);
+
+/// Create a recorder of scene edits for a single producer, like a job.
+/// Recorders don't share any state with each other or with the scene, so each
+/// one can be used from a different thread without locking. Recorded commands
+/// are applied by apply_scene_commands in the order in which the recorders
+/// were created, and then in the order in which they were recorded. Recorders
+/// are destroyed together with their scene.
+[[nodiscard]] auto create_scene_command_recorder(Scene *scene)
+    -> SceneCommandRecorder *;
+
+/// Handles are written to out when the command is applied, so it must stay
+/// valid until then. Optionally, transforms can be set for the new mesh
+/// instances.
+void record_create_mesh_instances(
+    SceneCommandRecorder *recorder,
+    Span<const MeshInstanceCreateInfo> create_info,
+    Span<const glm::mat4x3> transforms, Span<Handle<MeshInstance>> out);
+
+void record_destroy_mesh_instances(
+    SceneCommandRecorder *recorder,
+    Span<const Handle<MeshInstance>> mesh_instances);
+
+void record_mesh_instance_transforms(
+    SceneCommandRecorder *recorder,
+    Span<const Handle<MeshInstance>> mesh_instances,
+    Span<const glm::mat4x3> transforms);
+
+/// The handle is written to out when the command is applied, so it must stay
+/// valid until then.
+void record_create_material(SceneCommandRecorder *recorder,
+                            const MaterialCreateInfo &create_info,
+                            Handle<Material> *out);
+
+/// Apply and clear commands of all recorders. Must not be called while any
+/// recorder is in use. Called automatically by draw().
+void apply_scene_commands(NotNull<Arena *> frame_arena, Scene *scene);
+
+/// Save the meshes, materials, mesh instances and draw sets of a scene into a
+/// blob that can be loaded with load_scene_snapshot. Waits for the GPU to
+/// become idle. Returns an empty span if the scene can't be saved because it
+/// has textured materials. Cameras, lights, the environment and transform
+/// nodes are not saved.
+[[nodiscard]] auto save_scene_snapshot(NotNull<Arena *> arena, Scene *scene)
+    -> Span<std::byte>;
+
+/// Load a scene snapshot into a scene without meshes, materials and mesh
+/// instances. Handles are the same as in the saved scene. The blob is only
+/// used during the call. Returns false if the blob is invalid or if GPU
+/// resources can't be created, in which case the scene might be partially
+/// loaded and must be destroyed.
+[[nodiscard]] bool load_scene_snapshot(NotNull<Arena *> frame_arena,
+                                       Scene *scene,
+                                       Span<const std::byte> blob);
+
 [[nodiscard]] auto create_directional_light(Scene *scene,
                                             const DirectionalLightDesc &desc)
     -> Handle<DirectionalLight>;
@@ -278,8 +386,21 @@ struct Vtbl {
   ren_vtbl_f(create_image);
   ren_vtbl_f(create_material);
   ren_vtbl_f(create_mesh_instances);
+  ren_vtbl_f(create_mesh_instances_bulk);
   ren_vtbl_f(destroy_mesh_instances);
   ren_vtbl_f(set_mesh_instance_transforms);
+  ren_vtbl_f(create_transform_nodes);
+  ren_vtbl_f(destroy_transform_nodes);
+  ren_vtbl_f(set_transform_node_transforms);
+  ren_vtbl_f(update_transform_nodes);
+  ren_vtbl_f(create_scene_command_recorder);
+  ren_vtbl_f(record_create_mesh_instances);
+  ren_vtbl_f(record_destroy_mesh_instances);
+  ren_vtbl_f(record_mesh_instance_transforms);
+  ren_vtbl_f(record_create_material);
+  ren_vtbl_f(apply_scene_commands);
+  ren_vtbl_f(save_scene_snapshot);
+  ren_vtbl_f(load_scene_snapshot);
   ren_vtbl_f(create_directional_light);
   ren_vtbl_f(destroy_directional_light);
   ren_vtbl_f(set_directional_light);
@@ -389,6 +510,14 @@ create_mesh_instances(NotNull<Arena *> frame_arena, Scene *scene,
                                                      create_info, out);
 }
 
+inline void
+create_mesh_instances_bulk(NotNull<Arena *> frame_arena, Scene *scene,
+                           const MeshInstanceBulkCreateInfo &create_info,
+                           Span<Handle<MeshInstance>> out) {
+  return hot_reload::vtbl_ref->create_mesh_instances_bulk(frame_arena, scene,
+                                                          create_info, out);
+}
+
 inline void
 destroy_mesh_instances(NotNull<Arena *> frame_arena, Scene *scene,
                        Span<const Handle<MeshInstance>> mesh_instances) {
@@ -404,6 +533,81 @@ set_mesh_instance_transforms(NotNull<Arena *> frame_arena, Scene *scene,
       frame_arena, scene, mesh_instances, transforms);
 }
 
+inline void
+create_transform_nodes(Scene *scene,
+                       Span<const TransformNodeCreateInfo> create_info,
+                       Span<Handle<TransformNode>> out) {
+  return hot_reload::vtbl_ref->create_transform_nodes(scene, create_info, out);
+}
+
+inline void destroy_transform_nodes(Scene *scene,
+                                    Span<const Handle<TransformNode>> nodes) {
+  return hot_reload::vtbl_ref->destroy_transform_nodes(scene, nodes);
+}
+
+inline void
+set_transform_node_transforms(Scene *scene,
+                              Span<const Handle<TransformNode>> nodes,
+                              Span<const LocalTransform> transforms) {
+  return hot_reload::vtbl_ref->set_transform_node_transforms(scene, nodes,
+                                                             transforms);
+}
+
+inline void update_transform_nodes(NotNull<Arena *> frame_arena,
+                                   Scene *scene) {
+  return hot_reload::vtbl_ref->update_transform_nodes(frame_arena, scene);
+}
+
+inline auto create_scene_command_recorder(Scene *scene)
+    -> SceneCommandRecorder * {
+  return hot_reload::vtbl_ref->create_scene_command_recorder(scene);
+}
+
+inline void
+record_create_mesh_instances(SceneCommandRecorder *recorder,
+                             Span<const MeshInstanceCreateInfo> create_info,
+                             Span<const glm::mat4x3> transforms,
+                             Span<Handle<MeshInstance>> out) {
+  return hot_reload::vtbl_ref->record_create_mesh_instances(
+      recorder, create_info, transforms, out);
+}
+
+inline void
+record_destroy_mesh_instances(SceneCommandRecorder *recorder,
+                              Span<const Handle<MeshInstance>> mesh_instances) {
+  return hot_reload::vtbl_ref->record_destroy_mesh_instances(recorder,
+                                                             mesh_instances);
+}
+
+inline void
+record_mesh_instance_transforms(SceneCommandRecorder *recorder,
+                                Span<const Handle<MeshInstance>> mesh_instances,
+                                Span<const glm::mat4x3> transforms) {
+  return hot_reload::vtbl_ref->record_mesh_instance_transforms(
+      recorder, mesh_instances, transforms);
+}
+
+inline void record_create_material(SceneCommandRecorder *recorder,
+                                   const MaterialCreateInfo &create_info,
+                                   Handle<Material> *out) {
+  return hot_reload::vtbl_ref->record_create_material(recorder, create_info,
+                                                      out);
+}
+
+inline void apply_scene_commands(NotNull<Arena *> frame_arena, Scene *scene) {
+  return hot_reload::vtbl_ref->apply_scene_commands(frame_arena, scene);
+}
+
+inline auto save_scene_snapshot(NotNull<Arena *> arena, Scene *scene)
+    -> Span<std::byte> {
+  return hot_reload::vtbl_ref->save_scene_snapshot(arena, scene);
+}
+
+inline bool load_scene_snapshot(NotNull<Arena *> frame_arena, Scene *scene,
+                                Span<const std::byte> blob) {
+  return hot_reload::vtbl_ref->load_scene_snapshot(frame_arena, scene, blob);
+}
+
 inline auto create_directional_light(Scene *scene,
                                      const DirectionalLightDesc &desc)
     -> Handle<DirectionalLight> {
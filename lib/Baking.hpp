@@ -49,4 +49,8 @@ ktxTexture2 *create_ktx_texture(const DirectX::ScratchImage &mip_chain);
 Blob write_ktx_to_memory(NotNull<Arena *> arena,
                          const DirectX::ScratchImage &mip_chain);
 
+DirectX::ScratchImage compress_mip_chain(DirectX::ScratchImage mip_chain,
+                                         TinyImageFormat format,
+                                         TextureCompression compression);
+
 } // namespace ren
@@ -200,6 +200,10 @@ void CommandRecorder::reset_event(Handle<Event> event,
   rhi::cmd_reset_event(m_cmd, m_renderer->get_event(event).handle, stages);
 }
 
+void CommandRecorder::write_timestamp(rhi::QueryPool pool, u32 query) {
+  rhi::cmd_write_timestamp(m_cmd, pool, query);
+}
+
 auto CommandRecorder::render_pass(const RenderPassInfo &&begin_info)
     -> RenderPass {
   return RenderPass(*m_renderer, m_cmd, std::move(begin_info));
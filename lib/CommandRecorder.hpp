@@ -118,6 +118,8 @@ public:
   void reset_event(Handle<Event> event,
                    rhi::PipelineStageMask stages = rhi::PipelineStage::All);
 
+  void write_timestamp(rhi::QueryPool pool, u32 query);
+
   [[nodiscard]] auto debug_region(String8 label) -> DebugRegion;
 
 private:
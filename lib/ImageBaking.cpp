@@ -1,11 +1,16 @@
 #include "core/Math.hpp"
 #include "ren/baking/image.hpp"
+#include "ren/core/Array.hpp"
 #include "ren/core/Format.hpp"
+#include "ren/core/Job.hpp"
 #include "ren/core/Span.hpp"
 #include "ren/core/StdDef.hpp"
 
 #include <DirectXTex.h>
+#include <algorithm>
 #include <ktx.h>
+#include <tracy/Tracy.hpp>
+#include <tuple>
 
 #define KTX_CHECK(result, message)                                             \
   if (result) {                                                                \
@@ -197,35 +202,119 @@ Blob write_ktx_to_memory(NotNull<Arena *> arena, const TextureInfo &info) {
   return blob;
 }
 
-DirectX::ScratchImage bake_color_map(const TextureInfo &info) {
+// Number of pixel rows that are encoded by a single job. Must be a multiple of
+// the block height.
+constexpr usize COMPRESS_ROWS_PER_JOB = 64;
+
+DirectX::ScratchImage compress_mip_chain(DirectX::ScratchImage mip_chain,
+                                         TinyImageFormat tiny_format,
+                                         TextureCompression compression) {
+  ZoneScoped;
+
+  if (compression == TextureCompression::None) {
+    return mip_chain;
+  }
+
+  HRESULT hres = S_OK;
+
+  auto format = (DXGI_FORMAT)TinyImageFormat_ToDXGI_FORMAT(tiny_format);
+
+  DirectX::TexMetadata mdata = mip_chain.GetMetadata();
+  mdata.format = format;
+  DirectX::ScratchImage compressed;
+  hres = compressed.Initialize(mdata);
+  HRESULT_CHECK(hres, "DirectX::ScratchImage::Initialize failed");
+
+  DirectX::TEX_COMPRESS_FLAGS flags = DirectX::TEX_COMPRESS_DEFAULT;
+  switch (compression) {
+  case TextureCompression::None:
+  case TextureCompression::Normal:
+    break;
+  case TextureCompression::Fast:
+    flags = DirectX::TEX_COMPRESS_BC7_QUICK;
+    break;
+  case TextureCompression::High:
+    flags = DirectX::TEX_COMPRESS_BC7_USE_3SUBSETS;
+    break;
+  }
+
+  // Split each image into independent block rows and encode them in parallel.
+  // DirectXTex's own parallel path requires OpenMP, which might not be
+  // available.
+  ScratchArena scratch;
+  DynamicArray<JobDesc> jobs;
+  for (usize i : range(mip_chain.GetImageCount())) {
+    const DirectX::Image &src = mip_chain.GetImages()[i];
+    const DirectX::Image &dst = compressed.GetImages()[i];
+    for (usize y = 0; y < src.height; y += COMPRESS_ROWS_PER_JOB) {
+      DirectX::Image src_rows = src;
+      src_rows.height = min(COMPRESS_ROWS_PER_JOB, src.height - y);
+      src_rows.slicePitch = src.rowPitch * src_rows.height;
+      src_rows.pixels = src.pixels + y * src.rowPitch;
+      u8 *dst_rows = dst.pixels + y / 4 * dst.rowPitch;
+      jobs.push(scratch,
+                JobDesc::init(scratch, "Compress block rows",
+                              [src_rows, dst_rows, format, flags]() {
+                                ZoneScopedN("Compress block rows");
+                                DirectX::ScratchImage block_rows;
+                                HRESULT hres = DirectX::Compress(
+                                    src_rows, format, flags,
+                                    DirectX::TEX_THRESHOLD_DEFAULT,
+                                    block_rows);
+                                HRESULT_CHECK(hres, "DirectX::Compress failed");
+                                const DirectX::Image &image =
+                                    *block_rows.GetImage(0, 0, 0);
+                                std::memcpy(dst_rows, image.pixels,
+                                            image.slicePitch);
+                              }));
+    }
+  }
+  job_dispatch_and_wait(jobs);
+
+  return compressed;
+}
+
+DirectX::ScratchImage bake_color_map(const TextureInfo &info,
+                                     const TextureBakeOptions &opts) {
+  ZoneScoped;
   HRESULT hres = S_OK;
   DirectX::ScratchImage mip_chain;
   hres = DirectX::GenerateMipMaps(to_dxtex_image(info),
                                   DirectX::TEX_FILTER_LINEAR, 0, mip_chain);
   HRESULT_CHECK(hres, "DirectX::GenerateMipMaps failed");
-  return mip_chain;
+  TinyImageFormat format = DirectX::IsSRGB(mip_chain.GetMetadata().format)
+                               ? TinyImageFormat_DXBC7_SRGB
+                               : TinyImageFormat_DXBC7_UNORM;
+  return compress_mip_chain(std::move(mip_chain), format, opts.compression);
 }
 
-Blob bake_color_map_to_memory(NotNull<Arena *> arena, const TextureInfo &info) {
-  return write_ktx_to_memory(arena, bake_color_map(info));
+Blob bake_color_map_to_memory(NotNull<Arena *> arena, const TextureInfo &info,
+                              const TextureBakeOptions &opts) {
+  return write_ktx_to_memory(arena, bake_color_map(info, opts));
 }
 
-DirectX::ScratchImage bake_normal_map(const TextureInfo &info) {
+DirectX::ScratchImage bake_normal_map(const TextureInfo &info,
+                                      const TextureBakeOptions &opts) {
+  ZoneScoped;
   HRESULT hres = S_OK;
   DirectX::ScratchImage mip_chain;
   hres = DirectX::GenerateMipMaps(to_dxtex_image(info),
                                   DirectX::TEX_FILTER_LINEAR, 0, mip_chain);
   HRESULT_CHECK(hres, "DirectX::GenerateMipMaps failed");
-  return mip_chain;
+  // Only store XY, Z is reconstructed in the shader.
+  return compress_mip_chain(std::move(mip_chain), TinyImageFormat_DXBC5_UNORM,
+                            opts.compression);
 }
 
-Blob bake_normal_map_to_memory(NotNull<Arena *> arena,
-                               const TextureInfo &info) {
-  return write_ktx_to_memory(arena, bake_normal_map(info));
+Blob bake_normal_map_to_memory(NotNull<Arena *> arena, const TextureInfo &info,
+                               const TextureBakeOptions &opts) {
+  return write_ktx_to_memory(arena, bake_normal_map(info, opts));
 }
 
 DirectX::ScratchImage bake_orm_map(const TextureInfo &roughness_metallic_info,
-                                   const TextureInfo &occlusion_info) {
+                                   const TextureInfo &occlusion_info,
+                                   const TextureBakeOptions &opts) {
+  ZoneScoped;
   HRESULT hres = S_OK;
 
   DirectX::Image src = to_dxtex_image(roughness_metallic_info);
@@ -252,14 +341,117 @@ DirectX::ScratchImage bake_orm_map(const TextureInfo &roughness_metallic_info,
       DirectX::GenerateMipMaps(src, DirectX::TEX_FILTER_LINEAR, 0, mip_chain);
   HRESULT_CHECK(hres, "DirectX::GenerateMipMaps failed");
 
-  return mip_chain;
+  return compress_mip_chain(std::move(mip_chain),
+                            TinyImageFormat_DXBC7_UNORM,
+                            opts.compression);
 }
 
 Blob bake_orm_map_to_memory(NotNull<Arena *> arena,
                             const TextureInfo &roughness_metallic_info,
-                            const TextureInfo &occlusion_info) {
+                            const TextureInfo &occlusion_info,
+                            const TextureBakeOptions &opts) {
   return write_ktx_to_memory(
-      arena, bake_orm_map(roughness_metallic_info, occlusion_info));
+      arena, bake_orm_map(roughness_metallic_info, occlusion_info, opts));
+}
+
+BakedTextures bake_textures_to_memory(NotNull<Arena *> arena,
+                                      Span<const TextureBakeInfo> textures,
+                                      const TextureBakeOptions &opts) {
+  ZoneScoped;
+
+  ScratchArena scratch;
+
+  auto get_source = [&](u32 index) {
+    const TextureBakeInfo &texture = textures[index];
+    return std::tuple(texture.type, texture.info.data, texture.info.format,
+                      texture.occlusion_info.data);
+  };
+
+  // Sort by source to find duplicates. Ties are broken by index, so the first
+  // occurrence of each source comes first.
+  auto order = Span<u32>::allocate(scratch, textures.m_size);
+  for (usize i : range(textures.m_size)) {
+    order[i] = i;
+  }
+  std::ranges::sort(order, [&](u32 lhs, u32 rhs) {
+    return std::tuple(get_source(lhs), lhs) < std::tuple(get_source(rhs), rhs);
+  });
+
+  auto first = Span<u32>::allocate(scratch, textures.m_size);
+  for (usize i : range(textures.m_size)) {
+    u32 index = order[i];
+    first[index] = index;
+    if (i > 0 and get_source(order[i - 1]) == get_source(index)) {
+      first[index] = first[order[i - 1]];
+    }
+  }
+
+  BakedTextures baked = {
+      .indices = Span<u32>::allocate(arena, textures.m_size),
+  };
+  DynamicArray<u32> unique;
+  for (u32 index : range(textures.m_size)) {
+    if (first[index] == index) {
+      baked.indices[index] = unique.m_size;
+      unique.push(scratch, index);
+    } else {
+      baked.indices[index] = baked.indices[first[index]];
+    }
+  }
+
+  struct JobData {
+    const TextureBakeInfo *texture = nullptr;
+    const TextureBakeOptions *opts = nullptr;
+    Blob blob;
+  };
+
+  auto job_data = Span<JobData>::allocate(scratch, unique.m_size);
+  auto jobs = Span<JobDesc>::allocate(scratch, unique.m_size);
+  for (usize i : range(unique.m_size)) {
+    job_data[i] = {
+        .texture = &textures[unique[i]],
+        .opts = &opts,
+    };
+    jobs[i] = {
+        .function =
+            [](void *void_payload) {
+              auto *payload = (JobData *)void_payload;
+              Arena arena = Arena::from_tag(ArenaNamedTag::BakeTextures);
+              const TextureBakeInfo &texture = *payload->texture;
+              switch (texture.type) {
+              case TextureBakeType::Color:
+                payload->blob = bake_color_map_to_memory(&arena, texture.info,
+                                                         *payload->opts);
+                break;
+              case TextureBakeType::Normal:
+                payload->blob = bake_normal_map_to_memory(&arena, texture.info,
+                                                          *payload->opts);
+                break;
+              case TextureBakeType::Orm:
+                payload->blob = bake_orm_map_to_memory(
+                    &arena, texture.info, texture.occlusion_info,
+                    *payload->opts);
+                break;
+              }
+            },
+        .payload = &job_data[i],
+        .label = "Bake texture",
+    };
+  }
+  job_dispatch_and_wait(jobs);
+
+  baked.blobs = Span<Blob>::allocate(arena, unique.m_size);
+  for (usize i : range(unique.m_size)) {
+    const Blob &blob = job_data[i].blob;
+    baked.blobs[i] = {
+        .data = arena->allocate(blob.size, 8),
+        .size = blob.size,
+    };
+    std::memcpy(baked.blobs[i].data, blob.data, blob.size);
+  }
+  job_reset_tag(ArenaNamedTag::BakeTextures);
+
+  return baked;
 }
 
 } // namespace ren
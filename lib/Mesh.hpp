@@ -2,6 +2,7 @@
 #include "DrawSet.hpp"
 #include "core/Flags.hpp"
 #include "ren/core/GenIndex.hpp"
+#include "ren/core/Span.hpp"
 #include "ren/core/StdDef.hpp"
 #include "sh/Geometry.h"
 
@@ -63,7 +64,11 @@ struct Mesh {
   sh::BoundingSquare uv_bs = {};
   Handle<Buffer> colors;
   Handle<Buffer> meshlets;
+  // Base triangle of each meshlet relative to the start of the mesh's
+  // triangles, used to patch meshlets when the triangles are moved.
+  Span<const u32> meshlet_base_triangles;
   Handle<Buffer> meshlet_indices;
+  u32 index_pool = 0;
   TlsfAllocation *triangles = nullptr;
   u32 num_lods = 0;
   sh::MeshLOD lods[sh::MAX_NUM_LODS] = {};
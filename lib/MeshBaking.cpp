@@ -5,10 +5,13 @@
 #include "ren/core/Algorithm.hpp"
 #include "ren/core/Array.hpp"
 #include "ren/core/GLTF.hpp"
+#include "ren/core/Optional.hpp"
 #include "ren/core/Span.hpp"
 #include "sh/Transforms.h"
 
+#include <algorithm>
 #include <cstdio>
+#include <glm/gtc/constants.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <meshoptimizer.h>
 #include <mikktspace.h>
@@ -300,8 +303,8 @@ sh::Tangent *mesh_encode_tangents(NotNull<Arena *> arena,
   return enc_tangents;
 }
 
-sh::UV *mesh_encode_uvs(NotNull<Arena *> arena, Span<const glm::vec2> uvs,
-                        NotNull<sh::BoundingSquare *> uv_bs) {
+void mesh_compute_uv_bounds(Span<const glm::vec2> uvs,
+                            NotNull<sh::BoundingSquare *> uv_bs) {
   ZoneScoped;
 
   for (glm::vec2 uv : uvs) {
@@ -320,12 +323,15 @@ sh::UV *mesh_encode_uvs(NotNull<Arena *> arena, Span<const glm::vec2> uvs,
     uv_bs->max = glm::mix(glm::vec2(0.0f), bs,
                           glm::notEqual(uv_bs->max, glm::vec2(0.0f)));
   }
+}
 
+sh::UV *mesh_encode_uvs(NotNull<Arena *> arena, Span<const glm::vec2> uvs,
+                        const sh::BoundingSquare &uv_bs) {
+  ZoneScoped;
   auto *enc_uvs = arena->allocate<sh::UV>(uvs.m_size);
   for (usize i : range(uvs.m_size)) {
-    enc_uvs[i] = sh::encode_uv(uvs[i], *uv_bs);
+    enc_uvs[i] = sh::encode_uv(uvs[i], uv_bs);
   }
-
   return enc_uvs;
 }
 
@@ -347,19 +353,61 @@ struct MeshGenerateMeshletsOptions {
   NotNull<u32 **> meshlet_indices;
   NotNull<u8 **> meshlet_triangles;
   NotNull<MeshPackageHeader *> header;
+  MeshletAlgorithm algorithm = MeshletAlgorithm::Greedy;
   float cone_weight = 0.0f;
+  float fill_weight = 0.0f;
+  MeshletStats *stats = nullptr;
 };
 
+#if MESHOPTIMIZER_VERSION >= 250
+constexpr usize MIN_SPATIAL_MESHLET_TRIANGLES =
+    (sh::NUM_MESHLET_TRIANGLES / 2) & ~3u;
+#endif
+
+// Maximum number of meshlets that mesh_build_meshlets can generate for this
+// many indices. The spatial builder can emit meshlets with as few as
+// MIN_SPATIAL_MESHLET_TRIANGLES triangles.
+usize mesh_build_meshlets_bound(const MeshGenerateMeshletsOptions &opts,
+                                usize num_indices) {
+#if MESHOPTIMIZER_VERSION >= 250
+  if (opts.algorithm == MeshletAlgorithm::Spatial) {
+    return meshopt_buildMeshletsBound(num_indices, sh::NUM_MESHLET_VERTICES,
+                                      MIN_SPATIAL_MESHLET_TRIANGLES);
+  }
+#endif
+  return meshopt_buildMeshletsBound(num_indices, sh::NUM_MESHLET_VERTICES,
+                                    sh::NUM_MESHLET_TRIANGLES);
+}
+
+usize mesh_build_meshlets(const MeshGenerateMeshletsOptions &opts,
+                          Span<const u32> indices, meshopt_Meshlet *meshlets,
+                          u32 *meshlet_indices, u8 *meshlet_triangles) {
+  ZoneScoped;
+#if MESHOPTIMIZER_VERSION >= 250
+  if (opts.algorithm == MeshletAlgorithm::Spatial) {
+    return meshopt_buildMeshletsSpatial(
+        meshlets, meshlet_indices, meshlet_triangles, indices.m_data,
+        indices.m_size, (const float *)opts.positions.m_data,
+        opts.positions.m_size, sizeof(glm::vec3), sh::NUM_MESHLET_VERTICES,
+        MIN_SPATIAL_MESHLET_TRIANGLES, sh::NUM_MESHLET_TRIANGLES,
+        opts.fill_weight);
+  }
+#endif
+  return meshopt_buildMeshlets(
+      meshlets, meshlet_indices, meshlet_triangles, indices.m_data,
+      indices.m_size, (const float *)opts.positions.m_data,
+      opts.positions.m_size, sizeof(glm::vec3), sh::NUM_MESHLET_VERTICES,
+      sh::NUM_MESHLET_TRIANGLES, opts.cone_weight);
+}
+
 void mesh_generate_meshlets(NotNull<Arena *> arena,
                             const MeshGenerateMeshletsOptions &opts) {
   ZoneScoped;
   ren_assert(opts.header->scale != 0.0f);
 
   ScratchArena scratch;
-  auto *meshlets =
-      scratch->allocate<meshopt_Meshlet>(meshopt_buildMeshletsBound(
-          opts.lods[0].num_indices, sh::NUM_MESHLET_VERTICES,
-          sh::NUM_MESHLET_TRIANGLES));
+  auto *meshlets = scratch->allocate<meshopt_Meshlet>(
+      mesh_build_meshlets_bound(opts, opts.lods[0].num_indices));
 
   struct MeshletLod {
     Span<const sh::Meshlet> meshlets;
@@ -372,12 +420,16 @@ void mesh_generate_meshlets(NotNull<Arena *> arena,
   usize base_lod_index = 0;
   usize base_lod_triangle = 0;
 
+  MeshletStats stats;
+  usize num_cones = 0;
+  double cone_angle_sum = 0.0;
+  double sphere_tightness_sum = 0.0;
+
   for (isize l = isize(opts.lods.m_size) - 1; l >= 0; --l) {
     const LOD &lod = opts.lods[l];
     ren_assert(3 * base_lod_triangle == lod.base_index);
 
-    u32 num_lod_meshlets = meshopt_buildMeshletsBound(
-        lod.num_indices, sh::NUM_MESHLET_VERTICES, sh::NUM_MESHLET_TRIANGLES);
+    u32 num_lod_meshlets = mesh_build_meshlets_bound(opts, lod.num_indices);
 
     auto gpu_meshlets = Span<sh::Meshlet>::allocate(scratch, num_lod_meshlets);
     auto meshlet_indices = Span<u32>::allocate(
@@ -385,12 +437,9 @@ void mesh_generate_meshlets(NotNull<Arena *> arena,
     auto meshlet_triangles = Span<u8>::allocate(
         scratch, num_lod_meshlets * sh::NUM_MESHLET_TRIANGLES * 3);
 
-    num_lod_meshlets = meshopt_buildMeshlets(
-        meshlets, meshlet_indices.m_data, meshlet_triangles.m_data,
-        &opts.indices[lod.base_index], lod.num_indices,
-        (const float *)opts.positions.m_data, opts.positions.m_size,
-        sizeof(glm::vec3), sh::NUM_MESHLET_VERTICES, sh::NUM_MESHLET_TRIANGLES,
-        opts.cone_weight);
+    num_lod_meshlets = mesh_build_meshlets(
+        opts, opts.indices.subspan(lod.base_index, lod.num_indices), meshlets,
+        meshlet_indices.m_data, meshlet_triangles.m_data);
 
     usize num_lod_indices = 0;
     usize num_lod_triangles = 0;
@@ -411,20 +460,25 @@ void mesh_generate_meshlets(NotNull<Arena *> arena,
                             meshlet.triangle_count * 3);
 
       // Optimize meshlet.
-      // TODO: replace with meshopt_optimizeMeshlet
 
       u8 opt_triangles[sh::NUM_MESHLET_TRIANGLES * 3];
       ren_assert(size(opt_triangles) >= triangles.m_size);
-      meshopt_optimizeVertexCache(opt_triangles, triangles.m_data,
-                                  triangles.m_size, meshlet.vertex_count);
-      triangles = {opt_triangles, triangles.m_size};
-
       u32 opt_indices[sh::NUM_MESHLET_VERTICES];
       ren_assert(size(opt_indices) >= indices.m_size);
+#if MESHOPTIMIZER_VERSION >= 220
+      copy(triangles, opt_triangles);
+      copy(indices, opt_indices);
+      meshopt_optimizeMeshlet(opt_indices, opt_triangles,
+                              meshlet.triangle_count, meshlet.vertex_count);
+#else
+      meshopt_optimizeVertexCache(opt_triangles, triangles.m_data,
+                                  triangles.m_size, meshlet.vertex_count);
       usize num_indices = meshopt_optimizeVertexFetch(
-          opt_indices, triangles.m_data, triangles.m_size, indices.m_data,
+          opt_indices, opt_triangles, triangles.m_size, indices.m_data,
           indices.m_size, sizeof(u32));
       ren_assert(num_indices == indices.m_size);
+#endif
+      triangles = {opt_triangles, triangles.m_size};
       indices = {opt_indices, indices.m_size};
 
       // Compact triangle buffer.
@@ -460,11 +514,35 @@ void mesh_generate_meshlets(NotNull<Arena *> arena,
 
       gpu_meshlets[m] = gpu_meshlet;
 
+      if (opts.stats) {
+        // The cone can be used for culling only if all normals are within 90
+        // degrees of the axis, in which case the cutoff is the sine of the
+        // cone's half-angle.
+        if (bounds.cone_cutoff < 1.0f) {
+          num_cones++;
+          cone_angle_sum += glm::degrees(glm::asin(bounds.cone_cutoff));
+        }
+        float area = 0.0f;
+        for (usize t = 0; t < triangles.m_size; t += 3) {
+          glm::vec3 p0 = opts.positions[indices[triangles[t + 0]]];
+          glm::vec3 p1 = opts.positions[indices[triangles[t + 1]]];
+          glm::vec3 p2 = opts.positions[indices[triangles[t + 2]]];
+          area += 0.5f * glm::length(glm::cross(p1 - p0, p2 - p0));
+        }
+        float sphere_area = glm::pi<float>() * bounds.radius * bounds.radius;
+        if (sphere_area > 0.0f) {
+          sphere_tightness_sum += area / sphere_area;
+        }
+      }
+
       num_lod_indices += meshlet.vertex_count;
       num_lod_triangles += meshlet.triangle_count;
     }
     ren_assert(num_lod_triangles * 3 == lod.num_indices);
 
+    stats.num_meshlets += num_lod_meshlets;
+    stats.num_triangles += num_lod_triangles;
+
     base_lod_meshlet += num_lod_meshlets;
     base_lod_index += num_lod_indices;
     base_lod_triangle += num_lod_triangles;
@@ -479,6 +557,19 @@ void mesh_generate_meshlets(NotNull<Arena *> arena,
   }
   ren_assert(3 * base_lod_triangle == opts.indices.m_size);
 
+  if (opts.stats) {
+    stats.num_cones = num_cones;
+    if (stats.num_meshlets > 0) {
+      stats.cone_coverage = float(num_cones) / stats.num_meshlets;
+      stats.avg_sphere_tightness =
+          float(sphere_tightness_sum / stats.num_meshlets);
+    }
+    if (num_cones > 0) {
+      stats.avg_cone_angle = float(cone_angle_sum / num_cones);
+    }
+    *opts.stats = stats;
+  }
+
   opts.header->num_vertices = opts.positions.m_size;
   *opts.meshlets = arena->allocate<sh::Meshlet>(base_lod_meshlet);
   opts.header->num_meshlets = base_lod_meshlet;
@@ -520,7 +611,18 @@ struct BakedMesh {
   u8 *triangles = nullptr;
 };
 
-BakedMesh bake_mesh(NotNull<Arena *> arena, const MeshInfo &info) {
+struct MeshBakeBounds {
+  sh::PositionBoundingBox bb = {};
+  float scale = 0.0f;
+  sh::BoundingSquare uv_bs = {};
+};
+
+// If bounds are passed, the mesh is treated as a chunk of a bigger mesh: the
+// bounds are used for attribute encoding and borders are locked during
+// simplification.
+BakedMesh bake_mesh(NotNull<Arena *> arena, const MeshInfo &info,
+                    const MeshBakeOptions &opts,
+                    const MeshBakeBounds *chunk_bounds = nullptr) {
   ZoneScoped;
 
   usize num_vertices = info.num_vertices;
@@ -584,6 +686,7 @@ BakedMesh bake_mesh(NotNull<Arena *> arena, const MeshInfo &info) {
                              .indices = &indices,
                              .num_lods = &num_lods,
                              .lods = lods,
+                             .lock_border = chunk_bounds != nullptr,
                          });
 
   // Optimize each LOD separately
@@ -624,8 +727,17 @@ BakedMesh bake_mesh(NotNull<Arena *> arena, const MeshInfo &info) {
 
   // Compute bounds.
 
-  mesh_compute_bounds({positions, num_vertices}, &mesh.header.bb,
-                      &mesh.header.scale);
+  if (chunk_bounds) {
+    mesh.header.bb = chunk_bounds->bb;
+    mesh.header.scale = chunk_bounds->scale;
+    mesh.header.uv_bs = chunk_bounds->uv_bs;
+  } else {
+    mesh_compute_bounds({positions, num_vertices}, &mesh.header.bb,
+                        &mesh.header.scale);
+    if (uvs) {
+      mesh_compute_uv_bounds({uvs, num_vertices}, &mesh.header.uv_bs);
+    }
+  }
 
   // Generate meshlets
 
@@ -637,7 +749,10 @@ BakedMesh bake_mesh(NotNull<Arena *> arena, const MeshInfo &info) {
                                     .meshlet_indices = &mesh.indices,
                                     .meshlet_triangles = &mesh.triangles,
                                     .header = &mesh.header,
-                                    .cone_weight = 1.0f,
+                                    .algorithm = opts.meshlet_algorithm,
+                                    .cone_weight = opts.cone_weight,
+                                    .fill_weight = opts.fill_weight,
+                                    .stats = opts.stats,
                                 });
 
   // Encode vertex attributes
@@ -655,7 +770,7 @@ BakedMesh bake_mesh(NotNull<Arena *> arena, const MeshInfo &info) {
   }
 
   if (uvs) {
-    mesh.uvs = mesh_encode_uvs(arena, {uvs, num_vertices}, &mesh.header.uv_bs);
+    mesh.uvs = mesh_encode_uvs(arena, {uvs, num_vertices}, mesh.header.uv_bs);
   }
 
   if (colors) {
@@ -688,9 +803,596 @@ BakedMesh bake_mesh(NotNull<Arena *> arena, const MeshInfo &info) {
   return mesh;
 }
 
-IoResult<void> bake_mesh_to_file(const MeshInfo &info, File file) {
+// Rough estimate of the peak amount of memory used by bake_mesh() per input
+// triangle, including intermediate buffers for index generation, LODs and
+// meshlets.
+constexpr usize MESH_BAKE_BYTES_PER_TRIANGLE = 768;
+
+usize mesh_num_triangles(const MeshInfo &info) {
+  return (info.indices.m_size > 0 ? info.indices.m_size : info.num_vertices) /
+         3;
+}
+
+bool mesh_bake_needs_chunking(const MeshInfo &info,
+                              const MeshBakeOptions &opts) {
+  return opts.memory_budget > 0 and
+         mesh_num_triangles(info) * MESH_BAKE_BYTES_PER_TRIANGLE >
+             opts.memory_budget;
+}
+
+// Node of a k-d tree over triangle centroids.
+struct MeshChunkNode {
+  sh::BoundingBox bb = {};
+  u32 axis = 0;
+  float split = 0.0f;
+  // Index of the first child, 0 for leaves.
+  u32 children = 0;
+  u32 num_triangles = 0;
+  // Exact triangle count of the parent, 0 for the root.
+  u32 parent_num_triangles = 0;
+  // Chunk index for leaves, histogram slot for leaves that are being split.
+  i32 chunk = -1;
+  bool final = false;
+};
+
+struct MeshChunk {
+  u32 num_triangles = 0;
+  u32 num_vertices = 0;
+  u32 num_meshlets = 0;
+  u32 num_indices = 0;
+  u32 num_triangles_out = 0;
+  u32 num_lods = 0;
+  sh::MeshLOD lods[sh::MAX_NUM_LODS] = {};
+};
+
+struct MeshChunkTree {
+  Span<MeshChunkNode> nodes;
+  Span<MeshChunk> chunks;
+};
+
+u32 mesh_triangle_index(const MeshInfo &info, usize t, usize k) {
+  return info.indices.m_size > 0 ? info.indices[t * 3 + k] : t * 3 + k;
+}
+
+glm::vec3 mesh_triangle_centroid(const MeshInfo &info, usize t) {
+  return (info.positions[mesh_triangle_index(info, t, 0)] +
+          info.positions[mesh_triangle_index(info, t, 1)] +
+          info.positions[mesh_triangle_index(info, t, 2)]) /
+         3.0f;
+}
+
+u32 mesh_chunk_find_leaf(Span<const MeshChunkNode> nodes, glm::vec3 p) {
+  u32 n = 0;
+  while (nodes[n].children) {
+    const MeshChunkNode &node = nodes[n];
+    n = node.children + (p[node.axis] < node.split ? 0 : 1);
+  }
+  return n;
+}
+
+// Split the mesh into spatially coherent chunks of at most max_num_triangles
+// triangles each. Only the tree is kept in memory: triangles are reassigned to
+// chunks by walking the tree with their centroids.
+MeshChunkTree mesh_build_chunk_tree(NotNull<Arena *> arena,
+                                    const MeshInfo &info,
+                                    usize max_num_triangles) {
+  ZoneScoped;
+
+  constexpr usize NUM_BINS = 1024;
+
+  ScratchArena scratch;
+
+  usize num_triangles = mesh_num_triangles(info);
+
+  DynamicArray<MeshChunkNode> nodes;
+  {
+    MeshChunkNode root = {
+        .bb =
+            {
+                .min = glm::vec3(std::numeric_limits<float>::infinity()),
+                .max = -glm::vec3(std::numeric_limits<float>::infinity()),
+            },
+        .num_triangles = (u32)num_triangles,
+    };
+    for (usize t : range(num_triangles)) {
+      glm::vec3 c = mesh_triangle_centroid(info, t);
+      root.bb.min = glm::min(root.bb.min, c);
+      root.bb.max = glm::max(root.bb.max, c);
+    }
+    nodes.push(scratch, root);
+  }
+
+  // Split all oversized leaves of the current level at once to make a single
+  // pass over the triangles per level.
+  while (true) {
+    ScratchArena level_scratch;
+    DynamicArray<u32> split_nodes;
+    for (usize n : range(nodes.m_size)) {
+      MeshChunkNode &node = nodes[n];
+      if (node.children or node.final or
+          node.num_triangles <= max_num_triangles) {
+        continue;
+      }
+      glm::vec3 extent = node.bb.max - node.bb.min;
+      node.axis = extent.x >= extent.y and extent.x >= extent.z ? 0
+                  : extent.y >= extent.z                       ? 1
+                                                               : 2;
+      if (extent[node.axis] <= 0.0f) {
+        node.final = true;
+        continue;
+      }
+      node.chunk = split_nodes.m_size;
+      split_nodes.push(level_scratch, n);
+    }
+    if (split_nodes.m_size == 0) {
+      break;
+    }
+
+    auto histograms =
+        Span<u32>::allocate(level_scratch, split_nodes.m_size * NUM_BINS);
+    fill(histograms, 0);
+    for (usize t : range(num_triangles)) {
+      glm::vec3 c = mesh_triangle_centroid(info, t);
+      const MeshChunkNode &node = nodes[mesh_chunk_find_leaf(nodes, c)];
+      if (node.chunk < 0) {
+        continue;
+      }
+      float extent = node.bb.max[node.axis] - node.bb.min[node.axis];
+      float x = (c[node.axis] - node.bb.min[node.axis]) / extent * NUM_BINS;
+      usize bin = glm::clamp<isize>(isize(x), 0, NUM_BINS - 1);
+      histograms[node.chunk * NUM_BINS + bin]++;
+    }
+
+    for (u32 n : split_nodes) {
+      MeshChunkNode node = nodes[n];
+      Span<const u32> histogram =
+          histograms.subspan(node.chunk * NUM_BINS, NUM_BINS);
+      nodes[n].chunk = -1;
+
+      // Child triangle counts are estimated from the parent's histogram, get
+      // the exact count.
+      node.num_triangles = 0;
+      for (u32 count : histogram) {
+        node.num_triangles += count;
+      }
+      nodes[n].num_triangles = node.num_triangles;
+      if (node.num_triangles <= max_num_triangles) {
+        continue;
+      }
+      if (node.num_triangles == node.parent_num_triangles) {
+        // The parent's split didn't separate any triangles, splitting this
+        // node again would do the same.
+        nodes[n].final = true;
+        continue;
+      }
+
+      // Split at the median bin edge.
+      u32 num_left = 0;
+      usize bin = 0;
+      while (num_left + histogram[bin] <= node.num_triangles / 2) {
+        num_left += histogram[bin++];
+      }
+      if (num_left == 0) {
+        num_left += histogram[bin++];
+      }
+      if (num_left == node.num_triangles) {
+        // All centroids are in the same bin, accept an oversized chunk.
+        nodes[n].final = true;
+        continue;
+      }
+
+      float extent = node.bb.max[node.axis] - node.bb.min[node.axis];
+      float split = node.bb.min[node.axis] + extent * bin / NUM_BINS;
+      if (split <= node.bb.min[node.axis] or split >= node.bb.max[node.axis]) {
+        // The extent is too small compared to the coordinates for the split
+        // to be representable.
+        nodes[n].final = true;
+        continue;
+      }
+
+      MeshChunkNode left = {
+          .bb = node.bb,
+          .num_triangles = num_left,
+          .parent_num_triangles = node.num_triangles,
+      };
+      left.bb.max[node.axis] = split;
+      MeshChunkNode right = {
+          .bb = node.bb,
+          .num_triangles = node.num_triangles - num_left,
+          .parent_num_triangles = node.num_triangles,
+      };
+      right.bb.min[node.axis] = split;
+
+      nodes[n].split = split;
+      nodes[n].children = nodes.m_size;
+      nodes.push(scratch, left);
+      nodes.push(scratch, right);
+    }
+  }
+
+  // Get exact leaf triangle counts.
+  for (MeshChunkNode &node : nodes) {
+    node.num_triangles = 0;
+  }
+  for (usize t : range(num_triangles)) {
+    glm::vec3 c = mesh_triangle_centroid(info, t);
+    nodes[mesh_chunk_find_leaf(nodes, c)].num_triangles++;
+  }
+
+  // Assign chunks to leaves in depth-first order so that neighbouring chunks
+  // end up close to each other in the package.
+  DynamicArray<MeshChunk> chunks;
+  DynamicArray<u32> stack;
+  stack.push(scratch, 0);
+  while (stack.m_size > 0) {
+    MeshChunkNode &node = nodes[stack.back()];
+    stack.pop();
+    if (node.children) {
+      stack.push(scratch, node.children + 1);
+      stack.push(scratch, node.children);
+    } else if (node.num_triangles > 0) {
+      node.chunk = chunks.m_size;
+      chunks.push(scratch, {.num_triangles = node.num_triangles});
+    }
+  }
+
+  MeshChunkTree tree = {
+      .nodes = Span<MeshChunkNode>::allocate(arena, nodes.m_size),
+      .chunks = Span<MeshChunk>::allocate(arena, chunks.m_size),
+  };
+  copy(Span<const MeshChunkNode>(nodes), tree.nodes.m_data);
+  copy(Span<const MeshChunk>(chunks), tree.chunks.m_data);
+  return tree;
+}
+
+// Call cb(chunk, chunk_info) for each chunk in order. Chunk index lists are
+// gathered in batches that fit into budget bytes.
+template <typename F>
+IoResult<void> mesh_for_each_chunk(const MeshInfo &info,
+                                   const MeshChunkTree &tree, usize budget,
+                                   F cb) {
+  usize num_triangles = mesh_num_triangles(info);
+
+  usize first_chunk = 0;
+  while (first_chunk < tree.chunks.m_size) {
+    ScratchArena scratch;
+
+    usize batch_size = 0;
+    usize last_chunk = first_chunk;
+    while (last_chunk < tree.chunks.m_size) {
+      usize chunk_size =
+          tree.chunks[last_chunk].num_triangles * 3 * sizeof(u32);
+      if (last_chunk > first_chunk and batch_size + chunk_size > budget) {
+        break;
+      }
+      batch_size += chunk_size;
+      last_chunk++;
+    }
+
+    usize num_batch_chunks = last_chunk - first_chunk;
+    auto chunk_indices =
+        Span<DynamicArray<u32>>::allocate(scratch, num_batch_chunks);
+    for (usize c : range(num_batch_chunks)) {
+      chunk_indices[c] = {};
+      chunk_indices[c].reserve(scratch,
+                               tree.chunks[first_chunk + c].num_triangles * 3);
+    }
+    for (usize t : range(num_triangles)) {
+      const MeshChunkNode &node = tree.nodes[mesh_chunk_find_leaf(
+          tree.nodes, mesh_triangle_centroid(info, t))];
+      ren_assert(node.chunk >= 0);
+      if (usize(node.chunk) < first_chunk or usize(node.chunk) >= last_chunk) {
+        continue;
+      }
+      DynamicArray<u32> &indices = chunk_indices[node.chunk - first_chunk];
+      for (usize k : range(3)) {
+        indices.push(scratch, mesh_triangle_index(info, t, k));
+      }
+    }
+
+    for (usize c : range(num_batch_chunks)) {
+      ScratchArena chunk_scratch;
+      Span<u32> indices = chunk_indices[c];
+      ren_assert(indices.m_size ==
+                 tree.chunks[first_chunk + c].num_triangles * 3);
+
+      // Remap global vertex indices to chunk-local ones.
+      auto vertices = Span<u32>::allocate(chunk_scratch, indices.m_size);
+      copy(Span<const u32>(indices), vertices.m_data);
+      std::sort(vertices.begin(), vertices.end());
+      usize num_vertices =
+          std::unique(vertices.begin(), vertices.end()) - vertices.begin();
+      vertices = vertices.subspan(0, num_vertices);
+      for (u32 &index : indices) {
+        index = std::lower_bound(vertices.begin(), vertices.end(), index) -
+                vertices.begin();
+      }
+
+      auto gather = [&]<typename T>(const T *stream) -> const T * {
+        if (!stream) {
+          return nullptr;
+        }
+        T *chunk_stream = chunk_scratch->allocate<T>(num_vertices);
+        for (usize v : range(num_vertices)) {
+          chunk_stream[v] = stream[vertices[v]];
+        }
+        return chunk_stream;
+      };
+
+      MeshInfo chunk_info = {
+          .num_vertices = num_vertices,
+          .positions = gather(info.positions.get()),
+          .normals = gather(info.normals.get()),
+          .tangents = gather(info.tangents),
+          .uvs = gather(info.uvs),
+          .colors = gather(info.colors),
+          .indices = indices,
+      };
+      if (IoResult<void> result = cb(first_chunk + c, chunk_info); !result) {
+        return result.error();
+      }
+    }
+
+    first_chunk = last_chunk;
+  }
+
+  return {};
+}
+
+struct MeshPackageWriter {
+  File file = {};
+  u64 file_start = 0;
+  u8 *buffer = nullptr;
+
+  IoResult<void> write(u64 offset, const void *data, usize size) const {
+    if (buffer) {
+      std::memcpy(&buffer[offset], data, size);
+      return {};
+    }
+    if (IoResult<usize> result =
+            seek(file, file_start + offset, SeekMode::Set);
+        !result) {
+      return result.error();
+    }
+    return write_all(file, data, size);
+  }
+};
+
+// Bake a mesh that doesn't fit into the memory budget chunk by chunk and merge
+// the chunks into a single package. To avoid keeping baked chunks in memory,
+// they are baked twice: once to compute the package layout and once more to
+// write them out.
+IoResult<usize> bake_mesh_chunked(NotNull<Arena *> arena, const MeshInfo &info,
+                                  const MeshBakeOptions &opts,
+                                  Blob *blob, Optional<File> file) {
+  ZoneScoped;
+
+  ScratchArena scratch;
+
+  usize max_chunk_triangles =
+      max<usize>(opts.memory_budget * 3 / 4 / MESH_BAKE_BYTES_PER_TRIANGLE,
+                 sh::NUM_MESHLET_TRIANGLES);
+  usize gather_budget = opts.memory_budget / 4;
+  MeshChunkTree tree =
+      mesh_build_chunk_tree(scratch, info, max_chunk_triangles);
+
+  // Compute bounds for the whole mesh so that all chunks use the same
+  // quantization.
+  MeshBakeBounds bounds;
+  mesh_compute_bounds({info.positions.get(), info.num_vertices}, &bounds.bb,
+                      &bounds.scale);
+  if (info.uvs) {
+    mesh_compute_uv_bounds({info.uvs, info.num_vertices}, &bounds.uv_bs);
+  }
+
+  // Pass 1: compute chunk sizes.
+
+  usize num_meshlets = 0;
+  usize num_cones = 0;
+  double cone_angle_sum = 0.0;
+  double sphere_tightness_sum = 0.0;
+  MeshletStats stats;
+  IoResult<void> result = mesh_for_each_chunk(
+      info, tree, gather_budget,
+      [&](usize c, const MeshInfo &chunk_info) -> IoResult<void> {
+        ScratchArena scratch;
+        MeshletStats chunk_stats;
+        MeshBakeOptions chunk_opts = opts;
+        chunk_opts.stats = opts.stats ? &chunk_stats : nullptr;
+        BakedMesh mesh = bake_mesh(scratch, chunk_info, chunk_opts, &bounds);
+        MeshChunk &chunk = tree.chunks[c];
+        chunk.num_vertices = mesh.header.num_vertices;
+        chunk.num_meshlets = mesh.header.num_meshlets;
+        chunk.num_indices = mesh.header.num_indices;
+        chunk.num_triangles_out = mesh.header.num_triangles;
+        chunk.num_lods = mesh.header.num_lods;
+        copy(Span<const sh::MeshLOD>(mesh.header.lods, chunk.num_lods),
+             chunk.lods);
+        if (opts.stats) {
+          stats.num_meshlets += chunk_stats.num_meshlets;
+          stats.num_triangles += chunk_stats.num_triangles;
+          num_cones += chunk_stats.num_cones;
+          cone_angle_sum +=
+              chunk_stats.avg_cone_angle * chunk_stats.num_cones;
+          sphere_tightness_sum +=
+              chunk_stats.avg_sphere_tightness * chunk_stats.num_meshlets;
+        }
+        return {};
+      });
+  ren_assert(result);
+
+  if (opts.stats) {
+    stats.num_cones = num_cones;
+    if (stats.num_meshlets > 0) {
+      stats.cone_coverage = float(num_cones) / stats.num_meshlets;
+      stats.avg_sphere_tightness =
+          float(sphere_tightness_sum / stats.num_meshlets);
+    }
+    if (num_cones > 0) {
+      stats.avg_cone_angle = float(cone_angle_sum / num_cones);
+    }
+    *opts.stats = stats;
+  }
+
+  // Compute the merged layout. Chunks might end up with different numbers of
+  // LODs: align them by the finest LOD and reuse the coarsest LOD of chunks
+  // that have fewer.
+
+  MeshPackageHeader header = {
+      .bb = bounds.bb,
+      .scale = bounds.scale,
+      .uv_bs = bounds.uv_bs,
+  };
+  for (const MeshChunk &chunk : tree.chunks) {
+    header.num_lods = max(header.num_lods, chunk.num_lods);
+  }
+  auto chunk_lod = [&](const MeshChunk &chunk, u32 lod) -> u32 {
+    return max<i32>(i32(lod) - i32(header.num_lods - chunk.num_lods), 0);
+  };
+  for (u32 lod : range(header.num_lods)) {
+    sh::MeshLOD &merged_lod = header.lods[lod];
+    merged_lod.base_meshlet = num_meshlets;
+    for (const MeshChunk &chunk : tree.chunks) {
+      const sh::MeshLOD &src = chunk.lods[chunk_lod(chunk, lod)];
+      merged_lod.num_meshlets += src.num_meshlets;
+      merged_lod.num_triangles += src.num_triangles;
+    }
+    num_meshlets += merged_lod.num_meshlets;
+  }
+  for (const MeshChunk &chunk : tree.chunks) {
+    header.num_vertices += chunk.num_vertices;
+    header.num_indices += chunk.num_indices;
+    header.num_triangles += chunk.num_triangles_out;
+  }
+  header.num_meshlets = num_meshlets;
+
+  usize align = 8;
+  u64 end = pad(sizeof(header), align);
+  auto set_offset = [&](bool present, u64 *offset, usize size) {
+    *offset = present ? end : 0;
+    end = pad(end + (present ? size : 0), align);
+  };
+  set_offset(true, &header.positions_offset,
+             header.num_vertices * sizeof(sh::Position));
+  set_offset(true, &header.normals_offset,
+             header.num_vertices * sizeof(sh::Normal));
+  set_offset(info.tangents or info.uvs, &header.tangents_offset,
+             header.num_vertices * sizeof(sh::Tangent));
+  set_offset(info.uvs, &header.uvs_offset,
+             header.num_vertices * sizeof(sh::UV));
+  set_offset(info.colors, &header.colors_offset,
+             header.num_vertices * sizeof(sh::Color));
+  set_offset(true, &header.meshlets_offset,
+             header.num_meshlets * sizeof(sh::Meshlet));
+  set_offset(true, &header.indices_offset, header.num_indices * sizeof(u32));
+  set_offset(true, &header.triangles_offset, header.num_triangles * 3);
+
+  MeshPackageWriter writer;
+  if (file) {
+    IoResult<usize> file_start = seek(*file, 0, SeekMode::Cur);
+    if (!file_start) {
+      return file_start.error();
+    }
+    writer = {.file = *file, .file_start = *file_start};
+  } else {
+    writer.buffer = (u8 *)arena->allocate(end, 8);
+    *blob = {writer.buffer, end};
+  }
+
+  if (IoResult<void> result = writer.write(0, &header, sizeof(header));
+      !result) {
+    return result.error();
+  }
+
+  // Pass 2: bake again and write chunks out.
+
+  u32 meshlet_cursors[sh::MAX_NUM_LODS] = {};
+  for (u32 lod : range(header.num_lods)) {
+    meshlet_cursors[lod] = header.lods[lod].base_meshlet;
+  }
+  usize base_vertex = 0;
+  usize base_index = 0;
+  usize base_triangle = 0;
+  MeshBakeOptions chunk_opts = opts;
+  chunk_opts.stats = nullptr;
+  result = mesh_for_each_chunk(
+      info, tree, gather_budget,
+      [&](usize c, const MeshInfo &chunk_info) -> IoResult<void> {
+        ScratchArena scratch;
+        BakedMesh mesh = bake_mesh(scratch, chunk_info, chunk_opts, &bounds);
+        const MeshChunk &chunk = tree.chunks[c];
+        ren_assert_msg(mesh.header.num_vertices == chunk.num_vertices and
+                           mesh.header.num_meshlets == chunk.num_meshlets and
+                           mesh.header.num_lods == chunk.num_lods,
+                       "Mesh baking must be deterministic");
+
+#define write_array(arr, base, size)                                           \
+  do {                                                                         \
+    if (mesh.arr) {                                                            \
+      if (IoResult<void> result = writer.write(                                \
+              header.arr##_offset + (base) * sizeof(*mesh.arr), mesh.arr,      \
+              (size) * sizeof(*mesh.arr));                                     \
+          !result) {                                                           \
+        return result.error();                                                 \
+      }                                                                        \
+    }                                                                          \
+  } while (0)
+
+        write_array(positions, base_vertex, chunk.num_vertices);
+        write_array(normals, base_vertex, chunk.num_vertices);
+        write_array(tangents, base_vertex, chunk.num_vertices);
+        write_array(uvs, base_vertex, chunk.num_vertices);
+        write_array(colors, base_vertex, chunk.num_vertices);
+
+        for (u32 &index : Span(mesh.indices, chunk.num_indices)) {
+          index += base_vertex;
+        }
+        write_array(indices, base_index, chunk.num_indices);
+        write_array(triangles, 3 * base_triangle, 3 * chunk.num_triangles_out);
+
+        for (sh::Meshlet &meshlet : Span(mesh.meshlets, chunk.num_meshlets)) {
+          meshlet.base_index += base_index;
+          meshlet.base_triangle += 3 * base_triangle;
+        }
+#undef write_array
+        for (u32 lod : range(header.num_lods)) {
+          const sh::MeshLOD &src = chunk.lods[chunk_lod(chunk, lod)];
+          if (IoResult<void> result = writer.write(
+                  header.meshlets_offset +
+                      meshlet_cursors[lod] * sizeof(sh::Meshlet),
+                  &mesh.meshlets[src.base_meshlet],
+                  src.num_meshlets * sizeof(sh::Meshlet));
+              !result) {
+            return result.error();
+          }
+          meshlet_cursors[lod] += src.num_meshlets;
+        }
+
+        base_vertex += chunk.num_vertices;
+        base_index += chunk.num_indices;
+        base_triangle += chunk.num_triangles_out;
+        return {};
+      });
+  if (!result) {
+    return result.error();
+  }
+
+  return end;
+}
+
+IoResult<void> bake_mesh_to_file(const MeshInfo &info, File file,
+                                 const MeshBakeOptions &opts) {
   ScratchArena scratch;
-  BakedMesh mesh = bake_mesh(scratch, info);
+  if (mesh_bake_needs_chunking(info, opts)) {
+    IoResult<usize> result =
+        bake_mesh_chunked(scratch, info, opts, nullptr, file);
+    if (!result) {
+      return result.error();
+    }
+    return {};
+  }
+
+  BakedMesh mesh = bake_mesh(scratch, info, opts);
 
   IoResult<usize> file_start = seek(file, 0, SeekMode::Cur);
   if (!file_start) {
@@ -728,11 +1430,19 @@ IoResult<void> bake_mesh_to_file(const MeshInfo &info, File file) {
   return {};
 }
 
-Blob bake_mesh_to_memory(NotNull<Arena *> arena, const MeshInfo &info) {
+Blob bake_mesh_to_memory(NotNull<Arena *> arena, const MeshInfo &info,
+                         const MeshBakeOptions &opts) {
   ZoneScoped;
 
+  if (mesh_bake_needs_chunking(info, opts)) {
+    Blob blob;
+    IoResult<usize> result = bake_mesh_chunked(arena, info, opts, &blob, {});
+    ren_assert(result);
+    return blob;
+  }
+
   ScratchArena scratch;
-  BakedMesh mesh = bake_mesh(scratch, info);
+  BakedMesh mesh = bake_mesh(scratch, info, opts);
   u8 *buffer = (u8 *)arena->allocate(mesh.size, 8);
   std::memcpy(buffer, &mesh.header, sizeof(mesh.header));
 #define write_array(arr, size)                                                 \
@@ -27,12 +27,14 @@ void mesh_simplify(NotNull<Arena *> arena,
     }
 
     constexpr float LOD_ERROR = 0.001f;
+    u32 options = input.lock_border ? meshopt_SimplifyLockBorder : 0;
 
     u32 *indices = scratch->allocate<u32>(prev_lod.m_size);
     u32 num_lod_indices = meshopt_simplify(
         indices, prev_lod.m_data, prev_lod.m_size,
         (const float *)input.positions.get(), input.num_vertices,
-        sizeof(glm::vec3), num_lod_target_indices, LOD_ERROR, 0, nullptr);
+        sizeof(glm::vec3), num_lod_target_indices, LOD_ERROR, options,
+        nullptr);
     lods.push(scratch, {indices, num_lod_indices});
     if (num_lod_indices > num_lod_target_indices) {
       break;
@@ -27,6 +27,9 @@ struct MeshSimplificationInput {
   float threshold = 0.75f;
   /// Number of LOD triangles after which to stop simplification.
   u32 min_num_triangles = 1;
+  /// Don't move vertices on open borders. Used when parts of a mesh are
+  /// simplified independently to avoid cracks between them.
+  bool lock_border = false;
 };
 
 void mesh_simplify(NotNull<Arena *> arena,
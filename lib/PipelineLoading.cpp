@@ -22,6 +22,7 @@
 #include "PostProcessing.comp.hpp"
 #include "PrepareBatch.comp.hpp"
 #include "ReduceLuminanceHistogram.comp.hpp"
+#include "ScatterUpload.comp.hpp"
 #include "Skybox.frag.hpp"
 #include "Skybox.vert.hpp"
 #include "Ssao.comp.hpp"
@@ -138,6 +139,7 @@ Pipelines load_pipelines(ResourceArena &arena) {
           compute_pipeline(ExclusiveScanUint32CS, "Exclusive scan uint32"),
       .meshlet_sorting = compute_pipeline(MeshletSortingCS, "Meshlet soring"),
       .prepare_batch = compute_pipeline(PrepareBatchCS, "Prepare batch"),
+      .scatter_upload = compute_pipeline(ScatterUploadCS, "Scatter upload"),
       .hi_z = compute_pipeline(HiZCS, "Hi-Z"),
       .ssao_hi_z = compute_pipeline(SsaoHiZCS, "SSAO Hi-Z"),
       .ssao = compute_pipeline(SsaoCS, "SSAO"),
@@ -11,6 +11,7 @@ struct Pipelines {
   Handle<ComputePipeline> exclusive_scan_uint32;
   Handle<ComputePipeline> meshlet_sorting;
   Handle<ComputePipeline> prepare_batch;
+  Handle<ComputePipeline> scatter_upload;
   Handle<ComputePipeline> hi_z;
   Handle<ComputePipeline> ssao_hi_z;
   Handle<ComputePipeline> ssao;
@@ -2,8 +2,13 @@
 #include "CommandRecorder.hpp"
 #include "ren/core/Algorithm.hpp"
 #include "ren/core/Format.hpp"
+#include "ren/core/HashMap.hpp"
+#include "ren/core/Job.hpp"
 
+#include <algorithm>
+#include <cstring>
 #include <tracy/Tracy.hpp>
+#include <tracy/TracyC.h>
 
 namespace ren {
 
@@ -72,11 +77,441 @@ RgPersistent RgPersistent::init(NotNull<Arena *> arena,
       .m_arena = arena,
       .m_rcs_arena = ResourceArena::init(arena, renderer),
       .m_textures = GenArray<RgTexture>::init(arena),
+      .m_compiled_arena = Arena::init(),
       .m_semaphores = GenArray<RgSemaphore>::init(arena),
   };
 }
 
-void RgPersistent::destroy() { m_rcs_arena.clear(); }
+void RgPersistent::reset() {
+  for (const RgPhysicalTexture &ptex : m_physical_textures) {
+    if (ptex.external or !ptex.handle) {
+      continue;
+    }
+    // The transient memory block is reallocated when new transient textures
+    // are placed into it, so textures that live in it can't be reused.
+    if (ptex.aliased) {
+      retire(ptex.handle);
+    } else {
+      m_reusable_textures.push(m_arena, ptex);
+    }
+  }
+  m_physical_textures.clear();
+  m_textures.clear();
+  m_texture_aliases.clear();
+  m_semaphores.clear();
+  m_gfx_semaphore_id = {};
+  m_async_semaphore_id = {};
+  m_compiled.valid = false;
+}
+
+void RgPersistent::retire(Handle<Texture> texture) {
+  m_retired_resources.push(m_arena, {
+                                        .texture = texture,
+                                        .gfx_time = m_gfx_time,
+                                        .async_time = m_async_time,
+                                    });
+}
+
+void RgPersistent::retire(Handle<Buffer> buffer) {
+  m_retired_resources.push(m_arena, {
+                                        .buffer = buffer,
+                                        .gfx_time = m_gfx_time,
+                                        .async_time = m_async_time,
+                                    });
+}
+
+void RgPersistent::retire(rhi::Allocation memory) {
+  m_retired_resources.push(m_arena, {
+                                        .memory = memory,
+                                        .gfx_time = m_gfx_time,
+                                        .async_time = m_async_time,
+                                    });
+}
+
+void RgPersistent::release_retired_resources() {
+  if (m_retired_resources.m_size == 0) {
+    return;
+  }
+
+  Renderer *renderer = m_rcs_arena.m_renderer;
+  auto is_reached = [&](Handle<Semaphore> semaphore, u64 time) {
+    if (!semaphore or time == 0) {
+      return true;
+    }
+    return renderer->wait_for_semaphore(semaphore, time, 0) ==
+           rhi::WaitResult::Success;
+  };
+
+  // Resources are retired in timeline order.
+  usize num_released = 0;
+  while (num_released < m_retired_resources.m_size) {
+    const RgRetiredResource &resource = m_retired_resources[num_released];
+    if (!is_reached(m_gfx_semaphore, resource.gfx_time) or
+        !is_reached(m_async_semaphore, resource.async_time)) {
+      break;
+    }
+    if (resource.texture) {
+      renderer->destroy(resource.texture);
+    }
+    if (resource.buffer) {
+      renderer->destroy(resource.buffer);
+    }
+    if (resource.memory) {
+      rhi::free_memory(renderer->get_rhi_device(), resource.memory);
+    }
+    num_released++;
+  }
+
+  if (num_released > 0) {
+    std::memmove(m_retired_resources.m_data,
+                 m_retired_resources.m_data + num_released,
+                 (m_retired_resources.m_size - num_released) *
+                     sizeof(RgRetiredResource));
+    m_retired_resources.m_size -= num_released;
+  }
+}
+
+bool RgPersistent::update_buffer_pool(RgBufferPoolId id, usize size) {
+  RgBufferPool &pool = m_buffer_pools[id];
+
+  if (size == 0) {
+    pool.num_idle_frames++;
+    if (pool.buffer and pool.num_idle_frames >= m_buffer_pool_idle_frames) {
+      retire(pool.buffer);
+      pool = {};
+    }
+    return true;
+  }
+  pool.num_idle_frames = 0;
+
+  // Halve the high-water mark roughly every 180 frames.
+  pool.high_water_mark -= pool.high_water_mark / 256;
+  pool.high_water_mark = max(pool.high_water_mark, size);
+
+  // Leave some headroom when resizing so that small fluctuations don't cause
+  // reallocations, and only shrink once usage has dropped significantly.
+  if (size <= pool.size and pool.size / 2 <= pool.high_water_mark) {
+    return true;
+  }
+  usize new_size = pad(pool.high_water_mark + pool.high_water_mark / 4, MiB);
+
+  Renderer *renderer = m_rcs_arena.m_renderer;
+  rhi::Result<Handle<Buffer>> buffer = renderer->create_buffer({
+      .name = "Render graph buffer pool",
+      .heap = rhi::MemoryHeap::Default,
+      .size = new_size,
+  });
+  if (!buffer and new_size > size) {
+    new_size = size;
+    buffer = renderer->create_buffer({
+        .name = "Render graph buffer pool",
+        .heap = rhi::MemoryHeap::Default,
+        .size = new_size,
+    });
+  }
+  if (!buffer) {
+    // Spill to system memory instead of failing the frame.
+    fmt::println(stderr,
+                 "Render graph: failed to allocate {} bytes of device memory "
+                 "for buffer pool, falling back to host memory",
+                 new_size);
+    buffer = renderer->create_buffer({
+        .name = "Render graph buffer pool",
+        .heap = rhi::MemoryHeap::Upload,
+        .size = new_size,
+    });
+  }
+  if (!buffer) {
+    if (size <= pool.size) {
+      // Keep using the old pool if it was only going to shrink.
+      return true;
+    }
+    fmt::println(stderr,
+                 "Render graph: failed to allocate {} bytes for buffer pool",
+                 new_size);
+    return false;
+  }
+
+  if (pool.buffer) {
+    retire(pool.buffer);
+  }
+  pool.buffer = *buffer;
+  pool.size = new_size;
+
+  return true;
+}
+
+namespace {
+
+// Get the name that a pass's statistics are shown under. Passes with the same
+// name are numbered after the first one. The name is zero-terminated for
+// Tracy.
+String8 get_pass_stats_name(NotNull<Arena *> arena, String8 name, u32 index) {
+  if (index == 0) {
+    return String8(name.zero_terminated(arena), name.m_size);
+  }
+  const char *str = format_zero_terminated(arena, "{} #{}", name, index + 1);
+  return String8(str, std::strlen(str));
+}
+
+} // namespace
+
+void RgPersistent::record_pass_time(u64 pass, String8 name, RgQueue queue,
+                                    float time) {
+  // Weight of a new measurement in the moving average.
+  constexpr float SMOOTHING = 0.1f;
+  RgPassCost *cost = m_pass_costs.try_get(pass);
+  if (!cost) {
+    cost = &m_pass_costs.insert(m_arena, pass, {.name = name.copy(m_arena)});
+  }
+  float &average = queue == RgQueue::Async ? cost->async_time : cost->gfx_time;
+  if (average > 0.0f) {
+    average += SMOOTHING * (time - average);
+  } else {
+    average = time;
+  }
+}
+
+auto get_pass_timing_stats(const RgPassTiming &timing) -> RgPassTimingStats {
+  usize num_samples = min<usize>(timing.num_samples, RG_PASS_TIMING_HISTORY);
+  if (num_samples == 0) {
+    return {};
+  }
+  RgPassTimingStats stats = {
+      .last = timing.history[(timing.num_samples - 1) % RG_PASS_TIMING_HISTORY],
+      .min = timing.history[0],
+      .max = timing.history[0],
+  };
+  for (float time : Span(timing.history, num_samples)) {
+    stats.average += time;
+    stats.min = min(stats.min, time);
+    stats.max = max(stats.max, time);
+  }
+  stats.average /= num_samples;
+  return stats;
+}
+
+auto RgPersistent::begin_timestamp_frame(Span<const RgRtPass> gfx_passes,
+                                         Span<const RgRtPass> async_passes)
+    -> RgTimestampFrame * {
+  rhi::Device device = m_rcs_arena.m_renderer->get_rhi_device();
+
+  // Read back frames in the order in which they were submitted.
+  for (usize i : range(NUM_RG_TIMESTAMP_FRAMES)) {
+    RgTimestampFrame &frame =
+        m_timestamp_frames[(m_timestamp_frame + i) % NUM_RG_TIMESTAMP_FRAMES];
+    if (frame.pending and !read_timestamps(frame)) {
+      break;
+    }
+  }
+
+  if (!m_gpu_profiling) {
+    for (RgTimestampFrame &frame : m_timestamp_frames) {
+      if (frame.query_pool and !frame.pending) {
+        rhi::destroy_query_pool(device, frame.query_pool);
+        frame.query_pool = {};
+        frame.num_queries = 0;
+      }
+    }
+    return nullptr;
+  }
+
+  RgTimestampFrame &frame =
+      m_timestamp_frames[m_timestamp_frame % NUM_RG_TIMESTAMP_FRAMES];
+  // Skip this frame instead of waiting if the GPU is too far behind.
+  if (frame.pending) {
+    return nullptr;
+  }
+
+  frame.passes.clear();
+  Span<const RgRtPass> queue_passes[] = {gfx_passes, async_passes};
+  rhi::QueueFamily queue_families[] = {rhi::QueueFamily::Graphics,
+                                       rhi::QueueFamily::Compute};
+  RgQueue queues[] = {RgQueue::Graphics, RgQueue::Async};
+  for (usize q : range(std::size(queues))) {
+    if (rhi::get_timestamp_period(device, queue_families[q]) == 0.0f) {
+      frame.first_queries[q] = -1;
+      continue;
+    }
+    frame.first_queries[q] = 2 * frame.passes.m_size;
+    for (const RgRtPass &pass : queue_passes[q]) {
+      if (!m_pass_timings.try_get(pass.key)) {
+        m_pass_timings.insert(
+            m_arena, pass.key,
+            {.name = get_pass_stats_name(m_arena, pass.name, pass.index)});
+      }
+      frame.passes.push(m_arena, {.key = pass.key, .queue = queues[q]});
+    }
+  }
+  if (frame.passes.m_size == 0) {
+    return nullptr;
+  }
+
+  u32 num_queries = 2 * frame.passes.m_size;
+  if (frame.num_queries < num_queries) {
+    if (frame.query_pool) {
+      rhi::destroy_query_pool(device, frame.query_pool);
+    }
+    frame.num_queries = max(num_queries, 2 * frame.num_queries);
+    frame.query_pool =
+        rhi::create_query_pool(device, {.num_queries = frame.num_queries});
+  }
+  // The frame's previous timestamps have been read back, so the GPU has
+  // finished writing them.
+  rhi::reset_queries(device, frame.query_pool, 0, num_queries);
+
+  m_timestamp_frame++;
+  frame.pending = true;
+
+  return &frame;
+}
+
+bool RgPersistent::read_timestamps(RgTimestampFrame &frame) {
+  ZoneScoped;
+
+  ScratchArena scratch;
+
+  rhi::Device device = m_rcs_arena.m_renderer->get_rhi_device();
+  auto timestamps = Span<u64>::allocate(scratch, 2 * frame.passes.m_size);
+  if (!rhi::get_timestamps(device, frame.query_pool, 0, timestamps)) {
+    return false;
+  }
+  frame.pending = false;
+
+  float periods[] = {
+      rhi::get_timestamp_period(device, rhi::QueueFamily::Graphics),
+      rhi::get_timestamp_period(device, rhi::QueueFamily::Compute),
+  };
+
+  for (usize i : range(frame.passes.m_size)) {
+    const RgTimedPass &pass = frame.passes[i];
+    usize q = pass.queue == RgQueue::Async ? 1 : 0;
+    u64 begin = timestamps[2 * i];
+    u64 end = timestamps[2 * i + 1];
+    float time = end > begin ? (end - begin) * periods[q] : 0.0f;
+
+    RgPassTiming &timing = m_pass_timings.get(pass.key);
+    timing.history[timing.num_samples++ % RG_PASS_TIMING_HISTORY] = time;
+    timing.queue = pass.queue;
+    record_pass_time(pass.key, timing.name, pass.queue, time);
+
+#ifdef TRACY_ENABLE
+    u8 context = q;
+    if (!m_tracy_gpu_contexts[q]) {
+      // Timestamps are read back a few frames late, so GPU zones are only
+      // roughly aligned with CPU zones.
+      ___tracy_emit_gpu_new_context_serial({
+          .gpuTime = (i64)begin,
+          .period = periods[q],
+          .context = context,
+          .flags = 0,
+          .type = 2, // Vulkan
+      });
+      String8 name = q == 0 ? String8("Graphics queue")
+                            : String8("Async compute queue");
+      ___tracy_emit_gpu_context_name_serial({
+          .context = context,
+          .name = name.m_str,
+          .len = (u16)name.m_size,
+      });
+      m_tracy_gpu_contexts[q] = true;
+    }
+    if (!timing.tracy_source_location) {
+      auto *source_location =
+          m_arena->allocate<___tracy_source_location_data>();
+      *source_location = {
+          .name = timing.name.m_str,
+          .function = "RenderGraph::execute",
+          .file = __FILE__,
+          .line = __LINE__,
+      };
+      timing.tracy_source_location = (u64)source_location;
+    }
+    ___tracy_emit_gpu_zone_begin_serial({
+        .srcloc = timing.tracy_source_location,
+        .queryId = m_tracy_gpu_query,
+        .context = context,
+    });
+    ___tracy_emit_gpu_time_serial({
+        .gpuTime = (i64)begin,
+        .queryId = m_tracy_gpu_query++,
+        .context = context,
+    });
+    ___tracy_emit_gpu_zone_end_serial({
+        .queryId = m_tracy_gpu_query,
+        .context = context,
+    });
+    ___tracy_emit_gpu_time_serial({
+        .gpuTime = (i64)max(begin, end),
+        .queryId = m_tracy_gpu_query++,
+        .context = context,
+    });
+#endif
+  }
+
+  return true;
+}
+
+IoResult<void> RgPersistent::write_pass_timings_csv(Path path) const {
+  ScratchArena scratch;
+  auto csv = StringBuilder8::init(scratch);
+  csv.push("pass,queue,samples,last_ms,average_ms,min_ms,max_ms\n");
+  for (usize i : range(m_pass_timings.m_capacity)) {
+    if (!m_pass_timings.m_hashes[i]) {
+      continue;
+    }
+    const RgPassTiming &timing = m_pass_timings.m_values[i];
+    if (timing.num_samples == 0) {
+      continue;
+    }
+    RgPassTimingStats stats = get_pass_timing_stats(timing);
+    format_to(&csv, "\"{}\",{},{},{:.4f},{:.4f},{:.4f},{:.4f}\n",
+              timing.name, timing.queue == RgQueue::Async ? "async" : "gfx",
+              min<usize>(timing.num_samples, RG_PASS_TIMING_HISTORY),
+              stats.last / 1e6, stats.average / 1e6, stats.min / 1e6,
+              stats.max / 1e6);
+  }
+  return write(path, csv.string());
+}
+
+void RgPersistent::destroy() {
+  Renderer *renderer = m_rcs_arena.m_renderer;
+  for (RgTimestampFrame &frame : m_timestamp_frames) {
+    if (frame.query_pool) {
+      rhi::destroy_query_pool(renderer->get_rhi_device(), frame.query_pool);
+    }
+  }
+  for (const RgPhysicalTexture &ptex : m_physical_textures) {
+    if (!ptex.external and ptex.handle) {
+      renderer->destroy(ptex.handle);
+    }
+  }
+  for (const RgPhysicalTexture &ptex : m_reusable_textures) {
+    renderer->destroy(ptex.handle);
+  }
+  for (const RgBufferPool &pool : m_buffer_pools) {
+    if (pool.buffer) {
+      renderer->destroy(pool.buffer);
+    }
+  }
+  for (const RgRetiredResource &resource : m_retired_resources) {
+    if (resource.texture) {
+      renderer->destroy(resource.texture);
+    }
+    if (resource.buffer) {
+      renderer->destroy(resource.buffer);
+    }
+    if (resource.memory) {
+      rhi::free_memory(renderer->get_rhi_device(), resource.memory);
+    }
+  }
+  m_rcs_arena.clear();
+  if (m_transient_memory) {
+    rhi::free_memory(renderer->get_rhi_device(), m_transient_memory);
+    m_transient_memory = {};
+  }
+  m_compiled_arena.destroy();
+}
 
 namespace {
 
@@ -104,8 +539,93 @@ auto get_texture_usage_flags(rhi::AccessMask accesses) -> rhi::ImageUsageFlags {
   return flags;
 }
 
+bool is_transient(const RgTransientResource &texture) {
+  return texture.first_pass <= texture.last_pass;
+}
+
+bool lifetimes_overlap(const RgTransientResource &lhs,
+                       const RgTransientResource &rhs) {
+  return is_transient(lhs) and is_transient(rhs) and
+         lhs.first_pass <= rhs.last_pass and rhs.first_pass <= lhs.last_pass;
+}
+
+auto get_image_create_info(const RgPhysicalTexture &ptex)
+    -> rhi::ImageCreateInfo {
+  return {
+      .format = ptex.format,
+      .usage = ptex.usage,
+      .width = ptex.size.x,
+      .height = ptex.size.y,
+      .depth = ptex.size.z,
+      .cube_map = ptex.cube_map,
+      .num_mips = ptex.num_mips,
+      .num_layers = ptex.num_layers,
+  };
+}
+
+// Typical alignment of render targets and storage images.
+constexpr usize ESTIMATED_TEXTURE_ALIGNMENT = 64 * 1024;
+
 } // namespace
 
+auto rg_pack_transient_resources(Span<const RgTransientResource> resources,
+                                 Span<usize> offsets) -> usize {
+  ren_assert(offsets.m_size == resources.m_size);
+
+  ScratchArena scratch;
+
+  // Place large resources first to reduce fragmentation.
+  auto order = Span<u32>::allocate(scratch, resources.m_size);
+  for (u32 i : range<u32>(resources.m_size)) {
+    order[i] = i;
+  }
+  std::ranges::sort(order, [&](u32 lhs, u32 rhs) {
+    return resources[lhs].size > resources[rhs].size;
+  });
+
+  struct MemoryRange {
+    usize begin = 0;
+    usize end = 0;
+  };
+  DynamicArray<MemoryRange> occupied;
+
+  usize block_size = 0;
+  for (usize i : range(order.m_size)) {
+    const RgTransientResource &resource = resources[order[i]];
+    offsets[order[i]] = 0;
+    if (!is_transient(resource)) {
+      continue;
+    }
+
+    occupied.clear();
+    for (usize j : range(i)) {
+      const RgTransientResource &other = resources[order[j]];
+      if (lifetimes_overlap(resource, other)) {
+        usize begin = offsets[order[j]];
+        occupied.push(scratch, {begin, begin + other.size});
+      }
+    }
+    std::ranges::sort(occupied, [](const MemoryRange &lhs,
+                                   const MemoryRange &rhs) {
+      return lhs.begin < rhs.begin;
+    });
+
+    // Find the lowest gap that fits the resource.
+    usize offset = 0;
+    for (const MemoryRange &other : occupied) {
+      if (offset + resource.size <= other.begin) {
+        break;
+      }
+      offset = max(offset, pad(other.end, resource.alignment));
+    }
+
+    offsets[order[i]] = offset;
+    block_size = max(block_size, offset + resource.size);
+  }
+
+  return block_size;
+}
+
 void RgBuilder::init(NotNull<Arena *> arena, NotNull<RgPersistent *> rgp,
                      NotNull<Renderer *> renderer,
                      NotNull<DescriptorAllocatorScope *> descriptor_allocator) {
@@ -130,9 +650,17 @@ auto RgBuilder::create_pass(const RgPassCreateInfo &create_info)
   if (!m_rgp->m_async_compute) {
     queue = RgQueue::Graphics;
   }
+  u64 name_hash = hash_bytes(create_info.name.m_str, create_info.name.m_size);
+  u32 *count = m_pass_name_counts.try_get(name_hash);
+  u32 index = count ? (*count)++ : 0;
+  if (!count) {
+    m_pass_name_counts.insert(m_arena, name_hash, 1);
+  }
   RgPassId pass_id =
       m_passes.insert(m_arena, RgPass{
                                    .name = create_info.name.copy(m_arena),
+                                   .key = hash_mix(name_hash + index),
+                                   .index = index,
                                    .queue = queue,
                                });
   if (queue == RgQueue::Async) {
@@ -396,20 +924,34 @@ void RgBuilder::dump_pass_schedule() const {
   for (RgQueue queue : {RgQueue::Graphics, RgQueue::Async}) {
 
     Span<const RgPassId> schedule = m_gfx_schedule;
+    Span<const RgRtPass> rt_passes = m_rg.m_gfx_passes;
     if (queue == RgQueue::Graphics) {
       fmt::println(stderr, "Graphics queue passes:");
     } else {
       schedule = m_async_schedule;
+      rt_passes = m_rg.m_async_passes;
       if (schedule.m_size == 0) {
         continue;
       }
       fmt::println(stderr, "Async compute queue passes:");
     }
 
-    for (RgPassId pass_id : schedule) {
-      const RgPass &pass = m_passes[pass_id];
+    for (usize i : range(schedule.m_size)) {
+      const RgPass &pass = m_passes[schedule[i]];
+      const RgRtPass &rt_pass = rt_passes[i];
 
       fmt::println(stderr, "  * {}", pass.name);
+      fmt::println(stderr, "    Barriers: {} memory, {} texture",
+                   rt_pass.num_memory_barriers, rt_pass.num_texture_barriers);
+      for (const RgSplitBarrier &split : m_split_barriers) {
+        if (split.queue == queue and split.dst_pass == i) {
+          fmt::println(stderr,
+                       "    Split barrier from {}: {} memory, {} texture",
+                       m_passes[schedule[split.src_pass]].name,
+                       split.memory_barrier_count,
+                       split.texture_barrier_count);
+        }
+      }
 
       DynamicArray<RgUntypedBufferId> create_buffers;
       DynamicArray<RgUntypedBufferId> write_buffers;
@@ -515,135 +1057,1035 @@ void RgBuilder::dump_pass_schedule() const {
       fmt::println(stderr, "");
     }
   }
+
+  fmt::println(stderr, "Passes: {} scheduled, {} culled",
+               m_gfx_schedule.m_size + m_async_schedule.m_size,
+               m_culled_passes.m_size);
+  for (String8 name : m_culled_passes) {
+    fmt::println(stderr, "  - {}", name);
+  }
+  const RgBarrierStats &barrier_stats = m_rgp->m_barrier_stats;
+  fmt::println(stderr,
+               "Barriers: {} pipeline barriers, {} split, {} merged into "
+               "previous pass",
+               barrier_stats.num_pipeline_barriers,
+               barrier_stats.num_split_barriers,
+               barrier_stats.num_merged_barriers);
+  fmt::println(stderr, "  {} memory, {} texture, {} layout transitions",
+               barrier_stats.num_memory_barriers,
+               barrier_stats.num_texture_barriers,
+               barrier_stats.num_layout_transitions);
+  fmt::println(stderr, "  Source stages: {:#x}, destination stages: {:#x}",
+               u64(barrier_stats.src_stage_mask.get()),
+               u64(barrier_stats.dst_stage_mask.get()));
+
+  constexpr double MIB = 1024.0 * 1024.0;
+  RgTransientMemoryStats estimate = estimate_transient_memory();
+  const RgTransientMemoryStats &stats = m_rgp->m_transient_memory_stats;
+  fmt::println(stderr, "Transient texture memory:");
+  fmt::println(stderr, "  Estimated: {:.2f} MiB dedicated, {:.2f} MiB aliased",
+               estimate.dedicated_size / MIB, estimate.aliased_size / MIB);
+  fmt::println(stderr, "  Allocated: {:.2f} MiB dedicated, {:.2f} MiB aliased",
+               stats.dedicated_size / MIB, stats.aliased_size / MIB);
 }
 
-void RgBuilder::alloc_textures() {
-  bool need_alloc = false;
-  auto update_texture_usage_flags = [&](RgTextureUseId use_id) {
-    const RgTextureUse &use = m_texture_uses[use_id];
-    const RgTexture &texture = m_rgp->m_textures[use.texture];
-    RgPhysicalTextureId ptex_id = texture.parent;
-    RgPhysicalTexture &ptex = m_rgp->m_physical_textures[ptex_id];
-    rhi::ImageUsageFlags usage = get_texture_usage_flags(use.state.access_mask);
-    if (ptex.external) {
-      ren_assert((ptex.usage & usage) == usage);
-    } else {
-      bool needs_usage_update = (ptex.usage | usage) != ptex.usage;
-      ptex.usage |= usage;
-      if (!ptex.handle or needs_usage_update) {
-        need_alloc = true;
+void RgBuilder::cull_passes() {
+  ScratchArena scratch;
+
+  DynamicArray<RgPassId> passes;
+  for (const auto &[pass_id, _] : m_passes) {
+    passes.push(scratch, pass_id);
+  }
+
+  auto live = Span<bool>::allocate(scratch, m_passes.raw_size());
+  fill(live, false);
+
+  // Passes can only use resources written by passes that were declared before
+  // them, so liveness can be propagated in a single reverse sweep.
+  for (isize i = isize(passes.m_size) - 1; i >= 0; --i) {
+    RgPassId pass_id = passes[i];
+    const RgPass &pass = m_passes[pass_id];
+
+    if (!live[pass_id]) {
+      // Passes that synchronize with the outside world or write resources
+      // that outlive the graph are always live. Passes that don't write
+      // anything must have other side effects.
+      bool has_side_effects =
+          pass.wait_semaphores.m_size > 0 or
+          pass.signal_semaphores.m_size > 0 or
+          (pass.write_buffers.m_size == 0 and pass.write_textures.m_size == 0);
+      for (RgBufferUseId use : pass.write_buffers) {
+        const RgBuffer &buffer = m_buffers[m_buffer_uses[use].buffer];
+        const RgPhysicalBuffer &physical_buffer =
+            m_physical_buffers[buffer.parent];
+        // External buffers and buffers that can be read back on the host.
+        if (physical_buffer.view.buffer or
+            physical_buffer.heap != rhi::MemoryHeap::Default) {
+          has_side_effects = true;
+        }
+      }
+      for (RgTextureUseId use : pass.write_textures) {
+        const RgTexture &texture =
+            m_rgp->m_textures[m_texture_uses[use].texture];
+        const RgPhysicalTexture &ptex =
+            m_rgp->m_physical_textures[texture.parent];
+        if (ptex.external or ptex.persistent) {
+          has_side_effects = true;
+        }
+      }
+      if (!has_side_effects) {
+        continue;
       }
+      live[pass_id] = true;
+    }
+
+    // Writes are read-modify-write, so the previous contents of written
+    // resources are needed as well.
+    auto mark_live = [&](RgPassId def) {
+      if (def) {
+        live[def] = true;
+      }
+    };
+    for (RgBufferUseId use : pass.read_buffers) {
+      mark_live(m_buffers[m_buffer_uses[use].buffer].def);
+    }
+    for (RgBufferUseId use : pass.write_buffers) {
+      mark_live(m_buffers[m_buffer_uses[use].buffer].def);
     }
-  };
-  for (const auto &[_, pass] : m_passes) {
     for (RgTextureUseId use : pass.read_textures) {
-      update_texture_usage_flags(use);
+      mark_live(m_rgp->m_textures[m_texture_uses[use].texture].def);
     }
     for (RgTextureUseId use : pass.write_textures) {
-      update_texture_usage_flags(use);
-    }
-  }
-
-  if (not need_alloc) {
-    for (RgPhysicalTexture &ptex : m_rgp->m_physical_textures) {
-      ptex.layout = ptex.persistent ? ptex.layout : rhi::ImageLayout::Undefined;
+      mark_live(m_rgp->m_textures[m_texture_uses[use].texture].def);
     }
-    return;
   }
 
-  usize num_gfx_passes = m_gfx_schedule.m_size;
-
-  m_renderer->wait_idle();
-  m_rgp->m_rcs_arena.clear();
-  for (RgPhysicalTexture &ptex : m_rgp->m_physical_textures) {
-    // Skip unused temporal or external textures.
-    if (!ptex.usage or ptex.external) {
+  for (RgPassId pass_id : passes) {
+    if (live[pass_id]) {
       continue;
     }
-    auto handle = m_rgp->m_rcs_arena.create_texture({
-        .name = ptex.name,
-        .format = ptex.format,
-        .usage = ptex.usage,
-        .width = ptex.size.x,
-        .height = ptex.size.y,
-        .depth = ptex.size.z,
-        .cube_map = ptex.cube_map,
-        .num_mips = ptex.num_mips,
-        .num_layers = ptex.num_layers,
-    });
-    if (!handle) {
-      fmt::println(stderr, "RenderGraph render target allocation failed");
-      exit(EXIT_FAILURE);
+    const RgPass &pass = m_passes[pass_id];
+    // Nothing overwrites the resources that this pass wrote anymore.
+    for (RgBufferUseId use : pass.write_buffers) {
+      m_buffers[m_buffer_uses[use].buffer].kill = {};
     }
-    ptex.handle = *handle;
-    ptex.layout = rhi::ImageLayout::Undefined;
+    for (RgTextureUseId use : pass.write_textures) {
+      m_rgp->m_textures[m_texture_uses[use].texture].kill = {};
+    }
+    m_culled_passes.push(m_arena, pass.name);
+    m_passes.erase(pass_id);
   }
 
-  m_rgp->m_gfx_semaphore = m_rgp->m_rcs_arena.create_semaphore(
+  for (DynamicArray<RgPassId> *schedule :
+       {&m_gfx_schedule, &m_async_schedule}) {
+    usize num_live = 0;
+    for (RgPassId pass_id : *schedule) {
+      if (live[pass_id]) {
+        (*schedule)[num_live++] = pass_id;
+      }
+    }
+    schedule->m_size = num_live;
+  }
+}
 
-      {
-          .name = "Render graph graphics queue timeline",
-          .type = rhi::SemaphoreType::Timeline,
-          .initial_value = m_rgp->m_gfx_time,
-      });
-  m_rgp->m_async_semaphore = m_rgp->m_rcs_arena.create_semaphore({
-      .name = "Render graph async compute queue timeline",
-      .type = rhi::SemaphoreType::Timeline,
-      .initial_value = m_rgp->m_async_time,
-  });
-  if (!m_rgp->m_gfx_semaphore_id) {
-    m_rgp->m_gfx_semaphore_id = m_rgp->create_semaphore("gfx-queue-timeline");
+template <typename F>
+void RgBuilder::for_each_resource_dependency(RgPassId pass_id, F &&cb) const {
+  auto add_dependency = [&](RgPassId pass, RgPassId dependency) {
+    if (pass and dependency and pass != dependency) {
+      cb(pass, dependency);
+    }
+  };
+  const RgPass &pass = m_passes[pass_id];
+  for (RgBufferUseId use : pass.read_buffers) {
+    const RgBuffer &buffer = m_buffers[m_buffer_uses[use].buffer];
+    add_dependency(pass_id, buffer.def);
+    add_dependency(buffer.kill, pass_id);
   }
-  if (!m_rgp->m_async_semaphore_id) {
-    m_rgp->m_async_semaphore_id =
-        m_rgp->create_semaphore("async-queue-timeline");
+  for (RgBufferUseId use : pass.write_buffers) {
+    add_dependency(pass_id, m_buffers[m_buffer_uses[use].buffer].def);
+  }
+  for (RgTextureUseId use : pass.read_textures) {
+    const RgTexture &texture = m_rgp->m_textures[m_texture_uses[use].texture];
+    add_dependency(pass_id, texture.def);
+    add_dependency(texture.kill, pass_id);
   }
-  set_external_semaphore(m_rgp->m_gfx_semaphore_id, m_rgp->m_gfx_semaphore);
-  set_external_semaphore(m_rgp->m_async_semaphore_id, m_rgp->m_async_semaphore);
+  for (RgTextureUseId use : pass.write_textures) {
+    add_dependency(pass_id, m_rgp->m_textures[m_texture_uses[use].texture].def);
+  }
+}
 
-  // Schedule init passes before all other passes.
-  if (m_gfx_schedule.m_size != num_gfx_passes) {
-    ScratchArena scratch;
-    auto temp = Span<RgPassId>::allocate(scratch, m_gfx_schedule.m_size);
-    copy(m_gfx_schedule.begin() + num_gfx_passes, m_gfx_schedule.end(),
-         &temp[0]);
+namespace {
+
+// Cost of making a pass wait for a pass on the other queue, including
+// splitting the submission and waiting on a semaphore.
+constexpr float RG_QUEUE_SYNC_TIME = 25'000.0f;
+// Compute passes are slower on the async compute queue, since they share the
+// GPU with graphics work. Used to estimate the cost of passes that have only
+// been measured on one queue.
+constexpr float RG_ASYNC_COMPUTE_SLOWDOWN = 1.25f;
+// Minimum estimated savings to change which queues passes run on, so that
+// measurement noise doesn't cause the graph to be recompiled every frame.
+constexpr float RG_QUEUE_SCHEDULING_MIN_SAVINGS = 20'000.0f;
+
+// Estimate a frame's GPU time by simulating in-order execution of passes on
+// each queue. Passes depend only on passes that come before them.
+auto simulate_queue_schedule(Span<const RgQueue> queues,
+                             Span<const float> gfx_times,
+                             Span<const float> async_times,
+                             Span<const DynamicArray<u32>> dependencies,
+                             Span<float> end_times) -> float {
+  float gfx_end_time = 0.0f;
+  float async_end_time = 0.0f;
+  for (usize i : range(queues.m_size)) {
+    bool is_async = queues[i] == RgQueue::Async;
+    float start_time = is_async ? async_end_time : gfx_end_time;
+    for (u32 dependency : dependencies[i]) {
+      ren_assert(dependency < i);
+      float ready_time = end_times[dependency];
+      if (queues[dependency] != queues[i]) {
+        ready_time += RG_QUEUE_SYNC_TIME;
+      }
+      start_time = max(start_time, ready_time);
+    }
+    end_times[i] = start_time + (is_async ? async_times[i] : gfx_times[i]);
+    if (is_async) {
+      async_end_time = end_times[i];
+    } else {
+      gfx_end_time = end_times[i];
+    }
+  }
+  return max(gfx_end_time, async_end_time);
+}
+
+} // namespace
+
+void RgBuilder::schedule_queues() {
+  RgQueueSchedulingStats &stats = m_rgp->m_queue_scheduling_stats;
+  stats = {};
+  if (!m_rgp->m_async_compute) {
+    return;
+  }
+
+  ScratchArena scratch;
+
+  DynamicArray<RgPassId> passes;
+  for (const auto &[pass_id, _] : m_passes) {
+    passes.push(scratch, pass_id);
+  }
+  usize num_passes = passes.m_size;
+
+  auto keys = Span<u64>::allocate(scratch, num_passes);
+  for (usize i : range(num_passes)) {
+    const RgPass &pass = m_passes[passes[i]];
+    keys[i] = pass.key;
+    if (!m_rgp->m_pass_costs.try_get(keys[i])) {
+      m_rgp->m_pass_costs.insert(
+          m_rgp->m_arena, keys[i],
+          {.name = get_pass_stats_name(m_rgp->m_arena, pass.name, pass.index)});
+    }
+  }
+
+  auto requested_queues = Span<RgQueue>::allocate(scratch, num_passes);
+  auto queues = Span<RgQueue>::allocate(scratch, num_passes);
+  auto gfx_times = Span<float>::allocate(scratch, num_passes);
+  auto async_times = Span<float>::allocate(scratch, num_passes);
+  auto movable = Span<bool>::allocate(scratch, num_passes);
+  for (usize i : range(num_passes)) {
+    const RgPass &pass = m_passes[passes[i]];
+    const RgPassCost &cost = m_rgp->m_pass_costs.get(keys[i]);
+    requested_queues[i] = pass.queue;
+    queues[i] = pass.queue;
+    gfx_times[i] = cost.gfx_time;
+    async_times[i] = cost.async_time;
+    if (gfx_times[i] == 0.0f) {
+      gfx_times[i] = async_times[i] / RG_ASYNC_COMPUTE_SLOWDOWN;
+    }
+    if (async_times[i] == 0.0f) {
+      async_times[i] = gfx_times[i] * RG_ASYNC_COMPUTE_SLOWDOWN;
+    }
+    // Only compute passes that were created for the async compute queue can
+    // run on both queues. Passes that synchronize with the outside world and
+    // passes that haven't been measured yet stay where they are.
+    movable[i] = m_rgp->m_async_compute_scheduling and
+                 pass.queue == RgQueue::Async and
+                 pass.wait_semaphores.m_size == 0 and
+                 pass.signal_semaphores.m_size == 0 and gfx_times[i] > 0.0f;
+    // Start from the previous frame's decision.
+    if (movable[i] and cost.queue != RgQueue::None) {
+      queues[i] = cost.queue;
+    }
+  }
+
+  auto indices = Span<u32>::allocate(scratch, m_passes.raw_size());
+  for (usize i : range(num_passes)) {
+    indices[passes[i]] = i;
+  }
+  auto dependencies = Span<DynamicArray<u32>>::allocate(scratch, num_passes);
+  fill(dependencies, DynamicArray<u32>());
+  for (RgPassId pass_id : passes) {
+    for_each_resource_dependency(
+        pass_id, [&](RgPassId pass, RgPassId dependency) {
+          dependencies[indices[pass]].push(scratch, indices[dependency]);
+        });
+  }
+
+  auto end_times = Span<float>::allocate(scratch, num_passes);
+  auto simulate = [&](Span<const RgQueue> assignment) {
+    return simulate_queue_schedule(assignment, gfx_times, async_times,
+                                   dependencies, end_times);
+  };
+
+  stats.requested_time = simulate(requested_queues);
+
+  // Greedily move passes to the other queue while this shortens the frame.
+  // Each attempt simulates the whole frame, so this is quadratic in the number
+  // of passes. Limit the number of attempts to bound the cost for large
+  // graphs.
+  constexpr usize MAX_NUM_SWEEPS = 2;
+  constexpr usize MAX_NUM_ATTEMPTS = 256;
+  usize num_attempts = 0;
+  auto initial_queues = Span<RgQueue>::allocate(scratch, num_passes);
+  copy(queues, initial_queues.m_data);
+  float initial_time = simulate(queues);
+  float best_time = initial_time;
+  for (usize sweep : range(MAX_NUM_SWEEPS)) {
+    bool improved = false;
+    for (usize i : range(num_passes)) {
+      if (!movable[i]) {
+        continue;
+      }
+      if (num_attempts == MAX_NUM_ATTEMPTS) {
+        break;
+      }
+      num_attempts++;
+      RgQueue queue = queues[i];
+      queues[i] = queue == RgQueue::Async ? RgQueue::Graphics : RgQueue::Async;
+      float time = simulate(queues);
+      if (time < best_time) {
+        best_time = time;
+        improved = true;
+      } else {
+        queues[i] = queue;
+      }
+    }
+    if (!improved or num_attempts == MAX_NUM_ATTEMPTS) {
+      break;
+    }
+  }
+  if (initial_time - best_time < RG_QUEUE_SCHEDULING_MIN_SAVINGS) {
+    copy(initial_queues, queues.m_data);
+    best_time = initial_time;
+  }
+  stats.scheduled_time = best_time;
+
+  bool moved = false;
+  for (usize i : range(num_passes)) {
+    RgPass &pass = m_passes[passes[i]];
+    RgPassCost &cost = m_rgp->m_pass_costs.get(keys[i]);
+    cost.requested_queue = requested_queues[i];
+    cost.queue = queues[i];
+    if (queues[i] == requested_queues[i]) {
+      continue;
+    }
+    pass.queue = queues[i];
+    moved = true;
+    if (queues[i] == RgQueue::Async) {
+      stats.num_moved_to_async++;
+    } else {
+      stats.num_moved_to_gfx++;
+    }
+  }
+
+  if (moved) {
+    // Buffers are placed into pools based on the queues that write them.
+    auto buffer_queues =
+        Span<RgQueueMask>::allocate(scratch, m_physical_buffers.m_size);
+    fill(buffer_queues, RgQueueMask());
+    for (RgPassId pass_id : passes) {
+      const RgPass &pass = m_passes[pass_id];
+      for (RgBufferUseId use : pass.write_buffers) {
+        buffer_queues[m_buffers[m_buffer_uses[use].buffer].parent] |=
+            pass.queue;
+      }
+    }
+    for (usize i : range(m_physical_buffers.m_size)) {
+      // Keep the queues of buffers that are only written by culled passes.
+      if (buffer_queues[i]) {
+        m_physical_buffers[i].queues = buffer_queues[i];
+      }
+    }
+  }
+}
+
+void RgBuilder::reorder_passes() {
+  ScratchArena scratch;
+
+  DynamicArray<RgPassId> passes;
+  for (const auto &[pass_id, _] : m_passes) {
+    passes.push(scratch, pass_id);
+  }
+
+  usize num_slots = m_passes.raw_size();
+  auto num_dependencies = Span<u32>::allocate(scratch, num_slots);
+  fill(num_dependencies, 0);
+  auto successors = Span<DynamicArray<RgPassId>>::allocate(scratch, num_slots);
+  fill(successors, DynamicArray<RgPassId>());
+  auto add_dependency = [&](RgPassId pass_id, RgPassId dependency) {
+    if (!pass_id or !dependency or pass_id == dependency) {
+      return;
+    }
+    successors[dependency].push(scratch, pass_id);
+    num_dependencies[pass_id]++;
+  };
+
+  for (usize i : range(passes.m_size)) {
+    RgPassId pass_id = passes[i];
+    const RgPass &pass = m_passes[pass_id];
+
+    // Run after the passes that wrote the resources that this pass uses, and
+    // before the passes that overwrite the resources that this pass reads.
+    for_each_resource_dependency(pass_id, add_dependency);
+
+    // Don't move passes that synchronize with the outside world or whose
+    // dependencies are unknown.
+    bool pinned = pass.wait_semaphores.m_size > 0 or
+                  pass.signal_semaphores.m_size > 0 or
+                  (pass.read_buffers.m_size == 0 and
+                   pass.write_buffers.m_size == 0 and
+                   pass.read_textures.m_size == 0 and
+                   pass.write_textures.m_size == 0);
+    if (pinned) {
+      for (usize j : range(passes.m_size)) {
+        if (j < i) {
+          add_dependency(pass_id, passes[j]);
+        } else if (j > i) {
+          add_dependency(passes[j], pass_id);
+        }
+      }
+    }
+  }
+
+  // Passes that the async compute queue depends on should run as early as
+  // possible.
+  auto feeds_async = Span<bool>::allocate(scratch, num_slots);
+  fill(feeds_async, false);
+  for (isize i = isize(passes.m_size) - 1; i >= 0; --i) {
+    RgPassId pass_id = passes[i];
+    const RgPass &pass = m_passes[pass_id];
+    if (pass.queue == RgQueue::Async) {
+      feeds_async[pass_id] = true;
+    }
+    if (!feeds_async[pass_id]) {
+      continue;
+    }
+    auto mark_feeds_async = [&](RgPassId def) {
+      if (def) {
+        feeds_async[def] = true;
+      }
+    };
+    for (RgBufferUseId use : pass.read_buffers) {
+      mark_feeds_async(m_buffers[m_buffer_uses[use].buffer].def);
+    }
+    for (RgBufferUseId use : pass.write_buffers) {
+      mark_feeds_async(m_buffers[m_buffer_uses[use].buffer].def);
+    }
+    for (RgTextureUseId use : pass.read_textures) {
+      mark_feeds_async(m_rgp->m_textures[m_texture_uses[use].texture].def);
+    }
+    for (RgTextureUseId use : pass.write_textures) {
+      mark_feeds_async(m_rgp->m_textures[m_texture_uses[use].texture].def);
+    }
+  }
+
+  // Track texture layouts to prefer passes that don't need layout
+  // transitions.
+  auto layouts = Span<rhi::ImageLayout>::allocate(
+      scratch, m_rgp->m_physical_textures.m_size);
+  for (usize i : range(layouts.m_size)) {
+    const RgPhysicalTexture &ptex = m_rgp->m_physical_textures[i];
+    layouts[i] = ptex.persistent ? ptex.layout : rhi::ImageLayout::Undefined;
+  }
+  auto get_ptex_id = [&](RgTextureUseId use) {
+    return m_rgp->m_textures[m_texture_uses[use].texture].parent;
+  };
+
+  DynamicArray<RgPassId> ready;
+  for (RgPassId pass_id : passes) {
+    if (num_dependencies[pass_id] == 0) {
+      ready.push(scratch, pass_id);
+    }
+  }
+
+  m_gfx_schedule.clear();
+  m_async_schedule.clear();
+  while (ready.m_size > 0) {
+    usize best = 0;
+    u32 best_cost = -1;
+    for (usize i : range(ready.m_size)) {
+      const RgPass &pass = m_passes[ready[i]];
+      u32 cost = feeds_async[ready[i]] ? 0 : 1 << 16;
+      for (RgTextureUseId use : pass.read_textures) {
+        cost += m_texture_uses[use].state.layout != layouts[get_ptex_id(use)];
+      }
+      for (RgTextureUseId use : pass.write_textures) {
+        cost += m_texture_uses[use].state.layout != layouts[get_ptex_id(use)];
+      }
+      // Otherwise, keep declaration order.
+      if (cost < best_cost or
+          (cost == best_cost and u32(ready[i]) < u32(ready[best]))) {
+        best = i;
+        best_cost = cost;
+      }
+    }
+
+    RgPassId pass_id = ready[best];
+    ready[best] = ready.back();
+    ready.m_size--;
+
+    const RgPass &pass = m_passes[pass_id];
+    if (pass.queue == RgQueue::Async) {
+      m_async_schedule.push(m_arena, pass_id);
+    } else {
+      m_gfx_schedule.push(m_arena, pass_id);
+    }
+    for (RgTextureUseId use : pass.read_textures) {
+      layouts[get_ptex_id(use)] = m_texture_uses[use].state.layout;
+    }
+    for (RgTextureUseId use : pass.write_textures) {
+      layouts[get_ptex_id(use)] = m_texture_uses[use].state.layout;
+    }
+
+    for (RgPassId successor : successors[pass_id]) {
+      if (--num_dependencies[successor] == 0) {
+        ready.push(scratch, successor);
+      }
+    }
+  }
+
+  ren_assert(m_gfx_schedule.m_size + m_async_schedule.m_size ==
+             passes.m_size);
+}
+
+void RgBuilder::get_transient_texture_lifetimes(
+    Span<RgTransientResource> transient_textures) const {
+  ren_assert(transient_textures.m_size == m_rgp->m_physical_textures.m_size);
+  fill(transient_textures, RgTransientResource());
+
+  auto get_ptex_id = [&](RgTextureUseId use) {
+    return m_rgp->m_textures[m_texture_uses[use].texture].parent;
+  };
+
+  for (u32 i : range<u32>(m_gfx_schedule.m_size)) {
+    const RgPass &pass = m_passes[m_gfx_schedule[i]];
+    auto update_lifetime = [&](RgTextureUseId use) {
+      RgTransientResource &texture = transient_textures[get_ptex_id(use)];
+      texture.first_pass = min(texture.first_pass, i);
+      texture.last_pass = max(texture.last_pass, i);
+    };
+    for (RgTextureUseId use : pass.read_textures) {
+      update_lifetime(use);
+    }
+    for (RgTextureUseId use : pass.write_textures) {
+      update_lifetime(use);
+    }
+  }
+
+  // Aliasing barriers can't synchronize with the other queue, so only alias
+  // textures that are used exclusively on the graphics queue.
+  for (RgPassId pass_id : m_async_schedule) {
+    const RgPass &pass = m_passes[pass_id];
+    for (RgTextureUseId use : pass.read_textures) {
+      transient_textures[get_ptex_id(use)] = {};
+    }
+    for (RgTextureUseId use : pass.write_textures) {
+      transient_textures[get_ptex_id(use)] = {};
+    }
+  }
+
+  for (usize i : range(m_rgp->m_physical_textures.m_size)) {
+    const RgPhysicalTexture &ptex = m_rgp->m_physical_textures[i];
+    if (!ptex.usage or ptex.persistent or ptex.external) {
+      transient_textures[i] = {};
+    }
+  }
+}
+
+auto RgBuilder::estimate_transient_memory() const -> RgTransientMemoryStats {
+  ScratchArena scratch;
+
+  auto transient_textures = Span<RgTransientResource>::allocate(
+      scratch, m_rgp->m_physical_textures.m_size);
+  get_transient_texture_lifetimes(transient_textures);
+
+  RgTransientMemoryStats stats;
+  for (usize i : range(transient_textures.m_size)) {
+    RgTransientResource &texture = transient_textures[i];
+    if (!is_transient(texture)) {
+      continue;
+    }
+    const RgPhysicalTexture &ptex = m_rgp->m_physical_textures[i];
+    usize size = get_mip_chain_byte_size(
+        ptex.format, ptex.size, ptex.num_layers * (ptex.cube_map ? 6 : 1), 0,
+        ptex.num_mips);
+    texture.size = pad(size, ESTIMATED_TEXTURE_ALIGNMENT);
+    texture.alignment = ESTIMATED_TEXTURE_ALIGNMENT;
+    stats.dedicated_size += texture.size;
+  }
+
+  auto offsets = Span<usize>::allocate(scratch, transient_textures.m_size);
+  stats.aliased_size = rg_pack_transient_resources(transient_textures, offsets);
+
+  return stats;
+}
+
+namespace {
+
+// Whether an old texture can be used in place of a new one.
+bool can_reuse_texture(const RgPhysicalTexture &old_ptex,
+                       const RgPhysicalTexture &ptex) {
+  return old_ptex.handle and old_ptex.name == ptex.name and
+         old_ptex.format == ptex.format and old_ptex.size == ptex.size and
+         old_ptex.cube_map == ptex.cube_map and
+         old_ptex.persistent == ptex.persistent and
+         old_ptex.num_mips == ptex.num_mips and
+         old_ptex.num_layers == ptex.num_layers and
+         (old_ptex.usage & ptex.usage) == ptex.usage;
+}
+
+} // namespace
+
+void RgBuilder::alloc_textures() {
+  ScratchArena scratch;
+
+  rhi::Device device = m_renderer->get_rhi_device();
+
+  m_rgp->release_retired_resources();
+
+  // Timeline semaphores outlive textures, so that frames in flight can be used
+  // to tell when retired textures can be destroyed.
+  if (!m_rgp->m_gfx_semaphore) {
+    m_rgp->m_gfx_semaphore = m_rgp->m_rcs_arena.create_semaphore({
+        .name = "Render graph graphics queue timeline",
+        .type = rhi::SemaphoreType::Timeline,
+        .initial_value = m_rgp->m_gfx_time,
+    });
+    m_rgp->m_async_semaphore = m_rgp->m_rcs_arena.create_semaphore({
+        .name = "Render graph async compute queue timeline",
+        .type = rhi::SemaphoreType::Timeline,
+        .initial_value = m_rgp->m_async_time,
+    });
+  }
+  if (!m_rgp->m_gfx_semaphore_id) {
+    m_rgp->m_gfx_semaphore_id = m_rgp->create_semaphore("gfx-queue-timeline");
+    set_external_semaphore(m_rgp->m_gfx_semaphore_id, m_rgp->m_gfx_semaphore);
+  }
+  if (!m_rgp->m_async_semaphore_id) {
+    m_rgp->m_async_semaphore_id =
+        m_rgp->create_semaphore("async-queue-timeline");
+    set_external_semaphore(m_rgp->m_async_semaphore_id,
+                           m_rgp->m_async_semaphore);
+  }
+
+  usize num_ptexs = m_rgp->m_physical_textures.m_size;
+  auto used = Span<bool>::allocate(scratch, num_ptexs);
+  fill(used, false);
+  // Textures that need to be (re)created.
+  auto need_alloc = Span<bool>::allocate(scratch, num_ptexs);
+  fill(need_alloc, false);
+
+  for (RgPhysicalTexture &ptex : m_rgp->m_physical_textures) {
+    ptex.layout = ptex.persistent ? ptex.layout : rhi::ImageLayout::Undefined;
+  }
+
+  auto update_texture_usage_flags = [&](RgTextureUseId use_id) {
+    const RgTextureUse &use = m_texture_uses[use_id];
+    const RgTexture &texture = m_rgp->m_textures[use.texture];
+    RgPhysicalTextureId ptex_id = texture.parent;
+    RgPhysicalTexture &ptex = m_rgp->m_physical_textures[ptex_id];
+    used[ptex_id] = true;
+    rhi::ImageUsageFlags usage = get_texture_usage_flags(use.state.access_mask);
+    if (ptex.external) {
+      ren_assert((ptex.usage & usage) == usage);
+    } else {
+      bool needs_usage_update = (ptex.usage | usage) != ptex.usage;
+      ptex.usage |= usage;
+      if (!ptex.handle or needs_usage_update) {
+        need_alloc[ptex_id] = true;
+      }
+    }
+  };
+  for (const auto &[_, pass] : m_passes) {
+    for (RgTextureUseId use : pass.read_textures) {
+      update_texture_usage_flags(use);
+    }
+    for (RgTextureUseId use : pass.write_textures) {
+      update_texture_usage_flags(use);
+    }
+  }
+
+  // Take over textures from before the last reset that still fit. The rest
+  // are retired.
+  if (m_rgp->m_reusable_textures.m_size > 0) {
+    for (usize i : range(num_ptexs)) {
+      RgPhysicalTexture &ptex = m_rgp->m_physical_textures[i];
+      if (!need_alloc[i] or ptex.handle) {
+        continue;
+      }
+      for (RgPhysicalTexture &old_ptex : m_rgp->m_reusable_textures) {
+        if (!can_reuse_texture(old_ptex, ptex)) {
+          continue;
+        }
+        // Keep the queue and timeline of the last access so that this frame
+        // synchronizes with frames in flight that used the texture.
+        RgTextureId id = ptex.id;
+        ptex = old_ptex;
+        ptex.id = id;
+        if (!ptex.persistent) {
+          ptex.layout = rhi::ImageLayout::Undefined;
+        }
+        old_ptex.handle = {};
+        need_alloc[i] = false;
+        break;
+      }
+    }
+    for (const RgPhysicalTexture &old_ptex : m_rgp->m_reusable_textures) {
+      if (old_ptex.handle) {
+        m_rgp->retire(old_ptex.handle);
+      }
+    }
+    m_rgp->m_reusable_textures.clear();
+  }
+
+  auto transient_textures =
+      Span<RgTransientResource>::allocate(scratch, num_ptexs);
+  get_transient_texture_lifetimes(transient_textures);
+
+  // Textures can keep sharing memory only if their lifetimes are still
+  // disjoint and they are still used only on the graphics queue. New transient
+  // textures also require the memory block to be repacked.
+  bool realloc_transient_memory = false;
+  for (const RgTextureAlias &alias : m_rgp->m_texture_aliases) {
+    const RgTransientResource &lhs = transient_textures[alias.lhs];
+    const RgTransientResource &rhs = transient_textures[alias.rhs];
+    if (lifetimes_overlap(lhs, rhs) or
+        (used[alias.lhs] and !is_transient(lhs)) or
+        (used[alias.rhs] and !is_transient(rhs))) {
+      realloc_transient_memory = true;
+    }
+  }
+  bool any_need_alloc = false;
+  for (usize i : range(num_ptexs)) {
+    if (!need_alloc[i]) {
+      continue;
+    }
+    any_need_alloc = true;
+    if (is_transient(transient_textures[i]) or
+        m_rgp->m_physical_textures[i].aliased) {
+      realloc_transient_memory = true;
+    }
+  }
+
+  if (!any_need_alloc and !realloc_transient_memory) {
+    return;
+  }
+
+  usize num_gfx_passes = m_gfx_schedule.m_size;
+
+  // Texture handles and aliases are about to change.
+  m_rgp->m_compiled.valid = false;
+
+  if (realloc_transient_memory) {
+    // Textures that live in the old memory block are created again when
+    // they are used next time.
+    for (usize i : range(num_ptexs)) {
+      RgPhysicalTexture &ptex = m_rgp->m_physical_textures[i];
+      if (!ptex.aliased) {
+        continue;
+      }
+      m_rgp->retire(ptex.handle);
+      ptex.handle = {};
+      ptex.aliased = false;
+      ptex.layout = rhi::ImageLayout::Undefined;
+      need_alloc[i] = used[i];
+    }
+    if (m_rgp->m_transient_memory) {
+      m_rgp->retire(m_rgp->m_transient_memory);
+      m_rgp->m_transient_memory = {};
+    }
+    m_rgp->m_texture_aliases.clear();
+  }
+
+  // Only pack textures that are being created into a new memory block.
+  for (usize i : range(num_ptexs)) {
+    if (!realloc_transient_memory or !need_alloc[i]) {
+      transient_textures[i] = {};
+    }
+  }
+
+  // Place transient textures into a single memory block. Textures whose memory
+  // requirements are incompatible with the others get their own allocations.
+  u32 memory_type_mask = -1;
+  usize alignment = 1;
+  for (usize i : range(num_ptexs)) {
+    RgTransientResource &texture = transient_textures[i];
+    if (!is_transient(texture)) {
+      continue;
+    }
+    rhi::MemoryRequirements requirements = rhi::get_memory_requirements(
+        device, get_image_create_info(m_rgp->m_physical_textures[i]));
+    if (!(memory_type_mask & requirements.memory_type_mask)) {
+      texture = {};
+      continue;
+    }
+    memory_type_mask &= requirements.memory_type_mask;
+    texture.size = requirements.size;
+    texture.alignment = requirements.alignment;
+    alignment = max(alignment, requirements.alignment);
+  }
+
+  auto offsets = Span<usize>::allocate(scratch, num_ptexs);
+  if (realloc_transient_memory) {
+    RgTransientMemoryStats &stats = m_rgp->m_transient_memory_stats;
+    stats = {};
+    for (const RgTransientResource &texture : transient_textures) {
+      stats.dedicated_size += texture.size;
+    }
+    stats.aliased_size =
+        rg_pack_transient_resources(transient_textures, offsets);
+    if (stats.aliased_size > 0) {
+      rhi::Result<rhi::Allocation> memory = rhi::allocate_memory(
+          device, {
+                      .size = stats.aliased_size,
+                      .alignment = alignment,
+                      .memory_type_mask = memory_type_mask,
+                  });
+      if (memory) {
+        m_rgp->m_transient_memory = *memory;
+      } else {
+        // Fall back to dedicated allocations.
+        fill(transient_textures, RgTransientResource());
+        stats.aliased_size = stats.dedicated_size;
+      }
+    }
+  }
+
+  for (usize i : range(num_ptexs)) {
+    RgPhysicalTexture &ptex = m_rgp->m_physical_textures[i];
+    if (!need_alloc[i]) {
+      continue;
+    }
+    // Textures whose usage has changed are created again.
+    if (ptex.handle) {
+      m_rgp->retire(ptex.handle);
+    }
+    bool transient = is_transient(transient_textures[i]);
+    auto handle = m_renderer->create_texture({
+        .name = ptex.name,
+        .format = ptex.format,
+        .usage = ptex.usage,
+        .width = ptex.size.x,
+        .height = ptex.size.y,
+        .depth = ptex.size.z,
+        .cube_map = ptex.cube_map,
+        .num_mips = ptex.num_mips,
+        .num_layers = ptex.num_layers,
+        .allocation = transient ? m_rgp->m_transient_memory : rhi::Allocation(),
+        .allocation_offset = transient ? offsets[i] : 0,
+    });
+    if (!handle) {
+      fmt::println(stderr, "RenderGraph render target allocation failed");
+      exit(EXIT_FAILURE);
+    }
+    ptex.handle = *handle;
+    ptex.aliased = transient;
+    ptex.layout = rhi::ImageLayout::Undefined;
+  }
+
+  for (usize i : range(num_ptexs)) {
+    const RgTransientResource &lhs = transient_textures[i];
+    if (!is_transient(lhs)) {
+      continue;
+    }
+    for (usize j : range(i + 1, num_ptexs)) {
+      const RgTransientResource &rhs = transient_textures[j];
+      if (!is_transient(rhs)) {
+        continue;
+      }
+      if (offsets[i] < offsets[j] + rhs.size and
+          offsets[j] < offsets[i] + lhs.size) {
+        m_rgp->m_texture_aliases.push(
+            m_rgp->m_arena, {RgPhysicalTextureId(i), RgPhysicalTextureId(j)});
+      }
+    }
+  }
+
+  // Schedule init passes before all other passes.
+  if (m_gfx_schedule.m_size != num_gfx_passes) {
+    ScratchArena scratch;
+    auto temp = Span<RgPassId>::allocate(scratch, m_gfx_schedule.m_size);
+    copy(m_gfx_schedule.begin() + num_gfx_passes, m_gfx_schedule.end(),
+         &temp[0]);
     copy(m_gfx_schedule.begin(), m_gfx_schedule.begin() + num_gfx_passes,
          &temp[m_gfx_schedule.m_size - num_gfx_passes]);
     copy(temp, &m_gfx_schedule[0]);
   }
 }
 
-void RgBuilder::alloc_buffers(DeviceBumpAllocator &gfx_allocator,
-                              DeviceBumpAllocator &async_allocator,
-                              DeviceBumpAllocator &shared_allocator,
-                              UploadBumpAllocator &upload_allocator) {
-  for (auto i : range(m_physical_buffers.m_size)) {
-    RgPhysicalBufferId id(i);
-    RgPhysicalBuffer &physical_buffer = m_physical_buffers[id];
-    if (physical_buffer.view.buffer) {
+void RgBuilder::get_transient_buffer_lifetimes(
+    Span<RgTransientResource> transient_buffers) const {
+  ren_assert(transient_buffers.m_size == m_physical_buffers.m_size);
+
+  ScratchArena scratch;
+
+  // Buffers that are shared between queues or aren't used by any pass stay
+  // alive for the whole frame.
+  for (usize i : range(m_physical_buffers.m_size)) {
+    transient_buffers[i] = {.first_pass = 0, .last_pass = u32(-1)};
+  }
+
+  auto queues = Span<RgQueueMask>::allocate(scratch, m_physical_buffers.m_size);
+  fill(queues, RgQueueMask());
+  for (RgQueue queue : {RgQueue::Graphics, RgQueue::Async}) {
+    Span<const RgPassId> schedule =
+        queue == RgQueue::Async ? m_async_schedule : m_gfx_schedule;
+    for (u32 i : range<u32>(schedule.m_size)) {
+      const RgPass &pass = m_passes[schedule[i]];
+      for (auto uses : {pass.read_buffers, pass.write_buffers}) {
+        for (RgBufferUseId use : uses) {
+          RgPhysicalBufferId id = m_buffers[m_buffer_uses[use].buffer].parent;
+          RgTransientResource &buffer = transient_buffers[id];
+          if (!queues[id]) {
+            buffer = {};
+          }
+          queues[id] |= queue;
+          buffer.first_pass = min(buffer.first_pass, i);
+          buffer.last_pass = max(buffer.last_pass, i);
+        }
+      }
+    }
+  }
+
+  for (usize i : range(m_physical_buffers.m_size)) {
+    if (queues[i] and queues[i] != RgQueue::Graphics and
+        queues[i] != RgQueue::Async) {
+      transient_buffers[i] = {.first_pass = 0, .last_pass = u32(-1)};
+    }
+  }
+}
+
+void RgBuilder::alloc_dedicated_buffers(
+    Span<const RgTransientResource> transient_buffers) {
+  for (usize i : range(transient_buffers.m_size)) {
+    if (!is_transient(transient_buffers[i])) {
       continue;
     }
-    switch (physical_buffer.heap) {
-    default:
-      unreachable();
-    case rhi::MemoryHeap::Default: {
-      DeviceBumpAllocator *allocator = nullptr;
-      if (physical_buffer.queues == RgQueue::Graphics) {
-        allocator = &gfx_allocator;
-      } else if (physical_buffer.queues == RgQueue::Async) {
-        allocator = &async_allocator;
-      } else {
-        ren_assert(physical_buffer.queues != RgQueue::None);
-        allocator = &shared_allocator;
+    RgPhysicalBuffer &pbuf = m_physical_buffers[i];
+    rhi::Result<Handle<Buffer>> buffer = m_renderer->create_buffer({
+        .name = "Render graph dedicated buffer",
+        .heap = rhi::MemoryHeap::Default,
+        .size = pbuf.size,
+    });
+    if (!buffer) {
+      buffer = m_renderer->create_buffer({
+          .name = "Render graph dedicated buffer",
+          .heap = rhi::MemoryHeap::Upload,
+          .size = pbuf.size,
+      });
+    }
+    if (!buffer) {
+      fmt::println(stderr,
+                   "Render graph: failed to allocate {} bytes for buffer",
+                   pbuf.size);
+      exit(EXIT_FAILURE);
+    }
+    m_dedicated_buffers.push(m_arena, *buffer);
+    pbuf.view = {.buffer = *buffer, .count = pbuf.size};
+  }
+}
+
+void RgBuilder::alloc_buffers(UploadBumpAllocator &upload_allocator) {
+  ScratchArena scratch;
+
+  usize num_pbufs = m_physical_buffers.m_size;
+
+  m_rgp->m_shared_buffer_pool = (m_rgp->m_shared_buffer_pool + 1) % 2;
+  auto get_pool = [&](const RgPhysicalBuffer &pbuf) -> RgBufferPoolId {
+    if (pbuf.queues == RgQueue::Graphics) {
+      return RG_GFX_BUFFER_POOL;
+    }
+    if (pbuf.queues == RgQueue::Async) {
+      return RG_ASYNC_BUFFER_POOL;
+    }
+    ren_assert(pbuf.queues != RgQueue::None);
+    return RgBufferPoolId(RG_SHARED_BUFFER_POOL + m_rgp->m_shared_buffer_pool);
+  };
+
+  auto transient_buffers =
+      Span<RgTransientResource>::allocate(scratch, num_pbufs);
+  get_transient_buffer_lifetimes(transient_buffers);
+
+  auto pool_buffers = Span<RgTransientResource>::allocate(scratch, num_pbufs);
+  auto offsets = Span<usize>::allocate(scratch, num_pbufs);
+
+  // Place buffers with disjoint lifetimes in the same pool at overlapping
+  // offsets, like transient textures.
+  for (RgBufferPoolId pool :
+       {RG_GFX_BUFFER_POOL, RG_ASYNC_BUFFER_POOL,
+        RgBufferPoolId(RG_SHARED_BUFFER_POOL + m_rgp->m_shared_buffer_pool)}) {
+    fill(pool_buffers, RgTransientResource());
+    for (usize i : range(num_pbufs)) {
+      const RgPhysicalBuffer &pbuf = m_physical_buffers[i];
+      if (pbuf.view.buffer or pbuf.heap != rhi::MemoryHeap::Default or
+          get_pool(pbuf) != pool) {
+        continue;
       }
-      physical_buffer.view = allocator->allocate(physical_buffer.size).slice;
-    } break;
-    case rhi::MemoryHeap::Upload:
-    case rhi::MemoryHeap::DeviceUpload: {
-      physical_buffer.view =
-          upload_allocator.allocate(physical_buffer.size).slice;
-    } break;
+      pool_buffers[i] = transient_buffers[i];
+      pool_buffers[i].size = pbuf.size;
+      pool_buffers[i].alignment = sh::DEFAULT_DEVICE_PTR_ALIGNMENT;
     }
+
+    usize size = rg_pack_transient_resources(pool_buffers, offsets);
+    if (m_rgp->m_buffer_pool_failure or
+        !m_rgp->update_buffer_pool(pool, size)) {
+      alloc_dedicated_buffers(pool_buffers);
+      continue;
+    }
+    Handle<Buffer> buffer = m_rgp->m_buffer_pools[pool].buffer;
+
+    for (usize i : range(num_pbufs)) {
+      const RgTransientResource &lhs = pool_buffers[i];
+      if (!is_transient(lhs)) {
+        continue;
+      }
+      m_physical_buffers[i].view = {
+          .buffer = buffer,
+          .offset = offsets[i],
+          .count = lhs.size,
+      };
+      for (usize j : range(i)) {
+        const RgTransientResource &rhs = pool_buffers[j];
+        if (is_transient(rhs) and offsets[i] < offsets[j] + rhs.size and
+            offsets[j] < offsets[i] + lhs.size) {
+          m_buffer_aliases.push(
+              m_arena, {RgPhysicalBufferId(j), RgPhysicalBufferId(i)});
+        }
+      }
+    }
+  }
+
+  // The other shared buffer pool isn't used in this frame, but still needs to
+  // be released once it has been idle for long enough.
+  m_rgp->update_buffer_pool(
+      RgBufferPoolId(RG_SHARED_BUFFER_POOL + 1 - m_rgp->m_shared_buffer_pool),
+      0);
+
+  for (RgPhysicalBuffer &pbuf : m_physical_buffers) {
+    if (pbuf.view.buffer or pbuf.heap == rhi::MemoryHeap::Default) {
+      continue;
+    }
+    ren_assert(pbuf.heap == rhi::MemoryHeap::Upload or
+               pbuf.heap == rhi::MemoryHeap::DeviceUpload);
+    pbuf.view = upload_allocator.allocate(pbuf.size).slice;
   }
 }
 
@@ -664,6 +2106,8 @@ void RgBuilder::init_runtime_passes() {
       const RgPass &pass = m_passes[schedule[i]];
       (*rt_passes)[i] = {
           .name = pass.name,
+          .key = pass.key,
+          .index = pass.index,
           .rp_cb = pass.rp_cb,
           .cb = pass.cb,
           .render_targets = Span(pass.render_targets, pass.num_render_targets),
@@ -795,58 +2239,283 @@ void RgBuilder::add_inter_queue_semaphores() {
         }
       }
 
-      // No dependencies or already waited in a previous pass on the same queue.
-      if (pass.wait_time <= last_waited_time) {
-        continue;
+      // No dependencies or already waited in a previous pass on the same queue.
+      if (pass.wait_time <= last_waited_time) {
+        continue;
+      }
+
+      ren_assert(last_waited_time < pass.wait_time);
+      last_waited_time = pass.wait_time;
+      pass.wait = true;
+      if (pass.wait_time >= first_signaled_time) {
+        RgPassId signal_pass_id =
+            other_schedule[pass.wait_time - first_signaled_time];
+        RgPass &signal_pass = m_passes[signal_pass_id];
+        ren_assert(pass.wait_time == signal_pass.signal_time);
+        signal_pass.signal = true;
+      }
+    }
+    if (schedule.m_size > 0) {
+      m_passes[schedule.back()].signal = true;
+    }
+  }
+
+  place_inter_queue_semaphores();
+
+  for (RgPhysicalTexture &ptex : m_rgp->m_physical_textures) {
+    ptex.last_queue = ptex.queue;
+    ptex.last_time = ptex.time;
+    ptex.queue = RgQueue::None;
+    ptex.time = 0;
+  }
+
+  m_rgp->m_gfx_time = new_gfx_time;
+  m_rgp->m_async_time = new_async_time;
+}
+
+void RgBuilder::place_inter_queue_semaphores() {
+  for (RgQueue queue : {RgQueue::Graphics, RgQueue::Async}) {
+    Span<const RgPassId> schedule = m_gfx_schedule;
+    RgSemaphoreId semaphore = m_rgp->m_gfx_semaphore_id;
+    RgSemaphoreId other_semaphore = m_rgp->m_async_semaphore_id;
+    if (queue == RgQueue::Async) {
+      schedule = m_async_schedule;
+      semaphore = m_rgp->m_async_semaphore_id;
+      other_semaphore = m_rgp->m_gfx_semaphore_id;
+    }
+    for (isize i = isize(schedule.m_size) - 1; i >= 0; --i) {
+      RgPassId pass_id = schedule[i];
+      RgPass &pass = m_passes[pass_id];
+      if (pass.signal) {
+        signal_semaphore(pass_id, semaphore, pass.signal_time);
+      }
+      if (pass.wait) {
+        ren_assert(pass.wait_time);
+        wait_semaphore(pass_id, other_semaphore, pass.wait_time);
+      }
+    }
+  }
+}
+
+auto RgBuilder::serialize_topology(NotNull<Arena *> arena, u64 *hash) const
+    -> Span<const u64> {
+  DynamicArray<u64> topology;
+  u64 h = 0;
+  auto combine = [&](u64 value) {
+    topology.push(arena, value);
+    h = hash_mix(h ^ (value + 0x9e3779b97f4a7c15));
+  };
+
+  combine(m_physical_buffers.m_size);
+  combine(m_rgp->m_physical_textures.m_size);
+  // Buffers that share memory need to be synchronized with each other.
+  combine(m_buffer_aliases.m_size);
+  for (const RgBufferAlias &alias : m_buffer_aliases) {
+    combine(alias.lhs);
+    combine(alias.rhs);
+  }
+  // Barriers and semaphore waits depend on the state textures are left in by
+  // the previous frame.
+  for (const RgPhysicalTexture &ptex : m_rgp->m_physical_textures) {
+    combine(u64(ptex.layout));
+    combine(u64(ptex.last_queue));
+    if (ptex.last_queue == RgQueue::Graphics) {
+      combine(m_rgp->m_gfx_time - ptex.last_time);
+    } else if (ptex.last_queue == RgQueue::Async) {
+      combine(m_rgp->m_async_time - ptex.last_time);
+    }
+  }
+
+  auto combine_state = [&](const rhi::MemoryState &state) {
+    combine(u64(state.stage_mask.get()));
+    combine(u64(state.access_mask.get()));
+  };
+
+  for (Span<const RgPassId> schedule : {m_gfx_schedule, m_async_schedule}) {
+    combine(schedule.m_size);
+    for (RgPassId pass_id : schedule) {
+      const RgPass &pass = m_passes[pass_id];
+      combine(u32(pass_id));
+      combine(u64(pass.queue));
+
+      for (auto uses : {pass.read_buffers, pass.write_buffers}) {
+        combine(uses.m_size);
+        for (RgBufferUseId use_id : uses) {
+          const RgBufferUse &use = m_buffer_uses[use_id];
+          const RgBuffer &buffer = m_buffers[use.buffer];
+          combine(buffer.parent);
+          combine(u32(buffer.def));
+          combine(u32(buffer.kill));
+          combine_state(use.usage);
+        }
+      }
+
+      for (auto uses : {pass.read_textures, pass.write_textures}) {
+        combine(uses.m_size);
+        for (RgTextureUseId use_id : uses) {
+          const RgTextureUse &use = m_texture_uses[use_id];
+          const RgTexture &texture = m_rgp->m_textures[use.texture];
+          combine(texture.parent);
+          combine(u32(texture.def));
+          combine(u32(texture.kill));
+          combine_state({use.state.stage_mask, use.state.access_mask});
+          combine(u64(use.state.layout));
+        }
+      }
+    }
+  }
+
+  *hash = h;
+  return topology;
+}
+
+void RgBuilder::save_compiled_graph(u64 topology_hash,
+                                    Span<const u64> topology) {
+  Arena &arena = m_rgp->m_compiled_arena;
+  arena.clear();
+
+  RgCompiledGraph &compiled = m_rgp->m_compiled;
+  compiled.valid = true;
+  compiled.topology_hash = topology_hash;
+  compiled.topology = topology.copy(&arena);
+
+  // Timeline values at the start of this frame.
+  u64 gfx_time = m_rgp->m_gfx_time - m_gfx_schedule.m_size;
+  u64 async_time = m_rgp->m_async_time - m_async_schedule.m_size;
+  auto get_start_time = [&](RgQueue queue) {
+    return queue == RgQueue::Async ? async_time : gfx_time;
+  };
+
+  for (RgQueue queue : {RgQueue::Graphics, RgQueue::Async}) {
+    Span<const RgPassId> schedule = m_gfx_schedule;
+    Span<const RgRtPass> rt_passes = m_rg.m_gfx_passes;
+    Span<RgCompiledPass> *compiled_passes = &compiled.gfx_passes;
+    RgQueue other_queue = RgQueue::Async;
+    if (queue == RgQueue::Async) {
+      schedule = m_async_schedule;
+      rt_passes = m_rg.m_async_passes;
+      compiled_passes = &compiled.async_passes;
+      other_queue = RgQueue::Graphics;
+    }
+    *compiled_passes = Span<RgCompiledPass>::allocate(&arena, schedule.m_size);
+    for (usize i : range(schedule.m_size)) {
+      const RgPass &pass = m_passes[schedule[i]];
+      const RgRtPass &rt_pass = rt_passes[i];
+      RgCompiledPass &compiled_pass = (*compiled_passes)[i];
+      compiled_pass = {
+          .memory_barriers = rt_pass.memory_barriers.copy(&arena),
+          .texture_barriers = rt_pass.texture_barriers.copy(&arena),
+          .num_memory_barriers = rt_pass.num_memory_barriers,
+          .num_texture_barriers = rt_pass.num_texture_barriers,
+          .texture_barrier_textures = Span<RgPhysicalTextureId>::allocate(
+              &arena, rt_pass.texture_barriers.m_size),
+          .wait = pass.wait,
+          .signal = pass.signal,
+      };
+      if (pass.wait) {
+        compiled_pass.wait_time =
+            i64(pass.wait_time) - i64(get_start_time(other_queue));
       }
-
-      ren_assert(last_waited_time < pass.wait_time);
-      last_waited_time = pass.wait_time;
-      pass.wait = true;
-      if (pass.wait_time >= first_signaled_time) {
-        RgPassId signal_pass_id =
-            other_schedule[pass.wait_time - first_signaled_time];
-        RgPass &signal_pass = m_passes[signal_pass_id];
-        ren_assert(pass.wait_time == signal_pass.signal_time);
-        signal_pass.signal = true;
+      for (usize j : range(rt_pass.texture_barriers.m_size)) {
+        Handle<Texture> handle = rt_pass.texture_barriers[j].resource.handle;
+        const RgPhysicalTexture *ptex =
+            find_if(Span(m_rgp->m_physical_textures),
+                    [&](const RgPhysicalTexture &other) {
+                      return other.handle == handle;
+                    });
+        ren_assert(ptex);
+        compiled_pass.texture_barrier_textures[j] =
+            RgPhysicalTextureId(ptex - m_rgp->m_physical_textures.m_data);
       }
     }
-    if (schedule.m_size > 0) {
-      m_passes[schedule.back()].signal = true;
+  }
+
+  compiled.split_barriers = m_split_barriers.copy(&arena);
+  compiled.num_merged_barriers = m_num_merged_barriers;
+
+  compiled.textures = Span<RgCompiledTexture>::allocate(
+      &arena, m_rgp->m_physical_textures.m_size);
+  for (usize i : range(m_rgp->m_physical_textures.m_size)) {
+    const RgPhysicalTexture &ptex = m_rgp->m_physical_textures[i];
+    RgCompiledTexture &texture = compiled.textures[i];
+    texture = {
+        .layout = ptex.layout,
+        .last_queue = ptex.last_queue,
+    };
+    if (ptex.last_queue != RgQueue::None) {
+      texture.last_time =
+          i64(ptex.last_time) - i64(get_start_time(ptex.last_queue));
     }
   }
+}
+
+void RgBuilder::load_compiled_graph() {
+  const RgCompiledGraph &compiled = m_rgp->m_compiled;
+  ren_assert(compiled.gfx_passes.m_size == m_gfx_schedule.m_size);
+  ren_assert(compiled.async_passes.m_size == m_async_schedule.m_size);
+
+  u64 gfx_time = m_rgp->m_gfx_time;
+  u64 async_time = m_rgp->m_async_time;
+  auto get_start_time = [&](RgQueue queue) {
+    return queue == RgQueue::Async ? async_time : gfx_time;
+  };
 
   for (RgQueue queue : {RgQueue::Graphics, RgQueue::Async}) {
     Span<const RgPassId> schedule = m_gfx_schedule;
-    RgSemaphoreId semaphore = m_rgp->m_gfx_semaphore_id;
-    RgSemaphoreId other_semaphore = m_rgp->m_async_semaphore_id;
+    Span<RgRtPass> rt_passes = m_rg.m_gfx_passes;
+    Span<const RgCompiledPass> compiled_passes = compiled.gfx_passes;
+    RgQueue other_queue = RgQueue::Async;
     if (queue == RgQueue::Async) {
       schedule = m_async_schedule;
-      semaphore = m_rgp->m_async_semaphore_id;
-      other_semaphore = m_rgp->m_gfx_semaphore_id;
+      rt_passes = m_rg.m_async_passes;
+      compiled_passes = compiled.async_passes;
+      other_queue = RgQueue::Graphics;
     }
-    for (isize i = isize(schedule.m_size) - 1; i >= 0; --i) {
-      RgPassId pass_id = schedule[i];
-      RgPass &pass = m_passes[pass_id];
-      if (pass.signal) {
-        signal_semaphore(pass_id, semaphore, pass.signal_time);
-      }
+    for (usize i : range(schedule.m_size)) {
+      RgPass &pass = m_passes[schedule[i]];
+      RgRtPass &rt_pass = rt_passes[i];
+      const RgCompiledPass &compiled_pass = compiled_passes[i];
+
+      pass.signal = compiled_pass.signal;
+      pass.wait = compiled_pass.wait;
+      pass.signal_time = get_start_time(queue) + i + 1;
       if (pass.wait) {
-        ren_assert(pass.wait_time);
-        wait_semaphore(pass_id, other_semaphore, pass.wait_time);
+        pass.wait_time =
+            u64(i64(get_start_time(other_queue)) + compiled_pass.wait_time);
+      }
+
+      rt_pass.memory_barriers = compiled_pass.memory_barriers;
+      rt_pass.texture_barriers =
+          compiled_pass.texture_barriers.copy(m_arena);
+      rt_pass.num_memory_barriers = compiled_pass.num_memory_barriers;
+      rt_pass.num_texture_barriers = compiled_pass.num_texture_barriers;
+      for (usize j : range(rt_pass.texture_barriers.m_size)) {
+        RgPhysicalTextureId ptex_id = compiled_pass.texture_barrier_textures[j];
+        rt_pass.texture_barriers[j].resource.handle =
+            m_rgp->m_physical_textures[ptex_id].handle;
       }
     }
   }
 
-  for (RgPhysicalTexture &ptex : m_rgp->m_physical_textures) {
-    ptex.last_queue = ptex.queue;
-    ptex.last_time = ptex.time;
-    ptex.queue = RgQueue::None;
-    ptex.time = 0;
+  m_split_barriers = compiled.split_barriers;
+  m_num_merged_barriers = compiled.num_merged_barriers;
+
+  place_inter_queue_semaphores();
+
+  for (usize i : range(m_rgp->m_physical_textures.m_size)) {
+    RgPhysicalTexture &ptex = m_rgp->m_physical_textures[i];
+    const RgCompiledTexture &texture = compiled.textures[i];
+    ptex.layout = texture.layout;
+    ptex.last_queue = texture.last_queue;
+    ptex.last_time = 0;
+    if (texture.last_queue != RgQueue::None) {
+      ptex.last_time =
+          u64(i64(get_start_time(texture.last_queue)) + texture.last_time);
+    }
   }
 
-  m_rgp->m_gfx_time = new_gfx_time;
-  m_rgp->m_async_time = new_async_time;
+  m_rgp->m_gfx_time = gfx_time + m_gfx_schedule.m_size;
+  m_rgp->m_async_time = async_time + m_async_schedule.m_size;
 }
 
 void RgBuilder::init_runtime_buffers() {
@@ -888,6 +2557,11 @@ void RgBuilder::init_runtime_textures() {
         m_rgp->m_textures[use.texture].parent;
     const RgPhysicalTexture &physical_texture =
         m_rgp->m_physical_textures[physical_texture_id];
+    // Only used by culled passes.
+    if (!physical_texture.handle) {
+      m_rg.m_textures[i] = {};
+      continue;
+    }
 
     RgRtTexture texture = {physical_texture.handle};
 
@@ -925,51 +2599,105 @@ void RgBuilder::init_runtime_textures() {
   }
 }
 
-void RgBuilder::place_barriers_and_semaphores() {
+namespace {
+
+struct RgPlacedMemoryBarrier {
+  rhi::MemoryBarrier barrier;
+  /// Index in the queue's schedule of the last pass that the barrier waits
+  /// for.
+  u32 src_pass = 0;
+};
+
+struct RgPlacedTextureBarrier {
+  TextureBarrier barrier;
+  u32 src_pass = 0;
+};
+
+struct RgPassBarriers {
+  DynamicArray<RgPlacedMemoryBarrier> memory_barriers;
+  DynamicArray<RgPlacedTextureBarrier> texture_barriers;
+};
+
+struct RgPendingSplitBarrier {
+  u32 src_pass = 0;
+  u32 dst_pass = 0;
+  DynamicArray<rhi::MemoryBarrier> memory_barriers;
+  DynamicArray<TextureBarrier> texture_barriers;
+};
+
+} // namespace
+
+void RgBuilder::place_barriers() {
   ScratchArena scratch;
 
   auto *buffer_after_write_hazard_src_states =
       scratch->allocate<rhi::BufferState>(m_physical_buffers.m_size);
   auto *buffer_after_read_hazard_src_states =
       scratch->allocate<rhi::PipelineStageMask>(m_physical_buffers.m_size);
+  // All accesses to buffers in this frame, used to synchronize with buffers
+  // that share their memory.
+  auto buffer_alias_src_states =
+      Span<rhi::MemoryState>::allocate(scratch, m_physical_buffers.m_size);
+  fill(buffer_alias_src_states, rhi::MemoryState());
 
   auto *texture_after_write_hazard_src_states =
       scratch->allocate<rhi::MemoryState>(m_rgp->m_physical_textures.m_size);
   auto *texture_after_read_hazard_src_states =
       scratch->allocate<rhi::PipelineStageMask>(
           m_rgp->m_physical_textures.m_size);
+  // All accesses to textures in this frame, used to synchronize with textures
+  // that share their memory.
+  auto texture_alias_src_states = Span<rhi::MemoryState>::allocate(
+      scratch, m_rgp->m_physical_textures.m_size);
+  fill(texture_alias_src_states, rhi::MemoryState());
+
+  // Indices in their queue's schedule of the last passes whose accesses the
+  // source stage masks above include.
+  auto buffer_after_write_hazard_src_passes =
+      Span<u32>::allocate(scratch, m_physical_buffers.m_size);
+  fill(buffer_after_write_hazard_src_passes, 0);
+  auto buffer_after_read_hazard_src_passes =
+      Span<u32>::allocate(scratch, m_physical_buffers.m_size);
+  fill(buffer_after_read_hazard_src_passes, 0);
+  auto texture_after_write_hazard_src_passes =
+      Span<u32>::allocate(scratch, m_rgp->m_physical_textures.m_size);
+  fill(texture_after_write_hazard_src_passes, 0);
+  auto texture_after_read_hazard_src_passes =
+      Span<u32>::allocate(scratch, m_rgp->m_physical_textures.m_size);
+  fill(texture_after_read_hazard_src_passes, 0);
+
+  auto gfx_barriers =
+      Span<RgPassBarriers>::allocate(scratch, m_rg.m_gfx_passes.m_size);
+  fill(gfx_barriers, RgPassBarriers());
+  auto async_barriers =
+      Span<RgPassBarriers>::allocate(scratch, m_rg.m_async_passes.m_size);
+  fill(async_barriers, RgPassBarriers());
 
   usize gfx_i = 0;
   usize async_i = 0;
 
-  DynamicArray<rhi::MemoryBarrier> memory_barriers;
-  DynamicArray<TextureBarrier> texture_barriers;
-
   while (gfx_i < m_rg.m_gfx_passes.m_size or
          async_i < m_rg.m_async_passes.m_size) {
-    RgRtPass *rt_pass = nullptr;
     const RgPass *pass = nullptr;
+    RgPassBarriers *barriers = nullptr;
+    u32 pass_index = 0;
 
+    bool is_async = false;
     if (gfx_i == m_rg.m_gfx_passes.m_size) {
-      rt_pass = &m_rg.m_async_passes[async_i];
-      pass = &m_passes[m_async_schedule[async_i]];
-      async_i++;
-    } else if (async_i == m_rg.m_async_passes.m_size) {
-      rt_pass = &m_rg.m_gfx_passes[gfx_i];
-      pass = &m_passes[m_gfx_schedule[gfx_i]];
-      gfx_i++;
-    } else {
+      is_async = true;
+    } else if (async_i < m_rg.m_async_passes.m_size) {
       const RgPass &gfx_pass = m_passes[m_gfx_schedule[gfx_i]];
       const RgPass &async_pass = m_passes[m_async_schedule[async_i]];
-      if (gfx_pass.wait_time < async_pass.signal_time) {
-        rt_pass = &m_rg.m_gfx_passes[gfx_i];
-        pass = &gfx_pass;
-        gfx_i++;
-      } else {
-        rt_pass = &m_rg.m_async_passes[async_i];
-        pass = &async_pass;
-        async_i++;
-      }
+      is_async = gfx_pass.wait_time >= async_pass.signal_time;
+    }
+    if (is_async) {
+      pass = &m_passes[m_async_schedule[async_i]];
+      barriers = &async_barriers[async_i];
+      pass_index = async_i++;
+    } else {
+      pass = &m_passes[m_gfx_schedule[gfx_i]];
+      barriers = &gfx_barriers[gfx_i];
+      pass_index = gfx_i++;
     }
 
     auto maybe_place_barrier_for_buffer = [&](RgBufferUseId use_id) {
@@ -990,6 +2718,31 @@ void RgBuilder::place_barriers_and_semaphores() {
 
       rhi::PipelineStageMask src_stage_mask;
       rhi::AccessMask src_access_mask;
+      u32 src_pass = pass_index;
+
+      // If this is the first use of the buffer in this frame, its memory
+      // might have been used by other buffers earlier in this frame, so must
+      // wait for them to finish. Memory that was used in the previous frame
+      // is synchronized with at the start of the frame.
+      rhi::MemoryState alias_state;
+      rhi::MemoryState &alias_src_state = buffer_alias_src_states[pbuf_id];
+      if (!alias_src_state.stage_mask) {
+        for (RgBufferAlias alias : m_buffer_aliases) {
+          if (alias.rhs == pbuf_id) {
+            std::swap(alias.lhs, alias.rhs);
+          }
+          if (alias.lhs != pbuf_id) {
+            continue;
+          }
+          const rhi::MemoryState &other_state =
+              buffer_alias_src_states[alias.rhs];
+          alias_state.stage_mask |= other_state.stage_mask;
+          alias_state.access_mask |= other_state.access_mask;
+        }
+      }
+      alias_src_state.stage_mask |= dst_stage_mask;
+      alias_src_state.access_mask |=
+          dst_access_mask & rhi::WRITE_ONLY_ACCESS_MASK;
 
       if (dst_access_mask & rhi::WRITE_ONLY_ACCESS_MASK) {
         ren_assert(kill_pass);
@@ -999,6 +2752,7 @@ void RgBuilder::place_barriers_and_semaphores() {
         // Reset the source stage mask that the next WAR hazard will use
         src_stage_mask =
             std::exchange(buffer_after_read_hazard_src_states[pbuf_id], {});
+        src_pass = buffer_after_read_hazard_src_passes[pbuf_id];
         // If this is a WAR hazard, need to wait for all previous reads on the
         // same queue to finish. The previous write's memory has already been
         // made available by previous RAW barriers or semaphore waits, so it
@@ -1013,6 +2767,7 @@ void RgBuilder::place_barriers_and_semaphores() {
           // now.
           src_stage_mask = after_write_state.stage_mask;
           src_access_mask = after_write_state.access_mask;
+          src_pass = buffer_after_write_hazard_src_passes[pbuf_id];
         }
         // Update the source stage and access masks that further RAW and WAW
         // hazards on the same queue will use.
@@ -1020,37 +2775,48 @@ void RgBuilder::place_barriers_and_semaphores() {
         // Read accesses are redundant for source access mask.
         after_write_state.access_mask =
             dst_access_mask & rhi::WRITE_ONLY_ACCESS_MASK;
+        buffer_after_write_hazard_src_passes[pbuf_id] = pass_index;
       } else {
         // This is a RAW hazard. Need to wait for the previous write to finish
         // and make it's memory available and visible if it was performed on the
         // same queue.
-        // TODO/FIXME: all RAW barriers should be merged, since if they are
-        // issued separately they might cause the cache to be flushed multiple
-        // times.
         const rhi::BufferState &after_write_state =
             buffer_after_write_hazard_src_states[pbuf_id];
         if (def_pass and def_pass->queue == pass->queue) {
           src_stage_mask = after_write_state.stage_mask;
           src_access_mask = after_write_state.access_mask;
+          src_pass = buffer_after_write_hazard_src_passes[pbuf_id];
         }
         if (kill_pass and kill_pass->queue == pass->queue) {
           // Update the source stage mask that the next WAR hazard will use if
           // it's on the same queue.
           buffer_after_read_hazard_src_states[pbuf_id] |= dst_stage_mask;
+          buffer_after_read_hazard_src_passes[pbuf_id] = pass_index;
         }
       }
 
+      if (alias_state.stage_mask) {
+        src_stage_mask |= alias_state.stage_mask;
+        src_access_mask |= alias_state.access_mask;
+        src_pass = pass_index;
+      }
+
       if (!src_stage_mask) {
         ren_assert(!src_access_mask);
         return;
       }
 
-      memory_barriers.push(m_arena, {
-                                        .src_stage_mask = src_stage_mask,
-                                        .src_access_mask = src_access_mask,
-                                        .dst_stage_mask = dst_stage_mask,
-                                        .dst_access_mask = dst_access_mask,
-                                    });
+      barriers->memory_barriers.push(
+          scratch, {
+                       .barrier =
+                           {
+                               .src_stage_mask = src_stage_mask,
+                               .src_access_mask = src_access_mask,
+                               .dst_stage_mask = dst_stage_mask,
+                               .dst_access_mask = dst_access_mask,
+                           },
+                       .src_pass = src_pass,
+                   });
     };
 
     auto maybe_place_barrier_for_texture = [&](RgTextureUseId use_id) {
@@ -1071,6 +2837,11 @@ void RgBuilder::place_barriers_and_semaphores() {
         ren_assert(dst_access_mask);
       }
 
+      rhi::MemoryState &alias_src_state = texture_alias_src_states[ptex_id];
+      alias_src_state.stage_mask |= dst_stage_mask;
+      alias_src_state.access_mask |=
+          dst_access_mask & rhi::WRITE_ONLY_ACCESS_MASK;
+
       if (dst_layout == ptex.layout) {
         // Only a memory barrier is required if layout doesn't change.
         // However, this can cause the driver (RADV) to be overly conservative
@@ -1079,6 +2850,7 @@ void RgBuilder::place_barriers_and_semaphores() {
 
         rhi::PipelineStageMask src_stage_mask;
         rhi::AccessMask src_access_mask;
+        u32 src_pass = pass_index;
 
         if (dst_access_mask & rhi::WRITE_ONLY_ACCESS_MASK) {
           ren_assert(kill_pass);
@@ -1087,22 +2859,27 @@ void RgBuilder::place_barriers_and_semaphores() {
               texture_after_write_hazard_src_states[ptex_id];
           src_stage_mask =
               std::exchange(texture_after_read_hazard_src_states[ptex_id], {});
+          src_pass = texture_after_read_hazard_src_passes[ptex_id];
           if (!src_stage_mask and def_pass and def_pass->queue == pass->queue) {
             src_stage_mask = after_write_state.stage_mask;
             src_access_mask = after_write_state.access_mask;
+            src_pass = texture_after_write_hazard_src_passes[ptex_id];
           }
           after_write_state.stage_mask = dst_stage_mask;
           after_write_state.access_mask =
               dst_access_mask & rhi::WRITE_ONLY_ACCESS_MASK;
+          texture_after_write_hazard_src_passes[ptex_id] = pass_index;
         } else {
           const rhi::MemoryState &after_write_state =
               texture_after_write_hazard_src_states[ptex_id];
           if (def_pass and def_pass->queue == pass->queue) {
             src_stage_mask = after_write_state.stage_mask;
             src_access_mask = after_write_state.access_mask;
+            src_pass = texture_after_write_hazard_src_passes[ptex_id];
           }
           if (kill_pass and kill_pass->queue == pass->queue) {
             texture_after_read_hazard_src_states[ptex_id] |= dst_stage_mask;
+            texture_after_read_hazard_src_passes[ptex_id] = pass_index;
           }
         }
 
@@ -1111,13 +2888,18 @@ void RgBuilder::place_barriers_and_semaphores() {
           return;
         }
 
-        texture_barriers.push(m_arena, {
-                                           .resource = {ptex.handle},
-                                           .src_stage_mask = src_stage_mask,
-                                           .src_access_mask = src_access_mask,
-                                           .dst_stage_mask = dst_stage_mask,
-                                           .dst_access_mask = dst_access_mask,
-                                       });
+        barriers->texture_barriers.push(
+            scratch, {
+                         .barrier =
+                             {
+                                 .resource = {ptex.handle},
+                                 .src_stage_mask = src_stage_mask,
+                                 .src_access_mask = src_access_mask,
+                                 .dst_stage_mask = dst_stage_mask,
+                                 .dst_access_mask = dst_access_mask,
+                             },
+                         .src_pass = src_pass,
+                     });
       } else {
         // Need an image barrier to change the layout. Layout transitions are
         // read-write operations, so only to take care of WAR and WAW hazards in
@@ -1143,6 +2925,30 @@ void RgBuilder::place_barriers_and_semaphores() {
         after_write_state.stage_mask = dst_stage_mask;
         after_write_state.access_mask =
             dst_access_mask & rhi::WRITE_ONLY_ACCESS_MASK;
+        texture_after_write_hazard_src_passes[ptex_id] = pass_index;
+
+        if (ptex.layout == rhi::ImageLayout::Undefined) {
+          // This is the first use of the texture in this frame. Its memory
+          // might have been used by other textures earlier in this frame or
+          // in the previous one, so must wait for them to finish.
+          for (RgTextureAlias alias : m_rgp->m_texture_aliases) {
+            if (alias.rhs == ptex_id) {
+              std::swap(alias.lhs, alias.rhs);
+            }
+            if (alias.lhs != ptex_id) {
+              continue;
+            }
+            const rhi::MemoryState &other_state =
+                texture_alias_src_states[alias.rhs];
+            if (other_state.stage_mask) {
+              src_stage_mask |= other_state.stage_mask;
+              src_access_mask |= other_state.access_mask;
+            } else {
+              src_stage_mask |= rhi::PipelineStage::All;
+              src_access_mask |= rhi::Access::MemoryWrite;
+            }
+          }
+        }
 
 #if 0
         auto get_layout_name = [](rhi::ImageLayout layout) {
@@ -1162,27 +2968,33 @@ void RgBuilder::place_barriers_and_semaphores() {
           }
         };
 
-        fmt::println(stderr, "{}: transition {} from {} to {}", rt_pass->name,
+        fmt::println(stderr, "{}: transition {} from {} to {}", pass->name,
                      m_rgp->m_textures[use.texture].name,
                      get_layout_name(ptex.layout), get_layout_name(dst_layout));
 #endif
 
-        texture_barriers.push(m_arena, {
-                                           .resource = {ptex.handle},
-                                           .src_stage_mask = src_stage_mask,
-                                           .src_access_mask = src_access_mask,
-                                           .src_layout = ptex.layout,
-                                           .dst_stage_mask = dst_stage_mask,
-                                           .dst_access_mask = dst_access_mask,
-                                           .dst_layout = dst_layout,
-                                       });
+        // Layout transitions are always done right before the pass, since
+        // the texture's previous layout might still be used by passes in
+        // between.
+        barriers->texture_barriers.push(
+            scratch, {
+                         .barrier =
+                             {
+                                 .resource = {ptex.handle},
+                                 .src_stage_mask = src_stage_mask,
+                                 .src_access_mask = src_access_mask,
+                                 .src_layout = ptex.layout,
+                                 .dst_stage_mask = dst_stage_mask,
+                                 .dst_access_mask = dst_access_mask,
+                                 .dst_layout = dst_layout,
+                             },
+                         .src_pass = pass_index,
+                     });
 
         ptex.layout = dst_layout;
       }
     };
 
-    memory_barriers.clear();
-    texture_barriers.clear();
     for (RgBufferUseId use : pass->read_buffers) {
       maybe_place_barrier_for_buffer(use);
     }
@@ -1195,34 +3007,279 @@ void RgBuilder::place_barriers_and_semaphores() {
     for (RgTextureUseId use : pass->write_textures) {
       maybe_place_barrier_for_texture(use);
     }
+  }
+
+  DynamicArray<RgSplitBarrier> split_barriers;
+  m_num_merged_barriers = 0;
+  for (RgQueue queue : {RgQueue::Graphics, RgQueue::Async}) {
+    Span<RgRtPass> rt_passes = m_rg.m_gfx_passes;
+    Span<const RgPassBarriers> queue_barriers = gfx_barriers;
+    if (queue == RgQueue::Async) {
+      rt_passes = m_rg.m_async_passes;
+      queue_barriers = async_barriers;
+    }
+    usize num_passes = rt_passes.m_size;
+
+    auto memory_barriers =
+        Span<DynamicArray<rhi::MemoryBarrier>>::allocate(scratch, num_passes);
+    fill(memory_barriers, DynamicArray<rhi::MemoryBarrier>());
+    auto texture_barriers =
+        Span<DynamicArray<TextureBarrier>>::allocate(scratch, num_passes);
+    fill(texture_barriers, DynamicArray<TextureBarrier>());
+    // Sorted by destination pass.
+    DynamicArray<RgPendingSplitBarrier> pending_split_barriers;
+
+    for (usize i : range(num_passes)) {
+      // Barriers whose source passes finished before the previous pass
+      // started don't have to wait until right before this pass. Move them
+      // into the previous pass's barrier if it already waits for the same
+      // stages, and otherwise split them.
+      rhi::PipelineStageMask prev_src_stage_mask;
+      if (i > 0) {
+        for (const rhi::MemoryBarrier &barrier : memory_barriers[i - 1]) {
+          prev_src_stage_mask |= barrier.src_stage_mask;
+        }
+        for (const TextureBarrier &barrier : texture_barriers[i - 1]) {
+          prev_src_stage_mask |= barrier.src_stage_mask;
+        }
+      }
+      auto can_merge = [&](rhi::PipelineStageMask src_stage_mask) {
+        return (src_stage_mask & prev_src_stage_mask) == src_stage_mask;
+      };
+
+      usize first_split_barrier = pending_split_barriers.m_size;
+      auto get_split_barrier = [&](u32 src_pass) -> RgPendingSplitBarrier & {
+        for (usize j : range(first_split_barrier,
+                             pending_split_barriers.m_size)) {
+          if (pending_split_barriers[j].src_pass == src_pass) {
+            return pending_split_barriers[j];
+          }
+        }
+        pending_split_barriers.push(scratch, {
+                                                 .src_pass = src_pass,
+                                                 .dst_pass = u32(i),
+                                             });
+        return pending_split_barriers.back();
+      };
 
-    rt_pass->memory_barriers =
-        Span<rhi::MemoryBarrier>::allocate(m_arena, memory_barriers.m_size);
-    copy(Span(memory_barriers), rt_pass->memory_barriers.m_data);
+      for (const RgPlacedMemoryBarrier &placed :
+           queue_barriers[i].memory_barriers) {
+        if (placed.src_pass + 1 >= i) {
+          memory_barriers[i].push(scratch, placed.barrier);
+        } else if (can_merge(placed.barrier.src_stage_mask)) {
+          memory_barriers[i - 1].push(scratch, placed.barrier);
+          m_num_merged_barriers++;
+        } else {
+          get_split_barrier(placed.src_pass)
+              .memory_barriers.push(scratch, placed.barrier);
+        }
+      }
+      for (const RgPlacedTextureBarrier &placed :
+           queue_barriers[i].texture_barriers) {
+        if (placed.src_pass + 1 >= i) {
+          texture_barriers[i].push(scratch, placed.barrier);
+        } else if (can_merge(placed.barrier.src_stage_mask)) {
+          texture_barriers[i - 1].push(scratch, placed.barrier);
+          m_num_merged_barriers++;
+        } else {
+          get_split_barrier(placed.src_pass)
+              .texture_barriers.push(scratch, placed.barrier);
+        }
+      }
+    }
 
-    rt_pass->texture_barriers =
-        Span<TextureBarrier>::allocate(m_arena, texture_barriers.m_size);
-    copy(Span(texture_barriers), rt_pass->texture_barriers.m_data);
+    usize split_barrier_i = 0;
+    for (usize i : range(num_passes)) {
+      usize first_split_barrier = split_barrier_i;
+      while (split_barrier_i < pending_split_barriers.m_size and
+             pending_split_barriers[split_barrier_i].dst_pass == i) {
+        split_barrier_i++;
+      }
+      Span<const RgPendingSplitBarrier> wait_split_barriers =
+          Span<const RgPendingSplitBarrier>(pending_split_barriers)
+              .subspan(first_split_barrier,
+                       split_barrier_i - first_split_barrier);
+
+      usize num_memory_barriers = memory_barriers[i].m_size > 0;
+      usize num_texture_barriers = texture_barriers[i].m_size;
+      for (const RgPendingSplitBarrier &split : wait_split_barriers) {
+        num_memory_barriers += split.memory_barriers.m_size > 0;
+        num_texture_barriers += split.texture_barriers.m_size;
+      }
 
-    rt_pass->wait_semaphores =
-        Span<SemaphoreState>::allocate(m_arena, pass->wait_semaphores.m_size);
-    for (usize i : range(pass->wait_semaphores.m_size)) {
-      RgSemaphoreStateId id = pass->wait_semaphores[i];
-      const RgSemaphoreState &state = m_semaphore_states[id];
-      rt_pass->wait_semaphores[i] = {
-          .semaphore = m_rgp->m_semaphores[state.semaphore].handle,
-          .value = state.value,
+      RgRtPass &rt_pass = rt_passes[i];
+      rt_pass.memory_barriers =
+          Span<rhi::MemoryBarrier>::allocate(m_arena, num_memory_barriers);
+      rt_pass.texture_barriers =
+          Span<TextureBarrier>::allocate(m_arena, num_texture_barriers);
+      rt_pass.num_memory_barriers = 0;
+      rt_pass.num_texture_barriers = 0;
+
+      u32 memory_barrier_offset = 0;
+      u32 texture_barrier_offset = 0;
+      auto add_barriers = [&](Span<const rhi::MemoryBarrier> memory,
+                              Span<const TextureBarrier> textures) {
+        // Issue a single memory barrier, since separate barriers might cause
+        // caches to be flushed multiple times.
+        if (memory.m_size > 0) {
+          rhi::MemoryBarrier &merged =
+              rt_pass.memory_barriers[memory_barrier_offset++];
+          merged = {};
+          for (const rhi::MemoryBarrier &barrier : memory) {
+            merged.src_stage_mask |= barrier.src_stage_mask;
+            merged.src_access_mask |= barrier.src_access_mask;
+            merged.dst_stage_mask |= barrier.dst_stage_mask;
+            merged.dst_access_mask |= barrier.dst_access_mask;
+          }
+        }
+        copy(textures,
+             rt_pass.texture_barriers.m_data + texture_barrier_offset);
+        texture_barrier_offset += textures.m_size;
       };
+
+      add_barriers(memory_barriers[i], texture_barriers[i]);
+      rt_pass.num_memory_barriers = memory_barrier_offset;
+      rt_pass.num_texture_barriers = texture_barrier_offset;
+
+      for (const RgPendingSplitBarrier &split : wait_split_barriers) {
+        RgSplitBarrier split_barrier = {
+            .queue = queue,
+            .event = u32(split_barriers.m_size),
+            .src_pass = split.src_pass,
+            .dst_pass = split.dst_pass,
+            .memory_barrier_offset = memory_barrier_offset,
+            .texture_barrier_offset = texture_barrier_offset,
+        };
+        add_barriers(split.memory_barriers, split.texture_barriers);
+        split_barrier.memory_barrier_count =
+            memory_barrier_offset - split_barrier.memory_barrier_offset;
+        split_barrier.texture_barrier_count =
+            texture_barrier_offset - split_barrier.texture_barrier_offset;
+        split_barriers.push(m_arena, split_barrier);
+      }
+    }
+  }
+  m_split_barriers = split_barriers;
+}
+
+void RgBuilder::init_runtime_events() {
+  ScratchArena scratch;
+
+  DynamicArray<Handle<Event>> &events = m_rgp->m_events[m_rgp->m_event_set];
+  m_rgp->m_event_set = (m_rgp->m_event_set + 1) % NUM_RG_EVENT_SETS;
+  while (events.m_size < m_split_barriers.m_size) {
+    events.push(m_rgp->m_arena, m_rgp->m_rcs_arena.create_event());
+  }
+
+  for (RgQueue queue : {RgQueue::Graphics, RgQueue::Async}) {
+    Span<RgRtPass> rt_passes = m_rg.m_gfx_passes;
+    if (queue == RgQueue::Async) {
+      rt_passes = m_rg.m_async_passes;
+    }
+
+    auto num_set_events = Span<u32>::allocate(scratch, rt_passes.m_size);
+    fill(num_set_events, 0);
+    auto num_wait_events = Span<u32>::allocate(scratch, rt_passes.m_size);
+    fill(num_wait_events, 0);
+    for (const RgSplitBarrier &split : m_split_barriers) {
+      if (split.queue == queue) {
+        num_set_events[split.src_pass]++;
+        num_wait_events[split.dst_pass]++;
+      }
     }
-    rt_pass->signal_semaphores =
-        Span<SemaphoreState>::allocate(m_arena, pass->signal_semaphores.m_size);
-    for (usize i : range(pass->signal_semaphores.m_size)) {
-      RgSemaphoreStateId id = pass->signal_semaphores[i];
-      const RgSemaphoreState &state = m_semaphore_states[id];
-      rt_pass->signal_semaphores[i] = {
-          .semaphore = m_rgp->m_semaphores[state.semaphore].handle,
-          .value = state.value,
+
+    for (usize i : range(rt_passes.m_size)) {
+      rt_passes[i].set_events =
+          Span<RgRtEvent>::allocate(m_arena, num_set_events[i]);
+      rt_passes[i].wait_events =
+          Span<RgRtEvent>::allocate(m_arena, num_wait_events[i]);
+      num_set_events[i] = 0;
+      num_wait_events[i] = 0;
+    }
+
+    for (const RgSplitBarrier &split : m_split_barriers) {
+      if (split.queue != queue) {
+        continue;
+      }
+      const RgRtPass &dst_pass = rt_passes[split.dst_pass];
+      RgRtEvent event = {
+          .event = events[split.event],
+          .memory_barriers = dst_pass.memory_barriers.subspan(
+              split.memory_barrier_offset, split.memory_barrier_count),
+          .texture_barriers = dst_pass.texture_barriers.subspan(
+              split.texture_barrier_offset, split.texture_barrier_count),
       };
+      rt_passes[split.src_pass]
+          .set_events[num_set_events[split.src_pass]++] = event;
+      rt_passes[split.dst_pass]
+          .wait_events[num_wait_events[split.dst_pass]++] = event;
+    }
+  }
+}
+
+void RgBuilder::update_barrier_stats() {
+  RgBarrierStats stats = {
+      .num_split_barriers = u32(m_split_barriers.m_size),
+      .num_merged_barriers = m_num_merged_barriers,
+  };
+  Span<const RgRtPass> queue_passes[] = {m_rg.m_gfx_passes,
+                                         m_rg.m_async_passes};
+  for (Span<const RgRtPass> rt_passes : queue_passes) {
+    for (const RgRtPass &rt_pass : rt_passes) {
+      if (rt_pass.num_memory_barriers > 0 or rt_pass.num_texture_barriers > 0) {
+        stats.num_pipeline_barriers++;
+      }
+      stats.num_memory_barriers += rt_pass.memory_barriers.m_size;
+      stats.num_texture_barriers += rt_pass.texture_barriers.m_size;
+      for (const rhi::MemoryBarrier &barrier : rt_pass.memory_barriers) {
+        stats.src_stage_mask |= barrier.src_stage_mask;
+        stats.dst_stage_mask |= barrier.dst_stage_mask;
+      }
+      for (const TextureBarrier &barrier : rt_pass.texture_barriers) {
+        stats.src_stage_mask |= barrier.src_stage_mask;
+        stats.dst_stage_mask |= barrier.dst_stage_mask;
+        if (barrier.src_layout != barrier.dst_layout) {
+          stats.num_layout_transitions++;
+        }
+      }
+    }
+  }
+  m_rgp->m_barrier_stats = stats;
+}
+
+void RgBuilder::init_runtime_semaphores() {
+  for (RgQueue queue : {RgQueue::Graphics, RgQueue::Async}) {
+    Span<const RgPassId> schedule = m_gfx_schedule;
+    Span<RgRtPass> rt_passes = m_rg.m_gfx_passes;
+    if (queue == RgQueue::Async) {
+      schedule = m_async_schedule;
+      rt_passes = m_rg.m_async_passes;
+    }
+    for (usize i : range(schedule.m_size)) {
+      const RgPass &pass = m_passes[schedule[i]];
+      RgRtPass &rt_pass = rt_passes[i];
+      // External semaphores can change between frames, so always look them
+      // up.
+      rt_pass.wait_semaphores =
+          Span<SemaphoreState>::allocate(m_arena, pass.wait_semaphores.m_size);
+      for (usize j : range(pass.wait_semaphores.m_size)) {
+        RgSemaphoreStateId id = pass.wait_semaphores[j];
+        const RgSemaphoreState &state = m_semaphore_states[id];
+        rt_pass.wait_semaphores[j] = {
+            .semaphore = m_rgp->m_semaphores[state.semaphore].handle,
+            .value = state.value,
+        };
+      }
+      rt_pass.signal_semaphores = Span<SemaphoreState>::allocate(
+          m_arena, pass.signal_semaphores.m_size);
+      for (usize j : range(pass.signal_semaphores.m_size)) {
+        RgSemaphoreStateId id = pass.signal_semaphores[j];
+        const RgSemaphoreState &state = m_semaphore_states[id];
+        rt_pass.signal_semaphores[j] = {
+            .semaphore = m_rgp->m_semaphores[state.semaphore].handle,
+            .value = state.value,
+        };
+      }
     }
   }
 }
@@ -1230,21 +3287,60 @@ void RgBuilder::place_barriers_and_semaphores() {
 RenderGraph RgBuilder::build(const RgBuildInfo &build_info) {
   ZoneScoped;
 
+  cull_passes();
+  schedule_queues();
+  reorder_passes();
+
   alloc_textures();
-  alloc_buffers(*build_info.gfx_allocator, *build_info.async_allocator,
-                *build_info.shared_allocator, *build_info.upload_allocator);
+  alloc_buffers(*build_info.upload_allocator);
+
+  // The schedule, barriers and inter-queue synchronization only depend on the
+  // graph's topology, so reuse them from a previous frame if it hasn't
+  // changed.
+  ScratchArena scratch;
+  u64 topology_hash = 0;
+  Span<const u64> topology = serialize_topology(scratch, &topology_hash);
+  init_runtime_passes();
+  const RgCompiledGraph &compiled = m_rgp->m_compiled;
+  if (compiled.valid and topology_hash == compiled.topology_hash and
+      topology.m_size == compiled.topology.m_size and
+      std::ranges::equal(topology, compiled.topology)) {
+    load_compiled_graph();
+  } else {
+    ZoneScopedN("RgBuilder::compile");
 
-  add_inter_queue_semaphores();
+    add_inter_queue_semaphores();
+    place_barriers();
+    update_barrier_stats();
+    save_compiled_graph(topology_hash, topology);
 
 #if 0
-  dump_pass_schedule();
+    dump_pass_schedule();
 #endif
+  }
 
-  init_runtime_passes();
   init_runtime_buffers();
   init_runtime_textures();
+  init_runtime_semaphores();
+  init_runtime_events();
 
-  place_barriers_and_semaphores();
+  // The queue timelines have been advanced past this frame, so dedicated
+  // buffers are released once it completes.
+  for (Handle<Buffer> buffer : m_dedicated_buffers) {
+    m_rgp->retire(buffer);
+  }
+
+  const RgBarrierStats &barrier_stats = m_rgp->m_barrier_stats;
+  TracyPlot("Render graph pipeline barriers",
+            i64(barrier_stats.num_pipeline_barriers));
+  TracyPlot("Render graph memory barriers",
+            i64(barrier_stats.num_memory_barriers));
+  TracyPlot("Render graph texture barriers",
+            i64(barrier_stats.num_texture_barriers));
+  TracyPlot("Render graph split barriers",
+            i64(barrier_stats.num_split_barriers));
+  TracyPlot("Render graph merged barriers",
+            i64(barrier_stats.num_merged_barriers));
 
   for (RgTextureId texture : m_frame_textures) {
     m_rgp->m_textures.erase(texture);
@@ -1361,105 +3457,257 @@ void RgPassBuilder::signal_semaphore(RgSemaphoreId semaphore, u64 value) {
   m_builder->signal_semaphore(m_pass, semaphore, value);
 }
 
+namespace {
+
+constexpr usize MIN_NUM_PASSES_PER_RG_RECORDING_JOB = 4;
+
+void record_pass(Renderer &renderer, const RgRuntime &rt, CommandRecorder &cmd,
+                 const RgRtPass &pass) {
+  ZoneScopedN("RenderGraph::execute_pass");
+  ZoneText(pass.name.m_str, pass.name.m_size);
+
+  DebugRegion debug_region = cmd.debug_region(pass.name);
+
+  for (const RgRtEvent &event : pass.wait_events) {
+    cmd.wait_event(event.event, event.memory_barriers, event.texture_barriers);
+    cmd.reset_event(event.event);
+  }
+  if (pass.num_memory_barriers > 0 or pass.num_texture_barriers > 0) {
+    cmd.pipeline_barrier(
+        pass.memory_barriers.subspan(0, pass.num_memory_barriers),
+        pass.texture_barriers.subspan(0, pass.num_texture_barriers));
+  }
+
+  if (pass.rp_cb) {
+    glm::uvec2 viewport = {-1, -1};
+
+    RenderTarget render_targets[rhi::MAX_NUM_RENDER_TARGETS];
+    for (usize i : range(pass.render_targets.m_size)) {
+      const RgRenderTarget &rdt = pass.render_targets[i];
+      if (!rdt.texture) {
+        continue;
+      }
+      Handle<Texture> texture = rt.get_texture(rdt.texture);
+      viewport = renderer.get_texture(texture).size,
+      render_targets[i] = {.rtv = {texture}, .ops = rdt.ops};
+    }
+
+    DepthStencilTarget depth_stencil_target;
+    if (pass.depth_stencil_target.texture) {
+      Handle<Texture> texture =
+          rt.get_texture(pass.depth_stencil_target.texture);
+      viewport = renderer.get_texture(texture).size,
+      depth_stencil_target = {
+          .dsv = {texture},
+          .ops = pass.depth_stencil_target.ops,
+      };
+    }
+
+    RenderPass render_pass = cmd.render_pass({
+        .render_targets = Span(render_targets, pass.render_targets.m_size),
+        .depth_stencil_target = depth_stencil_target,
+    });
+    render_pass.set_viewports({{.size = viewport}});
+    render_pass.set_scissor_rects({{.size = viewport}});
+
+    pass.rp_cb(renderer, rt, render_pass);
+  } else {
+    pass.cb(renderer, rt, cmd);
+  }
+
+  for (const RgRtEvent &event : pass.set_events) {
+    cmd.set_event(event.event, event.memory_barriers, event.texture_barriers);
+  }
+}
+
+// Contiguous range of passes of a queue that is recorded by a single job.
+struct RgRecordingSegment {
+  const RenderGraph *rg = nullptr;
+  Handle<CommandPool> cmd_pool;
+  Span<const RgRtPass> passes;
+  // Submit batch of each pass.
+  Span<const u32> pass_batches;
+  // A new command buffer is started for each submit batch.
+  Span<rhi::CommandBuffer> cmd_buffers;
+  Span<u32> cmd_buffer_batches;
+  usize num_cmd_buffers = 0;
+  // Timestamps are written before and after each pass if GPU profiling is
+  // enabled.
+  rhi::QueryPool query_pool = {};
+  u32 first_query = 0;
+};
+
+void record_segment(RgRecordingSegment &segment) {
+  ZoneScopedN("RenderGraph::record_segment");
+
+  RgRuntime rt;
+  rt.m_rg = segment.rg;
+  Renderer &renderer = *segment.rg->m_renderer;
+
+  CommandRecorder cmd;
+  for (usize i : range(segment.passes.m_size)) {
+    if (cmd and segment.pass_batches[i] != segment.pass_batches[i - 1]) {
+      segment.cmd_buffers[segment.num_cmd_buffers++] = cmd.end();
+    }
+    if (!cmd) {
+      cmd.begin(renderer, segment.cmd_pool);
+      segment.cmd_buffer_batches[segment.num_cmd_buffers] =
+          segment.pass_batches[i];
+    }
+    if (segment.query_pool) {
+      cmd.write_timestamp(segment.query_pool, segment.first_query + 2 * i);
+    }
+    record_pass(renderer, rt, cmd, segment.passes[i]);
+    if (segment.query_pool) {
+      cmd.write_timestamp(segment.query_pool,
+                          segment.first_query + 2 * i + 1);
+    }
+  }
+  if (cmd) {
+    segment.cmd_buffers[segment.num_cmd_buffers++] = cmd.end();
+  }
+}
+
+} // namespace
+
 void execute(const RenderGraph &rg, const RgExecuteInfo &exec_info) {
   ZoneScoped;
 
+  ScratchArena scratch;
+
   RgRuntime rt;
   rt.m_rg = &rg;
 
-  for (rhi::QueueFamily queue_family :
-       {rhi::QueueFamily::Graphics, rhi::QueueFamily::Compute}) {
-    ZoneScopedN("RenderGraph::submit_queue");
+  rhi::QueueFamily queue_families[] = {rhi::QueueFamily::Graphics,
+                                       rhi::QueueFamily::Compute};
+  Span<const RgRtPass> queue_passes[] = {rg.m_gfx_passes, rg.m_async_passes};
+  Span<const Handle<CommandPool>> queue_cmd_pools[] = {
+      exec_info.gfx_cmd_pools, exec_info.async_cmd_pools};
+  Span<u32> queue_pass_batches[std::size(queue_families)];
+  Span<RgRecordingSegment> queue_segments[std::size(queue_families)];
 
-    CommandRecorder cmd;
-    Span<const SemaphoreState> batch_wait_semaphores;
-    Span<const SemaphoreState> batch_signal_semaphores;
+  DynamicArray<RgRecordingSegment *> all_segments;
 
-    auto submit_batch = [&]() {
-      if (!cmd and batch_wait_semaphores.m_size == 0 and
-          batch_signal_semaphores.m_size == 0) {
-        return;
-      }
-      ren_assert(cmd);
-      rg.m_renderer->submit(queue_family, {cmd.end()}, batch_wait_semaphores,
-                            batch_signal_semaphores);
-      batch_wait_semaphores = {};
-      batch_signal_semaphores = {};
-    };
+  RgTimestampFrame *timestamps =
+      rg.m_rgp->begin_timestamp_frame(rg.m_gfx_passes, rg.m_async_passes);
 
-    Span<const RgRtPass> passes = rg.m_gfx_passes;
-    Handle<CommandPool> cmd_pool = exec_info.gfx_cmd_pool;
-    if (queue_family == rhi::QueueFamily::Compute) {
-      passes = rg.m_async_passes;
-      cmd_pool = exec_info.async_cmd_pool;
+  for (usize q : range(std::size(queue_families))) {
+    Span<const RgRtPass> passes = queue_passes[q];
+    if (passes.m_size == 0) {
+      continue;
     }
 
-    for (const RgRtPass &pass : passes) {
-      ZoneScopedN("RenderGraph::execute_pass");
-      ZoneText(pass.name.m_str, pass.name.m_size);
-      if (pass.wait_semaphores.m_size > 0) {
-        submit_batch();
-        batch_wait_semaphores = pass.wait_semaphores;
+    // Passes are submitted in batches. A batch starts with a pass that waits
+    // for semaphores and ends with a pass that signals them.
+    auto pass_batches = Span<u32>::allocate(scratch, passes.m_size);
+    u32 batch = 0;
+    for (usize i : range(passes.m_size)) {
+      if (i > 0 and (passes[i].wait_semaphores.m_size > 0 or
+                     passes[i - 1].signal_semaphores.m_size > 0)) {
+        batch++;
       }
+      pass_batches[i] = batch;
+    }
+    queue_pass_batches[q] = pass_batches;
 
-      if (!cmd) {
-        cmd.begin(*rg.m_renderer, cmd_pool);
+    // Image views are created lazily and the renderer isn't thread-safe, so
+    // create render target views up front.
+    for (const RgRtPass &pass : passes) {
+      if (!pass.rp_cb) {
+        continue;
       }
-
-      {
-        DebugRegion debug_region = cmd.debug_region(pass.name);
-
-        if (pass.memory_barriers.m_size > 0 or
-            pass.texture_barriers.m_size > 0) {
-          cmd.pipeline_barrier(pass.memory_barriers, pass.texture_barriers);
+      for (const RgRenderTarget &rdt : pass.render_targets) {
+        if (rdt.texture) {
+          rg.m_renderer->get_rtv({rt.get_texture(rdt.texture)});
         }
+      }
+      if (pass.depth_stencil_target.texture) {
+        rg.m_renderer->get_rtv(
+            {rt.get_texture(pass.depth_stencil_target.texture)});
+      }
+    }
 
-        if (pass.rp_cb) {
-          glm::uvec2 viewport = {-1, -1};
+    Span<const Handle<CommandPool>> cmd_pools = queue_cmd_pools[q];
+    ren_assert(cmd_pools.m_size > 0);
+    usize num_segments =
+        min(cmd_pools.m_size,
+            ceil_div(passes.m_size, MIN_NUM_PASSES_PER_RG_RECORDING_JOB));
+    usize segment_size = ceil_div(passes.m_size, num_segments);
+    num_segments = ceil_div(passes.m_size, segment_size);
+
+    rhi::QueryPool query_pool = {};
+    u32 first_query = 0;
+    if (timestamps and timestamps->first_queries[q] != u32(-1)) {
+      query_pool = timestamps->query_pool;
+      first_query = timestamps->first_queries[q];
+    }
 
-          RenderTarget render_targets[rhi::MAX_NUM_RENDER_TARGETS];
-          for (usize i : range(pass.render_targets.m_size)) {
-            const RgRenderTarget &rdt = pass.render_targets[i];
-            if (!rdt.texture) {
-              continue;
-            }
-            Handle<Texture> texture = rt.get_texture(rdt.texture);
-            viewport = rg.m_renderer->get_texture(texture).size,
-            render_targets[i] = {.rtv = {texture}, .ops = rdt.ops};
-          }
+    auto segments = Span<RgRecordingSegment>::allocate(scratch, num_segments);
+    for (usize s : range(num_segments)) {
+      usize begin = s * segment_size;
+      usize count = min(segment_size, passes.m_size - begin);
+      segments[s] = {
+          .rg = &rg,
+          .cmd_pool = cmd_pools[s],
+          .passes = passes.subspan(begin, count),
+          .pass_batches = pass_batches.subspan(begin, count),
+          .cmd_buffers = Span<rhi::CommandBuffer>::allocate(scratch, count),
+          .cmd_buffer_batches = Span<u32>::allocate(scratch, count),
+          .query_pool = query_pool,
+          .first_query = u32(first_query + 2 * begin),
+      };
+      all_segments.push(scratch, &segments[s]);
+    }
+    queue_segments[q] = segments;
+  }
 
-          DepthStencilTarget depth_stencil_target;
-          if (pass.depth_stencil_target.texture) {
-            Handle<Texture> texture =
-                rt.get_texture(pass.depth_stencil_target.texture);
-            viewport = rg.m_renderer->get_texture(texture).size,
-            depth_stencil_target = {
-                .dsv = {texture},
-                .ops = pass.depth_stencil_target.ops,
-            };
-          }
+  if (all_segments.m_size == 1) {
+    record_segment(*all_segments[0]);
+  } else if (all_segments.m_size > 1) {
+    auto jobs = Span<JobDesc>::allocate(scratch, all_segments.m_size);
+    for (usize i : range(all_segments.m_size)) {
+      RgRecordingSegment *segment = all_segments[i];
+      jobs[i] = JobDesc::init(scratch, "Record render graph passes",
+                              [segment] { record_segment(*segment); });
+    }
+    job_dispatch_and_wait(jobs);
+  }
 
-          RenderPass render_pass = cmd.render_pass({
-              .render_targets =
-                  Span(render_targets, pass.render_targets.m_size),
-              .depth_stencil_target = depth_stencil_target,
-          });
-          render_pass.set_viewports({{.size = viewport}});
-          render_pass.set_scissor_rects({{.size = viewport}});
+  // Submit command buffers in pass order.
+  for (usize q : range(std::size(queue_families))) {
+    ZoneScopedN("RenderGraph::submit_queue");
 
-          pass.rp_cb(*rg.m_renderer, rt, render_pass);
-        } else {
-          pass.cb(*rg.m_renderer, rt, cmd);
-        }
+    Span<const RgRtPass> passes = queue_passes[q];
+    Span<const u32> pass_batches = queue_pass_batches[q];
+
+    DynamicArray<rhi::CommandBuffer> batch_cmd_buffers;
+    usize batch_begin = 0;
+    auto submit_batch = [&]() {
+      ren_assert(batch_cmd_buffers.m_size > 0);
+      usize batch_end = batch_begin;
+      while (batch_end < passes.m_size and
+             pass_batches[batch_end] == pass_batches[batch_begin]) {
+        batch_end++;
       }
+      rg.m_renderer->submit(queue_families[q], batch_cmd_buffers,
+                            passes[batch_begin].wait_semaphores,
+                            passes[batch_end - 1].signal_semaphores);
+      batch_cmd_buffers.clear();
+      batch_begin = batch_end;
+    };
 
-      if (pass.signal_semaphores.m_size > 0) {
-        batch_signal_semaphores = pass.signal_semaphores;
-        submit_batch();
+    for (const RgRecordingSegment &segment : queue_segments[q]) {
+      for (usize i : range(segment.num_cmd_buffers)) {
+        if (batch_cmd_buffers.m_size > 0 and
+            segment.cmd_buffer_batches[i] != pass_batches[batch_begin]) {
+          submit_batch();
+        }
+        batch_cmd_buffers.push(scratch, segment.cmd_buffers[i]);
       }
     }
-
-    submit_batch();
+    if (batch_cmd_buffers.m_size > 0) {
+      submit_batch();
+    }
   }
 
   if (exec_info.frame_end_semaphore) {
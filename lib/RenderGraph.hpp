@@ -8,7 +8,10 @@
 #include "core/NewType.hpp"
 #include "ren/core/Algorithm.hpp"
 #include "ren/core/Array.hpp"
+#include "ren/core/FileSystem.hpp"
 #include "ren/core/GenArray.hpp"
+#include "ren/core/HashMap.hpp"
+#include "ren/core/Mutex.hpp"
 #include "ren/core/NotNull.hpp"
 #include "ren/core/Optional.hpp"
 #include "ren/core/String.hpp"
@@ -163,6 +166,10 @@ struct RgDepthStencilTarget {
 
 struct RgPass {
   String8 name;
+  /// Pass names aren't unique, so passes are identified across frames by their
+  /// name and by the number of passes with the same name created before them.
+  u64 key = 0;
+  u32 index = 0;
   RgRenderPassCallback rp_cb;
   RgCallback cb;
   RgQueue queue = {};
@@ -209,6 +216,12 @@ struct RgBuffer {
   RgUntypedBufferId child;
 };
 
+/// Buffers that share memory.
+struct RgBufferAlias {
+  RgPhysicalBufferId lhs;
+  RgPhysicalBufferId rhs;
+};
+
 struct RgBufferUse {
   RgUntypedBufferId buffer;
   u32 offset = 0;
@@ -244,6 +257,8 @@ struct RgPhysicalTexture {
   u32 num_mips = 1;
   u32 num_layers = 1;
   Handle<Texture> handle;
+  /// The texture is placed into the shared transient memory block.
+  bool aliased = false;
   rhi::ImageLayout layout = rhi::ImageLayout::Undefined;
   RgTextureId id;
   RgQueue last_queue = RgQueue::None;
@@ -252,6 +267,34 @@ struct RgPhysicalTexture {
   u64 time = 0;
 };
 
+/// Memory requirements and lifetime of a transient texture or buffer.
+struct RgTransientResource {
+  usize size = 0;
+  usize alignment = 1;
+  /// First and last passes in the schedule of the resource's queue that use
+  /// it. Resources that can't be aliased have an empty lifetime.
+  u32 first_pass = -1;
+  u32 last_pass = 0;
+};
+
+struct RgTransientMemoryStats {
+  /// Peak memory usage if each transient texture has its own allocation.
+  usize dedicated_size = 0;
+  /// Peak memory usage if transient textures with disjoint lifetimes alias.
+  usize aliased_size = 0;
+};
+
+/// Place transient resources with overlapping lifetimes at non-overlapping
+/// offsets. Returns the size of the memory block required to hold them.
+auto rg_pack_transient_resources(Span<const RgTransientResource> resources,
+                                 Span<usize> offsets) -> usize;
+
+/// Textures that share memory.
+struct RgTextureAlias {
+  RgPhysicalTextureId lhs;
+  RgPhysicalTextureId rhs;
+};
+
 struct RgTexture {
   String8 name;
   RgPhysicalTextureId parent;
@@ -320,18 +363,215 @@ struct RgSemaphoreState {
   u64 value = 0;
 };
 
+/// Half of a split barrier.
+struct RgRtEvent {
+  Handle<Event> event;
+  Span<const rhi::MemoryBarrier> memory_barriers;
+  Span<const TextureBarrier> texture_barriers;
+};
+
 struct RgRtPass {
   String8 name;
+  u64 key = 0;
+  u32 index = 0;
   RgRenderPassCallback rp_cb;
   RgCallback cb;
+  /// Barriers that are issued before the pass come first, followed by the
+  /// barriers of the events that the pass waits for.
   Span<rhi::MemoryBarrier> memory_barriers;
   Span<TextureBarrier> texture_barriers;
+  u32 num_memory_barriers = 0;
+  u32 num_texture_barriers = 0;
+  /// Events that are set after the pass.
+  Span<RgRtEvent> set_events;
+  /// Events that are waited for before the pass.
+  Span<RgRtEvent> wait_events;
   Span<SemaphoreState> wait_semaphores;
   Span<SemaphoreState> signal_semaphores;
   Span<const RgRenderTarget> render_targets;
   RgDepthStencilTarget depth_stencil_target;
 };
 
+/// Barrier whose source and destination halves are recorded after and before
+/// two different passes on the same queue, so that the passes in between can
+/// overlap with it.
+struct RgSplitBarrier {
+  RgQueue queue = RgQueue::None;
+  /// Index of the barrier's event in the frame's event set.
+  u32 event = 0;
+  /// Indices of the passes in the queue's schedule.
+  u32 src_pass = 0;
+  u32 dst_pass = 0;
+  /// Barriers are stored after the destination pass's own barriers.
+  u32 memory_barrier_offset = 0;
+  u32 memory_barrier_count = 0;
+  u32 texture_barrier_offset = 0;
+  u32 texture_barrier_count = 0;
+};
+
+/// Barriers and inter-queue synchronization of a pass from a previous build.
+struct RgCompiledPass {
+  Span<rhi::MemoryBarrier> memory_barriers;
+  Span<TextureBarrier> texture_barriers;
+  u32 num_memory_barriers = 0;
+  u32 num_texture_barriers = 0;
+  /// Texture handles can change between frames, so barriers are patched with
+  /// the current handles of these textures.
+  Span<RgPhysicalTextureId> texture_barrier_textures;
+  bool wait = false;
+  bool signal = false;
+  /// Relative to the other queue's timeline value at the start of the frame.
+  i64 wait_time = 0;
+};
+
+/// State of a physical texture at the end of a frame.
+struct RgCompiledTexture {
+  rhi::ImageLayout layout = rhi::ImageLayout::Undefined;
+  RgQueue last_queue = RgQueue::None;
+  /// Relative to the queue's timeline value at the start of the frame.
+  i64 last_time = 0;
+};
+
+/// Render graph compilation results that can be reused by following frames
+/// with the same topology.
+struct RgCompiledGraph {
+  bool valid = false;
+  u64 topology_hash = 0;
+  /// Everything that went into the topology hash, to tell apart topologies
+  /// whose hashes collide.
+  Span<const u64> topology;
+  Span<RgCompiledPass> gfx_passes;
+  Span<RgCompiledPass> async_passes;
+  Span<RgSplitBarrier> split_barriers;
+  u32 num_merged_barriers = 0;
+  Span<RgCompiledTexture> textures;
+};
+
+struct RgBarrierStats {
+  /// Number of pipeline barrier commands.
+  u32 num_pipeline_barriers = 0;
+  u32 num_memory_barriers = 0;
+  u32 num_texture_barriers = 0;
+  u32 num_layout_transitions = 0;
+  /// Number of event set and wait command pairs.
+  u32 num_split_barriers = 0;
+  /// Number of barriers that were moved into the previous pass's barriers.
+  u32 num_merged_barriers = 0;
+  rhi::PipelineStageMask src_stage_mask;
+  rhi::PipelineStageMask dst_stage_mask;
+};
+
+/// GPU time of a pass, averaged over recent frames.
+struct RgPassCost {
+  /// Passes with the same name are numbered after the first one.
+  String8 name;
+  /// Average time in nanoseconds when the pass runs on the graphics and on the
+  /// async compute queue, or 0 if it hasn't been measured yet.
+  float gfx_time = 0.0f;
+  float async_time = 0.0f;
+  /// Queue that the pass was created for and queue that it was scheduled on
+  /// in the last frame.
+  RgQueue requested_queue = RgQueue::None;
+  RgQueue queue = RgQueue::None;
+};
+
+/// Estimated GPU time of the last frame if compute passes ran on the queues
+/// that they were created for, and with the queues picked by the scheduler.
+struct RgQueueSchedulingStats {
+  float requested_time = 0.0f;
+  float scheduled_time = 0.0f;
+  u32 num_moved_to_gfx = 0;
+  u32 num_moved_to_async = 0;
+};
+
+/// GPU resources that the render graph doesn't use anymore but that might still
+/// be in use by frames in flight. They are destroyed once both queue timelines
+/// reach the values that they had when the resources were retired.
+struct RgRetiredResource {
+  Handle<Texture> texture;
+  Handle<Buffer> buffer;
+  rhi::Allocation memory;
+  u64 gfx_time = 0;
+  u64 async_time = 0;
+};
+
+/// Buffer that transient buffers accessed by the same queues are placed into.
+/// Its size follows the peak usage of recent frames, and it is released after
+/// it hasn't been used for a while.
+struct RgBufferPool {
+  Handle<Buffer> buffer;
+  usize size = 0;
+  /// Decays every frame so that the pool can shrink after a usage spike.
+  usize high_water_mark = 0;
+  u32 num_idle_frames = 0;
+};
+
+/// Pools of buffers that are only accessed on the graphics queue, on the async
+/// compute queue, and on both. Buffers of consecutive frames that are shared
+/// between queues use different pools, since a frame's graphics work can start
+/// before the async compute work of the previous frame has finished.
+enum RgBufferPoolId {
+  RG_GFX_BUFFER_POOL,
+  RG_ASYNC_BUFFER_POOL,
+  RG_SHARED_BUFFER_POOL,
+  NUM_RG_BUFFER_POOLS = RG_SHARED_BUFFER_POOL + 2,
+};
+
+/// Default number of frames after which an unused buffer pool is released.
+constexpr u32 RG_BUFFER_POOL_IDLE_FRAMES = 256;
+
+/// Split barriers of consecutive frames use different events so that a frame
+/// never sets an event that the previous one might not have reset yet.
+constexpr usize NUM_RG_EVENT_SETS = 2;
+
+/// Number of frames that GPU time statistics are kept for.
+constexpr usize RG_PASS_TIMING_HISTORY = 128;
+
+/// GPU time of a pass in recent frames.
+struct RgPassTiming {
+  /// Numbered like in RgPassCost and zero-terminated for Tracy.
+  String8 name;
+  /// Queue that the pass ran on in the last measured frame.
+  RgQueue queue = RgQueue::None;
+  /// Total number of measured frames. Times are in nanoseconds and are stored
+  /// in a ring buffer.
+  u32 num_samples = 0;
+  float history[RG_PASS_TIMING_HISTORY] = {};
+  /// Tracy source location of the pass's GPU zones.
+  u64 tracy_source_location = 0;
+};
+
+struct RgPassTimingStats {
+  float last = 0.0f;
+  float average = 0.0f;
+  float min = 0.0f;
+  float max = 0.0f;
+};
+
+auto get_pass_timing_stats(const RgPassTiming &timing) -> RgPassTimingStats;
+
+struct RgTimedPass {
+  u64 key = 0;
+  RgQueue queue = RgQueue::None;
+};
+
+/// Timestamps that are written before and after each pass of a frame. Queries
+/// of the i-th timed pass are 2 * i and 2 * i + 1.
+struct RgTimestampFrame {
+  rhi::QueryPool query_pool = {};
+  u32 num_queries = 0;
+  DynamicArray<RgTimedPass> passes;
+  /// First query of the graphics and of the async compute queue's passes, or
+  /// -1 if the queue can't write timestamps.
+  u32 first_queries[2] = {};
+  /// Set until the timestamps have been read back.
+  bool pending = false;
+};
+
+/// Timestamps are read back without waiting, so a frame's queries are reused
+/// only after all frames that might still be in flight.
+constexpr usize NUM_RG_TIMESTAMP_FRAMES = 3;
+
 struct RgPersistent {
   Arena *m_arena = nullptr;
   ResourceArena m_rcs_arena;
@@ -339,9 +579,47 @@ struct RgPersistent {
   DynamicArray<RgPhysicalTexture> m_physical_textures;
   GenArray<RgTexture> m_textures;
 
+  rhi::Allocation m_transient_memory;
+  DynamicArray<RgTextureAlias> m_texture_aliases;
+  RgTransientMemoryStats m_transient_memory_stats;
+
+  // Textures from before the last reset that textures created with the same
+  // parameters can take over instead of being allocated again.
+  DynamicArray<RgPhysicalTexture> m_reusable_textures;
+  DynamicArray<RgRetiredResource> m_retired_resources;
+
+  RgBufferPool m_buffer_pools[NUM_RG_BUFFER_POOLS];
+  u32 m_shared_buffer_pool = 0;
+  u32 m_buffer_pool_idle_frames = RG_BUFFER_POOL_IDLE_FRAMES;
+  /// Debug: act as if buffer pools can't be allocated.
+  bool m_buffer_pool_failure = false;
+
+  Arena m_compiled_arena;
+  RgCompiledGraph m_compiled;
+
+  DynamicArray<Handle<Event>> m_events[NUM_RG_EVENT_SETS];
+  u32 m_event_set = 0;
+  RgBarrierStats m_barrier_stats;
+
+  // Passes can allocate upload memory while they are recorded in parallel.
+  Mutex m_upload_allocator_mutex;
+
   GenArray<RgSemaphore> m_semaphores;
 
   bool m_async_compute = false;
+  /// Move compute passes between the graphics and async compute queues based
+  /// on their measured cost.
+  bool m_async_compute_scheduling = true;
+  HashMap<u64, RgPassCost> m_pass_costs;
+  RgQueueSchedulingStats m_queue_scheduling_stats;
+
+  /// Write timestamps around each pass and read them back a few frames later.
+  bool m_gpu_profiling = false;
+  RgTimestampFrame m_timestamp_frames[NUM_RG_TIMESTAMP_FRAMES];
+  u64 m_timestamp_frame = 0;
+  HashMap<u64, RgPassTiming> m_pass_timings;
+  bool m_tracy_gpu_contexts[2] = {};
+  u16 m_tracy_gpu_query = 0;
 
   Handle<Semaphore> m_gfx_semaphore;
   Handle<Semaphore> m_async_semaphore;
@@ -361,10 +639,44 @@ public:
 
   [[nodiscard]] auto create_semaphore(String8 name) -> RgSemaphoreId;
 
+  /// Forget all textures and semaphores, but keep GPU resources around so that
+  /// the next build can reuse them. Ones that it doesn't reuse are retired
+  /// instead of waiting for the GPU to become idle.
+  void reset();
+
+  void retire(Handle<Texture> texture);
+
+  void retire(Handle<Buffer> buffer);
+
+  void retire(rhi::Allocation memory);
+
+  /// Destroy retired resources that the GPU has finished using.
+  void release_retired_resources();
+
+  /// Add a GPU time measurement of a pass that ran on a queue.
+  void record_pass_time(u64 pass, String8 name, RgQueue queue, float time);
+
+  /// Process timestamps of earlier frames that the GPU has finished writing,
+  /// and get the queries that this frame's passes should write. Returns null
+  /// if GPU profiling is disabled or if no queries are free.
+  auto begin_timestamp_frame(Span<const RgRtPass> gfx_passes,
+                             Span<const RgRtPass> async_passes)
+      -> RgTimestampFrame *;
+
+  /// Write statistics of pass GPU times as CSV.
+  [[nodiscard]] IoResult<void> write_pass_timings_csv(Path path) const;
+
+  /// Make sure that a buffer pool can hold this frame's buffers, shrinking it
+  /// if its peak usage has gone down and releasing it if it has been idle for
+  /// long enough. Returns false if the pool's buffer couldn't be created.
+  bool update_buffer_pool(RgBufferPoolId pool, usize size);
+
   void destroy();
 
 private:
   void rotate_textures();
+
+  bool read_timestamps(RgTimestampFrame &frame);
 };
 
 struct RgRtTexture {
@@ -389,9 +701,13 @@ struct RenderGraph {
   Span<RgRtTexture> m_textures;
 };
 
+constexpr usize MAX_NUM_RG_RECORDING_JOBS = 8;
+
 struct RgExecuteInfo {
-  Handle<CommandPool> gfx_cmd_pool;
-  Handle<CommandPool> async_cmd_pool;
+  /// Passes of each queue are split into at most as many contiguous segments
+  /// as there are command pools, and segments are recorded in parallel.
+  Span<const Handle<CommandPool>> gfx_cmd_pools;
+  Span<const Handle<CommandPool>> async_cmd_pools;
   Handle<Semaphore> *frame_end_semaphore = nullptr;
   u64 *frame_end_time = nullptr;
 };
@@ -399,9 +715,6 @@ struct RgExecuteInfo {
 void execute(const RenderGraph &rg, const RgExecuteInfo &execute_info);
 
 struct RgBuildInfo {
-  DeviceBumpAllocator *gfx_allocator = nullptr;
-  DeviceBumpAllocator *async_allocator = nullptr;
-  DeviceBumpAllocator *shared_allocator = nullptr;
   UploadBumpAllocator *upload_allocator = nullptr;
 };
 
@@ -422,18 +735,28 @@ struct RgBuilder {
   RenderGraph m_rg;
 
   GenArray<RgPass> m_passes;
+  /// Number of passes created with each name hash.
+  HashMap<u64, u32> m_pass_name_counts;
   DynamicArray<RgPassId> m_gfx_schedule;
   DynamicArray<RgPassId> m_async_schedule;
 
   GenArray<RgBuffer> m_buffers;
   DynamicArray<RgPhysicalBuffer> m_physical_buffers;
   DynamicArray<RgBufferUse> m_buffer_uses;
+  DynamicArray<RgBufferAlias> m_buffer_aliases;
+  /// Buffers that were created for this frame only because a buffer pool
+  /// couldn't be allocated.
+  DynamicArray<Handle<Buffer>> m_dedicated_buffers;
 
   DynamicArray<RgTextureUse> m_texture_uses;
   DynamicArray<RgTextureId> m_frame_textures;
 
   DynamicArray<RgSemaphoreState> m_semaphore_states;
 
+  DynamicArray<String8> m_culled_passes;
+  Span<const RgSplitBarrier> m_split_barriers;
+  u32 m_num_merged_barriers = 0;
+
 public:
   void init(NotNull<Arena *> arena, NotNull<RgPersistent *> rgp,
             NotNull<Renderer *> renderer,
@@ -495,6 +818,11 @@ public:
 
   RenderGraph build(const RgBuildInfo &build_info);
 
+  /// Estimate transient texture memory usage from the pass list without
+  /// querying the device.
+  [[nodiscard]] auto estimate_transient_memory() const
+      -> RgTransientMemoryStats;
+
 private:
   friend RgPassBuilder;
 
@@ -544,15 +872,45 @@ private:
     pass.cb.init(m_arena, std::forward<F>(cb));
   }
 
+  void cull_passes();
+
+  /// Call cb(pass_id, dependency) for each pass that must run before a pass
+  /// because it writes a resource that the pass uses, and cb(successor,
+  /// pass_id) for each pass that must run after it because it overwrites a
+  /// resource that the pass reads.
+  template <typename F>
+  void for_each_resource_dependency(RgPassId pass_id, F &&cb) const;
+
+  void schedule_queues();
+
+  void reorder_passes();
+
+  void get_transient_texture_lifetimes(
+      Span<RgTransientResource> transient_textures) const;
+
   void alloc_textures();
 
-  void alloc_buffers(DeviceBumpAllocator &gfx_allocator,
-                     DeviceBumpAllocator &async_allocator,
-                     DeviceBumpAllocator &shared_allocator,
-                     UploadBumpAllocator &upload_allocator);
+  void get_transient_buffer_lifetimes(
+      Span<RgTransientResource> transient_buffers) const;
+
+  /// Create a buffer for each transient buffer when their pool can't be
+  /// allocated.
+  void alloc_dedicated_buffers(
+      Span<const RgTransientResource> transient_buffers);
+
+  void alloc_buffers(UploadBumpAllocator &upload_allocator);
 
   void add_inter_queue_semaphores();
 
+  void place_inter_queue_semaphores();
+
+  [[nodiscard]] auto serialize_topology(NotNull<Arena *> arena,
+                                        u64 *hash) const -> Span<const u64>;
+
+  void save_compiled_graph(u64 topology_hash, Span<const u64> topology);
+
+  void load_compiled_graph();
+
   void dump_pass_schedule() const;
 
   void init_runtime_passes();
@@ -561,7 +919,13 @@ private:
 
   void init_runtime_textures();
 
-  void place_barriers_and_semaphores();
+  void place_barriers();
+
+  void init_runtime_semaphores();
+
+  void init_runtime_events();
+
+  void update_barrier_stats();
 };
 
 struct RgRuntime {
@@ -647,6 +1011,7 @@ public:
 
   template <typename T = std::byte>
   auto allocate(usize count = 1) const -> UploadBumpAllocation<T> {
+    AutoMutex lock(m_rg->m_rgp->m_upload_allocator_mutex);
     return get_allocator().allocate<T>(count);
   }
 
@@ -189,6 +189,9 @@ Renderer::create_texture(const TextureCreateInfo &create_info) {
                                       .cube_map = create_info.cube_map,
                                       .num_mips = create_info.num_mips,
                                       .num_layers = create_info.num_layers,
+                                      .allocation = create_info.allocation,
+                                      .allocation_offset =
+                                          create_info.allocation_offset,
                                   });
   if (!image) {
     return image.error();
@@ -234,6 +237,7 @@ auto Renderer::create_external_texture(
                                         .depth = create_info.depth,
                                         .num_mips = create_info.num_mips,
                                         .num_layers = create_info.num_layers,
+                                        .external = true,
                                         .views = views,
                                     });
 }
@@ -251,7 +255,7 @@ void Renderer::destroy(Handle<Texture> handle) {
   }
   last->next = m_image_view_free_list;
   m_image_view_free_list = texture.views;
-  if (rhi::get_allocation(m_device, texture.handle)) {
+  if (!texture.external) {
     rhi::destroy_image(m_device, texture.handle);
   }
 }
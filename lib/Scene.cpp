@@ -1,6 +1,7 @@
 #include "Scene.hpp"
 #include "CommandRecorder.hpp"
 #include "Formats.hpp"
+#include "SceneSnapshot.hpp"
 #include "SwapChain.hpp"
 #include "passes/HiZ.hpp"
 #include "passes/ImGui.hpp"
@@ -10,18 +11,24 @@
 #include "passes/Present.hpp"
 #include "passes/Skybox.hpp"
 #include "ren/core/Algorithm.hpp"
+#include "ren/core/Chrono.hpp"
 #include "ren/core/Format.hpp"
 #include "ren/core/Job.hpp"
 #include "ren/core/Span.hpp"
 #include "ren/core/Tlsf.hpp"
 #include "ren/core/sh/Random.h"
 #include "ren/ren.hpp"
+#include "sh/ScatterUpload.h"
 
 #include "Ssao.comp.hpp"
 #include "SsaoFilter.comp.hpp"
 #include "SsaoHiZ.comp.hpp"
 
 #include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <glm/gtc/type_ptr.hpp>
+#include <immintrin.h>
 #include <ktx.h>
 #include <tracy/Tracy.hpp>
 
@@ -56,6 +63,8 @@ rhi::Result<GpuScene> GpuScene::init(NotNull<ResourceArena *> arena) {
       "Scene mesh instance visibility", NUM_MESH_INSTANCE_VISIBILITY_MASKS);
   create_buffer(gpu_scene.materials, sh::Material, "Scene materials",
                 MAX_NUM_MATERIALS);
+  create_buffer(gpu_scene.transform_matrices, glm::mat4x3,
+                "Scene transform matrices", MAX_NUM_MESH_INSTANCES);
 
   ScratchArena scratch;
 
@@ -91,17 +100,6 @@ void init_internal_data(NotNull<Scene *> scene) {
       ResourceArena::init(&scene->m_internal_arena, scene->m_renderer);
   id->m_pipelines = load_pipelines(id->m_rcs_arena);
 
-  id->m_gfx_allocator =
-      DeviceBumpAllocator::init(*renderer, id->m_rcs_arena, 256 * MiB);
-  if (renderer->is_queue_family_supported(rhi::QueueFamily::Compute)) {
-    id->m_async_allocator =
-        DeviceBumpAllocator::init(*renderer, id->m_rcs_arena, 16 * MiB);
-    for (DeviceBumpAllocator &allocator : id->m_shared_allocators) {
-      allocator =
-          DeviceBumpAllocator::init(*renderer, id->m_rcs_arena, 16 * MiB);
-    }
-  }
-
   static_assert((u64)ArenaNamedTag::FrameData0 + NUM_FRAMES_IN_FLIGHT - 1 ==
                 (u64)ArenaNamedTag::FrameDataLast);
   for (auto i : range(NUM_FRAMES_IN_FLIGHT)) {
@@ -112,15 +110,17 @@ void init_internal_data(NotNull<Scene *> scene) {
         .name = format(scratch, "Acquire semaphore {}", i),
         .type = rhi::SemaphoreType::Binary,
     });
-    frcs.gfx_cmd_pool = id->m_rcs_arena.create_command_pool({
-        .name = format(scratch, "Command pool {}", i),
-        .queue_family = rhi::QueueFamily::Graphics,
-    });
-    if (renderer->is_queue_family_supported(rhi::QueueFamily::Compute)) {
-      frcs.async_cmd_pool = id->m_rcs_arena.create_command_pool({
-          .name = format(scratch, "Command pool {}", i),
-          .queue_family = rhi::QueueFamily::Compute,
+    for (usize j : range(MAX_NUM_RG_RECORDING_JOBS)) {
+      frcs.gfx_cmd_pools[j] = id->m_rcs_arena.create_command_pool({
+          .name = format(scratch, "Command pool {}, {}", i, j),
+          .queue_family = rhi::QueueFamily::Graphics,
       });
+      if (renderer->is_queue_family_supported(rhi::QueueFamily::Compute)) {
+        frcs.async_cmd_pools[j] = id->m_rcs_arena.create_command_pool({
+            .name = format(scratch, "Compute command pool {}, {}", i, j),
+            .queue_family = rhi::QueueFamily::Compute,
+        });
+      }
     }
     frcs.upload_allocator =
         UploadBumpAllocator::init(*renderer, id->m_rcs_arena, 128 * MiB);
@@ -136,6 +136,124 @@ void destroy_internal_data(NotNull<Scene *> scene) {
   scene->m_sid->m_rgp.destroy();
 }
 
+void retire(NotNull<Scene *> scene, RetiredResource resource) {
+  resource.frame = scene->m_frame_index;
+  resource.time = ren::clock();
+  scene->m_retirement_queue.push(scene->m_arena, resource);
+  scene->m_retirement_stats.num_pending++;
+  scene->m_retirement_stats.bytes_pending += resource.size;
+}
+
+void retire_buffer(NotNull<Scene *> scene, Handle<Buffer> buffer) {
+  RetiredResource resource = {
+      .type = RetiredResourceType::Buffer,
+      .size = scene->m_renderer->get_buffer(buffer).size,
+  };
+  resource.buffer = buffer;
+  retire(scene, resource);
+}
+
+void retire_index_range(NotNull<Scene *> scene, u32 pool,
+                        TlsfAllocation *range) {
+  RetiredResource resource = {
+      .type = RetiredResourceType::IndexRange,
+      .size = range->size,
+  };
+  resource.index_range = {range, pool};
+  retire(scene, resource);
+}
+
+void retire_descriptor(NotNull<Scene *> scene, sh::Handle<void> descriptor) {
+  RetiredResource resource = {.type = RetiredResourceType::Descriptor};
+  resource.descriptor = descriptor;
+  retire(scene, resource);
+}
+
+rhi::Result<void> create_index_pool(NotNull<Scene *> scene) {
+  ScratchArena scratch;
+  usize index = scene->m_index_pools.m_size;
+  if (index >= sh::MAX_NUM_INDEX_POOLS) {
+    return rhi::Error::OutOfMemory;
+  }
+  rhi::Result<Handle<Buffer>> buffer = scene->m_renderer->create_buffer({
+      .name = format(scratch, "Index pool {}", index),
+      .heap = rhi::MemoryHeap::Default,
+      .size = sh::INDEX_POOL_SIZE,
+  });
+  if (!buffer) {
+    return buffer.error();
+  }
+  scene->m_index_pools.push(
+      scene->m_arena,
+      {
+          .indices = {.buffer = *buffer, .count = sh::INDEX_POOL_SIZE},
+          .allocator = tlsf_init(scene->m_arena, sh::INDEX_POOL_SIZE),
+      });
+  return {};
+}
+
+// Release resources that were retired during or before completed_frame.
+void release_retired_resources(NotNull<Scene *> scene, u64 completed_frame) {
+  ZoneScoped;
+
+  Renderer *renderer = scene->m_renderer;
+  DynamicArray<RetiredResource> &queue = scene->m_retirement_queue;
+  RetirementStats &stats = scene->m_retirement_stats;
+
+  u64 now = ren::clock();
+  stats.max_latency = 0;
+  // Resources are retired in frame order.
+  usize num_released = 0;
+  while (num_released < queue.m_size and
+         queue[num_released].frame <= completed_frame) {
+    const RetiredResource &resource = queue[num_released++];
+    switch (resource.type) {
+    case RetiredResourceType::Buffer:
+      renderer->destroy(resource.buffer);
+      break;
+    case RetiredResourceType::IndexRange:
+      tlsf_free(scene->m_index_pools[resource.index_range.pool].allocator,
+                resource.index_range.allocation);
+      break;
+    case RetiredResourceType::Descriptor: {
+      DescriptorAllocator &allocator = scene->m_descriptor_allocator;
+      switch (resource.descriptor.m_kind) {
+      case sh::DescriptorKind::SamplerState:
+        allocator.free_sampler(
+            sh::Handle<sh::SamplerState>(resource.descriptor));
+        break;
+      case sh::DescriptorKind::Texture:
+        allocator.free_texture(resource.descriptor);
+        break;
+      case sh::DescriptorKind::Sampler:
+        allocator.free_sampled_texture(resource.descriptor);
+        break;
+      case sh::DescriptorKind::RWTexture:
+        allocator.free_storage_texture(resource.descriptor);
+        break;
+      default:
+        unreachable();
+      }
+      break;
+    }
+    }
+    stats.bytes_pending -= resource.size;
+    stats.max_latency = max(stats.max_latency, now - resource.time);
+  }
+
+  if (num_released > 0) {
+    std::memmove(queue.m_data, queue.m_data + num_released,
+                 (queue.m_size - num_released) * sizeof(RetiredResource));
+    queue.m_size -= num_released;
+  }
+  stats.num_pending = queue.m_size;
+  stats.num_released += num_released;
+
+  TracyPlot("Retired resources pending", i64(stats.num_pending));
+  TracyPlot("Retired bytes pending", i64(stats.bytes_pending));
+  TracyPlot("Retirement latency (ms)", double(stats.max_latency) / 1e6);
+}
+
 void next_frame(NotNull<Scene *> scene) {
   ZoneScoped;
 
@@ -152,25 +270,30 @@ void next_frame(NotNull<Scene *> scene) {
     }
   }
 
-  for (Handle<Buffer> buffer : frcs->buffer_delete_queue) {
-    renderer->destroy(buffer);
+  // Frames use per-frame resources round-robin, so waiting for this frame's
+  // resources to become available means that the frame that used them last
+  // has completed.
+  if (scene->m_frame_index >= NUM_FRAMES_IN_FLIGHT) {
+    release_retired_resources(scene,
+                              scene->m_frame_index - NUM_FRAMES_IN_FLIGHT);
   }
-  frcs->buffer_delete_queue = {};
+
   job_reset_tag(frcs->tag);
   frcs->arena = Arena::from_tag(frcs->tag);
 
   frcs->upload_allocator.reset();
-  renderer->reset_command_pool(frcs->gfx_cmd_pool);
-  if (frcs->async_cmd_pool) {
-    renderer->reset_command_pool(frcs->async_cmd_pool);
+  for (usize i : range(MAX_NUM_RG_RECORDING_JOBS)) {
+    renderer->reset_command_pool(frcs->gfx_cmd_pools[i]);
+    if (frcs->async_cmd_pools[i]) {
+      renderer->reset_command_pool(frcs->async_cmd_pools[i]);
+    }
   }
   frcs->descriptor_allocator.reset();
   frcs->end_semaphore = {};
   frcs->end_time = 0;
 
-  id->m_gfx_allocator.reset();
   CommandRecorder cmd;
-  cmd.begin(*renderer, frcs->gfx_cmd_pool);
+  cmd.begin(*renderer, frcs->gfx_cmd_pools[0]);
   {
     auto _ = cmd.debug_region("begin-frame");
     cmd.memory_barrier(rhi::ALL_COMMANDS_BARRIER);
@@ -178,11 +301,8 @@ void next_frame(NotNull<Scene *> scene) {
   renderer->submit(rhi::QueueFamily::Graphics, {cmd.end()});
 
   if (scene->m_settings.async_compute) {
-    id->m_async_allocator.reset();
-    std::swap(id->m_shared_allocators[0], id->m_shared_allocators[1]);
-    id->m_shared_allocators[0].reset();
     CommandRecorder cmd;
-    cmd.begin(*renderer, frcs->async_cmd_pool);
+    cmd.begin(*renderer, frcs->async_cmd_pools[0]);
     {
       auto _ = cmd.debug_region("begin-frame");
       cmd.memory_barrier(rhi::ALL_COMMANDS_BARRIER);
@@ -190,7 +310,6 @@ void next_frame(NotNull<Scene *> scene) {
     renderer->submit(rhi::QueueFamily::Compute, {cmd.end()});
   }
 
-  scene->m_sid->m_transform_staging_buffers = {};
   scene->m_gpu_scene_update = {};
   scene->m_sid->m_resource_uploader = {};
 }
@@ -234,6 +353,54 @@ bool is_amd_anti_lag_enabled(NotNull<Scene *> scene) {
   return is_amd_anti_lag_available(scene) and scene->m_settings.amd_anti_lag;
 }
 
+// Create a buffer for data and stage data to be uploaded to it. Does nothing if
+// data is empty.
+template <typename T>
+rhi::Result<void> create_mesh_buffer(NotNull<Arena *> frame_arena,
+                                     NotNull<Scene *> scene,
+                                     Span<const T> data, Handle<Buffer> *buffer,
+                                     String8 name) {
+  if (data.m_size == 0) {
+    return {};
+  }
+  Renderer *renderer = scene->m_renderer;
+  rhi::Result<Handle<Buffer>> buffer_result = renderer->create_buffer({
+      .name = std::move(name),
+      .heap = rhi::MemoryHeap::Default,
+      .size = data.m_size * sizeof(T),
+  });
+  if (!buffer_result) {
+    return buffer_result.error();
+  }
+  *buffer = *buffer_result;
+  BufferSlice<T> slice = {
+      .buffer = *buffer_result,
+      .count = data.m_size,
+  };
+  scene->m_sid->m_resource_uploader.stage_buffer(
+      frame_arena, *renderer, scene->m_frcs->upload_allocator, data, slice);
+  return {};
+}
+
+sh::Mesh get_gpu_mesh(Renderer &renderer, const Mesh &mesh) {
+  sh::Mesh gpu_mesh = {
+      .positions = renderer.get_buffer_device_ptr<sh::Position>(mesh.positions),
+      .normals = renderer.get_buffer_device_ptr<sh::Normal>(mesh.normals),
+      .tangents =
+          renderer.try_get_buffer_device_ptr<sh::Tangent>(mesh.tangents),
+      .uvs = renderer.try_get_buffer_device_ptr<sh::UV>(mesh.uvs),
+      .colors = renderer.try_get_buffer_device_ptr<sh::Color>(mesh.colors),
+      .meshlets = renderer.get_buffer_device_ptr<sh::Meshlet>(mesh.meshlets),
+      .meshlet_indices =
+          renderer.get_buffer_device_ptr<u32>(mesh.meshlet_indices),
+      .bb = mesh.bb,
+      .uv_bs = mesh.uv_bs,
+      .num_lods = mesh.num_lods,
+  };
+  copy(mesh.lods, mesh.num_lods, gpu_mesh.lods);
+  return gpu_mesh;
+}
+
 } // namespace
 
 Scene *create_scene(NotNull<Arena *> arena, Renderer *renderer,
@@ -252,6 +419,7 @@ Scene *create_scene(NotNull<Arena *> arena, Renderer *renderer,
       .m_images = GenArray<Image>::init(arena),
       .m_materials = GenArray<Material>::init(arena),
       .m_directional_lights = GenArray<DirectionalLight>::init(arena),
+      .m_transform_hierarchy = TransformHierarchy::init(arena),
   };
 
   scene->m_rcs_arena = ResourceArena::init(arena, renderer);
@@ -262,24 +430,17 @@ Scene *create_scene(NotNull<Arena *> arena, Renderer *renderer,
   }
   scene->m_gpu_scene = *gpu_scene;
 
-  rhi::Result<Handle<Buffer>> index_buffer = renderer->create_buffer({
-      .name = "Index buffer",
-      .heap = rhi::MemoryHeap::Default,
-      .size = sh::INDEX_POOL_SIZE,
-  });
-  if (!index_buffer) {
+  if (!create_index_pool(scene)) {
     ren_export::destroy_scene(scene);
     return nullptr;
   }
-  scene->m_index_buffer = {
-      .buffer = *index_buffer,
-      .count = sh::INDEX_POOL_SIZE,
-  };
-  scene->m_index_allocator = tlsf_init(scene->m_arena, sh::INDEX_POOL_SIZE);
 
   scene->m_settings.async_compute =
       renderer->is_queue_family_supported(rhi::QueueFamily::Compute);
+  // Scenes without a swap chain are only used for headless benchmarks and are
+  // never drawn.
   scene->m_settings.present_from_compute =
+      swap_chain and
       swap_chain->is_queue_family_supported(rhi::QueueFamily::Compute);
 
   scene->m_settings.amd_anti_lag =
@@ -300,14 +461,14 @@ void destroy_scene(Scene *scene) {
   for (const auto &[_, mesh] : scene->m_meshes) {
     free_mesh_resources(scene, mesh);
   }
-  scene->m_frcs->buffer_delete_queue.push(&scene->m_frcs->arena,
-                                          scene->m_index_buffer.buffer);
-  scene->m_renderer->wait_idle();
-  for (const FrameResources &rcs : scene->m_sid->m_per_frame_resources) {
-    for (Handle<Buffer> buffer : rcs.buffer_delete_queue) {
-      scene->m_renderer->destroy(buffer);
-    }
+  for (const IndexPool &pool : scene->m_index_pools) {
+    retire_buffer(scene, pool.indices.buffer);
   }
+  for (SceneCommandRecorder *recorder : scene->m_command_recorders) {
+    recorder->m_arena.destroy();
+  }
+  scene->m_renderer->wait_idle();
+  release_retired_resources(scene, UINT64_MAX);
   scene->m_rcs_arena.clear();
   destroy_internal_data(scene);
   scene->m_internal_arena.destroy();
@@ -364,6 +525,11 @@ Handle<Mesh> create_mesh(NotNull<Arena *> frame_arena, Scene *scene,
   auto meshlets = Span<sh::Meshlet>::allocate(scratch, header.num_meshlets);
   copy((const sh::Meshlet *)&blob[header.meshlets_offset], header.num_meshlets,
        meshlets.m_data);
+  auto meshlet_base_triangles =
+      Span<u32>::allocate(scene->m_arena, header.num_meshlets);
+  for (usize i : range(header.num_meshlets)) {
+    meshlet_base_triangles[i] = meshlets[i].base_triangle;
+  }
 
   Span triangles = {
       (const u8 *)&blob[header.triangles_offset],
@@ -374,6 +540,7 @@ Handle<Mesh> create_mesh(NotNull<Arena *> frame_arena, Scene *scene,
       .bb = header.bb,
       .scale = header.scale,
       .uv_bs = header.uv_bs,
+      .meshlet_base_triangles = meshlet_base_triangles,
       .num_lods = header.num_lods,
   };
   copy(header.lods, header.num_lods, mesh.lods);
@@ -382,71 +549,66 @@ Handle<Mesh> create_mesh(NotNull<Arena *> frame_arena, Scene *scene,
 
   Renderer *renderer = scene->m_renderer;
 
-  auto upload_buffer = [&]<typename T>(Span<const T> data,
-                                       Handle<Buffer> &buffer,
-                                       String8 name) -> rhi::Result<void> {
-    if (data.m_size > 0) {
-      rhi::Result<Handle<Buffer>> buffer_result =
-          scene->m_renderer->create_buffer({
-              .name = std::move(name),
-              .heap = rhi::MemoryHeap::Default,
-              .size = data.m_size * sizeof(T),
-          });
-      if (!buffer_result) {
-        return buffer_result.error();
-      }
-      buffer = *buffer_result;
-      BufferSlice<T> slice = {
-          .buffer = *buffer_result,
-          .count = data.m_size,
-      };
-      scene->m_sid->m_resource_uploader.stage_buffer(
-          frame_arena, *renderer, scene->m_frcs->upload_allocator, Span(data),
-          slice);
-    }
-    return {};
-  };
-
   u32 index = scene->m_meshes.size();
 
-  if (!upload_buffer(positions, mesh.positions,
-                     format(scratch, "Mesh {} positions", index))) {
+  if (!create_mesh_buffer(frame_arena, scene, positions, &mesh.positions,
+                          format(scratch, "Mesh {} positions", index))) {
     return NullHandle;
   }
-  if (!upload_buffer(normals, mesh.normals,
-                     format(scratch, "Mesh {} normals", index))) {
+  if (!create_mesh_buffer(frame_arena, scene, normals, &mesh.normals,
+                          format(scratch, "Mesh {} normals", index))) {
     return NullHandle;
   }
-  if (!upload_buffer(tangents, mesh.tangents,
-                     format(scratch, "Mesh {} tangents", index))) {
+  if (!create_mesh_buffer(frame_arena, scene, tangents, &mesh.tangents,
+                          format(scratch, "Mesh {} tangents", index))) {
     return NullHandle;
   }
-  if (!upload_buffer(uvs, mesh.uvs, format(scratch, "Mesh {} uvs", index))) {
+  if (!create_mesh_buffer(frame_arena, scene, uvs, &mesh.uvs,
+                          format(scratch, "Mesh {} uvs", index))) {
     return NullHandle;
   }
-  if (!upload_buffer(colors, mesh.colors,
-                     format(scratch, "Mesh {} colors", index))) {
+  if (!create_mesh_buffer(frame_arena, scene, colors, &mesh.colors,
+                          format(scratch, "Mesh {} colors", index))) {
     return NullHandle;
   }
 
   // Find or allocate index pool
-  mesh.triangles = tlsf_allocate(scene->m_arena, scene->m_index_allocator,
-                                 header.num_triangles * 3);
-  ren_assert_msg(mesh.triangles, "Index pool overflow");
+  usize num_triangle_indices = header.num_triangles * 3;
+  ren_assert(num_triangle_indices <= sh::INDEX_POOL_SIZE);
+  for (usize i : range(scene->m_index_pools.m_size)) {
+    mesh.triangles = tlsf_allocate(scene->m_arena,
+                                   scene->m_index_pools[i].allocator,
+                                   num_triangle_indices);
+    if (mesh.triangles) {
+      mesh.index_pool = i;
+      break;
+    }
+  }
+  if (!mesh.triangles) {
+    if (!create_index_pool(scene)) {
+      return NullHandle;
+    }
+    mesh.index_pool = scene->m_index_pools.m_size - 1;
+    mesh.triangles =
+        tlsf_allocate(scene->m_arena, scene->m_index_pools.back().allocator,
+                      num_triangle_indices);
+    ren_assert(mesh.triangles);
+  }
   u32 base_triangle = mesh.triangles->offset;
   for (sh::Meshlet &meshlet : meshlets) {
     meshlet.base_triangle += base_triangle;
   }
 
-  if (!upload_buffer(indices, mesh.meshlet_indices,
-                     format(scratch, "Mesh {} indices", index))) {
+  if (!create_mesh_buffer(frame_arena, scene, indices, &mesh.meshlet_indices,
+                          format(scratch, "Mesh {} indices", index))) {
     return NullHandle;
   }
 
   // Upload meshlets
 
-  if (!upload_buffer(Span<const sh::Meshlet>(meshlets), mesh.meshlets,
-                     format(scratch, "Mesh {} meshlets", index))) {
+  if (!create_mesh_buffer(frame_arena, scene, Span<const sh::Meshlet>(meshlets),
+                          &mesh.meshlets,
+                          format(scratch, "Mesh {} meshlets", index))) {
     return NullHandle;
   }
 
@@ -454,48 +616,34 @@ Handle<Mesh> create_mesh(NotNull<Arena *> frame_arena, Scene *scene,
 
   scene->m_sid->m_resource_uploader.stage_buffer(
       frame_arena, *renderer, scene->m_frcs->upload_allocator, triangles,
-      scene->m_index_buffer.slice(base_triangle, header.num_triangles * 3));
+      scene->m_index_pools[mesh.index_pool].indices.slice(
+          base_triangle, num_triangle_indices));
 
   Handle<Mesh> handle = scene->m_meshes.insert(scene->m_arena, mesh);
 
-  sh::Mesh gpu_mesh = {
-      .positions =
-          renderer->get_buffer_device_ptr<sh::Position>(mesh.positions),
-      .normals = renderer->get_buffer_device_ptr<sh::Normal>(mesh.normals),
-      .tangents =
-          renderer->try_get_buffer_device_ptr<sh::Tangent>(mesh.tangents),
-      .uvs = renderer->try_get_buffer_device_ptr<sh::UV>(mesh.uvs),
-      .colors = renderer->try_get_buffer_device_ptr<sh::Color>(mesh.colors),
-      .meshlets = renderer->get_buffer_device_ptr<sh::Meshlet>(mesh.meshlets),
-      .meshlet_indices =
-          renderer->get_buffer_device_ptr<u32>(mesh.meshlet_indices),
-      .bb = mesh.bb,
-      .uv_bs = mesh.uv_bs,
-      .num_lods = mesh.num_lods,
-  };
-  copy(mesh.lods, mesh.num_lods, gpu_mesh.lods);
-
-  scene->m_gpu_scene_update.meshes.push(frame_arena, {handle, gpu_mesh});
+  scene->m_gpu_scene_update.meshes.push(
+      frame_arena, {handle, get_gpu_mesh(*renderer, mesh)});
 
   return handle;
 }
 
 void free_mesh_resources(NotNull<Scene *> scene, const Mesh &mesh) {
-  FrameResources *rcs = scene->m_frcs;
-  rcs->buffer_delete_queue.push(&rcs->arena, mesh.positions);
-  rcs->buffer_delete_queue.push(&rcs->arena, mesh.normals);
+  retire_buffer(scene, mesh.positions);
+  retire_buffer(scene, mesh.normals);
   if (mesh.tangents) {
-    rcs->buffer_delete_queue.push(&rcs->arena, mesh.tangents);
+    retire_buffer(scene, mesh.tangents);
   }
   if (mesh.uvs) {
-    rcs->buffer_delete_queue.push(&rcs->arena, mesh.uvs);
+    retire_buffer(scene, mesh.uvs);
   }
   if (mesh.colors) {
-    rcs->buffer_delete_queue.push(&rcs->arena, mesh.colors);
+    retire_buffer(scene, mesh.colors);
   }
-  rcs->buffer_delete_queue.push(&rcs->arena, mesh.meshlets);
-  rcs->buffer_delete_queue.push(&rcs->arena, mesh.meshlet_indices);
-  tlsf_free(scene->m_index_allocator, mesh.triangles);
+  retire_buffer(scene, mesh.meshlets);
+  retire_buffer(scene, mesh.meshlet_indices);
+  // Triangles of new meshes must not overwrite the ones of this mesh while it
+  // is still being drawn.
+  retire_index_range(scene, mesh.index_pool, mesh.triangles);
 }
 
 void destroy_mesh(NotNull<Arena *> frame_arena, NotNull<Scene *> scene,
@@ -592,170 +740,1233 @@ auto get_batch_desc(DrawSet ds, const Scene &scene,
 
   switch (ds) {
   case DrawSet::DepthOnly:
-    return {scene.m_sid->m_pipelines.early_z_pass};
+    return {scene.m_sid->m_pipelines.early_z_pass, mesh.index_pool};
   case DrawSet::Opaque: {
     const sh::Material &material =
         scene.m_materials[mesh_instance.material].data;
 
-    MeshAttributeFlags attributes;
-    if (mesh.uvs) {
-      attributes |= MeshAttribute::UV;
+    MeshAttributeFlags attributes;
+    if (mesh.uvs) {
+      attributes |= MeshAttribute::UV;
+    }
+    if (material.normal_texture) {
+      attributes |= MeshAttribute::Tangent;
+    }
+    if (mesh.colors) {
+      attributes |= MeshAttribute::Color;
+    }
+    return {
+        scene.m_sid->m_pipelines.opaque_pass[(i32)attributes.get()],
+        mesh.index_pool,
+    };
+  };
+  }
+
+  unreachable();
+}
+
+// Grow per-mesh instance transform data to cover all mesh instance handles.
+void reserve_mesh_instance_transforms(NotNull<Scene *> scene) {
+  usize raw_size = scene->m_mesh_instances.raw_size();
+  if (scene->m_transforms.m_size >= raw_size) {
+    return;
+  }
+  usize capacity = max<usize>(raw_size, 2 * scene->m_transforms.m_capacity);
+  scene->m_transforms.reserve(scene->m_arena, capacity);
+  scene->m_mesh_instance_decode_scales.reserve(scene->m_arena, capacity);
+  while (scene->m_transforms.m_size < raw_size) {
+    scene->m_transforms.push(glm::mat4x3(1.0f));
+    scene->m_mesh_instance_decode_scales.push(1.0f);
+  }
+  usize num_words = ceil_div(ceil_div(raw_size, TRANSFORM_PAGE_SIZE), 64);
+  while (scene->m_transform_dirty_pages.m_size < num_words) {
+    scene->m_transform_dirty_pages.push(scene->m_arena, 0);
+  }
+}
+
+sh::BatchId get_or_create_batch(NotNull<Arena *> arena, DrawSetData &ds,
+                                const DrawSetBatchDesc &desc) {
+  if (const sh::BatchId *id = ds.batch_ids.try_get(desc)) {
+    return *id;
+  }
+  sh::BatchId id = ds.batches.m_size;
+  ds.batches.push(arena, {desc});
+  ds.batch_ids.insert(arena, desc, id);
+  return id;
+}
+
+void create_mesh_instances(NotNull<Arena *> frame_arena, Scene *scene,
+                           Span<const MeshInstanceCreateInfo> create_info,
+                           Span<Handle<MeshInstance>> out) {
+  ZoneScoped;
+
+  ren_assert(out.m_size >= create_info.m_size);
+  ren_assert(scene->m_mesh_instances.size() + create_info.m_size <=
+             MAX_NUM_MESH_INSTANCES);
+
+  ScratchArena scratch;
+
+  // Group create infos by mesh and material so that batches only have to be
+  // looked up once per group.
+  auto group_key = [&](usize i) -> u64 {
+    return (u64(u32(create_info[i].mesh)) << 32) |
+           u32(create_info[i].material);
+  };
+  Span<u32> order = Span<u32>::allocate(scratch, create_info.m_size);
+  for (usize i : range(order.m_size)) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(), [&](u32 lhs, u32 rhs) {
+    return group_key(lhs) < group_key(rhs);
+  });
+
+  usize group_begin = 0;
+  while (group_begin < order.m_size) {
+    usize group_end = group_begin + 1;
+    while (group_end < order.m_size and
+           group_key(order[group_end]) == group_key(order[group_begin])) {
+      group_end++;
+    }
+    usize group_size = group_end - group_begin;
+
+    const MeshInstanceCreateInfo &info = create_info[order[group_begin]];
+    ren_assert(info.mesh);
+    ren_assert(info.material);
+
+    const Mesh &mesh = scene->m_meshes[info.mesh];
+    u32 num_meshlets = mesh.lods[0].num_meshlets;
+    float decode_scale = sh::make_decode_position_matrix(mesh.scale)[0][0];
+
+    sh::BatchId batch_ids[NUM_DRAW_SETS];
+    for (auto k : range(NUM_DRAW_SETS)) {
+      DrawSetData &ds = scene->m_gpu_scene.draw_sets[k];
+      DrawSetBatchDesc batch_desc = get_batch_desc(
+          (DrawSet)(1 << k), *scene, {info.mesh, info.material});
+      batch_ids[k] = get_or_create_batch(scene->m_arena, ds, batch_desc);
+      ds.batches[batch_ids[k]].num_meshlets += num_meshlets * group_size;
+    }
+
+    for (usize i : order.subspan(group_begin, group_size)) {
+      Handle<MeshInstance> handle = scene->m_mesh_instances.insert(
+          scene->m_arena, {info.mesh, info.material});
+      MeshInstance &mesh_instance = scene->m_mesh_instances[handle];
+
+      reserve_mesh_instance_transforms(scene);
+      scene->m_mesh_instance_decode_scales[handle] = decode_scale;
+
+      for (auto k : range(NUM_DRAW_SETS)) {
+        DrawSetData &ds = scene->m_gpu_scene.draw_sets[k];
+
+        DrawSetId id(ds.items.m_size);
+        ds.items.push(scene->m_arena, handle);
+        mesh_instance.draw_set_ids[k] = id;
+
+        sh::DrawSetItem gpu_item = {
+            .mesh = mesh_instance.mesh,
+            .mesh_instance = handle,
+            .batch = batch_ids[k],
+        };
+        scene->m_gpu_scene_update.draw_sets[k].update.push(frame_arena,
+                                                           {id, gpu_item});
+      }
+
+      scene->m_gpu_scene_update.mesh_instances.push(
+          frame_arena, {
+                           handle,
+                           {
+                               .mesh = mesh_instance.mesh,
+                               .material = mesh_instance.material,
+                           },
+                       });
+
+      out[i] = handle;
+    }
+
+    group_begin = group_end;
+  }
+}
+
+void create_mesh_instances_bulk(NotNull<Arena *> frame_arena, Scene *scene,
+                                const MeshInstanceBulkCreateInfo &create_info,
+                                Span<Handle<MeshInstance>> out) {
+  ZoneScoped;
+
+  Span<const Handle<Mesh>> meshes = create_info.meshes;
+  Span<const Handle<Material>> materials = create_info.materials;
+  usize count = meshes.m_size;
+  ren_assert(materials.m_size == count or materials.m_size == 1);
+  ren_assert(create_info.transforms.m_size == 0 or
+             create_info.transforms.m_size == count);
+  ren_assert(out.m_size >= count);
+  ren_assert(scene->m_mesh_instances.size() + count <= MAX_NUM_MESH_INSTANCES);
+  if (count == 0) {
+    return;
+  }
+
+  // Consecutive handles are allocated past the end of the handle pool. If
+  // there is no space left there, reuse freed handles one by one instead.
+  if (scene->m_mesh_instances.raw_size() + count > MAX_NUM_MESH_INSTANCES) {
+    ScratchArena scratch;
+    auto aos_create_info =
+        Span<MeshInstanceCreateInfo>::allocate(scratch, count);
+    for (usize i : range(count)) {
+      aos_create_info[i] = {
+          .mesh = meshes[i],
+          .material = materials[materials.m_size > 1 ? i : 0],
+      };
+    }
+    ren_export::create_mesh_instances(frame_arena, scene, aos_create_info, out);
+    if (create_info.transforms.m_size > 0) {
+      ren_export::set_mesh_instance_transforms(
+          frame_arena, scene, out.subspan(0, count), create_info.transforms);
+    }
+    return;
+  }
+
+  Handle<MeshInstance> first =
+      scene->m_mesh_instances.insert_range(scene->m_arena, count);
+  MeshInstance *mesh_instances = &scene->m_mesh_instances[first];
+  reserve_mesh_instance_transforms(scene);
+  float *decode_scales = scene->m_mesh_instance_decode_scales.m_data;
+
+  UploadBumpAllocator &upload_allocator = scene->m_frcs->upload_allocator;
+  auto gpu_mesh_instances = upload_allocator.allocate<sh::MeshInstance>(count);
+  scene->m_gpu_scene_update.mesh_instance_ranges.push(
+      frame_arena, {.src = gpu_mesh_instances.slice, .offset = first.index});
+
+  UploadBumpAllocation<sh::DrawSetItem> gpu_items[NUM_DRAW_SETS];
+  DrawSetId base_ids[NUM_DRAW_SETS];
+  for (auto k : range(NUM_DRAW_SETS)) {
+    DrawSetData &ds = scene->m_gpu_scene.draw_sets[k];
+    base_ids[k] = DrawSetId(ds.items.m_size);
+    if (ds.items.m_size + count > ds.items.m_capacity) {
+      ds.items.reserve(scene->m_arena, max<usize>(ds.items.m_size + count,
+                                                  2 * ds.items.m_capacity));
+    }
+    gpu_items[k] = upload_allocator.allocate<sh::DrawSetItem>(count);
+    scene->m_gpu_scene_update.draw_sets[k].ranges.push(
+        frame_arena, {.src = gpu_items[k].slice, .offset = base_ids[k]});
+  }
+
+  Handle<Mesh> mesh;
+  Handle<Material> material;
+  u32 num_meshlets = 0;
+  float decode_scale = 1.0f;
+  sh::BatchId batch_ids[NUM_DRAW_SETS] = {};
+  for (usize i : range(count)) {
+    Handle<Material> material_i = materials[materials.m_size > 1 ? i : 0];
+    // Only look up mesh data and batches when the run changes.
+    if (i == 0 or meshes[i] != mesh or material_i != material) {
+      mesh = meshes[i];
+      material = material_i;
+      ren_assert(mesh);
+      ren_assert(material);
+      const Mesh &mesh_data = scene->m_meshes[mesh];
+      num_meshlets = mesh_data.lods[0].num_meshlets;
+      decode_scale = sh::make_decode_position_matrix(mesh_data.scale)[0][0];
+      for (auto k : range(NUM_DRAW_SETS)) {
+        batch_ids[k] = get_or_create_batch(
+            scene->m_arena, scene->m_gpu_scene.draw_sets[k],
+            get_batch_desc((DrawSet)(1 << k), *scene, {mesh, material}));
+      }
+    }
+
+    Handle<MeshInstance> handle = first;
+    handle.index = first.index + i;
+    MeshInstance &mesh_instance = mesh_instances[i];
+    mesh_instance.mesh = mesh;
+    mesh_instance.material = material;
+    decode_scales[handle] = decode_scale;
+
+    for (auto k : range(NUM_DRAW_SETS)) {
+      DrawSetData &ds = scene->m_gpu_scene.draw_sets[k];
+      DrawSetId id(base_ids[k] + i);
+      ds.items.m_data[id] = handle;
+      ds.batches[batch_ids[k]].num_meshlets += num_meshlets;
+      mesh_instance.draw_set_ids[k] = id;
+      gpu_items[k].host_ptr[i] = {
+          .mesh = mesh,
+          .mesh_instance = handle,
+          .batch = batch_ids[k],
+      };
+    }
+
+    gpu_mesh_instances.host_ptr[i] = {
+        .mesh = mesh,
+        .material = material,
+    };
+
+    out[i] = handle;
+  }
+
+  for (auto k : range(NUM_DRAW_SETS)) {
+    scene->m_gpu_scene.draw_sets[k].items.m_size += count;
+  }
+
+  if (create_info.transforms.m_size > 0) {
+    ren_export::set_mesh_instance_transforms(
+        frame_arena, scene, out.subspan(0, count), create_info.transforms);
+  }
+}
+
+void destroy_mesh_instances(NotNull<Arena *> frame_arena, Scene *scene,
+                            Span<const Handle<MeshInstance>> mesh_instances) {
+  for (Handle<MeshInstance> handle : mesh_instances) {
+    if (!handle) {
+      continue;
+    }
+
+    const MeshInstance &mesh_instance = scene->m_mesh_instances[handle];
+    const Mesh &mesh = scene->m_meshes.get(mesh_instance.mesh);
+    u32 num_meshlets = mesh.lods[0].num_meshlets;
+
+    for (auto k : range(NUM_DRAW_SETS)) {
+      DrawSetData &ds = scene->m_gpu_scene.draw_sets[k];
+
+      DrawSetBatchDesc batch_desc =
+          get_batch_desc((DrawSet)(1 << k), *scene, mesh_instance);
+      ds.batches[ds.batch_ids.get(batch_desc)].num_meshlets -= num_meshlets;
+
+      DrawSetId id = mesh_instance.draw_set_ids[k];
+      ren_assert(id != InvalidDrawSetId);
+      scene->m_gpu_scene_update.draw_sets[k].remove.push(frame_arena, id);
+    }
+
+    scene->m_mesh_instances.erase(handle);
+  }
+}
+
+void set_mesh_instance_transforms(
+    NotNull<Arena *> frame_arena, Scene *scene,
+    Span<const Handle<MeshInstance>> mesh_instances,
+    Span<const glm::mat4x3> matrices) {
+  ZoneScoped;
+
+  ren_assert(mesh_instances.m_size == matrices.m_size);
+
+  constexpr usize BATCH_SIZE = 16 * 1024;
+
+  ScratchArena scratch;
+  if (mesh_instances.m_size > BATCH_SIZE) {
+    // Batches are processed in parallel, so drop all but the last update of
+    // each mesh instance to make the result deterministic.
+    usize num_words = ceil_div(scene->m_mesh_instances.raw_size(), 64);
+    auto seen = Span<u64>::allocate(scratch, num_words);
+    fill(seen, 0);
+    auto unique_mesh_instances =
+        Span<Handle<MeshInstance>>::allocate(scratch, mesh_instances.m_size);
+    auto unique_matrices =
+        Span<glm::mat4x3>::allocate(scratch, mesh_instances.m_size);
+    usize first = mesh_instances.m_size;
+    for (isize i = isize(mesh_instances.m_size) - 1; i >= 0; --i) {
+      u32 index = mesh_instances[i].index;
+      u64 bit = u64(1) << (index % 64);
+      if (seen[index / 64] & bit) {
+        continue;
+      }
+      seen[index / 64] |= bit;
+      first--;
+      unique_mesh_instances[first] = mesh_instances[i];
+      unique_matrices[first] = matrices[i];
+    }
+    usize count = mesh_instances.m_size - first;
+    mesh_instances = unique_mesh_instances.subspan(first, count);
+    matrices = unique_matrices.subspan(first, count);
+  }
+
+  // Fold mesh position decode scale into the transform matrix: this scales
+  // the first 3 columns and leaves the translation column as is.
+  auto set_transforms = [scene, mesh_instances, matrices](usize begin,
+                                                          usize end) {
+    const float *scales = scene->m_mesh_instance_decode_scales.m_data;
+    glm::mat4x3 *transforms = scene->m_transforms.m_data;
+    u64 *dirty_pages = scene->m_transform_dirty_pages.m_data;
+    u64 dirty_word = 0;
+    usize dirty_word_index = -1;
+    for (usize i : range(begin, end)) {
+      u32 handle = mesh_instances[i];
+      ren_assert(handle < scene->m_transforms.m_size);
+      float scale = scales[handle];
+      const float *src = glm::value_ptr(matrices[i]);
+      float *dst = glm::value_ptr(transforms[handle]);
+#if __AVX2__
+      __m256 lo = _mm256_mul_ps(_mm256_loadu_ps(src), _mm256_set1_ps(scale));
+      __m128 hi = _mm_mul_ps(_mm_loadu_ps(src + 8),
+                             _mm_setr_ps(scale, 1.0f, 1.0f, 1.0f));
+      _mm256_storeu_ps(dst, lo);
+      _mm_storeu_ps(dst + 8, hi);
+#else
+      for (usize k : range(9)) {
+        dst[k] = src[k] * scale;
+      }
+      for (usize k : range<usize>(9, 12)) {
+        dst[k] = src[k];
+      }
+#endif
+
+      // Batch dirty bits of consecutive handles to reduce atomic traffic.
+      usize page = handle / TRANSFORM_PAGE_SIZE;
+      if (page / 64 != dirty_word_index) {
+        if (dirty_word) {
+          std::atomic_ref(dirty_pages[dirty_word_index])
+              .fetch_or(dirty_word, std::memory_order_relaxed);
+        }
+        dirty_word = 0;
+        dirty_word_index = page / 64;
+      }
+      dirty_word |= u64(1) << (page % 64);
+    }
+    if (dirty_word) {
+      std::atomic_ref(dirty_pages[dirty_word_index])
+          .fetch_or(dirty_word, std::memory_order_relaxed);
+    }
+  };
+
+  usize num_batches = ceil_div(mesh_instances.m_size, BATCH_SIZE);
+  if (num_batches <= 1) {
+    set_transforms(0, mesh_instances.m_size);
+    return;
+  }
+
+  auto jobs = Span<JobDesc>::allocate(scratch, num_batches);
+  for (usize b : range(num_batches)) {
+    usize begin = b * BATCH_SIZE;
+    usize end = min(begin + BATCH_SIZE, mesh_instances.m_size);
+    jobs[b] = JobDesc::init(scratch, "Set mesh instance transforms",
+                            [set_transforms, begin, end] {
+                              set_transforms(begin, end);
+                            });
+  }
+  job_dispatch_and_wait(jobs);
+}
+
+void create_transform_nodes(Scene *scene,
+                            Span<const TransformNodeCreateInfo> create_info,
+                            Span<Handle<TransformNode>> out) {
+  transform_hierarchy_create(&scene->m_transform_hierarchy, create_info, out);
+}
+
+void destroy_transform_nodes(Scene *scene,
+                             Span<const Handle<TransformNode>> nodes) {
+  transform_hierarchy_destroy(&scene->m_transform_hierarchy, nodes);
+}
+
+void set_transform_node_transforms(Scene *scene,
+                                   Span<const Handle<TransformNode>> nodes,
+                                   Span<const LocalTransform> transforms) {
+  transform_hierarchy_set_local(&scene->m_transform_hierarchy, nodes,
+                                transforms);
+}
+
+void update_transform_nodes(NotNull<Arena *> frame_arena, Scene *scene) {
+  ZoneScoped;
+  ScratchArena scratch;
+  TransformHierarchyUpdate update =
+      transform_hierarchy_update(scratch, &scene->m_transform_hierarchy);
+  // Skip mesh instances that were destroyed while still attached to a node.
+  usize num_alive = 0;
+  for (usize i : range(update.mesh_instances.m_size)) {
+    if (scene->m_mesh_instances.contains(update.mesh_instances[i])) {
+      update.mesh_instances[num_alive] = update.mesh_instances[i];
+      update.transforms[num_alive] = update.transforms[i];
+      num_alive++;
+    }
+  }
+  ren_export::set_mesh_instance_transforms(
+      frame_arena, scene, update.mesh_instances.subspan(0, num_alive),
+      update.transforms.subspan(0, num_alive));
+}
+
+auto create_scene_command_recorder(Scene *scene) -> SceneCommandRecorder * {
+  auto *recorder = scene->m_arena->allocate<SceneCommandRecorder>();
+  recorder->m_arena = Arena::init();
+  scene->m_command_recorders.push(scene->m_arena, recorder);
+  return recorder;
+}
+
+void record_create_mesh_instances(
+    SceneCommandRecorder *recorder,
+    Span<const MeshInstanceCreateInfo> create_info,
+    Span<const glm::mat4x3> transforms, Span<Handle<MeshInstance>> out) {
+  ren_assert(out.m_size >= create_info.m_size);
+  ren_assert(transforms.m_size == 0 or
+             transforms.m_size == create_info.m_size);
+  recorder->m_commands.push(
+      &recorder->m_arena,
+      {
+          .type = SceneCommandType::CreateMeshInstances,
+          .create_info = create_info.copy(&recorder->m_arena),
+          .transforms = transforms.copy(&recorder->m_arena),
+          .out = out,
+      });
+}
+
+void record_destroy_mesh_instances(
+    SceneCommandRecorder *recorder,
+    Span<const Handle<MeshInstance>> mesh_instances) {
+  recorder->m_commands.push(
+      &recorder->m_arena,
+      {
+          .type = SceneCommandType::DestroyMeshInstances,
+          .mesh_instances = mesh_instances.copy(&recorder->m_arena),
+      });
+}
+
+void record_mesh_instance_transforms(
+    SceneCommandRecorder *recorder,
+    Span<const Handle<MeshInstance>> mesh_instances,
+    Span<const glm::mat4x3> transforms) {
+  ren_assert(mesh_instances.m_size == transforms.m_size);
+  recorder->m_commands.push(
+      &recorder->m_arena,
+      {
+          .type = SceneCommandType::SetMeshInstanceTransforms,
+          .mesh_instances = mesh_instances.copy(&recorder->m_arena),
+          .transforms = transforms.copy(&recorder->m_arena),
+      });
+}
+
+void record_create_material(SceneCommandRecorder *recorder,
+                            const MaterialCreateInfo &create_info,
+                            Handle<Material> *out) {
+  auto *info = recorder->m_arena.allocate<MaterialCreateInfo>();
+  *info = create_info;
+  recorder->m_commands.push(&recorder->m_arena,
+                            {
+                                .type = SceneCommandType::CreateMaterial,
+                                .material_create_info = info,
+                                .material = out,
+                            });
+}
+
+void apply_scene_commands(NotNull<Arena *> frame_arena, Scene *scene) {
+  ZoneScoped;
+
+  ScratchArena scratch;
+
+  // Transform updates are merged into a single call until a mesh instance is
+  // destroyed, since its handle can be reused.
+  DynamicArray<Handle<MeshInstance>> mesh_instances;
+  DynamicArray<glm::mat4x3> transforms;
+  auto flush_transforms = [&] {
+    if (mesh_instances.m_size == 0) {
+      return;
+    }
+    ren_export::set_mesh_instance_transforms(frame_arena, scene,
+                                             mesh_instances, transforms);
+    mesh_instances.clear();
+    transforms.clear();
+  };
+
+  for (SceneCommandRecorder *recorder : scene->m_command_recorders) {
+    for (const SceneCommand &command : recorder->m_commands) {
+      switch (command.type) {
+      case SceneCommandType::CreateMeshInstances: {
+        Span<Handle<MeshInstance>> out =
+            command.out.subspan(0, command.create_info.m_size);
+        ren_export::create_mesh_instances(frame_arena, scene,
+                                          command.create_info, out);
+        if (command.transforms.m_size > 0) {
+          mesh_instances.push(scratch, Span<const Handle<MeshInstance>>(out));
+          transforms.push(scratch, command.transforms);
+        }
+      } break;
+      case SceneCommandType::DestroyMeshInstances: {
+        flush_transforms();
+        ren_export::destroy_mesh_instances(frame_arena, scene,
+                                           command.mesh_instances);
+      } break;
+      case SceneCommandType::SetMeshInstanceTransforms: {
+        mesh_instances.push(scratch, command.mesh_instances);
+        transforms.push(scratch, command.transforms);
+      } break;
+      case SceneCommandType::CreateMaterial: {
+        *command.material = ren_export::create_material(
+            frame_arena, scene, *command.material_create_info);
+      } break;
+      }
+    }
+    recorder->m_commands = {};
+    recorder->m_arena.clear();
+  }
+  flush_transforms();
+}
+
+// Swap-remove draw set items, from the highest id to the lowest. Calls
+// moved(id) for each id that the last item was moved to.
+void remove_draw_set_items(DynamicArray<Handle<MeshInstance>> &items,
+                           Span<DrawSetId> ids, auto moved) {
+  std::ranges::sort(ids);
+  for (isize i = isize(ids.m_size) - 1; i >= 0; --i) {
+    DrawSetId id = ids[i];
+    if (id == items.m_size - 1) {
+      items.pop();
+      continue;
+    }
+    std::swap(items.back(), items[id]);
+    items.pop();
+    moved(id);
+  }
+}
+
+auto get_draw_set_pipelines(const Scene &scene, DrawSet ds)
+    -> Span<const Handle<GraphicsPipeline>> {
+  const Pipelines &pipelines = scene.m_sid->m_pipelines;
+  switch (ds) {
+  case DrawSet::DepthOnly:
+    return {&pipelines.early_z_pass, 1};
+  case DrawSet::Opaque:
+    return {pipelines.opaque_pass.m_data, sh::NUM_MESH_ATTRIBUTE_FLAGS};
+  }
+  unreachable();
+}
+
+struct SnapshotWriter {
+  struct Chunk {
+    const void *data = nullptr;
+    usize size = 0;
+    usize offset = 0;
+  };
+
+  DynamicArray<Chunk> chunks;
+  usize size = sizeof(SceneSnapshotHeader);
+
+public:
+  template <typename T>
+  SnapshotArray write(NotNull<Arena *> arena, Span<T> data) {
+    size = pad(size, SCENE_SNAPSHOT_ALIGNMENT);
+    SnapshotArray array = {.offset = size, .count = data.m_size};
+    chunks.push(arena, {data.m_data, data.size_bytes(), size});
+    size += data.size_bytes();
+    return array;
+  }
+
+  template <typename K>
+  SnapshotKeys write_keys(NotNull<Arena *> arena, const GenIndexPool<K> &pool) {
+    return {
+        .generations = write(arena, Span(pool.m_generations)),
+        .free_list = pool.m_free_list,
+        .num_free = pool.m_num_free,
+    };
+  }
+};
+
+// Returns false if the array doesn't fit into the snapshot.
+template <typename T>
+bool get_snapshot_span(Span<const std::byte> blob, SnapshotArray array,
+                       Span<const T> *out) {
+  if (array.offset > blob.m_size or array.offset % alignof(T) != 0 or
+      array.count > (blob.m_size - array.offset) / sizeof(T)) {
+    return false;
+  }
+  *out = {(const T *)&blob[array.offset], array.count};
+  return true;
+}
+
+// For arrays that have already been checked with get_snapshot_span.
+template <typename T>
+Span<const T> snapshot_span(Span<const std::byte> blob, SnapshotArray array) {
+  Span<const T> span;
+  ren_assert(get_snapshot_span(blob, array, &span));
+  return span;
+}
+
+// Returns false if the keys can't be restored into a pool with at most
+// max_size slots.
+template <typename K>
+bool get_snapshot_keys(Span<const std::byte> blob, const SnapshotKeys &keys,
+                       usize max_size, Span<const GenIndex> *out) {
+  Span<const GenIndex> generations;
+  if (!get_snapshot_span(blob, keys.generations, &generations) or
+      generations.m_size == 0 or generations.m_size > max_size or
+      keys.num_free >= generations.m_size) {
+    return false;
+  }
+  // Each free slot can only be on the free list once.
+  ScratchArena scratch;
+  auto on_free_list = Span<bool>::allocate(scratch, generations.m_size);
+  fill(on_free_list, false);
+  u32 index = keys.free_list;
+  for (u32 num_visited = 0; num_visited < keys.num_free; ++num_visited) {
+    if (index == 0 or index >= generations.m_size or on_free_list[index] or
+        generations[index].index == GenIndexPool<K>::ACTIVE) {
+      return false;
+    }
+    on_free_list[index] = true;
+    index = generations[index].index;
+  }
+  *out = generations;
+  return true;
+}
+
+template <typename K>
+bool snapshot_keys_contain(Span<const GenIndex> generations, K key) {
+  return key.index < generations.m_size and
+         generations[key.index].gen == key.gen and
+         generations[key.index].index == GenIndexPool<K>::ACTIVE;
+}
+
+// Check everything that is needed to restore a mesh, and that its triangles
+// can be allocated at the same place in their index pool.
+bool validate_snapshot_meshes(Span<const std::byte> blob,
+                              Span<const GenIndex> generations,
+                              Span<const SnapshotMesh> meshes,
+                              usize num_index_pools) {
+  ScratchArena scratch;
+
+  struct TriangleRange {
+    u32 index_pool = 0;
+    u64 offset = 0;
+    u64 size = 0;
+  };
+  DynamicArray<TriangleRange> ranges;
+  for (usize i : range(usize(1), generations.m_size)) {
+    if (generations[i].index != GenIndexPool<Handle<Mesh>>::ACTIVE) {
+      continue;
+    }
+    const SnapshotMesh &mesh = meshes[i];
+    if (mesh.num_lods > sh::MAX_NUM_LODS or
+        mesh.index_pool >= num_index_pools or
+        mesh.triangles_offset > sh::INDEX_POOL_SIZE or
+        mesh.triangles_size > sh::INDEX_POOL_SIZE - mesh.triangles_offset) {
+      return false;
+    }
+    Span<const u8> data;
+    for (SnapshotArray array : {
+             mesh.positions,
+             mesh.normals,
+             mesh.tangents,
+             mesh.uvs,
+             mesh.colors,
+             mesh.meshlets,
+             mesh.meshlet_indices,
+         }) {
+      if (!get_snapshot_span(blob, array, &data)) {
+        return false;
+      }
+    }
+    Span<const u32> base_triangles;
+    if (!get_snapshot_span(blob, mesh.meshlet_base_triangles,
+                           &base_triangles)) {
+      return false;
+    }
+    ranges.push(scratch,
+                TriangleRange{
+                    .index_pool = mesh.index_pool,
+                    .offset = mesh.triangles_offset,
+                    .size = max<u64>(mesh.triangles_size,
+                                     MIN_TLSF_ALLOCATION_SIZE),
+                });
+  }
+
+  // Allocations can't overlap, and the free space between them must be large
+  // enough to form a free block.
+  std::ranges::sort(ranges, [](const TriangleRange &lhs,
+                               const TriangleRange &rhs) {
+    if (lhs.index_pool != rhs.index_pool) {
+      return lhs.index_pool < rhs.index_pool;
+    }
+    return lhs.offset < rhs.offset;
+  });
+  for (usize i : range(ranges.m_size)) {
+    u64 free_begin = 0;
+    if (i > 0 and ranges[i - 1].index_pool == ranges[i].index_pool) {
+      free_begin = ranges[i - 1].offset + ranges[i - 1].size;
+    }
+    if (ranges[i].offset < free_begin or
+        (ranges[i].offset > free_begin and
+         ranges[i].offset - free_begin < MIN_TLSF_ALLOCATION_SIZE) or
+        ranges[i].offset + ranges[i].size > sh::INDEX_POOL_SIZE) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+auto save_scene_snapshot(NotNull<Arena *> arena, Scene *scene)
+    -> Span<std::byte> {
+  ZoneScoped;
+
+  ScratchArena scratch;
+  Renderer *renderer = scene->m_renderer;
+
+  // Texture descriptors can't be restored without their images.
+  for (const auto &[_, material] : scene->m_materials) {
+    if (material.data.base_color_texture or material.data.orm_texture or
+        material.data.normal_texture) {
+      return {};
+    }
+  }
+
+  // Read back the contents of index pools and mesh buffers. Make sure that
+  // triangles of meshes created since the last frame are uploaded first.
+  scene->m_sid->m_resource_uploader.upload(*renderer,
+                                           scene->m_frcs->gfx_cmd_pools[0]);
+
+  auto index_pool_sizes =
+      Span<usize>::allocate(scratch, scene->m_index_pools.m_size);
+  fill(index_pool_sizes, 0);
+  for (const auto &[_, mesh] : scene->m_meshes) {
+    usize &size = index_pool_sizes[mesh.index_pool];
+    size = max(size, mesh.triangles->offset + mesh.triangles->size);
+  }
+
+  DynamicArray<BufferView> sources;
+  for (usize i : range(scene->m_index_pools.m_size)) {
+    BufferView pool = BufferView(scene->m_index_pools[i].indices);
+    sources.push(scratch, pool.slice(0, index_pool_sizes[i]));
+  }
+  for (const auto &[_, mesh] : scene->m_meshes) {
+    Handle<Buffer> buffers[] = {
+        mesh.positions, mesh.normals,  mesh.tangents,        mesh.uvs,
+        mesh.colors,    mesh.meshlets, mesh.meshlet_indices,
+    };
+    for (Handle<Buffer> buffer : buffers) {
+      sources.push(scratch, buffer ? renderer->get_buffer_view(buffer)
+                                   : BufferView());
     }
-    if (material.normal_texture) {
-      attributes |= MeshAttribute::Tangent;
+  }
+
+  usize readback_size = 0;
+  for (const BufferView &source : sources) {
+    readback_size += source.count;
+  }
+  Handle<Buffer> readback;
+  const std::byte *readback_data = nullptr;
+  if (readback_size > 0) {
+    rhi::Result<Handle<Buffer>> buffer = renderer->create_buffer({
+        .name = "Scene snapshot readback",
+        .heap = rhi::MemoryHeap::Readback,
+        .size = readback_size,
+    });
+    if (!buffer) {
+      return {};
     }
-    if (mesh.colors) {
-      attributes |= MeshAttribute::Color;
+    readback = *buffer;
+    CommandRecorder cmd;
+    cmd.begin(*renderer, scene->m_frcs->gfx_cmd_pools[0]);
+    usize offset = 0;
+    for (const BufferView &source : sources) {
+      if (source.count > 0) {
+        cmd.copy_buffer(source, BufferView{
+                                    .buffer = readback,
+                                    .offset = offset,
+                                    .count = source.count,
+                                });
+      }
+      offset += source.count;
     }
-    return {scene.m_sid->m_pipelines.opaque_pass[(i32)attributes.get()]};
+    renderer->submit(rhi::QueueFamily::Graphics, {cmd.end()});
+    renderer->wait_idle();
+    readback_data = renderer->map_buffer<std::byte>(readback);
+  }
+
+  SnapshotWriter writer;
+  SceneSnapshotHeader header;
+
+  usize readback_offset = 0;
+  auto write_readback = [&](usize source) {
+    usize size = sources[source].count;
+    SnapshotArray array = writer.write(
+        scratch, Span<const std::byte>(readback_data + readback_offset, size));
+    readback_offset += size;
+    return array;
   };
+
+  usize source = 0;
+  auto index_pools =
+      Span<SnapshotArray>::allocate(scratch, scene->m_index_pools.m_size);
+  for (SnapshotArray &pool : index_pools) {
+    pool = write_readback(source++);
+  }
+  header.index_pools = writer.write(scratch, index_pools);
+
+  header.materials = writer.write_keys(scratch, scene->m_materials.m_indices);
+  auto materials =
+      Span<sh::Material>::allocate(scratch, scene->m_materials.raw_size());
+  fill(materials, sh::Material());
+  for (const auto &[handle, material] : scene->m_materials) {
+    materials[handle.index] = material.data;
+  }
+  header.material_data = writer.write(scratch, materials);
+
+  header.meshes = writer.write_keys(scratch, scene->m_meshes.m_indices);
+  auto meshes =
+      Span<SnapshotMesh>::allocate(scratch, scene->m_meshes.raw_size());
+  fill(meshes, SnapshotMesh());
+  for (const auto &[handle, mesh] : scene->m_meshes) {
+    SnapshotMesh &snapshot_mesh = meshes[handle.index];
+    snapshot_mesh = {
+        .bb = mesh.bb,
+        .scale = mesh.scale,
+        .uv_bs = mesh.uv_bs,
+        .num_lods = mesh.num_lods,
+        .index_pool = mesh.index_pool,
+        .triangles_offset = mesh.triangles->offset,
+        .triangles_size = mesh.triangles->size,
+        .meshlet_base_triangles =
+            writer.write(scratch, mesh.meshlet_base_triangles),
+    };
+    copy(mesh.lods, mesh.num_lods, snapshot_mesh.lods);
+    for (SnapshotArray *array : {
+             &snapshot_mesh.positions,
+             &snapshot_mesh.normals,
+             &snapshot_mesh.tangents,
+             &snapshot_mesh.uvs,
+             &snapshot_mesh.colors,
+             &snapshot_mesh.meshlets,
+             &snapshot_mesh.meshlet_indices,
+         }) {
+      *array = write_readback(source++);
+    }
   }
+  header.mesh_data = writer.write(scratch, meshes);
+
+  // Apply draw set item removals that haven't been processed yet to copies of
+  // the draw sets and mesh instances.
+  header.mesh_instances =
+      writer.write_keys(scratch, scene->m_mesh_instances.m_indices);
+  usize num_mesh_instances = scene->m_mesh_instances.raw_size();
+  Span<MeshInstance> mesh_instances =
+      Span<const MeshInstance>(scene->m_mesh_instances.raw_data(),
+                               num_mesh_instances)
+          .copy(scratch);
+  for (usize s : range(NUM_DRAW_SETS)) {
+    DrawSet draw_set = (DrawSet)(1 << s);
+    const DrawSetData &ds = scene->m_gpu_scene.draw_sets[s];
+    DynamicArray<Handle<MeshInstance>> items;
+    items.push(scratch, Span(ds.items));
+    Span<DrawSetId> remove =
+        Span(scene->m_gpu_scene_update.draw_sets[s].remove).copy(scratch);
+    remove_draw_set_items(items, remove, [&](DrawSetId id) {
+      mesh_instances[items[id].index].draw_set_ids[s] = id;
+    });
 
-  unreachable();
-}
+    auto gpu_items = Span<sh::DrawSetItem>::allocate(scratch, items.m_size);
+    for (usize i : range(items.m_size)) {
+      const MeshInstance &mesh_instance = scene->m_mesh_instances[items[i]];
+      gpu_items[i] = {
+          .mesh = mesh_instance.mesh,
+          .mesh_instance = items[i],
+          .batch = ds.batch_ids.get(
+              get_batch_desc(draw_set, *scene, mesh_instance)),
+      };
+    }
 
-void create_mesh_instances(NotNull<Arena *> frame_arena, Scene *scene,
-                           Span<const MeshInstanceCreateInfo> create_info,
-                           Span<Handle<MeshInstance>> out) {
-  ren_assert(out.m_size >= create_info.m_size);
-  ren_assert(scene->m_mesh_instances.size() + create_info.m_size <=
-             MAX_NUM_MESH_INSTANCES);
+    Span<const Handle<GraphicsPipeline>> pipelines =
+        get_draw_set_pipelines(*scene, draw_set);
+    auto batches =
+        Span<SnapshotDrawSetBatch>::allocate(scratch, ds.batches.m_size);
+    for (usize b : range(ds.batches.m_size)) {
+      const DrawSetBatch &batch = ds.batches[b];
+      batches[b] = {
+          .pipeline =
+              u32(find(pipelines, batch.desc.pipeline) - pipelines.m_data),
+          .index_pool = batch.desc.index_pool,
+          .num_meshlets = batch.num_meshlets,
+      };
+    }
 
-  for (usize i : range(create_info.m_size)) {
-    ren_assert(create_info[i].mesh);
-    ren_assert(create_info[i].material);
+    header.draw_sets[s] = {
+        .items = writer.write(scratch, Span(items)),
+        .gpu_items = writer.write(scratch, gpu_items),
+        .batches = writer.write(scratch, batches),
+    };
+  }
+  header.mesh_instance_data =
+      writer.write(scratch, mesh_instances);
+  header.transforms = writer.write(
+      scratch, Span<const glm::mat4x3>(scene->m_transforms.m_data,
+                                       num_mesh_instances));
+  header.decode_scales =
+      writer.write(scratch, Span<const float>(
+                                scene->m_mesh_instance_decode_scales.m_data,
+                                num_mesh_instances));
+
+  header.size = writer.size;
+  auto blob = Span<std::byte>::allocate(arena, writer.size);
+  fill(blob, std::byte(0));
+  std::memcpy(blob.m_data, &header, sizeof(header));
+  for (const SnapshotWriter::Chunk &chunk : writer.chunks) {
+    if (chunk.size > 0) {
+      std::memcpy(&blob[chunk.offset], chunk.data, chunk.size);
+    }
+  }
 
-    Handle<MeshInstance> handle = scene->m_mesh_instances.insert(
-        scene->m_arena, {create_info[i].mesh, create_info[i].material});
-    MeshInstance &mesh_instance = scene->m_mesh_instances[handle];
+  if (readback) {
+    renderer->destroy(readback);
+  }
 
-    const Mesh &mesh = scene->m_meshes[create_info[i].mesh];
-    u32 num_meshlets = mesh.lods[0].num_meshlets;
+  return blob;
+}
 
-    for (auto k : range(NUM_DRAW_SETS)) {
-      DrawSetData &ds = scene->m_gpu_scene.draw_sets[k];
+bool load_scene_snapshot(NotNull<Arena *> frame_arena, Scene *scene,
+                         Span<const std::byte> blob) {
+  ZoneScoped;
 
-      DrawSetBatchDesc batch_desc =
-          get_batch_desc((DrawSet)(1 << k), *scene, mesh_instance);
-      DrawSetBatch *batch = nullptr;
-      for (DrawSetBatch &b : ds.batches) {
-        if (b.desc == batch_desc) {
-          batch = &b;
-          break;
-        }
-      }
-      if (!batch) {
-        ds.batches.push(scene->m_arena, {batch_desc});
-        batch = &ds.batches.back();
-      }
-      batch->num_meshlets += num_meshlets;
+  ScratchArena scratch;
 
-      DrawSetId id(ds.items.m_size);
-      ds.items.push(scene->m_arena, handle);
-      mesh_instance.draw_set_ids[k] = id;
+  if (blob.m_size < sizeof(SceneSnapshotHeader)) {
+    return false;
+  }
+  const auto &header = *(const SceneSnapshotHeader *)blob.m_data;
+  if (header.magic != SCENE_SNAPSHOT_MAGIC) {
+    return false;
+  }
+  if (header.version != SCENE_SNAPSHOT_VERSION) {
+    return false;
+  }
+  if (header.size != blob.m_size) {
+    return false;
+  }
 
-      sh::DrawSetItem gpu_item = {
-          .mesh = mesh_instance.mesh,
-          .mesh_instance = handle,
-          .batch = sh::BatchId(batch - ds.batches.m_data),
-      };
-      scene->m_gpu_scene_update.draw_sets[k].update.push(frame_arena,
-                                                         {id, gpu_item});
+  ren_assert_msg(scene->m_meshes.empty() and scene->m_materials.empty() and
+                     scene->m_mesh_instances.empty(),
+                 "Scene snapshots can only be loaded into empty scenes");
+
+  // Check everything before anything is restored. Only allocation failures
+  // after this point can leave the scene partially loaded.
+  Span<const SnapshotArray> index_pools;
+  if (!get_snapshot_span(blob, header.index_pools, &index_pools) or
+      index_pools.m_size > sh::MAX_NUM_INDEX_POOLS) {
+    return false;
+  }
+  auto index_pool_indices =
+      Span<Span<const u8>>::allocate(scratch, index_pools.m_size);
+  for (usize i : range(index_pools.m_size)) {
+    if (!get_snapshot_span(blob, index_pools[i], &index_pool_indices[i]) or
+        index_pool_indices[i].m_size > sh::INDEX_POOL_SIZE) {
+      return false;
     }
+  }
 
-    scene->m_gpu_scene_update.mesh_instances.push(
-        frame_arena, {
-                         handle,
-                         {
-                             .mesh = mesh_instance.mesh,
-                             .material = mesh_instance.material,
-                         },
-                     });
+  Span<const GenIndex> material_keys;
+  Span<const sh::Material> materials;
+  if (!get_snapshot_keys<Handle<Material>>(blob, header.materials,
+                                           MAX_NUM_MATERIALS, &material_keys) or
+      !get_snapshot_span(blob, header.material_data, &materials) or
+      materials.m_size != material_keys.m_size) {
+    return false;
+  }
 
-    out[i] = handle;
+  Span<const GenIndex> mesh_keys;
+  Span<const SnapshotMesh> meshes;
+  if (!get_snapshot_keys<Handle<Mesh>>(blob, header.meshes, MAX_NUM_MESHES,
+                                       &mesh_keys) or
+      !get_snapshot_span(blob, header.mesh_data, &meshes) or
+      meshes.m_size != mesh_keys.m_size or
+      !validate_snapshot_meshes(blob, mesh_keys, meshes,
+                                index_pools.m_size)) {
+    return false;
   }
-}
 
-void destroy_mesh_instances(NotNull<Arena *> frame_arena, Scene *scene,
-                            Span<const Handle<MeshInstance>> mesh_instances) {
-  for (Handle<MeshInstance> handle : mesh_instances) {
-    if (!handle) {
+  Span<const GenIndex> mesh_instance_keys;
+  Span<const MeshInstance> mesh_instances;
+  Span<const glm::mat4x3> transforms;
+  Span<const float> decode_scales;
+  if (!get_snapshot_keys<Handle<MeshInstance>>(
+          blob, header.mesh_instances, MAX_NUM_MESH_INSTANCES,
+          &mesh_instance_keys) or
+      !get_snapshot_span(blob, header.mesh_instance_data, &mesh_instances) or
+      !get_snapshot_span(blob, header.transforms, &transforms) or
+      !get_snapshot_span(blob, header.decode_scales, &decode_scales) or
+      mesh_instances.m_size != mesh_instance_keys.m_size or
+      transforms.m_size != mesh_instance_keys.m_size or
+      decode_scales.m_size != mesh_instance_keys.m_size) {
+    return false;
+  }
+  usize num_mesh_instances = mesh_instance_keys.m_size;
+  usize num_live_mesh_instances = 0;
+  for (usize i : range(usize(1), num_mesh_instances)) {
+    if (mesh_instance_keys[i].index !=
+        GenIndexPool<Handle<MeshInstance>>::ACTIVE) {
       continue;
     }
+    num_live_mesh_instances++;
+    if (!snapshot_keys_contain(mesh_keys, mesh_instances[i].mesh) or
+        !snapshot_keys_contain(material_keys, mesh_instances[i].material)) {
+      return false;
+    }
+  }
 
-    const MeshInstance &mesh_instance = scene->m_mesh_instances[handle];
-    const Mesh &mesh = scene->m_meshes.get(mesh_instance.mesh);
-    u32 num_meshlets = mesh.lods[0].num_meshlets;
-
-    for (auto k : range(NUM_DRAW_SETS)) {
-      DrawSetData &ds = scene->m_gpu_scene.draw_sets[k];
+  Span<const Handle<MeshInstance>> draw_set_items[NUM_DRAW_SETS];
+  Span<const sh::DrawSetItem> draw_set_gpu_items[NUM_DRAW_SETS];
+  Span<const SnapshotDrawSetBatch> draw_set_batches[NUM_DRAW_SETS];
+  for (usize s : range(NUM_DRAW_SETS)) {
+    const SnapshotDrawSet &snapshot_ds = header.draw_sets[s];
+    Span<const Handle<MeshInstance>> &items = draw_set_items[s];
+    Span<const sh::DrawSetItem> &gpu_items = draw_set_gpu_items[s];
+    Span<const SnapshotDrawSetBatch> &batches = draw_set_batches[s];
+    if (!get_snapshot_span(blob, snapshot_ds.items, &items) or
+        !get_snapshot_span(blob, snapshot_ds.gpu_items, &gpu_items) or
+        !get_snapshot_span(blob, snapshot_ds.batches, &batches) or
+        items.m_size != num_live_mesh_instances or
+        gpu_items.m_size != items.m_size) {
+      return false;
+    }
 
-      DrawSetBatchDesc batch_desc =
-          get_batch_desc((DrawSet)(1 << k), *scene, mesh_instance);
-      DrawSetBatch *batch = nullptr;
-      for (DrawSetBatch &b : ds.batches) {
-        if (b.desc == batch_desc) {
-          batch = &b;
-          break;
-        }
+    usize num_pipelines =
+        get_draw_set_pipelines(*scene, (DrawSet)(1 << s)).m_size;
+    for (const SnapshotDrawSetBatch &batch : batches) {
+      if (batch.pipeline >= num_pipelines or
+          batch.index_pool >= index_pools.m_size) {
+        return false;
       }
-      ren_assert(batch);
-      batch->num_meshlets -= num_meshlets;
+    }
 
-      DrawSetId id = mesh_instance.draw_set_ids[k];
-      ren_assert(id != InvalidDrawSetId);
-      scene->m_gpu_scene_update.draw_sets[k].remove.push(frame_arena, id);
+    // Each mesh instance is in every draw set, at the position that it
+    // remembers.
+    for (usize i : range(usize(1), num_mesh_instances)) {
+      if (mesh_instance_keys[i].index !=
+          GenIndexPool<Handle<MeshInstance>>::ACTIVE) {
+        continue;
+      }
+      DrawSetId id = mesh_instances[i].draw_set_ids[s];
+      if (id >= items.m_size or items[id].index != i or
+          items[id].gen != mesh_instance_keys[i].gen) {
+        return false;
+      }
+    }
+    for (usize i : range(items.m_size)) {
+      const MeshInstance &mesh_instance = mesh_instances[items[i].index];
+      if (gpu_items[i].mesh_instance != items[i].index or
+          gpu_items[i].mesh != mesh_instance.mesh.index or
+          gpu_items[i].batch >= batches.m_size) {
+        return false;
+      }
     }
+  }
 
-    scene->m_mesh_instances.erase(handle);
+  Renderer *renderer = scene->m_renderer;
+  ResourceUploader &uploader = scene->m_sid->m_resource_uploader;
+  UploadBumpAllocator &upload_allocator = scene->m_frcs->upload_allocator;
+  GpuSceneUpdate &update = scene->m_gpu_scene_update;
+
+  // Upload each index pool with a single copy.
+  while (scene->m_index_pools.m_size < index_pools.m_size) {
+    if (!create_index_pool(scene)) {
+      return false;
+    }
+  }
+  for (usize i : range(index_pools.m_size)) {
+    Span<const u8> indices = index_pool_indices[i];
+    if (indices.m_size > 0) {
+      uploader.stage_buffer(
+          frame_arena, *renderer, upload_allocator, indices,
+          scene->m_index_pools[i].indices.slice(0, indices.m_size));
+    }
   }
-}
 
-struct StagingBufferIndexAndOffset {
-  usize index = 0;
-  usize offset = 0;
-};
+  scene->m_materials.restore(scene->m_arena, material_keys,
+                             header.materials.free_list,
+                             header.materials.num_free);
+  for (auto &&[handle, material] : scene->m_materials) {
+    material.data = materials[handle.index];
+    update.materials.push(frame_arena, {handle, material.data});
+  }
 
-// If base size is 1, then
-// Index 0b000 maps to 0,
-// Indices 0b001 and 0b010 map to 1,
-// Indices 0b011, 0b100, 0b101, 0b110 map to 2.
-// Notice that the staging buffer index is equal to the MSB position of (index
-// + 1), and the offset into the staging buffer is all the bits except the
-// MSB.
-StagingBufferIndexAndOffset mesh_instance_index_to_sb_and_offset(usize index) {
-  index = index + MIN_TRANSFORM_STAGING_BUFFER_SIZE;
-  usize hi_bit = find_msb(index);
-  usize mask = (1 << hi_bit) - 1;
-  return {hi_bit - find_msb(MIN_TRANSFORM_STAGING_BUFFER_SIZE), index & mask};
-};
+  scene->m_meshes.restore(scene->m_arena, mesh_keys, header.meshes.free_list,
+                          header.meshes.num_free);
+  for (auto &&[handle, mesh] : scene->m_meshes) {
+    const SnapshotMesh &snapshot_mesh = meshes[handle.index];
+    mesh = {
+        .bb = snapshot_mesh.bb,
+        .scale = snapshot_mesh.scale,
+        .uv_bs = snapshot_mesh.uv_bs,
+        .meshlet_base_triangles =
+            snapshot_span<u32>(blob, snapshot_mesh.meshlet_base_triangles)
+                .copy(scene->m_arena),
+        .index_pool = snapshot_mesh.index_pool,
+        .num_lods = snapshot_mesh.num_lods,
+    };
+    copy(snapshot_mesh.lods, snapshot_mesh.num_lods, mesh.lods);
+
+    struct {
+      SnapshotArray data;
+      Handle<Buffer> *buffer;
+      const char *name;
+    } buffers[] = {
+        {snapshot_mesh.positions, &mesh.positions, "positions"},
+        {snapshot_mesh.normals, &mesh.normals, "normals"},
+        {snapshot_mesh.tangents, &mesh.tangents, "tangents"},
+        {snapshot_mesh.uvs, &mesh.uvs, "uvs"},
+        {snapshot_mesh.colors, &mesh.colors, "colors"},
+        {snapshot_mesh.meshlets, &mesh.meshlets, "meshlets"},
+        {snapshot_mesh.meshlet_indices, &mesh.meshlet_indices, "indices"},
+    };
+    for (const auto &[data, buffer, name] : buffers) {
+      if (!create_mesh_buffer(frame_arena, scene, snapshot_span<u8>(blob, data),
+                              buffer,
+                              format(scratch, "Mesh {} {}", handle.index,
+                                     name))) {
+        return false;
+      }
+    }
 
-void set_mesh_instance_transforms(
-    NotNull<Arena *> frame_arena, Scene *scene,
-    Span<const Handle<MeshInstance>> mesh_instances,
-    Span<const glm::mat4x3> matrices) {
-  ZoneScoped;
+    // Triangles were uploaded together with their index pool.
+    mesh.triangles = tlsf_allocate_at(
+        scene->m_arena, scene->m_index_pools[mesh.index_pool].allocator,
+        snapshot_mesh.triangles_offset, snapshot_mesh.triangles_size);
+    if (!mesh.triangles) {
+      return false;
+    }
 
-  ren_assert(mesh_instances.m_size == matrices.m_size);
+    update.meshes.push(frame_arena, {handle, get_gpu_mesh(*renderer, mesh)});
+  }
 
-  usize raw_size = scene->m_mesh_instances.raw_size();
-  usize num_sbs = mesh_instance_index_to_sb_and_offset(raw_size - 1).index + 1;
-  for (usize i : range<usize>(scene->m_sid->m_transform_staging_buffers.m_size,
-                              num_sbs)) {
-    usize size = MIN_TRANSFORM_STAGING_BUFFER_SIZE << i;
-    scene->m_sid->m_transform_staging_buffers.push(
-        frame_arena,
-        scene->m_frcs->upload_allocator.allocate<glm::mat4x3>(size));
+  scene->m_mesh_instances.restore(scene->m_arena, mesh_instance_keys,
+                                  header.mesh_instances.free_list,
+                                  header.mesh_instances.num_free);
+  copy(mesh_instances, scene->m_mesh_instances.raw_data());
+  reserve_mesh_instance_transforms(scene);
+  copy(transforms, scene->m_transforms.m_data);
+  copy(decode_scales, scene->m_mesh_instance_decode_scales.m_data);
+  fill(Span(scene->m_transform_dirty_pages), ~u64(0));
+
+  // Upload all mesh instances with a single copy.
+  auto gpu_mesh_instances =
+      upload_allocator.allocate<sh::MeshInstance>(num_mesh_instances);
+  for (usize i : range(num_mesh_instances)) {
+    gpu_mesh_instances.host_ptr[i] = {
+        .mesh = mesh_instances[i].mesh,
+        .material = mesh_instances[i].material,
+    };
   }
+  update.mesh_instance_ranges.push(frame_arena,
+                                   {.src = gpu_mesh_instances.slice});
 
-  for (usize i : range(mesh_instances.m_size)) {
-    Handle<MeshInstance> handle = mesh_instances[i];
-    const MeshInstance &mesh_instance = scene->m_mesh_instances[handle];
-    const Mesh &mesh = scene->m_meshes[mesh_instance.mesh];
-    auto [sb, offset] = mesh_instance_index_to_sb_and_offset(handle);
-    scene->m_sid->m_transform_staging_buffers[sb].host_ptr[offset] =
-        matrices[i] * sh::make_decode_position_matrix(mesh.scale);
+  for (usize s : range(NUM_DRAW_SETS)) {
+    DrawSet draw_set = (DrawSet)(1 << s);
+    DrawSetData &ds = scene->m_gpu_scene.draw_sets[s];
+    ren_assert(ds.items.m_size == 0);
+
+    ds.items.push(scene->m_arena, draw_set_items[s]);
+
+    Span<const Handle<GraphicsPipeline>> pipelines =
+        get_draw_set_pipelines(*scene, draw_set);
+    ds.batches.clear();
+    ds.batch_ids.clear();
+    for (const SnapshotDrawSetBatch &batch : draw_set_batches[s]) {
+      DrawSetBatchDesc desc = {
+          .pipeline = pipelines[batch.pipeline],
+          .index_pool = batch.index_pool,
+      };
+      ds.batch_ids.insert(scene->m_arena, desc, ds.batches.m_size);
+      ds.batches.push(scene->m_arena, {desc, batch.num_meshlets});
+    }
+
+    // Upload all draw set items with a single copy.
+    Span<const sh::DrawSetItem> items = draw_set_gpu_items[s];
+    if (items.m_size > 0) {
+      auto gpu_items = upload_allocator.allocate<sh::DrawSetItem>(items.m_size);
+      copy(items, gpu_items.host_ptr);
+      update.draw_sets[s].ranges.push(
+          frame_arena, {.src = gpu_items.slice, .offset = DrawSetId(0)});
+    }
   }
+
+  return true;
 }
 
 Handle<DirectionalLight>
@@ -785,6 +1996,10 @@ void set_environment_color(Scene *scene, const glm::vec3 &luminance) {
 }
 
 void set_environment_map(Scene *scene, Handle<Image> image) {
+  if (scene->m_environment_map) {
+    retire_descriptor(scene, sh::Handle(scene->m_environment_map.m_id,
+                                        scene->m_environment_map.Kind));
+  }
   if (!image) {
     scene->m_environment_map = {};
     return;
@@ -805,49 +2020,239 @@ void delay_input(Scene *scene) {
   }
 }
 
+// Upload count elements to scattered locations in dst with a single compute
+// dispatch. get(i, &index, &data) must return the i-th element and its index.
+// If the same index is updated multiple times, the last update wins. Returns
+// the number of recorded commands.
+template <typename T>
+usize scatter_upload(Renderer &renderer, const RgRuntime &rg,
+                     CommandRecorder &cmd, Handle<ComputePipeline> pipeline,
+                     BufferSlice<T> dst, usize count, auto get) {
+  static_assert(sizeof(T) % sizeof(u32) == 0);
+  if (count == 0) {
+    return 0;
+  }
+  ScratchArena scratch;
+  auto indices = rg.allocate<u32>(count);
+  auto data = rg.allocate<T>(count);
+  // Threads are not ordered within a dispatch, so drop overwritten updates.
+  DynamicArray<u64> seen;
+  usize num_unique = 0;
+  for (isize i = isize(count) - 1; i >= 0; --i) {
+    u32 index;
+    T value;
+    get(i, &index, &value);
+    while (seen.m_size <= index / 64) {
+      seen.push(scratch, 0);
+    }
+    u64 bit = u64(1) << (index % 64);
+    if (seen[index / 64] & bit) {
+      continue;
+    }
+    seen[index / 64] |= bit;
+    indices.host_ptr[num_unique] = index;
+    data.host_ptr[num_unique] = value;
+    num_unique++;
+  }
+  u32 stride = sizeof(T) / sizeof(u32);
+  cmd.bind_compute_pipeline(pipeline);
+  cmd.push_constants(sh::ScatterUploadArgs{
+      .indices = indices.device_ptr,
+      .src = DevicePtr<u32>(data.device_ptr),
+      .dst = DevicePtr<u32>(renderer.get_buffer_device_ptr(dst)),
+      .count = (u32)num_unique,
+      .stride = stride,
+  });
+  cmd.dispatch_grid(num_unique * stride);
+  return 3;
+}
+
+// Upload elements that were already written to upload memory to consecutive
+// locations in dst starting at offset. Returns the number of recorded
+// commands.
+template <typename T>
+usize range_upload(Renderer &renderer, CommandRecorder &cmd,
+                   Handle<ComputePipeline> pipeline, BufferSlice<T> dst,
+                   BufferSlice<T> src, u32 offset) {
+  static_assert(sizeof(T) % sizeof(u32) == 0);
+  u32 stride = sizeof(T) / sizeof(u32);
+  cmd.bind_compute_pipeline(pipeline);
+  cmd.push_constants(sh::ScatterUploadArgs{
+      .src = DevicePtr<u32>(renderer.get_buffer_device_ptr(src)),
+      .dst = DevicePtr<u32>(renderer.get_buffer_device_ptr(dst)),
+      .base = offset,
+      .count = (u32)src.count,
+      .stride = stride,
+  });
+  cmd.dispatch_grid(src.count * stride);
+  return 3;
+}
+
+void scatter_upload_barrier(CommandRecorder &cmd) {
+  cmd.memory_barrier({
+      .src_stage_mask = rhi::PipelineStage::ComputeShader,
+      .src_access_mask = rhi::Access::UnorderedAccess,
+      .dst_stage_mask = rhi::PipelineStage::ComputeShader,
+      .dst_access_mask = rhi::Access::UnorderedAccess,
+  });
+}
+
+// Update index pool statistics and move mesh triangles towards the start of
+// fragmented index pools. Triangles are only ever moved to lower offsets, so
+// compaction converges once there are no holes below a mesh that can fit it.
+void compact_index_pools(NotNull<Arena *> arena, NotNull<Scene *> scene) {
+  ZoneScoped;
+
+  constexpr usize MAX_NUM_MOVES = 64;
+
+  bool fragmented = false;
+  for (IndexPool &pool : scene->m_index_pools) {
+    pool.stats = tlsf_get_stats(pool.allocator);
+    fragmented = fragmented or tlsf_fragmentation(pool.stats) >
+                                   INDEX_POOL_COMPACTION_THRESHOLD;
+  }
+  scene->m_index_pool_compaction_bytes = 0;
+  if (!fragmented or !scene->m_settings.index_pool_compaction) {
+    return;
+  }
+
+  ScratchArena scratch;
+  struct Candidate {
+    usize offset = 0;
+    Handle<Mesh> mesh;
+  };
+  DynamicArray<Candidate> candidates;
+  for (const auto &[handle, mesh] : scene->m_meshes) {
+    const IndexPool &pool = scene->m_index_pools[mesh.index_pool];
+    if (tlsf_fragmentation(pool.stats) > INDEX_POOL_COMPACTION_THRESHOLD) {
+      candidates.push(scratch, {mesh.triangles->offset, handle});
+    }
+  }
+  // Moving the highest meshes first frees up the end of the pool.
+  std::ranges::sort(candidates, [](const Candidate &lhs,
+                                   const Candidate &rhs) {
+    return lhs.offset > rhs.offset;
+  });
+
+  Renderer *renderer = scene->m_renderer;
+  usize budget = INDEX_POOL_COMPACTION_BUDGET;
+  DynamicArray<IndexPoolMove> &moves =
+      scene->m_gpu_scene_update.index_pool_moves;
+  for (const Candidate &candidate : candidates) {
+    if (moves.m_size == MAX_NUM_MOVES) {
+      break;
+    }
+    Mesh &mesh = scene->m_meshes[candidate.mesh];
+    usize size = mesh.triangles->size;
+    if (size > budget) {
+      continue;
+    }
+    IndexPool &pool = scene->m_index_pools[mesh.index_pool];
+    TlsfAllocation *dst = tlsf_allocate(scene->m_arena, pool.allocator, size);
+    if (!dst) {
+      continue;
+    }
+    if (dst->offset >= mesh.triangles->offset) {
+      tlsf_free(pool.allocator, dst);
+      continue;
+    }
+    usize num_meshlets = mesh.meshlet_base_triangles.m_size;
+    rhi::Result<Handle<Buffer>> meshlets = renderer->create_buffer({
+        .name = format(scratch, "Mesh {} meshlets", candidate.mesh.index),
+        .heap = rhi::MemoryHeap::Default,
+        .size = num_meshlets * sizeof(sh::Meshlet),
+    });
+    if (!meshlets) {
+      tlsf_free(pool.allocator, dst);
+      continue;
+    }
+    moves.push(arena, {
+                          .mesh = candidate.mesh,
+                          .index_pool = mesh.index_pool,
+                          .src = (u32)mesh.triangles->offset,
+                          .dst = (u32)dst->offset,
+                          .size = (u32)size,
+                          .src_meshlets = {mesh.meshlets, 0, num_meshlets},
+                          .dst_meshlets = {*meshlets, 0, num_meshlets},
+                      });
+    // The old range and meshlets are still used by frames in flight.
+    retire_index_range(scene, mesh.index_pool, mesh.triangles);
+    retire_buffer(scene, mesh.meshlets);
+    mesh.triangles = dst;
+    mesh.meshlets = *meshlets;
+    scene->m_gpu_scene_update.meshes.push(
+        arena, {candidate.mesh, get_gpu_mesh(*renderer, mesh)});
+    budget -= size;
+  }
+  scene->m_index_pool_compaction_bytes = INDEX_POOL_COMPACTION_BUDGET - budget;
+  TracyPlot("Index pool compaction bytes",
+            i64(scene->m_index_pool_compaction_bytes));
+}
+
 RgGpuScene gpu_scene_update_pass(NotNull<Scene *> scene,
                                  const PassCommonConfig &cfg) {
   ScratchArena scratch;
 
+  compact_index_pools(cfg.rgb->m_arena, scene);
+
   for (usize s : range(NUM_DRAW_SETS)) {
     DrawSetData &data = scene->m_gpu_scene.draw_sets[s];
     DrawSetUpdate &update = scene->m_gpu_scene_update.draw_sets[s];
-    std::ranges::sort(update.remove);
-    for (isize i = isize(update.remove.m_size) - 1; i >= 0; --i) {
-      DrawSetId id = update.remove[i];
-      if (id == data.items.m_size - 1) {
-        data.items.pop();
-        continue;
-      }
-
-      std::swap(data.items.back(), data.items[id]);
-      data.items.pop();
-
+    remove_draw_set_items(data.items, update.remove, [&](DrawSetId id) {
       Handle<MeshInstance> handle = data.items[id];
       MeshInstance &mesh_instance = scene->m_mesh_instances[handle];
       mesh_instance.draw_set_ids[s] = id;
 
       DrawSetBatchDesc batch_desc =
           get_batch_desc((DrawSet)(1 << s), *scene, mesh_instance);
-      DrawSetBatch *batch = nullptr;
-      for (DrawSetBatch &b : data.batches) {
-        if (b.desc == batch_desc) {
-          batch = &b;
-          break;
-        }
-      }
-      ren_assert(batch);
 
       sh::DrawSetItem gpu_item = {
           .mesh = mesh_instance.mesh,
           .mesh_instance = handle,
-          .batch = (sh::BatchId)(batch - data.batches.m_data),
+          .batch = data.batch_ids.get(batch_desc),
       };
       update.overwrite.push(cfg.rgb->m_arena, {id, gpu_item});
-    }
+    });
     update.remove.clear();
   }
 
+  {
+    ZoneScopedN("Collect dirty transforms");
+    // Upload runs of dirty pages with one copy each.
+    Span<const glm::mat4x3> transforms = scene->m_transforms;
+    Span<u64> dirty_pages = scene->m_transform_dirty_pages;
+    usize num_pages = ceil_div(transforms.m_size, TRANSFORM_PAGE_SIZE);
+    auto is_dirty = [&](usize page) {
+      return (dirty_pages[page / 64] >> (page % 64)) & 1;
+    };
+    scene->m_transform_upload_bytes = 0;
+    usize page = 0;
+    while (page < num_pages) {
+      if (dirty_pages[page / 64] == 0) {
+        page = (page / 64 + 1) * 64;
+        continue;
+      }
+      if (!is_dirty(page)) {
+        page++;
+        continue;
+      }
+      usize first_page = page;
+      while (page < num_pages and is_dirty(page)) {
+        page++;
+      }
+      usize begin = first_page * TRANSFORM_PAGE_SIZE;
+      usize count = min(page * TRANSFORM_PAGE_SIZE, transforms.m_size) - begin;
+      auto data =
+          scene->m_frcs->upload_allocator.allocate<glm::mat4x3>(count);
+      copy(transforms.subspan(begin, count), data.host_ptr);
+      scene->m_gpu_scene_update.transforms.push(
+          cfg.rgb->m_arena, {.src = data.slice, .offset = (u32)begin});
+      scene->m_transform_upload_bytes += count * sizeof(glm::mat4x3);
+    }
+    fill(dirty_pages, 0);
+    TracyPlot("Transform upload bytes", i64(scene->m_transform_upload_bytes));
+  }
+
   RgBuilder &rgb = *cfg.rgb;
 
   RgGpuScene rg_gpu_scene = {
@@ -855,8 +2260,8 @@ RgGpuScene gpu_scene_update_pass(NotNull<Scene *> scene,
       .meshes = rgb.create_buffer("meshes", scene->m_gpu_scene.meshes),
       .mesh_instances = rgb.create_buffer("mesh-instances",
                                           scene->m_gpu_scene.mesh_instances),
-      .transform_matrices =
-          rgb.create_buffer<glm::mat4x3>({.count = MAX_NUM_MESH_INSTANCES}),
+      .transform_matrices = rgb.create_buffer(
+          "transform-matrices", scene->m_gpu_scene.transform_matrices),
       .mesh_instance_visibility =
           rgb.create_buffer("mesh-instance-visibility",
                             scene->m_gpu_scene.mesh_instance_visibility),
@@ -876,6 +2281,7 @@ RgGpuScene gpu_scene_update_pass(NotNull<Scene *> scene,
 
   struct {
     const Scene *scene = nullptr;
+    Handle<ComputePipeline> scatter_upload;
     RgBufferToken<sh::Mesh> meshes;
     RgBufferToken<sh::MeshInstance> mesh_instances;
     StackArray<RgBufferToken<sh::DrawSetItem>, NUM_DRAW_SETS> draw_sets;
@@ -885,36 +2291,38 @@ RgGpuScene gpu_scene_update_pass(NotNull<Scene *> scene,
   } rcs;
 
   rcs.scene = scene;
+  rcs.scatter_upload = scene->m_sid->m_pipelines.scatter_upload;
 
   if (scene->m_gpu_scene_update.meshes.m_size > 0) {
-    rcs.meshes = pass.write_buffer("meshes-updated", &rg_gpu_scene.meshes,
-                                   rhi::TRANSFER_DST_BUFFER);
+    rcs.meshes = pass.write_buffer("meshes-updated", &rg_gpu_scene.meshes);
   }
 
-  if (scene->m_gpu_scene_update.mesh_instances.m_size > 0) {
+  if (scene->m_gpu_scene_update.mesh_instances.m_size > 0 or
+      scene->m_gpu_scene_update.mesh_instance_ranges.m_size > 0) {
     rcs.mesh_instances = pass.write_buffer("mesh-instances-updated",
-                                           &rg_gpu_scene.mesh_instances,
-                                           rhi::TRANSFER_DST_BUFFER);
+                                           &rg_gpu_scene.mesh_instances);
   }
 
   for (auto i : range(NUM_DRAW_SETS)) {
     const DrawSetUpdate &ds = scene->m_gpu_scene_update.draw_sets[i];
-    if (ds.update.m_size > 0 or ds.overwrite.m_size > 0) {
+    if (ds.ranges.m_size > 0 or ds.update.m_size > 0 or
+        ds.overwrite.m_size > 0) {
       rcs.draw_sets[i] = pass.write_buffer(
           format(scratch, "{}-draw-set-updated",
                  get_draw_set_name((DrawSet)(1 << i))),
-          &rg_gpu_scene.draw_sets[i].items,
-          rhi::TRANSFER_SRC_BUFFER | rhi::TRANSFER_DST_BUFFER);
+          &rg_gpu_scene.draw_sets[i].items);
     }
   }
 
-  rcs.transform_matrices =
-      pass.write_buffer("transform-matrices", &rg_gpu_scene.transform_matrices,
-                        rhi::TRANSFER_DST_BUFFER);
+  if (scene->m_gpu_scene_update.transforms.m_size > 0) {
+    rcs.transform_matrices = pass.write_buffer(
+        "transform-matrices-updated", &rg_gpu_scene.transform_matrices,
+        rhi::TRANSFER_DST_BUFFER);
+  }
 
   if (scene->m_gpu_scene_update.materials.m_size > 0) {
-    rcs.materials = pass.write_buffer(
-        "materials-updated", &rg_gpu_scene.materials, rhi::TRANSFER_DST_BUFFER);
+    rcs.materials =
+        pass.write_buffer("materials-updated", &rg_gpu_scene.materials);
   }
 
   rg_gpu_scene.directional_lights =
@@ -929,50 +2337,54 @@ RgGpuScene gpu_scene_update_pass(NotNull<Scene *> scene,
   pass.set_callback([rcs](Renderer &renderer, const RgRuntime &rg,
                           CommandRecorder &cmd) {
     const GpuSceneUpdate *gsu = &rcs.scene->m_gpu_scene_update;
+    u64 start = ren::clock();
+    usize num_commands = 0;
 
     if (rcs.meshes) {
       auto _ = cmd.debug_region("Update meshes");
       ZoneScopedN("Update meshes");
-      auto data = rg.allocate<sh::Mesh>(gsu->meshes.m_size);
-      BufferSlice<sh::Mesh> meshes = rg.get_buffer(rcs.meshes);
-      for (usize i : range(gsu->meshes.m_size)) {
-        data.host_ptr[i] = gsu->meshes[i].data;
-        cmd.copy_buffer(data.slice.slice(i, 1),
-                        meshes.slice(gsu->meshes[i].handle, 1));
-      }
+      num_commands += scatter_upload(
+          renderer, rg, cmd, rcs.scatter_upload, rg.get_buffer(rcs.meshes),
+          gsu->meshes.m_size, [&](usize i, u32 *index, sh::Mesh *data) {
+            *index = gsu->meshes[i].handle;
+            *data = gsu->meshes[i].data;
+          });
     }
 
     if (rcs.mesh_instances) {
       auto _ = cmd.debug_region("Update mesh instances");
       ZoneScopedN("Update mesh instances");
-      auto data = rg.allocate<sh::MeshInstance>(gsu->mesh_instances.m_size);
       BufferSlice<sh::MeshInstance> mesh_instances =
           rg.get_buffer(rcs.mesh_instances);
-      for (usize i : range(gsu->mesh_instances.m_size)) {
-        data.host_ptr[i] = gsu->mesh_instances[i].data;
-        cmd.copy_buffer(data.slice.slice(i, 1),
-                        mesh_instances.slice(gsu->mesh_instances[i].handle, 1));
+      for (const GpuSceneMeshInstanceRangeUpdate &update :
+           gsu->mesh_instance_ranges) {
+        num_commands += range_upload(renderer, cmd, rcs.scatter_upload,
+                                     mesh_instances, update.src, update.offset);
       }
+      // A handle from a range might have been destroyed and reused.
+      if (gsu->mesh_instance_ranges.m_size > 0 and
+          gsu->mesh_instances.m_size > 0) {
+        scatter_upload_barrier(cmd);
+        num_commands++;
+      }
+      num_commands += scatter_upload(
+          renderer, rg, cmd, rcs.scatter_upload, mesh_instances,
+          gsu->mesh_instances.m_size,
+          [&](usize i, u32 *index, sh::MeshInstance *data) {
+            *index = gsu->mesh_instances[i].handle;
+            *data = gsu->mesh_instances[i].data;
+          });
     }
 
-    {
+    if (rcs.transform_matrices) {
       auto _ = cmd.debug_region("Update mesh instance transforms");
       ZoneScopedN("Update mesh instance transforms");
-      Span<const UploadBumpAllocation<glm::mat4x3>> sbs =
-          rcs.scene->m_sid->m_transform_staging_buffers;
-      usize count = rcs.scene->m_mesh_instances.raw_size();
-      usize offset = 0;
-      for (usize sb : range(sbs.m_size)) {
-        usize sb_size = MIN_TRANSFORM_STAGING_BUFFER_SIZE << sb;
-
-        usize num_copy = min(sb_size, count);
-        BufferSlice<glm::mat4x3> src = sbs[sb].slice.slice(0, num_copy);
-        BufferSlice<glm::mat4x3> dst =
-            rg.get_buffer(rcs.transform_matrices).slice(offset, num_copy);
-        cmd.copy_buffer(src, dst);
-
-        count -= num_copy;
-        offset += sb_size;
+      BufferSlice<glm::mat4x3> transform_matrices =
+          rg.get_buffer(rcs.transform_matrices);
+      for (const GpuSceneTransformUpdate &update : gsu->transforms) {
+        cmd.copy_buffer(update.src, transform_matrices.slice(
+                                        update.offset, update.src.count));
+        num_commands++;
       }
     }
 
@@ -985,46 +2397,93 @@ RgGpuScene gpu_scene_update_pass(NotNull<Scene *> scene,
       ScratchArena scratch;
       auto _ = cmd.debug_region(format(scratch, "Update draw set {}", s));
 
-      if (ds.update.m_size) {
-        auto data = rg.allocate<sh::DrawSetItem>(ds.update.m_size);
-        for (usize i : range(ds.update.m_size)) {
-          data.host_ptr[i] = ds.update[i].data;
-          cmd.copy_buffer(
-              data.slice.slice(i, 1),
-              rg.get_buffer(rcs.draw_sets[s]).slice(ds.update[i].id));
-        }
+      BufferSlice<sh::DrawSetItem> items = rg.get_buffer(rcs.draw_sets[s]);
+      auto get_item = [](Span<const DrawSetItemUpdate> updates) {
+        return [updates](usize i, u32 *index, sh::DrawSetItem *data) {
+          *index = updates[i].id;
+          *data = updates[i].data;
+        };
+      };
+
+      for (const DrawSetItemRangeUpdate &update : ds.ranges) {
+        num_commands += range_upload(renderer, cmd, rcs.scatter_upload, items,
+                                     update.src, update.offset);
       }
 
-      if (ds.update.m_size > 0 and ds.overwrite.m_size > 0) {
-        cmd.memory_barrier({
-            .src_stage_mask = rhi::PipelineStage::Transfer,
-            .src_access_mask = rhi::Access::TransferWrite,
-            .dst_stage_mask = rhi::PipelineStage::Transfer,
-            .dst_access_mask = rhi::Access::TransferWrite,
-        });
+      num_commands +=
+          scatter_upload(renderer, rg, cmd, rcs.scatter_upload, items,
+                         ds.update.m_size, get_item(ds.update));
+
+      // Items created this frame might have been moved by swap removal.
+      if ((ds.ranges.m_size > 0 or ds.update.m_size > 0) and
+          ds.overwrite.m_size > 0) {
+        scatter_upload_barrier(cmd);
+        num_commands++;
       }
 
-      if (ds.overwrite.m_size) {
-        auto data = rg.allocate<sh::DrawSetItem>(ds.overwrite.m_size);
-        for (usize i : range(ds.overwrite.m_size)) {
-          data.host_ptr[i] = ds.overwrite[i].data;
-          cmd.copy_buffer(
-              data.slice.slice(i, 1),
-              rg.get_buffer(rcs.draw_sets[s]).slice(ds.overwrite[i].id));
-        }
+      num_commands +=
+          scatter_upload(renderer, rg, cmd, rcs.scatter_upload, items,
+                         ds.overwrite.m_size, get_item(ds.overwrite));
+    }
+
+    if (gsu->index_pool_moves.m_size > 0) {
+      auto _ = cmd.debug_region("Compact index pools");
+      ZoneScopedN("Compact index pools");
+      constexpr u32 MESHLET_STRIDE = sizeof(sh::Meshlet) / sizeof(u32);
+      constexpr u32 BASE_TRIANGLE_WORD =
+          offsetof(sh::Meshlet, base_triangle) / sizeof(u32);
+      // Triangles are moved into free ranges and meshlets are copied into
+      // new buffers, so nothing that frames in flight read is overwritten.
+      for (const IndexPoolMove &move : gsu->index_pool_moves) {
+        BufferSlice<u8> indices =
+            rcs.scene->m_index_pools[move.index_pool].indices;
+        cmd.copy_buffer(indices.slice(move.src, move.size),
+                        indices.slice(move.dst, move.size));
+        cmd.copy_buffer(move.src_meshlets, move.dst_meshlets);
+        num_commands += 2;
+      }
+      cmd.memory_barrier({
+          .src_stage_mask = rhi::PipelineStage::Transfer,
+          .src_access_mask = rhi::Access::TransferWrite,
+          .dst_stage_mask = rhi::PipelineStage::ComputeShader,
+          .dst_access_mask = rhi::Access::UnorderedAccess,
+      });
+      num_commands++;
+      for (const IndexPoolMove &move : gsu->index_pool_moves) {
+        const Mesh &mesh = rcs.scene->m_meshes.get(move.mesh);
+        Span<const u32> base_triangles = mesh.meshlet_base_triangles;
+        BufferSlice<u32> meshlets = {
+            .buffer = move.dst_meshlets.buffer,
+            .count = base_triangles.m_size * MESHLET_STRIDE,
+        };
+        num_commands += scatter_upload(
+            renderer, rg, cmd, rcs.scatter_upload, meshlets,
+            base_triangles.m_size, [&](usize i, u32 *index, u32 *data) {
+              *index = i * MESHLET_STRIDE + BASE_TRIANGLE_WORD;
+              *data = base_triangles[i] + move.dst;
+            });
       }
+      // Meshlets and triangles are not tracked by the render graph.
+      cmd.memory_barrier({
+          .src_stage_mask =
+              rhi::PipelineStage::Transfer | rhi::PipelineStage::ComputeShader,
+          .src_access_mask =
+              rhi::Access::TransferWrite | rhi::Access::UnorderedAccess,
+          .dst_stage_mask = rhi::PipelineStage::All,
+          .dst_access_mask = rhi::Access::MemoryRead,
+      });
+      num_commands++;
     }
 
     if (rcs.materials) {
       auto _ = cmd.debug_region("Update materials");
       ZoneScopedN("Update materials");
-      auto data = rg.allocate<sh::Material>(gsu->materials.m_size);
-      BufferSlice<sh::Material> materials = rg.get_buffer(rcs.materials);
-      for (auto i : range(gsu->materials.m_size)) {
-        data.host_ptr[i] = gsu->materials[i].data;
-        cmd.copy_buffer(data.slice.slice(i, 1),
-                        materials.slice(gsu->materials[i].handle, 1));
-      }
+      num_commands += scatter_upload(
+          renderer, rg, cmd, rcs.scatter_upload, rg.get_buffer(rcs.materials),
+          gsu->materials.m_size, [&](usize i, u32 *index, sh::Material *data) {
+            *index = gsu->materials[i].handle;
+            *data = gsu->materials[i].data;
+          });
     }
 
     if (rcs.directional_lights) {
@@ -1041,8 +2500,13 @@ RgGpuScene gpu_scene_update_pass(NotNull<Scene *> scene,
         auto data = rg.allocate<sh::DirectionalLight>(packed.m_size);
         copy(Span(packed), data.host_ptr);
         cmd.copy_buffer(data.slice, rg.get_buffer(rcs.directional_lights));
+        num_commands++;
       }
     }
+
+    TracyPlot("GPU scene update commands", i64(num_commands));
+    TracyPlot("GPU scene update record time (us)",
+              double(ren::clock() - start) / 1000.0);
   });
 
   return rg_gpu_scene;
@@ -1087,15 +2551,19 @@ RenderGraph build_rg(NotNull<Arena *> arena, Scene *scene) {
   set_if_changed(pass_cfg.ltm_pyramid_mip, scene->m_settings.ltm_llm_mip);
 
   if (dirty) {
-    renderer->wait_idle();
-    rgp.destroy();
-    scene->m_rg_arena.clear();
-    rgp = RgPersistent::init(&scene->m_rg_arena, renderer);
+    // Textures that are still used by frames in flight are destroyed once
+    // those frames complete, so there is no need to wait for the GPU here.
+    rgp.reset();
     rgp.m_async_compute = pass_cfg.async_compute;
     pass_rcs = {};
     pass_rcs.backbuffer = rgp.create_texture("backbuffer");
     pass_rcs.sdr = pass_rcs.backbuffer;
   }
+  rgp.m_buffer_pool_idle_frames =
+      max(scene->m_settings.rg_buffer_pool_idle_frames, 1);
+  rgp.m_buffer_pool_failure = scene->m_settings.rg_buffer_pool_failure;
+  rgp.m_async_compute_scheduling = scene->m_settings.async_compute_scheduling;
+  rgp.m_gpu_profiling = scene->m_settings.gpu_profiling;
 
   RgBuilder rgb;
   rgb.init(arena, &rgp, renderer, &frcs->descriptor_allocator);
@@ -1357,9 +2825,6 @@ RenderGraph build_rg(NotNull<Arena *> arena, Scene *scene) {
                           });
 
   return rgb.build({
-      .gfx_allocator = &sid->m_gfx_allocator,
-      .async_allocator = &sid->m_async_allocator,
-      .shared_allocator = &sid->m_shared_allocators[0],
       .upload_allocator = &frcs->upload_allocator,
   });
 }
@@ -1377,13 +2842,16 @@ void draw(Scene *scene, const DrawInfo &draw_info) {
   auto *frcs = scene->m_frcs;
 
   scene->m_sid->m_resource_uploader.upload(*renderer,
-                                           scene->m_frcs->gfx_cmd_pool);
+                                           scene->m_frcs->gfx_cmd_pools[0]);
+
+  ren_export::apply_scene_commands(scratch, scene);
+  ren_export::update_transform_nodes(scratch, scene);
 
   RenderGraph render_graph = build_rg(scratch, scene);
 
   execute(render_graph, {
-                            .gfx_cmd_pool = frcs->gfx_cmd_pool,
-                            .async_cmd_pool = frcs->async_cmd_pool,
+                            .gfx_cmd_pools = frcs->gfx_cmd_pools,
+                            .async_cmd_pools = frcs->async_cmd_pools,
                             .frame_end_semaphore = &frcs->end_semaphore,
                             .frame_end_time = &frcs->end_time,
                         });
@@ -1463,7 +2931,54 @@ void draw_imgui(Scene *scene) {
     ImGui::Checkbox("Present from compute", &settings.present_from_compute);
     ImGui::EndDisabled();
 
+    ImGui::BeginDisabled(!settings.async_compute);
+    ImGui::Checkbox("Schedule by measured cost",
+                    &settings.async_compute_scheduling);
+    ImGui::EndDisabled();
+
     ImGui::EndDisabled();
+
+    const RgPersistent &rgp = scene->m_sid->m_rgp;
+    const RgQueueSchedulingStats &stats = rgp.m_queue_scheduling_stats;
+    if (settings.async_compute and settings.async_compute_scheduling) {
+      ImGui::Text("Estimated GPU time: %.3f ms, %.3f ms as requested",
+                  stats.scheduled_time / 1e6, stats.requested_time / 1e6);
+      ImGui::Text("Estimated savings: %.3f ms",
+                  (stats.requested_time - stats.scheduled_time) / 1e6);
+      ImGui::Text("Passes moved to graphics queue: %u, to async queue: %u",
+                  stats.num_moved_to_gfx, stats.num_moved_to_async);
+      if (ImGui::BeginTable("Async compute passes", 4,
+                            ImGuiTableFlags_Borders |
+                                ImGuiTableFlags_SizingFixedFit)) {
+        ImGui::TableSetupColumn("Pass");
+        ImGui::TableSetupColumn("Queue");
+        ImGui::TableSetupColumn("Graphics, ms");
+        ImGui::TableSetupColumn("Async, ms");
+        ImGui::TableHeadersRow();
+        const HashMap<u64, RgPassCost> &costs = rgp.m_pass_costs;
+        for (usize i : range(costs.m_capacity)) {
+          if (!costs.m_hashes[i]) {
+            continue;
+          }
+          const RgPassCost &cost = costs.m_values[i];
+          if (cost.requested_queue != RgQueue::Async) {
+            continue;
+          }
+          ImGui::TableNextRow();
+          ImGui::TableNextColumn();
+          ImGui::Text("%.*s", (int)cost.name.m_size, cost.name.m_str);
+          ImGui::TableNextColumn();
+          ImGui::TextUnformatted(cost.queue == RgQueue::Async ? "Async"
+                                                              : "Graphics");
+          ImGui::TableNextColumn();
+          ImGui::Text("%.3f", cost.gfx_time / 1e6);
+          ImGui::TableNextColumn();
+          ImGui::Text("%.3f", cost.async_time / 1e6);
+        }
+        ImGui::EndTable();
+      }
+    }
+
     ImGui::TreePop();
   }
 
@@ -1625,6 +3140,110 @@ void draw_imgui(Scene *scene) {
 
     ImGui::TreePop();
   }
+
+  if (ImGui::TreeNode("Statistics")) {
+    ImGui::Text("Transform upload: %zu bytes", scene->m_transform_upload_bytes);
+
+    const RetirementStats &retirement = scene->m_retirement_stats;
+    ImGui::Text("Retired resources pending: %zu (%zu bytes)",
+                retirement.num_pending, retirement.bytes_pending);
+    ImGui::Text("Retired resources released: %zu", retirement.num_released);
+    ImGui::Text("Retirement latency: %.2f ms",
+                double(retirement.max_latency) / 1e6);
+
+    ImGui::TreePop();
+  }
+
+  if (ImGui::TreeNode("Render graph buffer pools")) {
+    ImGui::SliderInt("Idle frames before release",
+                     &settings.rg_buffer_pool_idle_frames, 1, 4096, "%d",
+                     ImGuiSliderFlags_Logarithmic);
+    ImGui::Checkbox("Simulate allocation failure",
+                    &settings.rg_buffer_pool_failure);
+    const char *pool_names[NUM_RG_BUFFER_POOLS] = {
+        "Graphics",
+        "Async compute",
+        "Shared 0",
+        "Shared 1",
+    };
+    const RgPersistent &rgp = scene->m_sid->m_rgp;
+    for (usize i : range(NUM_RG_BUFFER_POOLS)) {
+      const RgBufferPool &pool = rgp.m_buffer_pools[i];
+      ImGui::Text("%s: %zu bytes, peak %zu bytes, idle for %u frames",
+                  pool_names[i], pool.size, pool.high_water_mark,
+                  pool.num_idle_frames);
+    }
+
+    ImGui::TreePop();
+  }
+
+  if (ImGui::TreeNode("GPU profiling")) {
+    ImGui::Checkbox("Pass timestamps", &settings.gpu_profiling);
+    const RgPersistent &rgp = scene->m_sid->m_rgp;
+    if (ImGui::Button("Write CSV")) {
+      Path path = Path::init("gpu-pass-timings.csv");
+      if (IoResult<void> result = rgp.write_pass_timings_csv(path); !result) {
+        fmt::println(stderr, "Failed to write {}: {}", path, result.error());
+      }
+    }
+    if (ImGui::BeginTable("GPU pass timings", 6,
+                          ImGuiTableFlags_Borders |
+                              ImGuiTableFlags_SizingFixedFit)) {
+      ImGui::TableSetupColumn("Pass");
+      ImGui::TableSetupColumn("Queue");
+      ImGui::TableSetupColumn("Last, ms");
+      ImGui::TableSetupColumn("Average, ms");
+      ImGui::TableSetupColumn("Min, ms");
+      ImGui::TableSetupColumn("Max, ms");
+      ImGui::TableHeadersRow();
+      const HashMap<u64, RgPassTiming> &timings = rgp.m_pass_timings;
+      for (usize i : range(timings.m_capacity)) {
+        if (!timings.m_hashes[i]) {
+          continue;
+        }
+        const RgPassTiming &timing = timings.m_values[i];
+        if (timing.num_samples == 0) {
+          continue;
+        }
+        RgPassTimingStats stats = get_pass_timing_stats(timing);
+        ImGui::TableNextRow();
+        ImGui::TableNextColumn();
+        ImGui::TextUnformatted(timing.name.m_str);
+        ImGui::TableNextColumn();
+        ImGui::TextUnformatted(timing.queue == RgQueue::Async ? "Async"
+                                                              : "Graphics");
+        ImGui::TableNextColumn();
+        ImGui::Text("%.3f", stats.last / 1e6);
+        ImGui::TableNextColumn();
+        ImGui::Text("%.3f", stats.average / 1e6);
+        ImGui::TableNextColumn();
+        ImGui::Text("%.3f", stats.min / 1e6);
+        ImGui::TableNextColumn();
+        ImGui::Text("%.3f", stats.max / 1e6);
+      }
+      ImGui::EndTable();
+    }
+
+    ImGui::TreePop();
+  }
+
+  if (ImGui::TreeNode("Index pools")) {
+    ImGui::Checkbox("Compaction", &settings.index_pool_compaction);
+    ImGui::Text("Compaction: %zu bytes moved",
+                scene->m_index_pool_compaction_bytes);
+    for (usize i : range(scene->m_index_pools.m_size)) {
+      const TlsfStats &stats = scene->m_index_pools[i].stats;
+      ImGui::Text("Pool %zu: %zu allocations, %zu/%u bytes used", i,
+                  stats.num_allocations, stats.allocated_size,
+                  sh::INDEX_POOL_SIZE);
+      ImGui::Text("Pool %zu: %zu free blocks, largest %zu bytes, %.1f%% "
+                  "fragmentation",
+                  i, stats.num_free_blocks, stats.largest_free_block,
+                  100.0f * tlsf_fragmentation(stats));
+    }
+
+    ImGui::TreePop();
+  }
 #endif
 }
 
@@ -1634,6 +3253,7 @@ namespace ren::hot_reload {
 
 void unload(Scene *scene) {
   scene->m_renderer->wait_idle();
+  release_retired_resources(scene, UINT64_MAX);
   destroy_internal_data(scene);
   scene->m_internal_arena.clear();
   scene->m_rg_arena.clear();
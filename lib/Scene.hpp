@@ -5,9 +5,13 @@
 #include "PipelineLoading.hpp"
 #include "RenderGraph.hpp"
 #include "ResourceUploader.hpp"
+#include "SceneCommands.hpp"
 #include "Texture.hpp"
+#include "TransformHierarchy.hpp"
 #include "passes/Pass.hpp"
 #include "ren/core/GenArray.hpp"
+#include "ren/core/HashMap.hpp"
+#include "ren/core/Tlsf.hpp"
 #include "ren/ren.hpp"
 #include "sh/Lighting.h"
 #include "sh/PostProcessing.h"
@@ -16,11 +20,17 @@ struct ImGuiContext;
 
 namespace ren {
 
-struct TlsfAllocator;
-
 constexpr usize NUM_FRAMES_IN_FLIGHT = 2;
 
-constexpr usize MIN_TRANSFORM_STAGING_BUFFER_SIZE = 1024;
+// Granularity of mesh instance transform dirty tracking.
+constexpr usize TRANSFORM_PAGE_SIZE = 256;
+
+// Maximum number of triangle index bytes moved by index pool compaction each
+// frame.
+constexpr usize INDEX_POOL_COMPACTION_BUDGET = 1024 * 1024;
+// Index pools are only compacted once the fraction of their free space that is
+// not part of the largest free block is above this.
+constexpr float INDEX_POOL_COMPACTION_THRESHOLD = 0.25f;
 
 struct Image {
   Handle<Texture> handle;
@@ -36,11 +46,17 @@ struct DirectionalLight {
 
 struct DrawSetBatchDesc {
   Handle<GraphicsPipeline> pipeline;
+  u32 index_pool = 0;
 
 public:
   bool operator==(const DrawSetBatchDesc &) const = default;
 };
 
+inline u64 hash(const DrawSetBatchDesc &desc) {
+  return hash_mix(hash((u64(desc.pipeline.gen) << 32) | desc.pipeline.index) ^
+                  desc.index_pool);
+}
+
 struct DrawSetBatch {
   DrawSetBatchDesc desc;
   u32 num_meshlets = 0;
@@ -50,6 +66,7 @@ struct DrawSetData {
   DynamicArray<Handle<MeshInstance>> items;
   BufferSlice<sh::DrawSetItem> data;
   DynamicArray<DrawSetBatch> batches;
+  HashMap<DrawSetBatchDesc, sh::BatchId> batch_ids;
 };
 
 struct DrawSetItemUpdate {
@@ -57,7 +74,14 @@ struct DrawSetItemUpdate {
   sh::DrawSetItem data;
 };
 
+// Draw set items with consecutive ids that were written to upload memory.
+struct DrawSetItemRangeUpdate {
+  BufferSlice<sh::DrawSetItem> src;
+  DrawSetId offset;
+};
+
 struct DrawSetUpdate {
+  DynamicArray<DrawSetItemRangeUpdate> ranges;
   DynamicArray<DrawSetItemUpdate> update;
   DynamicArray<DrawSetId> remove;
   DynamicArray<DrawSetItemUpdate> overwrite;
@@ -70,6 +94,7 @@ struct GpuScene {
   BufferSlice<sh::MeshInstanceVisibilityMask> mesh_instance_visibility;
   DrawSetData draw_sets[NUM_DRAW_SETS];
   BufferSlice<sh::Material> materials;
+  BufferSlice<glm::mat4x3> transform_matrices;
 
 public:
   static rhi::Result<GpuScene> init(NotNull<ResourceArena *> arena);
@@ -85,6 +110,12 @@ struct GpuSceneMeshInstanceUpdate {
   sh::MeshInstance data;
 };
 
+// Mesh instances with consecutive handles that were written to upload memory.
+struct GpuSceneMeshInstanceRangeUpdate {
+  BufferSlice<sh::MeshInstance> src;
+  u32 offset = 0;
+};
+
 struct GpuSceneMaterialUpdate {
   Handle<Material> handle;
   sh::Material data;
@@ -95,11 +126,32 @@ struct GpuSceneDirectionalLightUpdate {
   sh::DirectionalLight data;
 };
 
+struct GpuSceneTransformUpdate {
+  BufferSlice<glm::mat4x3> src;
+  u32 offset = 0;
+};
+
+// Move of a mesh's triangles to a lower offset in the same index pool.
+struct IndexPoolMove {
+  Handle<Mesh> mesh;
+  u32 index_pool = 0;
+  u32 src = 0;
+  u32 dst = 0;
+  u32 size = 0;
+  // Meshlets are patched into a new buffer, since frames in flight might
+  // still read the old one.
+  BufferSlice<sh::Meshlet> src_meshlets;
+  BufferSlice<sh::Meshlet> dst_meshlets;
+};
+
 struct GpuSceneUpdate {
   DrawSetUpdate draw_sets[NUM_DRAW_SETS];
   DynamicArray<GpuSceneMeshUpdate> meshes;
   DynamicArray<GpuSceneMeshInstanceUpdate> mesh_instances;
+  DynamicArray<GpuSceneMeshInstanceRangeUpdate> mesh_instance_ranges;
   DynamicArray<GpuSceneMaterialUpdate> materials;
+  DynamicArray<GpuSceneTransformUpdate> transforms;
+  DynamicArray<IndexPoolMove> index_pool_moves;
 };
 
 struct RgDrawSetData {
@@ -122,17 +174,63 @@ struct FrameResources {
   Arena arena;
   Handle<Semaphore> acquire_semaphore;
   UploadBumpAllocator upload_allocator;
-  Handle<CommandPool> gfx_cmd_pool;
-  Handle<CommandPool> async_cmd_pool;
+  // Render graph passes are recorded in parallel with a pool per job. The
+  // first pools are also used outside of the render graph.
+  Handle<CommandPool> gfx_cmd_pools[MAX_NUM_RG_RECORDING_JOBS];
+  Handle<CommandPool> async_cmd_pools[MAX_NUM_RG_RECORDING_JOBS];
   DescriptorAllocatorScope descriptor_allocator;
   Handle<Semaphore> end_semaphore;
   u64 end_time = 0;
-  DynamicArray<Handle<Buffer>> buffer_delete_queue;
+};
+
+enum class RetiredResourceType {
+  Buffer,
+  IndexRange,
+  Descriptor,
+};
+
+// Resource that was destroyed by the client but might still be in use by
+// frames in flight.
+struct RetiredResource {
+  RetiredResourceType type = RetiredResourceType::Buffer;
+  union {
+    Handle<Buffer> buffer = {};
+    struct {
+      TlsfAllocation *allocation;
+      u32 pool;
+    } index_range;
+    sh::Handle<void> descriptor;
+  };
+  // Frame during which this resource was retired.
+  u64 frame = 0;
+  // Time at which this resource was retired.
+  u64 time = 0;
+  usize size = 0;
+};
+
+struct RetirementStats {
+  usize num_pending = 0;
+  usize bytes_pending = 0;
+  usize num_released = 0;
+  // Longest time between retirement and release of resources released during
+  // the last frame, in nanoseconds.
+  u64 max_latency = 0;
+};
+
+// Buffer of 8-bit meshlet triangle indices that is suballocated between
+// meshes.
+struct IndexPool {
+  BufferSlice<u8> indices;
+  TlsfAllocator *allocator = nullptr;
+  // Updated at the start of each frame.
+  TlsfStats stats;
 };
 
 struct SceneGraphicsSettings {
   bool async_compute = false;
   bool present_from_compute = false;
+  // Move compute passes between queues based on their measured GPU time.
+  bool async_compute_scheduling = true;
 
   // Instance culling and LOD
   bool instance_frustum_culling = true;
@@ -146,6 +244,19 @@ struct SceneGraphicsSettings {
   bool meshlet_frustum_culling = true;
   bool meshlet_occlusion_culling = true;
 
+  // Move mesh triangles over multiple frames to reduce index pool
+  // fragmentation.
+  bool index_pool_compaction = true;
+
+  // Number of frames after which unused render graph buffer pools are
+  // released.
+  i32 rg_buffer_pool_idle_frames = RG_BUFFER_POOL_IDLE_FRAMES;
+  // Debug: act as if render graph buffer pools can't be allocated.
+  bool rg_buffer_pool_failure = false;
+
+  // Measure the GPU time of render graph passes with timestamp queries.
+  bool gpu_profiling = false;
+
   bool ssao = true;
   i32 ssao_num_samples = 16;
   float ssao_radius = 1.0f;
@@ -211,15 +322,10 @@ struct SceneGraphicsSettings {
 struct SceneInternalData {
   ResourceArena m_rcs_arena;
   Pipelines m_pipelines;
-  DeviceBumpAllocator m_gfx_allocator;
-  DeviceBumpAllocator m_async_allocator;
-  StackArray<DeviceBumpAllocator, 2> m_shared_allocators;
   StackArray<FrameResources, NUM_FRAMES_IN_FLIGHT> m_per_frame_resources;
   PassPersistentConfig m_pass_cfg;
   PassPersistentResources m_pass_rcs;
   RgPersistent m_rgp;
-  DynamicArray<UploadBumpAllocator::Allocation<glm::mat4x3>>
-      m_transform_staging_buffers;
   ResourceUploader m_resource_uploader;
 };
 
@@ -241,11 +347,29 @@ struct Scene {
   Handle<Camera> m_camera;
   GenArray<Camera> m_cameras;
 
-  TlsfAllocator *m_index_allocator = nullptr;
-  BufferSlice<u8> m_index_buffer;
+  // Resources are released once all frames that might use them complete.
+  DynamicArray<RetiredResource> m_retirement_queue;
+  RetirementStats m_retirement_stats;
+
+  // New index pools are created when none of the existing ones can fit a
+  // mesh, up to sh::MAX_NUM_INDEX_POOLS.
+  DynamicArray<IndexPool> m_index_pools;
+  usize m_index_pool_compaction_bytes = 0;
   GenArray<Mesh> m_meshes;
 
   GenArray<MeshInstance> m_mesh_instances;
+  // Host copy of mesh instance transforms and a bitmap of transform pages
+  // that have changed since they were last uploaded.
+  DynamicArray<glm::mat4x3> m_transforms;
+  DynamicArray<u64> m_transform_dirty_pages;
+  // Mesh position decode scale for each mesh instance.
+  DynamicArray<float> m_mesh_instance_decode_scales;
+  usize m_transform_upload_bytes = 0;
+
+  TransformHierarchy m_transform_hierarchy;
+
+  // Applied in creation order.
+  DynamicArray<SceneCommandRecorder *> m_command_recorders;
 
   GenArray<Image> m_images;
 
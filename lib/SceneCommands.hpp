@@ -0,0 +1,33 @@
+#pragma once
+#include "ren/core/Arena.hpp"
+#include "ren/core/Array.hpp"
+#include "ren/ren.hpp"
+
+namespace ren {
+
+enum class SceneCommandType {
+  CreateMeshInstances,
+  DestroyMeshInstances,
+  SetMeshInstanceTransforms,
+  CreateMaterial,
+};
+
+struct SceneCommand {
+  SceneCommandType type = {};
+  Span<const MeshInstanceCreateInfo> create_info;
+  Span<const Handle<MeshInstance>> mesh_instances;
+  Span<const glm::mat4x3> transforms;
+  Span<Handle<MeshInstance>> out;
+  const MaterialCreateInfo *material_create_info = nullptr;
+  Handle<Material> *material = nullptr;
+};
+
+// Scene edits of a single producer. Recorders don't share any state, so each
+// one can be used from a different thread without synchronization. All
+// arguments are copied into the recorder's own arena.
+struct SceneCommandRecorder {
+  Arena m_arena;
+  DynamicArray<SceneCommand> m_commands;
+};
+
+} // namespace ren
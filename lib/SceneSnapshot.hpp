@@ -0,0 +1,79 @@
+#pragma once
+#include "DrawSet.hpp"
+#include "ren/core/StdDef.hpp"
+#include "sh/Geometry.h"
+
+namespace ren {
+
+constexpr u32 SCENE_SNAPSHOT_MAGIC =
+    ('s' << 24) | ('n' << 16) | ('e' << 8) | 'r';
+constexpr u32 SCENE_SNAPSHOT_VERSION = 0;
+
+// Arrays are aligned so that a memory-mapped snapshot can be used in place.
+constexpr usize SCENE_SNAPSHOT_ALIGNMENT = 64;
+
+// Byte offset and number of elements of an array in a snapshot.
+struct SnapshotArray {
+  u64 offset = 0;
+  u64 count = 0;
+};
+
+// Keys of a GenIndexPool.
+struct SnapshotKeys {
+  SnapshotArray generations;
+  u32 free_list = 0;
+  u32 num_free = 0;
+};
+
+struct SnapshotMesh {
+  sh::PositionBoundingBox bb = {};
+  float scale = 0.0f;
+  sh::BoundingSquare uv_bs = {};
+  u32 num_lods = 0;
+  sh::MeshLOD lods[sh::MAX_NUM_LODS] = {};
+  u32 index_pool = 0;
+  u64 triangles_offset = 0;
+  u64 triangles_size = 0;
+  // Buffer contents in bytes.
+  SnapshotArray positions;
+  SnapshotArray normals;
+  SnapshotArray tangents;
+  SnapshotArray uvs;
+  SnapshotArray colors;
+  SnapshotArray meshlets;
+  SnapshotArray meshlet_indices;
+  SnapshotArray meshlet_base_triangles;
+};
+
+struct SnapshotDrawSetBatch {
+  // Index of the batch's pipeline among the draw set's pipelines.
+  u32 pipeline = 0;
+  u32 index_pool = 0;
+  u32 num_meshlets = 0;
+};
+
+struct SnapshotDrawSet {
+  SnapshotArray items;
+  SnapshotArray gpu_items;
+  SnapshotArray batches;
+};
+
+// Arrays of per-handle data cover all handle slots, including unused ones.
+struct SceneSnapshotHeader {
+  u32 magic = SCENE_SNAPSHOT_MAGIC;
+  u32 version = SCENE_SNAPSHOT_VERSION;
+  u64 size = 0;
+  // Contents of each index pool up to the end of its last allocation.
+  SnapshotArray index_pools;
+  SnapshotKeys materials;
+  SnapshotArray material_data;
+  SnapshotKeys meshes;
+  SnapshotArray mesh_data;
+  SnapshotKeys mesh_instances;
+  SnapshotArray mesh_instance_data;
+  SnapshotArray transforms;
+  SnapshotArray decode_scales;
+  SnapshotDrawSet draw_sets[NUM_DRAW_SETS];
+};
+
+} // namespace ren
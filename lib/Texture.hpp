@@ -27,6 +27,9 @@ struct TextureCreateInfo {
   bool cube_map : 1 = false;
   u32 num_mips = 1;
   u32 num_layers = 1;
+  /// Optional: memory to place the texture into.
+  rhi::Allocation allocation = {};
+  usize allocation_offset = 0;
 };
 
 struct ExternalTextureCreateInfo {
@@ -56,6 +59,7 @@ struct Texture {
   bool cube_map = false;
   u32 num_mips = 0;
   u32 num_layers = 0;
+  bool external = false;
   ImageViewBlock *views = nullptr;
 };
 
@@ -0,0 +1,309 @@
+#include "TransformHierarchy.hpp"
+#include "core/Math.hpp"
+#include "ren/core/Algorithm.hpp"
+#include "ren/core/Job.hpp"
+
+#include <tracy/Tracy.hpp>
+
+namespace ren {
+
+TransformHierarchy TransformHierarchy::init(NotNull<Arena *> arena) {
+  return {
+      .m_arena = arena,
+      .m_handles = GenIndexPool<Handle<TransformNode>>::init(arena),
+  };
+}
+
+void transform_hierarchy_create(NotNull<TransformHierarchy *> th,
+                                Span<const TransformNodeCreateInfo> create_info,
+                                Span<Handle<TransformNode>> out) {
+  ZoneScoped;
+
+  ren_assert(out.m_size >= create_info.m_size);
+
+  Arena *arena = th->m_arena;
+  for (usize i : range(create_info.m_size)) {
+    const TransformNodeCreateInfo &info = create_info[i];
+
+    Handle<TransformNode> node = th->m_handles.generate(arena);
+    u32 slot = th->m_nodes.m_size;
+    while (th->m_slots.m_size <= node.index) {
+      th->m_slots.push(arena, 0);
+    }
+    th->m_slots[node.index] = slot;
+
+    u32 parent = TransformHierarchy::NO_PARENT;
+    u32 depth = 0;
+    if (info.parent) {
+      ren_assert(th->m_handles.contains(info.parent));
+      parent = th->m_slots[info.parent.index];
+      depth = th->m_depths[parent] + 1;
+      th->m_num_children[parent]++;
+    }
+
+    th->m_nodes.push(arena, node);
+    th->m_parents.push(arena, parent);
+    th->m_depths.push(arena, depth);
+    th->m_num_children.push(arena, 0);
+    th->m_translations.push(arena, info.transform.translation);
+    th->m_rotations.push(arena, info.transform.rotation);
+    th->m_scales.push(arena, info.transform.scale);
+    th->m_world_matrices.push(arena, glm::mat4x3(1.0f));
+    th->m_mesh_instances.push(arena, info.mesh_instance);
+    th->m_world_dirty.push(arena, false);
+    th->m_dirty_roots.push(arena, node);
+
+    out[i] = node;
+  }
+
+  if (create_info.m_size > 0) {
+    th->m_sorted = false;
+  }
+}
+
+void transform_hierarchy_destroy(NotNull<TransformHierarchy *> th,
+                                 Span<const Handle<TransformNode>> nodes) {
+  ZoneScoped;
+  for (Handle<TransformNode> node : nodes) {
+    if (!th->m_handles.contains(node)) {
+      continue;
+    }
+    u32 slot = th->m_slots[node.index];
+    ren_assert_msg(th->m_num_children[slot] == 0,
+                   "Transform node children must be destroyed first");
+    u32 parent = th->m_parents[slot];
+    if (parent != TransformHierarchy::NO_PARENT) {
+      th->m_num_children[parent]--;
+    }
+    th->m_nodes[slot] = {};
+    th->m_handles.erase(node);
+    th->m_sorted = false;
+  }
+}
+
+void transform_hierarchy_set_local(NotNull<TransformHierarchy *> th,
+                                   Span<const Handle<TransformNode>> nodes,
+                                   Span<const LocalTransform> transforms) {
+  ZoneScoped;
+  ren_assert(nodes.m_size == transforms.m_size);
+  for (usize i : range(nodes.m_size)) {
+    ren_assert(th->m_handles.contains(nodes[i]));
+    u32 slot = th->m_slots[nodes[i].index];
+    th->m_translations[slot] = transforms[i].translation;
+    th->m_rotations[slot] = transforms[i].rotation;
+    th->m_scales[slot] = transforms[i].scale;
+    th->m_dirty_roots.push(th->m_arena, nodes[i]);
+  }
+}
+
+namespace {
+
+// Drop destroyed nodes and sort the rest by depth with a counting sort.
+void transform_hierarchy_sort(NotNull<TransformHierarchy *> th) {
+  ZoneScoped;
+
+  ScratchArena scratch;
+
+  usize num_slots = th->m_nodes.m_size;
+  DynamicArray<u32> level_sizes;
+  for (usize slot : range(num_slots)) {
+    if (!th->m_nodes[slot]) {
+      continue;
+    }
+    u32 depth = th->m_depths[slot];
+    while (level_sizes.m_size <= depth) {
+      level_sizes.push(scratch, 0);
+    }
+    level_sizes[depth]++;
+  }
+
+  th->m_levels.clear();
+  th->m_levels.push(th->m_arena, 0);
+  for (u32 size : level_sizes) {
+    th->m_levels.push(th->m_arena, th->m_levels.back() + size);
+  }
+  u32 num_nodes = th->m_levels.back();
+
+  constexpr u32 DEAD = -1;
+  Span<u32> cursors = Span(th->m_levels).copy(scratch);
+  Span<u32> new_slots = Span<u32>::allocate(scratch, num_slots);
+  for (usize slot : range(num_slots)) {
+    new_slots[slot] =
+        th->m_nodes[slot] ? cursors[th->m_depths[slot]]++ : DEAD;
+  }
+
+  auto permute = [&]<typename T>(DynamicArray<T> &array) {
+    Span<const T> old = Span(array).copy(scratch);
+    for (usize slot : range(num_slots)) {
+      if (new_slots[slot] != DEAD) {
+        array.m_data[new_slots[slot]] = old[slot];
+      }
+    }
+  };
+  permute(th->m_parents);
+  permute(th->m_depths);
+  permute(th->m_num_children);
+  permute(th->m_translations);
+  permute(th->m_rotations);
+  permute(th->m_scales);
+  permute(th->m_world_matrices);
+  permute(th->m_mesh_instances);
+  permute(th->m_world_dirty);
+  permute(th->m_nodes);
+
+  th->m_nodes.m_size = num_nodes;
+  th->m_parents.m_size = num_nodes;
+  th->m_depths.m_size = num_nodes;
+  th->m_num_children.m_size = num_nodes;
+  th->m_translations.m_size = num_nodes;
+  th->m_rotations.m_size = num_nodes;
+  th->m_scales.m_size = num_nodes;
+  th->m_world_matrices.m_size = num_nodes;
+  th->m_mesh_instances.m_size = num_nodes;
+  th->m_world_dirty.m_size = num_nodes;
+
+  for (usize slot : range(num_nodes)) {
+    u32 parent = th->m_parents[slot];
+    if (parent != TransformHierarchy::NO_PARENT) {
+      th->m_parents[slot] = new_slots[parent];
+    }
+    th->m_slots[th->m_nodes[slot].index] = slot;
+  }
+
+  th->m_child_offsets.clear();
+  th->m_child_offsets.push(th->m_arena, 0);
+  for (usize slot : range(num_nodes)) {
+    th->m_child_offsets.push(th->m_arena, th->m_child_offsets.back() +
+                                              th->m_num_children[slot]);
+  }
+  th->m_children.clear();
+  while (th->m_children.m_size < th->m_child_offsets.back()) {
+    th->m_children.push(th->m_arena, 0);
+  }
+  Span<u32> child_cursors = Span(th->m_child_offsets).copy(scratch);
+  for (usize slot : range(num_nodes)) {
+    u32 parent = th->m_parents[slot];
+    if (parent != TransformHierarchy::NO_PARENT) {
+      th->m_children[child_cursors[parent]++] = slot;
+    }
+  }
+
+  th->m_sorted = true;
+}
+
+} // namespace
+
+auto transform_hierarchy_update(NotNull<Arena *> arena,
+                                NotNull<TransformHierarchy *> th)
+    -> TransformHierarchyUpdate {
+  ZoneScoped;
+
+  if (!th->m_sorted) {
+    transform_hierarchy_sort(th);
+  }
+  if (th->m_dirty_roots.m_size == 0) {
+    return {};
+  }
+
+  ScratchArena scratch;
+
+  // Slots to update at each level. A slot is added either as a dirty root or
+  // as a child of an updated slot, but only once.
+  usize num_levels = th->m_levels.m_size - 1;
+  auto level_slots = Span<DynamicArray<u32>>::allocate(scratch, num_levels);
+  u8 *world_dirty = th->m_world_dirty.m_data;
+  for (Handle<TransformNode> node : th->m_dirty_roots) {
+    if (!th->m_handles.contains(node)) {
+      continue;
+    }
+    u32 slot = th->m_slots[node.index];
+    if (!world_dirty[slot]) {
+      world_dirty[slot] = true;
+      level_slots[th->m_depths[slot]].push(scratch, slot);
+    }
+  }
+  th->m_dirty_roots.clear();
+
+  auto propagate = [th = th.get()](Span<const u32> slots) {
+    const u32 *parents = th->m_parents.m_data;
+    const glm::vec3 *translations = th->m_translations.m_data;
+    const glm::quat *rotations = th->m_rotations.m_data;
+    const glm::vec3 *scales = th->m_scales.m_data;
+    glm::mat4x3 *world_matrices = th->m_world_matrices.m_data;
+    for (u32 slot : slots) {
+      glm::mat3 rs = glm::mat3_cast(rotations[slot]);
+      rs[0] *= scales[slot].x;
+      rs[1] *= scales[slot].y;
+      rs[2] *= scales[slot].z;
+      u32 parent = parents[slot];
+      if (parent == TransformHierarchy::NO_PARENT) {
+        world_matrices[slot] =
+            glm::mat4x3(rs[0], rs[1], rs[2], translations[slot]);
+        continue;
+      }
+      const glm::mat4x3 &pw = world_matrices[parent];
+      glm::mat3 p(pw);
+      world_matrices[slot] = glm::mat4x3(p * rs[0], p * rs[1], p * rs[2],
+                                         p * translations[slot] + pw[3]);
+    }
+  };
+
+  // Parents are always in the previous level, so each level can be split
+  // between jobs once the previous one is done.
+  constexpr usize BATCH_SIZE = 16 * 1024;
+  for (usize level : range(num_levels)) {
+    Span<const u32> slots = level_slots[level];
+    usize num_batches = ceil_div(slots.m_size, BATCH_SIZE);
+    if (num_batches <= 1) {
+      propagate(slots);
+    } else {
+      ScratchArena job_scratch;
+      auto jobs = Span<JobDesc>::allocate(job_scratch, num_batches);
+      for (usize b : range(num_batches)) {
+        usize begin = b * BATCH_SIZE;
+        Span<const u32> batch =
+            slots.subspan(begin, min(BATCH_SIZE, slots.m_size - begin));
+        jobs[b] = JobDesc::init(job_scratch, "Propagate transforms",
+                                [propagate, batch] { propagate(batch); });
+      }
+      job_dispatch_and_wait(jobs);
+    }
+    for (u32 slot : slots) {
+      for (usize c : range(th->m_child_offsets[slot],
+                           th->m_child_offsets[slot + 1])) {
+        u32 child = th->m_children[c];
+        if (!world_dirty[child]) {
+          world_dirty[child] = true;
+          level_slots[level + 1].push(scratch, child);
+        }
+      }
+    }
+  }
+
+  usize num_updated = 0;
+  for (Span<const u32> slots : level_slots) {
+    for (u32 slot : slots) {
+      num_updated += bool(th->m_mesh_instances[slot]);
+    }
+  }
+  TransformHierarchyUpdate update = {
+      .mesh_instances =
+          Span<Handle<MeshInstance>>::allocate(arena, num_updated),
+      .transforms = Span<glm::mat4x3>::allocate(arena, num_updated),
+  };
+  usize num_written = 0;
+  for (Span<const u32> slots : level_slots) {
+    for (u32 slot : slots) {
+      world_dirty[slot] = false;
+      if (th->m_mesh_instances[slot]) {
+        update.mesh_instances[num_written] = th->m_mesh_instances[slot];
+        update.transforms[num_written] = th->m_world_matrices[slot];
+        num_written++;
+      }
+    }
+  }
+
+  return update;
+}
+
+} // namespace ren
@@ -0,0 +1,77 @@
+#pragma once
+#include "ren/core/Array.hpp"
+#include "ren/core/GenIndexPool.hpp"
+#include "ren/ren.hpp"
+
+#include <glm/gtc/quaternion.hpp>
+
+namespace ren {
+
+// Scene graph of local transforms. Node data is stored in structure of arrays
+// layout that is sorted by depth, so that world matrices can be computed level
+// by level, with each level split between jobs. Only the subtrees of nodes
+// whose local transform has changed are visited.
+struct TransformHierarchy {
+  static constexpr u32 NO_PARENT = -1;
+
+  Arena *m_arena = nullptr;
+  GenIndexPool<Handle<TransformNode>> m_handles;
+  // Slot of each node handle.
+  DynamicArray<u32> m_slots;
+
+  // Per-slot data. Slots of destroyed nodes have a null node handle until
+  // the next sort.
+  DynamicArray<Handle<TransformNode>> m_nodes;
+  DynamicArray<u32> m_parents;
+  DynamicArray<u32> m_depths;
+  DynamicArray<u32> m_num_children;
+  DynamicArray<glm::vec3> m_translations;
+  DynamicArray<glm::quat> m_rotations;
+  DynamicArray<glm::vec3> m_scales;
+  DynamicArray<glm::mat4x3> m_world_matrices;
+  DynamicArray<Handle<MeshInstance>> m_mesh_instances;
+  // Set for nodes that have been visited by the current update.
+  DynamicArray<u8> m_world_dirty;
+
+  // Nodes whose local transform has changed since the last update. Might
+  // contain destroyed nodes and duplicates.
+  DynamicArray<Handle<TransformNode>> m_dirty_roots;
+
+  // First slot of each depth level and one past the last slot of the last
+  // level. Only valid if the hierarchy is sorted.
+  DynamicArray<u32> m_levels;
+  // Children of each slot are stored in m_children, starting at the slot's
+  // offset. Only valid if the hierarchy is sorted.
+  DynamicArray<u32> m_child_offsets;
+  DynamicArray<u32> m_children;
+  bool m_sorted = true;
+
+public:
+  static TransformHierarchy init(NotNull<Arena *> arena);
+};
+
+void transform_hierarchy_create(NotNull<TransformHierarchy *> th,
+                                Span<const TransformNodeCreateInfo> create_info,
+                                Span<Handle<TransformNode>> out);
+
+void transform_hierarchy_destroy(NotNull<TransformHierarchy *> th,
+                                 Span<const Handle<TransformNode>> nodes);
+
+void transform_hierarchy_set_local(NotNull<TransformHierarchy *> th,
+                                   Span<const Handle<TransformNode>> nodes,
+                                   Span<const LocalTransform> transforms);
+
+struct TransformHierarchyUpdate {
+  Span<Handle<MeshInstance>> mesh_instances;
+  Span<glm::mat4x3> transforms;
+};
+
+// Recompute world matrices of nodes whose local transform or one of whose
+// ancestors' local transforms has changed by walking the subtrees of dirty
+// roots. Returns the new world matrices of
+// the mesh instances attached to these nodes.
+auto transform_hierarchy_update(NotNull<Arena *> arena,
+                                NotNull<TransformHierarchy *> th)
+    -> TransformHierarchyUpdate;
+
+} // namespace ren
@@ -3,14 +3,20 @@
 #include "ren/core/CmdLine.hpp"
 #include "ren/core/FileSystem.hpp"
 #include "ren/core/Format.hpp"
+#include "ren/core/Job.hpp"
 #include "ren/core/StdDef.hpp"
 
 #include "BakeIrradianceMap.comp.hpp"
 #include "BakeReflectionMap.comp.hpp"
 #include "BakeSpecularMap.comp.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
 #include <fmt/base.h>
 #include <ktx.h>
+#include <string_view>
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
@@ -24,8 +30,7 @@
 
 namespace ren {
 
-DirectX::ScratchImage bake_ibl(Baker *baker, const TextureInfo &info,
-                               bool compress) {
+DirectX::ScratchImage bake_ibl(Baker *baker, const TextureInfo &info) {
   HRESULT hres = S_OK;
 
   if (!baker->pipelines.reflection_map) {
@@ -193,7 +198,7 @@ DirectX::ScratchImage bake_ibl(Baker *baker, const TextureInfo &info,
   rgb.copy_texture_to_buffer(cube_map, &cube_map_readback);
 
   RenderGraph rg = rgb.build({});
-  execute(rg, {.gfx_cmd_pool = baker->cmd_pool});
+  execute(rg, {.gfx_cmd_pools = {&baker->cmd_pool, 1}});
   baker->renderer->wait_idle();
 
   rhi::end_gfx_capture();
@@ -212,36 +217,245 @@ DirectX::ScratchImage bake_ibl(Baker *baker, const TextureInfo &info,
                       },
                       &images);
 
-  DirectX::ScratchImage compressed;
+  // Copy out of the readback buffer so that the baker can be reset and reused
+  // while the cube map is encoded.
+  DirectX::ScratchImage cube_map_image;
+  hres = cube_map_image.Initialize(mdata);
+  HRESULT_CHECK(hres, "DirectX::ScratchImage::Initialize failed");
+  for (usize i : range(images.m_size)) {
+    ren_assert(cube_map_image.GetImages()[i].slicePitch ==
+               images[i].slicePitch);
+    std::memcpy(cube_map_image.GetImages()[i].pixels, images[i].pixels,
+                images[i].slicePitch);
+  }
+
+  return cube_map_image;
+}
 
-#if !_OPENMP
+DirectX::ScratchImage encode_ibl(DirectX::ScratchImage cube_map,
+                                 bool compress) {
   if (compress) {
-    fmt::println("OpenMP not available, skip environment map compression");
-    compress = false;
+    return compress_mip_chain(std::move(cube_map),
+                              TinyImageFormat_DXBC6H_UFLOAT,
+                              TextureCompression::Normal);
   }
-#endif
-  if (compress) {
-    fmt::println("Compress environment map");
-    hres = DirectX::Compress(images.m_data, images.m_size, mdata,
-                             DXGI_FORMAT_BC6H_UF16,
-                             DirectX::TEX_COMPRESS_PARALLEL, 0.0f, compressed);
-    HRESULT_CHECK(hres, "DirectX::Compress failed");
-  } else {
-    hres = DirectX::Convert(images.m_data, images.m_size, mdata,
-                            DXGI_FORMAT_R9G9B9E5_SHAREDEXP,
-                            DirectX::TEX_FILTER_DEFAULT, 0.0f, compressed);
-    HRESULT_CHECK(hres, "DirectX::Convert failed");
+  const DirectX::TexMetadata &mdata = cube_map.GetMetadata();
+  DirectX::ScratchImage converted;
+  HRESULT hres = DirectX::Convert(
+      cube_map.GetImages(), cube_map.GetImageCount(), mdata,
+      DXGI_FORMAT_R9G9B9E5_SHAREDEXP, DirectX::TEX_FILTER_DEFAULT, 0.0f,
+      converted);
+  HRESULT_CHECK(hres, "DirectX::Convert failed");
+  return converted;
+}
+
+// Compare baked environment map with a reference file. Returns false if the
+// mean square error of any mip or face exceeds the tolerance.
+bool compare_with_reference(Blob blob, Path reference_path, float tolerance) {
+  ScratchArena scratch;
+
+  IoResult<Span<u8>> reference = read<u8>(scratch, reference_path);
+  if (!reference) {
+    fmt::println(stderr, "Failed to read {}: {}", reference_path,
+                 reference.error());
+    return false;
+  }
+
+  ktxTexture2 *textures[2] = {};
+  ktx_error_code_e err = ktxTexture2_CreateFromMemory(
+      (const ktx_uint8_t *)blob.data, blob.size,
+      KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, &textures[0]);
+  if (err) {
+    fmt::println(stderr, "ktxTexture2_CreateFromMemory failed: {}", (i32)err);
+    return false;
+  }
+  err = ktxTexture2_CreateFromMemory(
+      reference->m_data, reference->m_size,
+      KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, &textures[1]);
+  if (err) {
+    fmt::println(stderr, "Failed to load {}: {}", reference_path, (i32)err);
+    ktxTexture_Destroy(ktxTexture(textures[0]));
+    return false;
+  }
+
+  auto destroy_textures = [&] {
+    ktxTexture_Destroy(ktxTexture(textures[0]));
+    ktxTexture_Destroy(ktxTexture(textures[1]));
+  };
+
+  const ktxTexture2 &lhs = *textures[0];
+  const ktxTexture2 &rhs = *textures[1];
+  if (lhs.vkFormat != rhs.vkFormat or lhs.baseWidth != rhs.baseWidth or
+      lhs.baseHeight != rhs.baseHeight or lhs.numLevels != rhs.numLevels or
+      lhs.numFaces != rhs.numFaces) {
+    fmt::println(stderr, "Format or size doesn't match {}", reference_path);
+    destroy_textures();
+    return false;
+  }
+
+  auto format = (DXGI_FORMAT)TinyImageFormat_ToDXGI_FORMAT(
+      TinyImageFormat_FromVkFormat((TinyImageFormat_VkFormat)lhs.vkFormat));
+  float max_mse = 0.0f;
+  for (u32 mip : range(lhs.numLevels)) {
+    u32 width = max(lhs.baseWidth >> mip, 1u);
+    u32 height = max(lhs.baseHeight >> mip, 1u);
+    usize row_pitch, slice_pitch;
+    HRESULT hres =
+        DirectX::ComputePitch(format, width, height, row_pitch, slice_pitch);
+    HRESULT_CHECK(hres, "DirectX::ComputePitch failed");
+    for (u32 face : range(lhs.numFaces)) {
+      DirectX::Image images[2];
+      for (usize i : range(2)) {
+        ktxTexture *texture = ktxTexture(textures[i]);
+        ktx_size_t offset = 0;
+        err = ktxTexture_GetImageOffset(texture, mip, 0, face, &offset);
+        ren_assert(!err);
+        images[i] = {
+            .width = width,
+            .height = height,
+            .format = format,
+            .rowPitch = row_pitch,
+            .slicePitch = slice_pitch,
+            .pixels = texture->pData + offset,
+        };
+      }
+      float mse = 0.0f;
+      hres = DirectX::ComputeMSE(images[0], images[1], mse, nullptr);
+      HRESULT_CHECK(hres, "DirectX::ComputeMSE failed");
+      max_mse = max(max_mse, mse);
+    }
+  }
+  destroy_textures();
+
+  if (max_mse > tolerance) {
+    fmt::println(stderr, "Doesn't match {}: MSE {} > {}", reference_path,
+                 max_mse, tolerance);
+    return false;
   }
 
-  return compressed;
+  return true;
 }
 
-Blob bake_ibl_to_memory(NotNull<Arena *> arena, Baker *baker,
-                        const TextureInfo &info, bool compress) {
-  DirectX::ScratchImage image = bake_ibl(baker, info, compress);
-  Blob blob = write_ktx_to_memory(arena, image);
-  reset_baker(baker);
-  return blob;
+struct HdrImage {
+  float *pixels = nullptr;
+  u32 width = 0;
+  u32 height = 0;
+};
+
+HdrImage load_hdr_image(Path path) {
+  ScratchArena scratch;
+  IoResult<Span<stbi_uc>> buffer = [&] {
+    JobIoQueueScope io_scope(is_job());
+    return read<stbi_uc>(scratch, path);
+  }();
+  if (!buffer) {
+    fmt::println(stderr, "Failed to read {}: {}", path, buffer.error());
+    return {};
+  }
+  int w, h;
+  float *pixels = stbi_loadf_from_memory(buffer->m_data, buffer->size_bytes(),
+                                         &w, &h, nullptr, 4);
+  if (!pixels) {
+    fmt::println(stderr, "Failed to read HDR environment map from {}: {}",
+                 path, stbi_failure_reason());
+    return {};
+  }
+  return {
+      .pixels = pixels,
+      .width = (u32)w,
+      .height = (u32)h,
+  };
+}
+
+struct BakeIblItem {
+  Path in;
+  Path out;
+  Path reference;
+};
+
+struct BakeIblBatchOptions {
+  Span<const BakeIblItem> items;
+  bool compress = true;
+  float tolerance = 0.0f;
+};
+
+// Bake a batch of environment maps with a single baker. Decoding of the next
+// input and encoding and writing of the previous output run on the job server
+// while the current environment map is being baked on the GPU.
+bool bake_ibl_batch(NotNull<Arena *> arena, Baker *baker,
+                    const BakeIblBatchOptions &opts) {
+  if (opts.items.is_empty()) {
+    return true;
+  }
+
+  struct WriteJobResult {
+    bool success = true;
+  };
+  auto *write_result = arena->allocate<WriteJobResult>();
+  *write_result = {};
+
+  auto decode = [](Path path) {
+    return [path]() { return load_hdr_image(path); };
+  };
+
+  JobFuture<HdrImage> next_image =
+      job_dispatch(arena, "Decode environment map", decode(opts.items[0].in));
+  JobToken write_token;
+  for (usize i : range(opts.items.m_size)) {
+    const BakeIblItem &item = opts.items[i];
+    HdrImage image = next_image.receive();
+    if (i + 1 < opts.items.m_size) {
+      next_image = job_dispatch(arena, "Decode environment map",
+                                decode(opts.items[i + 1].in));
+    }
+    if (!image.pixels) {
+      write_result->success = false;
+      continue;
+    }
+
+    fmt::println("Bake {}", item.in);
+    auto *cube_map = new (arena->allocate<DirectX::ScratchImage>())
+        DirectX::ScratchImage(
+            bake_ibl(baker, {
+                                .format = TinyImageFormat_R32G32B32A32_SFLOAT,
+                                .width = image.width,
+                                .height = image.height,
+                                .data = image.pixels,
+                            }));
+    reset_baker(baker);
+    stbi_image_free(image.pixels);
+
+    // Keep at most one cube map in flight to bound memory usage.
+    job_wait(write_token);
+    write_token = job_dispatch(
+        "Write environment map",
+        [cube_map, item, compress = opts.compress, tolerance = opts.tolerance,
+         write_result]() {
+          ScratchArena scratch;
+          Blob blob = write_ktx_to_memory(
+              scratch, encode_ibl(std::move(*cube_map), compress));
+          cube_map->~ScratchImage();
+          bool success = true;
+          IgnoreResult = create_directories(item.out.parent());
+          if (IoResult<void> result = write(item.out, blob.data, blob.size);
+              !result) {
+            fmt::println(stderr, "Failed to write {}: {}", item.out,
+                         result.error());
+            success = false;
+          }
+          if (item.reference and
+              !compare_with_reference(blob, item.reference, tolerance)) {
+            success = false;
+          }
+          if (!success) {
+            std::atomic_ref(write_result->success)
+                .store(false, std::memory_order_relaxed);
+          }
+        });
+  }
+  job_wait(write_token);
+
+  return write_result->success;
 }
 
 } // namespace ren
@@ -252,24 +466,72 @@ enum BakeIblOptions {
   OPTION_IN,
   OPTION_OUT,
   OPTION_NO_COMPRESS,
+  OPTION_BATCH,
+  OPTION_REFERENCE,
+  OPTION_TOLERANCE,
   OPTION_HELP,
   OPTION_COUNT,
 };
 
-int main(int argc, const char *argv[]) {
-  ren::ScratchArena::init_for_thread();
-  ren::Arena arena = ren::Arena::init();
+// Collect all HDR files from the input directory in a stable order.
+bool collect_batch_items(NotNull<Arena *> arena, Path in_dir, Path out_dir,
+                         Path reference_dir, Span<const BakeIblItem> *out) {
+  IoResult<NotNull<Directory *>> dir = open_directory(arena, in_dir);
+  if (!dir) {
+    fmt::println(stderr, "Failed to open {}: {}", in_dir, dir.error());
+    return false;
+  }
+  DynamicArray<BakeIblItem> items;
+  while (true) {
+    IoResult<Path> entry = read_directory(arena, *dir);
+    if (!entry) {
+      fmt::println(stderr, "Failed to read directory entry in {}: {}", in_dir,
+                   entry.error());
+      close_directory(*dir);
+      return false;
+    }
+    if (!*entry) {
+      break;
+    }
+    if (entry->extension() != Path::init(".hdr")) {
+      continue;
+    }
+    Path out = entry->replace_extension(arena, ".ktx2");
+    items.push(arena, {
+                          .in = in_dir.concat(arena, *entry),
+                          .out = out_dir.concat(arena, out),
+                          .reference = reference_dir
+                                           ? reference_dir.concat(arena, out)
+                                           : Path(),
+                      });
+  }
+  close_directory(*dir);
+  std::ranges::sort(items, [](const BakeIblItem &lhs, const BakeIblItem &rhs) {
+    String8 l = lhs.in;
+    String8 r = rhs.in;
+    return std::string_view(l.m_str, l.m_size) <
+           std::string_view(r.m_str, r.m_size);
+  });
+  *out = items;
+  return true;
+}
 
+// Runs while the job server is up, so that main() can stop it on every exit
+// path.
+int run(NotNull<Arena *> arena, const char *argv[]) {
   // clang-format off
   CmdLineOption options[] = {
     {OPTION_IN, CmdLinePath, "in", 0, "input HDR environment map path", CmdLinePositional},
     {OPTION_OUT, CmdLinePath,  "out", 0, "output filtered HDR environment cube map path", CmdLinePositional},
     {OPTION_NO_COMPRESS, CmdLineFlag, "no-compress", 0, "don't compress"},
+    {OPTION_BATCH, CmdLineFlag, "batch", 0, "bake all .hdr files from input directory into output directory"},
+    {OPTION_REFERENCE, CmdLinePath, "reference", 0, "compare output with reference file or directory"},
+    {OPTION_TOLERANCE, CmdLineString, "tolerance", 0, "maximum mean square error when comparing with reference"},
     {OPTION_HELP, CmdLineFlag, "help", 'h', "show this message"},
   };
   // clang-format on
   ParsedCmdLineOption parsed[OPTION_COUNT];
-  bool success = parse_cmd_line(&arena, argv, options, parsed);
+  bool success = parse_cmd_line(arena, argv, options, parsed);
   if (!success or parsed[OPTION_HELP].is_set) {
     ScratchArena scratch;
     fmt::print("{}", cmd_line_help(scratch, argv[0], options));
@@ -278,46 +540,66 @@ int main(int argc, const char *argv[]) {
 
   Path in_path = parsed[OPTION_IN].as_path;
   Path out_path = parsed[OPTION_OUT].as_path;
-  Renderer *renderer =
-      ren_export::create_renderer(&arena, {.type = RendererType::Headless});
-  if (!renderer) {
-    return EXIT_FAILURE;
+  Path reference_path;
+  if (parsed[OPTION_REFERENCE].is_set) {
+    reference_path = parsed[OPTION_REFERENCE].as_path;
   }
-
-  Baker *baker = create_baker(&arena, renderer);
-
-  IoResult<Span<stbi_uc>> buffer = read<stbi_uc>(&arena, in_path);
-  if (!buffer) {
-    fmt::println(stderr, "Failed to read {}: {}", in_path, buffer.error());
-    return EXIT_FAILURE;
+  float tolerance = 1e-4f;
+  if (parsed[OPTION_TOLERANCE].is_set) {
+    String8 str = parsed[OPTION_TOLERANCE].as_string;
+    const char *cstr = str.zero_terminated(arena);
+    char *end = nullptr;
+    tolerance = std::strtof(cstr, &end);
+    if (str.m_size == 0 or end != cstr + str.m_size or
+        !std::isfinite(tolerance) or tolerance < 0.0f) {
+      fmt::println(stderr, "Invalid tolerance: {}", str);
+      return EXIT_FAILURE;
+    }
   }
 
-  int w, h;
-  const float *hdr_map = stbi_loadf_from_memory(
-      buffer->m_data, buffer->size_bytes(), &w, &h, nullptr, 4);
-  if (!hdr_map) {
-    fmt::println(stderr, "Failed to read HDR environment map from {}: {}",
-                 in_path, stbi_failure_reason());
-    return EXIT_FAILURE;
+  Span<const BakeIblItem> items;
+  if (parsed[OPTION_BATCH].is_set) {
+    if (!collect_batch_items(arena, in_path, out_path, reference_path,
+                             &items)) {
+      return EXIT_FAILURE;
+    }
+  } else {
+    auto *item = arena->allocate<BakeIblItem>();
+    *item = {
+        .in = in_path,
+        .out = out_path,
+        .reference = reference_path,
+    };
+    items = {item, 1};
   }
 
-  ScratchArena scratch;
-  Blob blob =
-      bake_ibl_to_memory(scratch, baker,
-                         {
-                             .format = TinyImageFormat_R32G32B32A32_SFLOAT,
-                             .width = (u32)w,
-                             .height = (u32)h,
-                             .data = hdr_map,
-                         },
-                         not parsed[OPTION_NO_COMPRESS].is_set);
-
-  IgnoreResult = create_directory(out_path.parent());
-  if (IoResult<void> result = write(out_path, blob.data, blob.size); !result) {
-    fmt::println(stderr, "Failed to write {}: {}", out_path, result.error());
+  Renderer *renderer =
+      ren_export::create_renderer(arena, {.type = RendererType::Headless});
+  if (!renderer) {
     return EXIT_FAILURE;
   }
 
+  Baker *baker = create_baker(arena, renderer);
+
+  bool compress = not parsed[OPTION_NO_COMPRESS].is_set;
+  success = bake_ibl_batch(arena, baker,
+                           {
+                               .items = items,
+                               .compress = compress,
+                               .tolerance = tolerance,
+                           });
+
   destroy_baker(baker);
   ren_export::destroy_renderer(renderer);
+
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc, const char *argv[]) {
+  ren::ScratchArena::init_for_thread();
+  launch_job_server();
+  ren::Arena arena = ren::Arena::init();
+  int status = run(&arena, argv);
+  stop_job_server();
+  return status;
 }
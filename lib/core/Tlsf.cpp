@@ -22,6 +22,33 @@ static void tlsf_insert(NotNull<TlsfAllocator *> allocator,
                     &allocation->free_list);
 }
 
+static TlsfAllocation *tlsf_new_allocation(NotNull<Arena *> arena,
+                                           NotNull<TlsfAllocator *> allocator) {
+  TlsfAllocation *allocation = allocator->m_free_list;
+  if (!allocation) {
+    return arena->allocate<TlsfAllocation>();
+  }
+  allocator->m_free_list = allocation->next_free;
+  *allocation = {};
+  return allocation;
+}
+
+// Shrink allocation to size and return the rest of it to the free lists.
+static void tlsf_split(NotNull<Arena *> arena,
+                       NotNull<TlsfAllocator *> allocator,
+                       NotNull<TlsfAllocation *> allocation, usize size) {
+  usize remainder_size = allocation->size - size;
+  if (remainder_size < MIN_TLSF_ALLOCATION_SIZE) {
+    return;
+  }
+  TlsfAllocation *remainder = tlsf_new_allocation(arena, allocator);
+  remainder->size = remainder_size;
+  remainder->offset = allocation->offset + size;
+  allocation->size = size;
+  list_insert_after(&allocation->physical_list, &remainder->physical_list);
+  tlsf_insert(allocator, remainder);
+}
+
 NotNull<TlsfAllocator *> tlsf_init(NotNull<Arena *> arena, usize size) {
   size = max(size, MIN_TLSF_ALLOCATION_SIZE);
   auto *allocator = arena->allocate<TlsfAllocator>();
@@ -55,22 +82,7 @@ TlsfAllocation *tlsf_allocate(NotNull<Arena *> arena,
           container_of(class_free_list_head->next, TlsfAllocation, free_list);
       ren_assert(allocation->size > size);
       list_remove(&allocation->free_list);
-
-      usize remainder_size = allocation->size - size;
-      if (remainder_size >= MIN_TLSF_ALLOCATION_SIZE) {
-        TlsfAllocation *remainder = allocator->m_free_list;
-        if (!remainder) {
-          remainder = arena->allocate<TlsfAllocation>();
-        } else {
-          allocator->m_free_list = remainder->next_free;
-        }
-        remainder->size = remainder_size;
-        remainder->offset = allocation->offset + size;
-        list_insert_after(&allocation->physical_list,
-                          &remainder->physical_list);
-        tlsf_insert(allocator, remainder);
-      }
-
+      tlsf_split(arena, allocator, allocation, size);
       return allocation;
     }
     sli = 0;
@@ -78,29 +90,58 @@ TlsfAllocation *tlsf_allocate(NotNull<Arena *> arena,
   return nullptr;
 }
 
+static TlsfAllocation *
+tlsf_physical_prev(NotNull<const TlsfAllocator *> allocator,
+                   NotNull<const TlsfAllocation *> allocation) {
+  ListNode<TlsfAllocation> *prev = allocation->physical_list.prev;
+  if (prev == &allocator->m_physical_list) {
+    return nullptr;
+  }
+  return container_of(prev, TlsfAllocation, physical_list);
+}
+
+static TlsfAllocation *
+tlsf_physical_next(NotNull<const TlsfAllocator *> allocator,
+                   NotNull<const TlsfAllocation *> allocation) {
+  ListNode<TlsfAllocation> *next = allocation->physical_list.next;
+  if (next == &allocator->m_physical_list) {
+    return nullptr;
+  }
+  return container_of(next, TlsfAllocation, physical_list);
+}
+
+static bool tlsf_is_free(NotNull<const TlsfAllocation *> allocation) {
+  return is_in_list(allocation->free_list);
+}
+
+// Merge right into left. The result is not in any free list.
 static TlsfAllocation *tlsf_merge(NotNull<TlsfAllocator *> allocator,
                                   NotNull<TlsfAllocation *> left,
                                   NotNull<TlsfAllocation *> right) {
   ren_assert(left->offset + left->size == right->offset);
+  if (tlsf_is_free(left)) {
+    list_remove(&left->free_list);
+  }
+  if (tlsf_is_free(right)) {
+    list_remove(&right->free_list);
+  }
   left->size += right->size;
-  list_remove(&left->free_list);
-  list_remove(&right->free_list);
   list_remove(&right->physical_list);
   right->next_free = allocator->m_free_list;
-  allocator->m_free_list = right->next_free;
-  tlsf_insert(allocator, left);
+  allocator->m_free_list = right;
   return left;
 }
 
 void tlsf_free(NotNull<TlsfAllocator *> allocator, TlsfAllocation *allocation) {
   [[unlikely]] if (!allocation) { return; }
-  if (allocation->prev->offset < allocation->offset and
-      is_in_list(allocation->free_list)) {
-    allocation = tlsf_merge(allocator, allocation->prev, allocation);
+  ren_assert(!tlsf_is_free(allocation));
+  TlsfAllocation *prev = tlsf_physical_prev(allocator, allocation);
+  if (prev and tlsf_is_free(prev)) {
+    allocation = tlsf_merge(allocator, prev, allocation);
   }
-  if (allocation->next->offset > allocation->offset and
-      is_in_list(allocation->free_list)) {
-    allocation = tlsf_merge(allocator, allocation, allocation->next);
+  TlsfAllocation *next = tlsf_physical_next(allocator, allocation);
+  if (next and tlsf_is_free(next)) {
+    allocation = tlsf_merge(allocator, allocation, next);
   }
   tlsf_insert(allocator, allocation);
 }
@@ -111,15 +152,73 @@ void tlsf_expand(NotNull<Arena *> arena, NotNull<TlsfAllocator *> allocator,
                                       TlsfAllocation, physical_list);
   usize old_size = last->offset + last->size;
   ren_assert(old_size < new_size);
-  TlsfAllocation *allocation = allocator->m_free_list;
-  if (!allocation) {
-    allocation = arena->allocate<TlsfAllocation>();
-  } else {
-    allocator->m_free_list = allocation->next_free;
+  TlsfAllocation *allocation = tlsf_new_allocation(arena, allocator);
+  allocation->size = new_size - old_size;
+  allocation->offset = old_size;
+  list_insert_after(&last->physical_list, &allocation->physical_list);
+  if (tlsf_is_free(last)) {
+    allocation = tlsf_merge(allocator, last, allocation);
   }
-  allocation->size = new_size;
-  allocation->offset = new_size;
   tlsf_insert(allocator, allocation);
 }
 
+TlsfAllocation *tlsf_allocate_at(NotNull<Arena *> arena,
+                                 NotNull<TlsfAllocator *> allocator,
+                                 usize offset, usize size) {
+  size = max(size, MIN_TLSF_ALLOCATION_SIZE);
+  // Allocations are usually restored in order of their offsets, so search
+  // from the end.
+  TlsfAllocation *block = nullptr;
+  const ListNode<TlsfAllocation> *head = &allocator->m_physical_list;
+  for (ListNode<TlsfAllocation> *node = head->prev; node != head;
+       node = node->prev) {
+    TlsfAllocation *allocation =
+        container_of(node, TlsfAllocation, physical_list);
+    if (allocation->offset <= offset) {
+      block = allocation;
+      break;
+    }
+  }
+  if (!block or !tlsf_is_free(block) or
+      offset + size > block->offset + block->size) {
+    return nullptr;
+  }
+  list_remove(&block->free_list);
+
+  if (offset > block->offset) {
+    // Return the space before offset to the free lists.
+    ren_assert(offset - block->offset >= MIN_TLSF_ALLOCATION_SIZE);
+    TlsfAllocation *allocation = tlsf_new_allocation(arena, allocator);
+    allocation->size = block->offset + block->size - offset;
+    allocation->offset = offset;
+    block->size = offset - block->offset;
+    list_insert_after(&block->physical_list, &allocation->physical_list);
+    tlsf_insert(allocator, block);
+    block = allocation;
+  }
+
+  tlsf_split(arena, allocator, block, size);
+  return block;
+}
+
+TlsfStats tlsf_get_stats(NotNull<const TlsfAllocator *> allocator) {
+  TlsfStats stats;
+  const ListNode<TlsfAllocation> *head = &allocator->m_physical_list;
+  for (const ListNode<TlsfAllocation> *node = head->next; node != head;
+       node = node->next) {
+    const TlsfAllocation *allocation =
+        container_of(node, TlsfAllocation, physical_list);
+    if (tlsf_is_free(allocation)) {
+      stats.num_free_blocks++;
+      stats.free_size += allocation->size;
+      stats.largest_free_block =
+          max(stats.largest_free_block, allocation->size);
+    } else {
+      stats.num_allocations++;
+      stats.allocated_size += allocation->size;
+    }
+  }
+  return stats;
+}
+
 } // namespace ren
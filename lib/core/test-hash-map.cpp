@@ -0,0 +1,124 @@
+#include "ren/core/Arena.hpp"
+#include "ren/core/HashMap.hpp"
+
+#include <cstdlib>
+#include <fmt/base.h>
+#include <source_location>
+
+using namespace ren;
+
+namespace {
+
+void check(bool condition,
+           std::source_location sl = std::source_location::current()) {
+  if (!condition) {
+    fmt::println(stderr, "{}:{}: check failed", sl.file_name(), sl.line());
+    std::exit(EXIT_FAILURE);
+  }
+}
+
+// Check that exactly m_size slots are occupied.
+template <typename K, typename V>
+void check_slots(const HashMap<K, V> &map,
+                 std::source_location sl = std::source_location::current()) {
+  usize num_occupied = 0;
+  for (usize i = 0; i < map.m_capacity; ++i) {
+    num_occupied += map.m_hashes[i] != 0;
+  }
+  check(num_occupied == map.size(), sl);
+}
+
+// All keys hash to 0, which collides with the empty slot marker.
+struct ZeroHashKey {
+  u32 value = 0;
+
+public:
+  bool operator==(const ZeroHashKey &) const = default;
+};
+
+u64 hash(const ZeroHashKey &) { return 0; }
+
+void test_insert_get() {
+  Arena arena = Arena::init();
+  HashMap<u32, u32> map;
+  check(map.is_empty());
+  check(not map.try_get(1));
+
+  map.insert(&arena, 1, 10);
+  map.insert(&arena, 2, 20);
+  check(map.size() == 2);
+  check(map.try_get(1) and *map.try_get(1) == 10);
+  check(map.try_get(2) and *map.try_get(2) == 20);
+  check(not map.try_get(3));
+  check_slots(map);
+
+  // Overwrite an existing key.
+  map.insert(&arena, 1, 11);
+  check(map.size() == 2);
+  check(map.get(1) == 11);
+  check_slots(map);
+
+  map.clear();
+  check(map.is_empty());
+  check(not map.try_get(1));
+  check_slots(map);
+
+  arena.destroy();
+}
+
+void test_growth() {
+  Arena arena = Arena::init();
+  HashMap<u32, u32> map = HashMap<u32, u32>::init(&arena, 4);
+  usize capacity = map.m_capacity;
+  check(capacity == 16);
+
+  constexpr u32 NUM_KEYS = 1000;
+  for (u32 i = 0; i < NUM_KEYS; ++i) {
+    map.insert(&arena, i, 2 * i);
+    check(4 * map.size() <= 3 * map.m_capacity);
+  }
+  check(map.size() == NUM_KEYS);
+  check(map.m_capacity > capacity);
+  check_slots(map);
+  for (u32 i = 0; i < NUM_KEYS; ++i) {
+    check(map.try_get(i) and *map.try_get(i) == 2 * i);
+  }
+  check(not map.try_get(NUM_KEYS));
+
+  arena.destroy();
+}
+
+void test_zero_hash() {
+  Arena arena = Arena::init();
+
+  // hash(0) is 0 for integers.
+  HashMap<u64, u32> map;
+  map.insert(&arena, 0, 1);
+  check(map.size() == 1);
+  check(map.try_get(0) and *map.try_get(0) == 1);
+  check_slots(map);
+
+  // Keys that hash to 0 must still occupy slots and probe past each other,
+  // including across a rehash.
+  HashMap<ZeroHashKey, u32> zero_map;
+  constexpr u32 NUM_KEYS = 32;
+  for (u32 i = 0; i < NUM_KEYS; ++i) {
+    zero_map.insert(&arena, {i}, i);
+  }
+  check(zero_map.size() == NUM_KEYS);
+  check_slots(zero_map);
+  for (u32 i = 0; i < NUM_KEYS; ++i) {
+    check(zero_map.try_get({i}) and *zero_map.try_get({i}) == i);
+  }
+  check(not zero_map.try_get({NUM_KEYS}));
+
+  arena.destroy();
+}
+
+} // namespace
+
+int main() {
+  test_insert_get();
+  test_growth();
+  test_zero_hash();
+}
@@ -0,0 +1,176 @@
+#include "ren/core/Arena.hpp"
+#include "ren/core/Tlsf.hpp"
+
+#include <cstdlib>
+#include <fmt/base.h>
+#include <source_location>
+
+using namespace ren;
+
+namespace {
+
+void check(bool condition,
+           std::source_location sl = std::source_location::current()) {
+  if (!condition) {
+    fmt::println(stderr, "{}:{}: check failed", sl.file_name(), sl.line());
+    std::exit(EXIT_FAILURE);
+  }
+}
+
+// Check that all space is accounted for and that the allocator's blocks match
+// the expected ones.
+void check_stats(NotNull<const TlsfAllocator *> allocator, usize size,
+                 const TlsfStats &expected,
+                 std::source_location sl = std::source_location::current()) {
+  TlsfStats stats = tlsf_get_stats(allocator);
+  check(stats.allocated_size + stats.free_size == size, sl);
+  check(stats.largest_free_block <= stats.free_size, sl);
+  check((stats.num_free_blocks == 0) == (stats.free_size == 0), sl);
+  check(stats.num_allocations == expected.num_allocations, sl);
+  check(stats.allocated_size == expected.allocated_size, sl);
+  check(stats.num_free_blocks == expected.num_free_blocks, sl);
+  check(stats.free_size == expected.free_size, sl);
+  check(stats.largest_free_block == expected.largest_free_block, sl);
+}
+
+void test_alloc_free() {
+  Arena arena = Arena::init();
+  constexpr usize SIZE = 4096;
+  TlsfAllocator *allocator = tlsf_init(&arena, SIZE);
+  check_stats(allocator, SIZE,
+              {.num_free_blocks = 1,
+               .free_size = SIZE,
+               .largest_free_block = SIZE});
+
+  TlsfAllocation *a = tlsf_allocate(&arena, allocator, 256);
+  TlsfAllocation *b = tlsf_allocate(&arena, allocator, 256);
+  TlsfAllocation *c = tlsf_allocate(&arena, allocator, 256);
+  check(a and b and c);
+  check(a->offset == 0 and b->offset == 256 and c->offset == 512);
+  check_stats(allocator, SIZE,
+              {.num_allocations = 3,
+               .allocated_size = 768,
+               .num_free_blocks = 1,
+               .free_size = SIZE - 768,
+               .largest_free_block = SIZE - 768});
+
+  // Small allocations are rounded up.
+  TlsfAllocation *d = tlsf_allocate(&arena, allocator, 1);
+  check(d and d->size == MIN_TLSF_ALLOCATION_SIZE);
+  tlsf_free(allocator, d);
+  check_stats(allocator, SIZE,
+              {.num_allocations = 3,
+               .allocated_size = 768,
+               .num_free_blocks = 1,
+               .free_size = SIZE - 768,
+               .largest_free_block = SIZE - 768});
+
+  // Neither neighbour is free.
+  tlsf_free(allocator, b);
+  check_stats(allocator, SIZE,
+              {.num_allocations = 2,
+               .allocated_size = 512,
+               .num_free_blocks = 2,
+               .free_size = SIZE - 512,
+               .largest_free_block = SIZE - 768});
+
+  // The hole is reused.
+  b = tlsf_allocate(&arena, allocator, 128);
+  check(b and b->offset == 256);
+  tlsf_free(allocator, b);
+
+  // Coalesce with the next block.
+  tlsf_free(allocator, a);
+  check_stats(allocator, SIZE,
+              {.num_allocations = 1,
+               .allocated_size = 256,
+               .num_free_blocks = 2,
+               .free_size = SIZE - 256,
+               .largest_free_block = SIZE - 768});
+
+  // Coalesce with both the previous and the next block.
+  tlsf_free(allocator, c);
+  check_stats(allocator, SIZE,
+              {.num_free_blocks = 1,
+               .free_size = SIZE,
+               .largest_free_block = SIZE});
+
+  // Coalesce with the previous block.
+  a = tlsf_allocate(&arena, allocator, 512);
+  b = tlsf_allocate(&arena, allocator, 512);
+  c = tlsf_allocate(&arena, allocator, 512);
+  check(a and b and c);
+  tlsf_free(allocator, a);
+  tlsf_free(allocator, b);
+  check_stats(allocator, SIZE,
+              {.num_allocations = 1,
+               .allocated_size = 512,
+               .num_free_blocks = 2,
+               .free_size = SIZE - 512,
+               .largest_free_block = SIZE - 1536});
+  a = tlsf_allocate(&arena, allocator, 768);
+  check(a and a->offset == 0);
+  tlsf_free(allocator, a);
+  tlsf_free(allocator, c);
+  check_stats(allocator, SIZE,
+              {.num_free_blocks = 1,
+               .free_size = SIZE,
+               .largest_free_block = SIZE});
+
+  arena.destroy();
+}
+
+void test_expand() {
+  Arena arena = Arena::init();
+  usize size = 4096;
+  TlsfAllocator *allocator = tlsf_init(&arena, size);
+
+  // The last block is free and grows.
+  size = 8192;
+  tlsf_expand(&arena, allocator, size);
+  check_stats(allocator, size,
+              {.num_free_blocks = 1,
+               .free_size = size,
+               .largest_free_block = size});
+
+  // The last block is allocated, so a new free block is added after it.
+  TlsfAllocation *tail = tlsf_allocate_at(&arena, allocator, size - 256, 256);
+  check(tail and tail->offset == size - 256 and tail->size == 256);
+  check_stats(allocator, size,
+              {.num_allocations = 1,
+               .allocated_size = 256,
+               .num_free_blocks = 1,
+               .free_size = size - 256,
+               .largest_free_block = size - 256});
+  usize old_size = size;
+  size = 16384;
+  tlsf_expand(&arena, allocator, size);
+  check_stats(allocator, size,
+              {.num_allocations = 1,
+               .allocated_size = 256,
+               .num_free_blocks = 2,
+               .free_size = size - 256,
+               .largest_free_block = size - old_size});
+
+  // New space can be allocated. The old free block is too small for this.
+  TlsfAllocation *allocation =
+      tlsf_allocate(&arena, allocator, size - old_size - 192);
+  check(allocation and allocation->offset >= old_size);
+  tlsf_free(allocator, allocation);
+
+  // Freeing the old last block merges it with the space on both sides.
+  tlsf_free(allocator, tail);
+  check_stats(allocator, size,
+              {.num_free_blocks = 1,
+               .free_size = size,
+               .largest_free_block = size});
+
+  arena.destroy();
+}
+
+} // namespace
+
+int main() {
+  test_alloc_free();
+  test_expand();
+}
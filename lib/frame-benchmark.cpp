@@ -0,0 +1,212 @@
+// Build and submit frames with the mock RHI backend to measure CPU frame time
+// without a GPU, and compare the recorded command stream against a golden
+// file to catch changes in synchronization and pass scheduling.
+#include "Renderer.hpp"
+#include "Scene.hpp"
+#include "ren/baking/mesh.hpp"
+#include "ren/core/Chrono.hpp"
+#include "ren/core/CmdLine.hpp"
+#include "ren/core/FileSystem.hpp"
+#include "ren/core/Format.hpp"
+#include "ren/core/Job.hpp"
+#include "ren/ren.hpp"
+
+#include <SDL3/SDL_hints.h>
+#include <SDL3/SDL_init.h>
+#include <SDL3/SDL_video.h>
+#include <cstdlib>
+#include <cstring>
+#include <fmt/base.h>
+
+using namespace ren;
+
+namespace {
+
+Handle<Mesh> create_triangle(NotNull<Arena *> frame_arena, Scene *scene) {
+  ScratchArena scratch;
+  glm::vec3 positions[] = {
+      {0.0f, 0.0f, 0.0f},
+      {1.0f, 0.0f, 0.0f},
+      {0.0f, 1.0f, 0.0f},
+  };
+  glm::vec3 normals[] = {
+      {0.0f, 0.0f, 1.0f},
+      {0.0f, 0.0f, 1.0f},
+      {0.0f, 0.0f, 1.0f},
+  };
+  u32 indices[] = {0, 1, 2};
+  Blob blob = bake_mesh_to_memory(scratch, {
+                                               .num_vertices = 3,
+                                               .positions = positions,
+                                               .normals = normals,
+                                               .indices = indices,
+                                           });
+  return create_mesh(frame_arena, scene, blob.data, blob.size);
+}
+
+// Returns the 1-based number of the first line that differs, or 0 if the
+// strings are equal.
+auto find_first_different_line(String8 lhs, String8 rhs) -> usize {
+  usize line = 1;
+  usize size = min(lhs.m_size, rhs.m_size);
+  for (usize i : range(size)) {
+    if (lhs.m_str[i] != rhs.m_str[i]) {
+      return line;
+    }
+    line += lhs.m_str[i] == '\n';
+  }
+  return lhs.m_size == rhs.m_size ? 0 : line;
+}
+
+enum FrameBenchmarkOptions {
+  OPTION_NUM_MESH_INSTANCES,
+  OPTION_NUM_FRAMES,
+  OPTION_GOLDEN,
+  OPTION_WRITE_GOLDEN,
+  OPTION_HELP,
+  OPTION_COUNT,
+};
+
+} // namespace
+
+int main(int argc, const char *argv[]) {
+  ScratchArena::init_for_thread();
+  launch_job_server();
+  ScratchArena scratch;
+
+  // clang-format off
+  CmdLineOption options[] = {
+    {OPTION_NUM_MESH_INSTANCES, CmdLineUInt, "num-mesh-instances", 'n', "Number of mesh instances to draw"},
+    {OPTION_NUM_FRAMES, CmdLineUInt, "num-frames", 'f', "Number of frames to time"},
+    {OPTION_GOLDEN, CmdLinePath, "golden", 'g', "Compare last frame's command stream with golden file"},
+    {OPTION_WRITE_GOLDEN, CmdLineFlag, "write-golden", 'w', "Write last frame's command stream to golden file instead"},
+    {OPTION_HELP, CmdLineFlag, "help", 'h', "Show this message"},
+  };
+  // clang-format on
+  ParsedCmdLineOption parsed[OPTION_COUNT];
+  bool success = parse_cmd_line(scratch, argv, options, parsed);
+  if (!success or parsed[OPTION_HELP].is_set or
+      (parsed[OPTION_WRITE_GOLDEN].is_set and !parsed[OPTION_GOLDEN].is_set)) {
+    ScratchArena scratch;
+    fmt::print("{}", cmd_line_help(scratch, argv[0], options));
+    return EXIT_FAILURE;
+  }
+
+  usize num_mesh_instances = 100'000;
+  if (parsed[OPTION_NUM_MESH_INSTANCES].is_set) {
+    num_mesh_instances = parsed[OPTION_NUM_MESH_INSTANCES].as_uint;
+  }
+  usize num_frames = 1000;
+  if (parsed[OPTION_NUM_FRAMES].is_set) {
+    num_frames = max<usize>(parsed[OPTION_NUM_FRAMES].as_uint, 1);
+  }
+
+  // The mock backend doesn't present anything, so there is no need for a
+  // real window.
+  SDL_SetHint(SDL_HINT_VIDEO_DRIVER, "offscreen,dummy");
+  if (!SDL_Init(SDL_INIT_VIDEO)) {
+    fmt::println(stderr, "{}", SDL_GetError());
+    return EXIT_FAILURE;
+  }
+
+  Arena arena = Arena::init();
+  Arena frame_arena = Arena::init();
+  Renderer *renderer = create_renderer(&arena, {});
+  if (!renderer) {
+    return EXIT_FAILURE;
+  }
+  SDL_Window *window = SDL_CreateWindow("Frame benchmark", 1280, 720,
+                                        get_sdl_window_flags(renderer));
+  if (!window) {
+    fmt::println(stderr, "{}", SDL_GetError());
+    return EXIT_FAILURE;
+  }
+  SwapChain *swap_chain = create_swapchain(&arena, renderer, window);
+  Scene *scene = create_scene(&arena, renderer, swap_chain);
+  if (!scene) {
+    fmt::println(stderr, "Scene initialization failed");
+    return EXIT_FAILURE;
+  }
+  rhi::Device device = scene->m_renderer->get_rhi_device();
+
+  Handle<Camera> camera = create_camera(scene);
+  set_camera(scene, camera);
+  set_camera_transform(scene, camera,
+                       {
+                           .position = {-10.0f, 0.0f, 10.0f},
+                           .forward = {1.0f, 0.0f, -1.0f},
+                       });
+
+  Handle<Mesh> mesh = create_triangle(&frame_arena, scene);
+  Handle<Material> material = create_material(&frame_arena, scene, {});
+  auto meshes = Span<Handle<Mesh>>::allocate(&arena, num_mesh_instances);
+  fill(meshes, mesh);
+  auto mesh_instances =
+      Span<Handle<MeshInstance>>::allocate(&arena, num_mesh_instances);
+  create_mesh_instances_bulk(&frame_arena, scene,
+                             {
+                                 .meshes = meshes,
+                                 .materials = {&material, 1},
+                             },
+                             mesh_instances);
+
+  // Let uploads and pipeline creation settle before timing.
+  constexpr usize NUM_WARMUP_FRAMES = 4;
+  for (usize i : range(NUM_WARMUP_FRAMES)) {
+    draw(scene, {});
+    frame_arena.clear();
+  }
+
+  u64 total_time = 0;
+  for (usize i : range(num_frames)) {
+    {
+      ScratchArena scratch;
+      (void)rhi::take_command_stream(scratch, device);
+    }
+    u64 start = ren::clock();
+    draw(scene, {});
+    total_time += ren::clock() - start;
+    frame_arena.clear();
+  }
+  fmt::println("{} mesh instances, {} frames: {:.3f} ms/frame",
+               num_mesh_instances, num_frames, total_time / 1e6 / num_frames);
+
+  int status = EXIT_SUCCESS;
+  if (parsed[OPTION_GOLDEN].is_set) {
+    Path golden_path = parsed[OPTION_GOLDEN].as_path;
+    String8 stream = rhi::take_command_stream(scratch, device);
+    if (parsed[OPTION_WRITE_GOLDEN].is_set) {
+      IoResult<void> result = ren::write(golden_path, stream);
+      if (!result) {
+        fmt::println(stderr, "Failed to write {}: {}", golden_path,
+                     result.error());
+        status = EXIT_FAILURE;
+      }
+    } else {
+      IoResult<Span<char>> golden = ren::read(scratch, golden_path);
+      if (!golden) {
+        fmt::println(stderr, "Failed to read {}: {}", golden_path,
+                     golden.error());
+        status = EXIT_FAILURE;
+      } else {
+        usize line = find_first_different_line(
+            stream, String8(golden->m_data, golden->m_size));
+        if (line) {
+          fmt::println(stderr, "Command stream differs from {} at line {}",
+                       golden_path, line);
+          status = EXIT_FAILURE;
+        }
+      }
+    }
+  }
+
+  destroy_scene(scene);
+  destroy_swap_chain(swap_chain);
+  destroy_renderer(renderer);
+  SDL_DestroyWindow(window);
+  SDL_Quit();
+  frame_arena.destroy();
+  arena.destroy();
+
+  return status;
+}
@@ -28,8 +28,21 @@ ren::hot_reload::Vtbl ren_vtbl = {
     ren_vtbl_f(create_image),
     ren_vtbl_f(create_material),
     ren_vtbl_f(create_mesh_instances),
+    ren_vtbl_f(create_mesh_instances_bulk),
     ren_vtbl_f(destroy_mesh_instances),
     ren_vtbl_f(set_mesh_instance_transforms),
+    ren_vtbl_f(create_transform_nodes),
+    ren_vtbl_f(destroy_transform_nodes),
+    ren_vtbl_f(set_transform_node_transforms),
+    ren_vtbl_f(update_transform_nodes),
+    ren_vtbl_f(create_scene_command_recorder),
+    ren_vtbl_f(record_create_mesh_instances),
+    ren_vtbl_f(record_destroy_mesh_instances),
+    ren_vtbl_f(record_mesh_instance_transforms),
+    ren_vtbl_f(record_create_material),
+    ren_vtbl_f(apply_scene_commands),
+    ren_vtbl_f(save_scene_snapshot),
+    ren_vtbl_f(load_scene_snapshot),
     ren_vtbl_f(create_directional_light),
     ren_vtbl_f(destroy_directional_light),
     ren_vtbl_f(set_directional_light),
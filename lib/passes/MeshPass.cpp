@@ -432,7 +432,8 @@ void record_render_pass(const PassCommonConfig &ccfg,
     rcs.commands = pass.read_buffer(commands, rhi::INDIRECT_COMMAND_BUFFER);
     rcs.batch_sizes =
         pass.read_buffer(cfg.batch_sizes, rhi::INDIRECT_COMMAND_BUFFER, batch);
-    rcs.indices = ccfg.scene->m_index_buffer;
+    rcs.indices =
+        ccfg.scene->m_index_pools[rcs.batch_desc.index_pool].indices;
 
     auto args = get_render_pass_args(ccfg, info, pass);
 
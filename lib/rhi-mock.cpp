@@ -0,0 +1,891 @@
+#include "rhi.hpp"
+#if REN_RHI_MOCK
+#include "core/Math.hpp"
+#include "ren/core/Algorithm.hpp"
+#include "ren/core/Arena.hpp"
+#include "ren/core/Assert.hpp"
+#include "ren/core/Format.hpp"
+#include "ren/core/Mutex.hpp"
+
+#include <bit>
+#include <cstdlib>
+#include <fmt/format.h>
+
+namespace ren::rhi {
+
+namespace mock {
+
+struct InstanceData {
+  bool headless = false;
+};
+
+struct AllocationData {
+  std::byte *ptr = nullptr;
+  usize size = 0;
+};
+
+// All objects share the same representation so that they can be recycled
+// through a single free list.
+struct ObjectData {
+  ObjectData *next_free = nullptr;
+  String8 name;
+  char id_name[32] = {};
+  usize id_name_size = 0;
+  AllocationData allocation;
+  u64 address = 0;
+  u64 value = 0;
+};
+
+struct QueueData {
+  Device device = nullptr;
+  QueueFamily family = {};
+};
+
+struct DeviceData {
+  const InstanceData *instance = nullptr;
+  Mutex mutex;
+  Arena arena;
+  ObjectData *free_objects = nullptr;
+  u32 num_objects = 0;
+  u64 next_address = 0;
+  QueueData queues[ENUM_SIZE<QueueFamily>] = {};
+  Arena stream_arena;
+  StringBuilder stream;
+};
+
+struct CommandBufferData {
+  StringBuilder text;
+  u32 label_depth = 0;
+};
+
+struct CommandPoolData {
+  CommandPoolHeader header;
+  char name[64] = {};
+  usize name_size = 0;
+  Arena arena;
+  u32 cmd_index = 0;
+  CommandBufferData cmd_buffers[8] = {};
+};
+
+constexpr usize MAX_SWAP_CHAIN_IMAGES = 8;
+
+struct SwapChainData {
+  Device device = nullptr;
+  glm::uvec2 size = {};
+  u32 num_images = 0;
+  PresentMode present_mode = {};
+  ObjectData *images[MAX_SWAP_CHAIN_IMAGES] = {};
+  u32 next_image = 0;
+  u32 image = u32(-1);
+};
+
+} // namespace mock
+
+namespace {
+
+constexpr u64 BASE_DEVICE_ADDRESS = u64(1) << 32;
+constexpr usize DEVICE_ADDRESS_ALIGNMENT = 256;
+constexpr usize IMAGE_ALIGNMENT = 64 * KiB;
+
+constexpr const char *QUEUE_FAMILY_NAMES[] = {
+    "Graphics",
+    "Compute",
+    "Transfer",
+};
+
+constexpr const char *PIPELINE_STAGE_NAMES[] = {
+    "ExecuteIndirect",    "TaskShader",        "MeshShader",
+    "IndexInput",         "VertexShader",      "EarlyFragmentTests",
+    "FragmentShader",     "LateFragmentTests", "RenderTargetOutput",
+    "ComputeShader",      "Transfer",          "All",
+};
+
+constexpr const char *ACCESS_NAMES[] = {
+    "IndirectCommandRead", "IndexRead",         "ShaderBufferRead",
+    "ShaderImageRead",     "UnorderedAccess",   "RenderTarget",
+    "DepthStencilRead",    "DepthStencilWrite", "TransferRead",
+    "TransferWrite",       "MemoryRead",        "MemoryWrite",
+};
+
+constexpr const char *IMAGE_LAYOUT_NAMES[] = {
+    "Undefined", "General", "RenderTarget", "TransferSrc", "TransferDst",
+    "Present",
+};
+
+constexpr const char *LOAD_OP_NAMES[] = {"Load", "Clear", "Discard"};
+
+constexpr const char *STORE_OP_NAMES[] = {"Store", "Discard", "None"};
+
+auto create_object(Device device, const char *kind) -> ObjectData * {
+  AutoMutex lock(device->mutex);
+  ObjectData *object = device->free_objects;
+  if (object) {
+    device->free_objects = object->next_free;
+  } else {
+    object = device->arena.allocate<ObjectData>();
+  }
+  *object = {};
+  u32 id = device->num_objects++;
+  object->id_name_size =
+      fmt::format_to_n(object->id_name, std::size(object->id_name), "{}#{}",
+                       kind, id)
+          .size;
+  object->id_name_size = min(object->id_name_size, std::size(object->id_name));
+  return object;
+}
+
+void destroy_object(Device device, ObjectData *object) {
+  if (!object) {
+    return;
+  }
+  AutoMutex lock(device->mutex);
+  object->next_free = device->free_objects;
+  device->free_objects = object;
+}
+
+void set_object_name(Device device, ObjectData *object, String8 name) {
+  AutoMutex lock(device->mutex);
+  object->name = format(&device->arena, "{}", name);
+}
+
+auto get_object_name(const ObjectData *object) -> String8 {
+  if (!object) {
+    return "null";
+  }
+  if (object->name.m_size > 0) {
+    return object->name;
+  }
+  return {object->id_name, object->id_name_size};
+}
+
+template <CFlagsEnum E, usize N>
+void write_mask(NotNull<StringBuilder *> builder, Flags<E> mask,
+                const char *const (&names)[N]) {
+  u32 bits = (u32)mask.get();
+  if (!bits) {
+    builder->push("None");
+    return;
+  }
+  bool first = true;
+  while (bits) {
+    usize bit = std::countr_zero(bits);
+    bits &= bits - 1;
+    if (!first) {
+      builder->push('|');
+    }
+    first = false;
+    builder->push(bit < N ? names[bit] : "?");
+  }
+}
+
+auto begin_line(CommandBuffer cmd) -> StringBuilder * {
+  StringBuilder *builder = &cmd.handle->text;
+  for (usize i : range(2 * (cmd.handle->label_depth + 1))) {
+    builder->push(' ');
+  }
+  return builder;
+}
+
+void write_memory_state(NotNull<StringBuilder *> builder,
+                        PipelineStageMask stage_mask, AccessMask access_mask) {
+  write_mask(builder, stage_mask, PIPELINE_STAGE_NAMES);
+  builder->push(':');
+  write_mask(builder, access_mask, ACCESS_NAMES);
+}
+
+void write_barriers(CommandBuffer cmd,
+                    Span<const MemoryBarrier> memory_barriers,
+                    Span<const ImageBarrier> image_barriers) {
+  cmd.handle->label_depth++;
+  for (const MemoryBarrier &barrier : memory_barriers) {
+    StringBuilder *builder = begin_line(cmd);
+    builder->push("memory ");
+    write_memory_state(builder, barrier.src_stage_mask,
+                       barrier.src_access_mask);
+    builder->push(" -> ");
+    write_memory_state(builder, barrier.dst_stage_mask,
+                       barrier.dst_access_mask);
+    builder->push('\n');
+  }
+  for (const ImageBarrier &barrier : image_barriers) {
+    StringBuilder *builder = begin_line(cmd);
+    format_to(builder, "image {} mips {}+{} layers {}+{} ",
+              get_object_name(barrier.image.handle), barrier.base_mip,
+              barrier.num_mips, barrier.base_layer, barrier.num_layers);
+    write_memory_state(builder, barrier.src_stage_mask,
+                       barrier.src_access_mask);
+    format_to(builder, ":{} -> ",
+              IMAGE_LAYOUT_NAMES[(usize)barrier.src_layout]);
+    write_memory_state(builder, barrier.dst_stage_mask,
+                       barrier.dst_access_mask);
+    format_to(builder, ":{}\n", IMAGE_LAYOUT_NAMES[(usize)barrier.dst_layout]);
+  }
+  cmd.handle->label_depth--;
+}
+
+} // namespace
+
+Result<void> load(bool headless) { return {}; }
+
+Result<void> load(Instance instance) { return {}; }
+
+auto create_instance(NotNull<Arena *> arena,
+                     const InstanceCreateInfo &create_info)
+    -> Result<Instance> {
+  InstanceData *instance = arena->allocate<InstanceData>();
+  instance->headless = create_info.headless;
+  return instance;
+}
+
+void destroy_instance(Instance instance) {}
+
+auto get_adapter_count(Instance instance) -> u32 { return 1; }
+
+auto get_adapter(Instance instance, u32 adapter) -> Adapter {
+  ren_assert(adapter < get_adapter_count(instance));
+  return {adapter};
+}
+
+auto get_adapter_by_preference(Instance instance, AdapterPreference preference)
+    -> Adapter {
+  return {0};
+}
+
+auto get_adapter_features(Instance instance, Adapter adapter)
+    -> AdapterFeatures {
+  return {};
+}
+
+auto is_queue_family_supported(Instance instance, Adapter adapter,
+                               QueueFamily family) -> bool {
+  return true;
+}
+
+auto create_device(NotNull<Arena *> arena, Instance instance,
+                   const DeviceCreateInfo &create_info) -> Result<Device> {
+  Device device = arena->allocate<DeviceData>();
+  device->instance = instance;
+  device->arena = Arena::init();
+  device->next_address = BASE_DEVICE_ADDRESS;
+  for (usize i : range(ENUM_SIZE<QueueFamily>)) {
+    device->queues[i] = {
+        .device = device,
+        .family = (QueueFamily)i,
+    };
+  }
+  device->stream_arena = Arena::init();
+  device->stream = StringBuilder::init(&device->stream_arena);
+  return device;
+}
+
+void destroy_device(Device device) {
+  if (!device) {
+    return;
+  }
+  device->stream_arena.destroy();
+  device->arena.destroy();
+}
+
+void device_wait_idle(Device device) {}
+
+auto get_queue(Device device, QueueFamily family) -> Queue {
+  return {.handle = &device->queues[(usize)family]};
+}
+
+void queue_submit(Queue queue, Span<const CommandBuffer> cmd_buffers,
+                  Span<const SemaphoreState> wait_semaphores,
+                  Span<const SemaphoreState> signal_semaphores) {
+  Device device = queue.handle->device;
+  AutoMutex lock(device->mutex);
+  StringBuilder *builder = &device->stream;
+  format_to(builder, "submit {}",
+            QUEUE_FAMILY_NAMES[(usize)queue.handle->family]);
+  for (const SemaphoreState &wait : wait_semaphores) {
+    format_to(builder, " wait {}={}",
+              get_object_name(wait.semaphore.handle), wait.value);
+  }
+  for (const SemaphoreState &signal : signal_semaphores) {
+    format_to(builder, " signal {}={}",
+              get_object_name(signal.semaphore.handle),
+              signal.value);
+  }
+  builder->push('\n');
+  for (CommandBuffer cmd : cmd_buffers) {
+    const DynamicArray<char> &text = cmd.handle->text.m_buffer;
+    builder->push(String8(text.m_data, text.m_size));
+  }
+  // Work completes as soon as it's submitted.
+  for (const SemaphoreState &signal : signal_semaphores) {
+    ObjectData *semaphore = signal.semaphore.handle;
+    semaphore->value = max(semaphore->value, signal.value);
+  }
+}
+
+void queue_wait_idle(Queue queue) {}
+
+Semaphore create_semaphore(Device device,
+                           const SemaphoreCreateInfo &create_info) {
+  ObjectData *object = create_object(device, "semaphore");
+  object->value = create_info.initial_value;
+  return {.handle = object};
+}
+
+void destroy_semaphore(Device device, Semaphore semaphore) {
+  destroy_object(device, semaphore.handle);
+}
+
+void set_debug_name(Device device, Semaphore semaphore, String8 name) {
+  set_object_name(device, semaphore.handle, name);
+}
+
+WaitResult wait_for_semaphores(Device device,
+                               Span<const SemaphoreWaitInfo> wait_infos,
+                               u64 timeout) {
+  return WaitResult::Success;
+}
+
+void *map(Device device, Allocation allocation) {
+  return allocation.handle->ptr;
+}
+
+auto create_buffer(Device device, const BufferCreateInfo &create_info)
+    -> Result<Buffer> {
+  ObjectData *object = create_object(device, "buffer");
+  object->allocation.size = create_info.size;
+  // Device-local memory is never accessed on the host, so don't back it.
+  if (create_info.heap != MemoryHeap::Default) {
+    object->allocation.ptr = (std::byte *)std::calloc(create_info.size, 1);
+    if (!object->allocation.ptr) {
+      destroy_object(device, object);
+      return Error::OutOfMemory;
+    }
+  }
+  {
+    AutoMutex lock(device->mutex);
+    object->address = device->next_address;
+    device->next_address +=
+        pad(max<usize>(create_info.size, 1), DEVICE_ADDRESS_ALIGNMENT);
+  }
+  return Buffer{
+      .handle = object,
+      .allocation = {&object->allocation},
+  };
+}
+
+void destroy_buffer(Device device, Buffer buffer) {
+  if (!buffer) {
+    return;
+  }
+  std::free(buffer.handle->allocation.ptr);
+  destroy_object(device, buffer.handle);
+}
+
+void set_debug_name(Device device, Buffer buffer, String8 name) {
+  set_object_name(device, buffer.handle, name);
+}
+
+auto get_allocation(Device device, Buffer buffer) -> Allocation {
+  return buffer.allocation;
+}
+
+auto get_device_ptr(Device device, Buffer buffer) -> u64 {
+  return buffer.handle->address;
+}
+
+auto create_image(Device device, const ImageCreateInfo &create_info)
+    -> Result<Image> {
+  ObjectData *object = create_object(device, "image");
+  Allocation allocation = create_info.allocation;
+  if (!allocation) {
+    object->allocation.size =
+        get_memory_requirements(device, create_info).size;
+    allocation = {&object->allocation};
+  }
+  return Image{
+      .handle = object,
+      .allocation = allocation,
+  };
+}
+
+void destroy_image(Device device, Image image) {
+  destroy_object(device, image.handle);
+}
+
+void set_debug_name(Device device, Image image, String8 name) {
+  set_object_name(device, image.handle, name);
+}
+
+auto get_allocation(Device device, Image image) -> Allocation {
+  return image.allocation;
+}
+
+auto get_memory_requirements(Device device, const ImageCreateInfo &create_info)
+    -> MemoryRequirements {
+  u32 block_width = TinyImageFormat_WidthOfBlock(create_info.format);
+  u32 block_height = TinyImageFormat_HeightOfBlock(create_info.format);
+  u32 block_size = TinyImageFormat_BitSizeOfBlock(create_info.format) / 8;
+  u32 num_layers = create_info.num_layers * (create_info.cube_map ? 6 : 1);
+  usize size = 0;
+  for (usize mip : range(create_info.num_mips)) {
+    usize width = max<usize>(create_info.width >> mip, 1);
+    usize height = max<usize>(create_info.height >> mip, 1);
+    usize depth = max<usize>(create_info.depth >> mip, 1);
+    size += ceil_div(width, block_width) * ceil_div(height, block_height) *
+            depth * block_size;
+  }
+  return {
+      .size = pad(size * num_layers, IMAGE_ALIGNMENT),
+      .alignment = IMAGE_ALIGNMENT,
+      .memory_type_mask = 1,
+  };
+}
+
+auto allocate_memory(Device device, const MemoryRequirements &requirements)
+    -> Result<Allocation> {
+  ObjectData *object = create_object(device, "memory");
+  object->allocation.size = requirements.size;
+  return Allocation{&object->allocation};
+}
+
+void free_memory(Device device, Allocation allocation) {
+  if (allocation) {
+    destroy_object(device,
+                   container_of(allocation.handle, ObjectData, allocation));
+  }
+}
+
+ImageView create_image_view(Device device,
+                            const ImageViewCreateInfo &create_info) {
+  return {.handle = create_object(device, "view")};
+}
+
+void destroy_image_view(Device device, ImageView view) {
+  destroy_object(device, view.handle);
+}
+
+Sampler create_sampler(Device device, const SamplerCreateInfo &create_info) {
+  return {.handle = create_object(device, "sampler")};
+}
+
+void destroy_sampler(Device device, Sampler sampler) {
+  destroy_object(device, sampler.handle);
+}
+
+void write_sampler_descriptor_heap(Device device, Span<const Sampler> samplers,
+                                   u32 base_index) {}
+
+void write_srv_descriptor_heap(Device device, Span<const ImageView> views,
+                               u32 base_index) {}
+
+void write_cis_descriptor_heap(Device device, Span<const ImageView> views,
+                               Span<const Sampler> samplers, u32 base_index) {}
+
+void write_uav_descriptor_heap(Device device, Span<const ImageView> views,
+                               u32 base_index) {}
+
+Pipeline
+create_graphics_pipeline(Device device,
+                         const GraphicsPipelineCreateInfo &create_info) {
+  return {.handle = create_object(device, "pipeline")};
+}
+
+Pipeline create_compute_pipeline(Device device,
+                                 const ComputePipelineCreateInfo &create_info) {
+  return {.handle = create_object(device, "pipeline")};
+}
+
+void destroy_pipeline(Device device, Pipeline pipeline) {
+  destroy_object(device, pipeline.handle);
+}
+
+void set_debug_name(Device device, Pipeline pipeline, String8 name) {
+  set_object_name(device, pipeline.handle, name);
+}
+
+auto create_event(Device device) -> Event {
+  return {.handle = create_object(device, "event")};
+}
+
+void destroy_event(Device device, Event event) {
+  destroy_object(device, event.handle);
+}
+
+auto create_query_pool(Device device, const QueryPoolCreateInfo &create_info)
+    -> QueryPool {
+  return {.handle = create_object(device, "query_pool")};
+}
+
+void destroy_query_pool(Device device, QueryPool pool) {
+  destroy_object(device, pool.handle);
+}
+
+void reset_queries(Device device, QueryPool pool, u32 first_query,
+                   u32 num_queries) {}
+
+bool get_timestamps(Device device, QueryPool pool, u32 first_query,
+                    Span<u64> timestamps) {
+  // Nothing is executed, so report every query as written at the same time.
+  fill(timestamps, 0);
+  return true;
+}
+
+auto get_timestamp_period(Device device, QueueFamily queue_family) -> float {
+  return 1.0f;
+}
+
+CommandPool create_command_pool(NotNull<Arena *> arena, Device device,
+                                const CommandPoolCreateInfo &create_info) {
+  CommandPoolData *pool = arena->allocate<CommandPoolData>();
+  pool->header.queue_family = create_info.queue_family;
+  pool->arena = Arena::init();
+  return &pool->header;
+}
+
+void destroy_command_pool(Device device, CommandPool header) {
+  CommandPoolData *pool = container_of(header, CommandPoolData, header);
+  if (pool) {
+    pool->arena.destroy();
+  }
+}
+
+void set_debug_name(Device device, CommandPool header, String8 name) {
+  CommandPoolData *pool = container_of(header, CommandPoolData, header);
+  pool->name_size = min(name.m_size, std::size(pool->name));
+  copy(Span(name.m_str, pool->name_size), pool->name);
+}
+
+void reset_command_pool(Device device, CommandPool header) {
+  CommandPoolData *pool = container_of(header, CommandPoolData, header);
+  pool->arena.clear();
+  pool->cmd_index = 0;
+}
+
+CommandBuffer begin_command_buffer(Device device, CommandPool header) {
+  CommandPoolData *pool = container_of(header, CommandPoolData, header);
+  ren_assert(pool->cmd_index < std::size(pool->cmd_buffers));
+  CommandBufferData *cmd = &pool->cmd_buffers[pool->cmd_index++];
+  *cmd = {.text = StringBuilder::init(&pool->arena)};
+  format_to(&cmd->text, "  begin {}\n",
+            String8(pool->name, pool->name_size));
+  return {
+      .handle = cmd,
+      .device = device,
+  };
+}
+
+void end_command_buffer(CommandBuffer cmd) {
+  ren_assert(cmd.handle->label_depth == 0);
+  begin_line(cmd)->push("end\n");
+}
+
+void cmd_pipeline_barrier(CommandBuffer cmd,
+                          Span<const MemoryBarrier> memory_barriers,
+                          Span<const ImageBarrier> image_barriers) {
+  begin_line(cmd)->push("pipeline_barrier\n");
+  write_barriers(cmd, memory_barriers, image_barriers);
+}
+
+void cmd_set_event(CommandBuffer cmd, Event event,
+                   Span<const MemoryBarrier> memory_barriers,
+                   Span<const ImageBarrier> image_barriers) {
+  format_to(begin_line(cmd), "set_event {}\n", get_object_name(event.handle));
+  write_barriers(cmd, memory_barriers, image_barriers);
+}
+
+void cmd_wait_event(CommandBuffer cmd, Event event,
+                    Span<const MemoryBarrier> memory_barriers,
+                    Span<const ImageBarrier> image_barriers) {
+  format_to(begin_line(cmd), "wait_event {}\n", get_object_name(event.handle));
+  write_barriers(cmd, memory_barriers, image_barriers);
+}
+
+void cmd_reset_event(CommandBuffer cmd, Event event, PipelineStageMask stages) {
+  StringBuilder *builder = begin_line(cmd);
+  format_to(builder, "reset_event {} ", get_object_name(event.handle));
+  write_mask(builder, stages, PIPELINE_STAGE_NAMES);
+  builder->push('\n');
+}
+
+void cmd_write_timestamp(CommandBuffer cmd, QueryPool pool, u32 query) {
+  format_to(begin_line(cmd), "write_timestamp {} {}\n",
+            get_object_name(pool.handle), query);
+}
+
+void cmd_copy_buffer(CommandBuffer cmd, const BufferCopyInfo &copy_info) {
+  format_to(begin_line(cmd), "copy_buffer {}+{} -> {}+{} size {}\n",
+            get_object_name(copy_info.src.handle), copy_info.src_offset,
+            get_object_name(copy_info.dst.handle), copy_info.dst_offset,
+            copy_info.size);
+}
+
+void cmd_copy_buffer_to_image(CommandBuffer cmd,
+                              const BufferImageCopyInfo &copy_info) {
+  format_to(begin_line(cmd),
+            "copy_buffer_to_image {}+{} -> {} mip {} layers {}+{}\n",
+            get_object_name(copy_info.buffer.handle), copy_info.buffer_offset,
+            get_object_name(copy_info.image.handle), copy_info.mip,
+            copy_info.base_layer, copy_info.num_layers);
+}
+
+void cmd_copy_image_to_buffer(CommandBuffer cmd,
+                              const BufferImageCopyInfo &copy_info) {
+  format_to(begin_line(cmd),
+            "copy_image_to_buffer {} mip {} layers {}+{} -> {}+{}\n",
+            get_object_name(copy_info.image.handle), copy_info.mip,
+            copy_info.base_layer, copy_info.num_layers,
+            get_object_name(copy_info.buffer.handle), copy_info.buffer_offset);
+}
+
+void cmd_fill_buffer(CommandBuffer cmd, const BufferFillInfo &fill_info) {
+  format_to(begin_line(cmd), "fill_buffer {}+{} size {} value {:#x}\n",
+            get_object_name(fill_info.buffer.handle), fill_info.offset,
+            fill_info.size, fill_info.value);
+}
+
+void cmd_clear_image(CommandBuffer cmd, const ImageClearInfo &clear_info) {
+  format_to(begin_line(cmd), "clear_image {} mips {}+{} layers {}+{}\n",
+            get_object_name(clear_info.image.handle), clear_info.base_mip,
+            clear_info.num_mips, clear_info.base_layer, clear_info.num_layers);
+}
+
+void cmd_bind_pipeline(CommandBuffer cmd, PipelineBindPoint bind_point,
+                       Pipeline pipeline) {
+  format_to(begin_line(cmd), "bind_pipeline {} {}\n",
+            bind_point == PipelineBindPoint::Graphics ? "Graphics" : "Compute",
+            get_object_name(pipeline.handle));
+}
+
+void cmd_push_constants(CommandBuffer cmd, usize offset,
+                        Span<const std::byte> data) {
+  // Push constants contain device addresses, which depend on allocation
+  // order, so only record their size.
+  format_to(begin_line(cmd), "push_constants {}+{}\n", offset, data.m_size);
+}
+
+void cmd_begin_render_pass(CommandBuffer cmd, const RenderPassInfo &info) {
+  StringBuilder *builder = begin_line(cmd);
+  format_to(builder, "begin_render_pass {}x{}", info.render_area.x,
+            info.render_area.y);
+  for (const RenderTarget &rt : info.render_targets) {
+    format_to(builder, " rt {} {}/{}", get_object_name(rt.rtv.handle),
+              LOAD_OP_NAMES[(usize)rt.ops.load],
+              STORE_OP_NAMES[(usize)rt.ops.store]);
+  }
+  const DepthStencilTarget &dst = info.depth_stencil_target;
+  if (dst.dsv) {
+    format_to(builder, " ds {} {}/{}", get_object_name(dst.dsv.handle),
+              LOAD_OP_NAMES[(usize)dst.ops.load],
+              STORE_OP_NAMES[(usize)dst.ops.store]);
+  }
+  builder->push('\n');
+}
+
+void cmd_end_render_pass(CommandBuffer cmd) {
+  begin_line(cmd)->push("end_render_pass\n");
+}
+
+void cmd_set_viewports(CommandBuffer cmd, Span<const Viewport> viewports) {
+  format_to(begin_line(cmd), "set_viewports {}\n", viewports.m_size);
+}
+
+void cmd_set_scissor_rects(CommandBuffer cmd, Span<const Rect2D> rects) {
+  format_to(begin_line(cmd), "set_scissor_rects {}\n", rects.m_size);
+}
+
+void cmd_bind_index_buffer(CommandBuffer cmd, Buffer buffer, usize offset,
+                           IndexType index_type) {
+  format_to(begin_line(cmd), "bind_index_buffer {}+{}\n",
+            get_object_name(buffer.handle), offset);
+}
+
+void cmd_draw(CommandBuffer cmd, const DrawInfo &draw_info) {
+  format_to(begin_line(cmd), "draw {} vertices {} instances\n",
+            draw_info.num_vertices, draw_info.num_instances);
+}
+
+void cmd_draw_indexed(CommandBuffer cmd, const DrawIndexedInfo &draw_info) {
+  format_to(begin_line(cmd), "draw_indexed {} indices {} instances\n",
+            draw_info.num_indices, draw_info.num_instances);
+}
+
+void cmd_draw_indirect_count(CommandBuffer cmd,
+                             const DrawIndirectCountInfo &draw_info) {
+  format_to(begin_line(cmd), "draw_indirect_count {}+{} count {}+{} max {}\n",
+            get_object_name(draw_info.buffer.handle), draw_info.buffer_offset,
+            get_object_name(draw_info.count_buffer.handle),
+            draw_info.count_buffer_offset, draw_info.max_count);
+}
+
+void cmd_draw_indexed_indirect_count(CommandBuffer cmd,
+                                     const DrawIndirectCountInfo &draw_info) {
+  format_to(begin_line(cmd),
+            "draw_indexed_indirect_count {}+{} count {}+{} max {}\n",
+            get_object_name(draw_info.buffer.handle), draw_info.buffer_offset,
+            get_object_name(draw_info.count_buffer.handle),
+            draw_info.count_buffer_offset, draw_info.max_count);
+}
+
+void cmd_dispatch(CommandBuffer cmd, u32 num_groups_x, u32 num_groups_y,
+                  u32 num_groups_z) {
+  format_to(begin_line(cmd), "dispatch {}x{}x{}\n", num_groups_x,
+            num_groups_y, num_groups_z);
+}
+
+void cmd_dispatch_indirect(CommandBuffer cmd, Buffer buffer, usize offset) {
+  format_to(begin_line(cmd), "dispatch_indirect {}+{}\n",
+            get_object_name(buffer.handle), offset);
+}
+
+void cmd_begin_debug_label(CommandBuffer cmd, String8 label) {
+  format_to(begin_line(cmd), "{}\n", label);
+  cmd.handle->label_depth++;
+}
+
+void cmd_end_debug_label(CommandBuffer cmd) {
+  ren_assert(cmd.handle->label_depth > 0);
+  cmd.handle->label_depth--;
+}
+
+extern const u32 SDL_WINDOW_FLAGS = 0;
+
+Surface create_surface(Instance instance, SDL_Window *window) {
+  return {.handle = 1};
+}
+
+void destroy_surface(Instance instance, Surface surface) {}
+
+auto is_queue_family_present_supported(Instance instance, Adapter adapter,
+                                       QueueFamily family, Surface surface)
+    -> bool {
+  return family != QueueFamily::Transfer;
+}
+
+void get_surface_present_modes(NotNull<Arena *> arena, Instance instance,
+                               Adapter adapter, Surface surface,
+                               u32 *num_present_modes,
+                               PresentMode **present_modes) {
+  *num_present_modes = 3;
+  *present_modes = arena->allocate<PresentMode>(*num_present_modes);
+  (*present_modes)[0] = PresentMode::Fifo;
+  (*present_modes)[1] = PresentMode::Mailbox;
+  (*present_modes)[2] = PresentMode::Immediate;
+}
+
+void get_surface_formats(NotNull<Arena *> arena, Instance instance,
+                         Adapter adapter, Surface surface, u32 *num_formats,
+                         TinyImageFormat **formats) {
+  *num_formats = 2;
+  *formats = arena->allocate<TinyImageFormat>(*num_formats);
+  (*formats)[0] = TinyImageFormat_B8G8R8A8_UNORM;
+  (*formats)[1] = TinyImageFormat_R8G8B8A8_UNORM;
+}
+
+Flags<ImageUsage> get_surface_supported_image_usage(Instance instance,
+                                                    Adapter adapter,
+                                                    Surface surface) {
+  return ImageUsage::TransferSrc | ImageUsage::TransferDst |
+         ImageUsage::ShaderResource | ImageUsage::UnorderedAccess |
+         ImageUsage::RenderTarget;
+}
+
+namespace {
+
+void recreate_swap_chain(SwapChain swap_chain, glm::uvec2 size,
+                         u32 num_images) {
+  Device device = swap_chain->device;
+  for (ObjectData *&image : swap_chain->images) {
+    destroy_object(device, image);
+    image = nullptr;
+  }
+  swap_chain->size = {max(size.x, 1u), max(size.y, 1u)};
+  swap_chain->num_images =
+      min<u32>(max(num_images, 2u), MAX_SWAP_CHAIN_IMAGES);
+  for (usize i : range(swap_chain->num_images)) {
+    swap_chain->images[i] = create_object(device, "swap_chain_image");
+  }
+  swap_chain->next_image = 0;
+}
+
+} // namespace
+
+SwapChain create_swap_chain(NotNull<Arena *> arena, Device device,
+                            const SwapChainCreateInfo &create_info) {
+  SwapChain swap_chain = arena->allocate<SwapChainData>();
+  *swap_chain = {
+      .device = device,
+      .present_mode = create_info.present_mode,
+  };
+  recreate_swap_chain(swap_chain, {create_info.width, create_info.height},
+                      create_info.num_images);
+  return swap_chain;
+}
+
+void destroy_swap_chain(SwapChain swap_chain) {
+  if (swap_chain) {
+    for (ObjectData *image : swap_chain->images) {
+      destroy_object(swap_chain->device, image);
+    }
+  }
+}
+
+auto get_swap_chain_size(SwapChain swap_chain) -> glm::uvec2 {
+  return swap_chain->size;
+}
+
+void get_swap_chain_images(NotNull<Arena *> arena, SwapChain swap_chain,
+                           u32 *num_images, Image **images) {
+  *num_images = swap_chain->num_images;
+  *images = arena->allocate<Image>(*num_images);
+  for (usize i : range(*num_images)) {
+    (*images)[i] = {.handle = swap_chain->images[i]};
+  }
+}
+
+void resize_swap_chain(SwapChain swap_chain, glm::uvec2 size, u32 num_images,
+                       ImageUsageFlags usage) {
+  recreate_swap_chain(swap_chain, size, num_images);
+}
+
+void set_present_mode(SwapChain swap_chain, PresentMode present_mode) {
+  swap_chain->present_mode = present_mode;
+}
+
+SwapChainResult<u32> acquire_image(SwapChain swap_chain, Semaphore semaphore) {
+  ren_assert(swap_chain);
+  ren_assert(swap_chain->image == u32(-1));
+  swap_chain->image = swap_chain->next_image;
+  swap_chain->next_image =
+      (swap_chain->next_image + 1) % swap_chain->num_images;
+  return swap_chain->image;
+}
+
+SwapChainResult<void> present(Queue queue, SwapChain swap_chain,
+                              Semaphore semaphore) {
+  ren_assert(swap_chain);
+  ren_assert(swap_chain->image != u32(-1));
+  Device device = swap_chain->device;
+  {
+    AutoMutex lock(device->mutex);
+    format_to(&device->stream, "present {} wait {}\n",
+              QUEUE_FAMILY_NAMES[(usize)queue.handle->family],
+              get_object_name(semaphore.handle));
+  }
+  swap_chain->image = u32(-1);
+  return {};
+}
+
+void amd_anti_lag_input(Device device, u64 frame, bool enable, u32 max_fps) {}
+
+void amd_anti_lag_present(Device device, u64 frame, bool enable, u32 max_fps) {}
+
+auto take_command_stream(NotNull<Arena *> arena, Device device) -> String8 {
+  AutoMutex lock(device->mutex);
+  String8 stream = device->stream.materialize(arena);
+  device->stream_arena.clear();
+  device->stream = StringBuilder::init(&device->stream_arena);
+  return stream;
+}
+
+} // namespace ren::rhi
+
+#endif // REN_RHI_MOCK
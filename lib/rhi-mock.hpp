@@ -0,0 +1,124 @@
+#pragma once
+#if REN_RHI_MOCK
+#include "ren/core/Arena.hpp"
+#include "ren/core/NotNull.hpp"
+#include "ren/core/StdDef.hpp"
+#include "ren/core/String.hpp"
+
+namespace ren::rhi {
+
+enum class QueueFamily;
+
+// Backend that doesn't talk to a GPU. Resource creation, command recording
+// and submission are cheap in-memory operations, and submitted command
+// buffers are appended to a text command stream. This allows to run and
+// benchmark frame building on machines without a GPU and to catch
+// synchronization regressions by comparing command streams.
+namespace mock {
+
+template <typename Self> struct HandleBase {
+  explicit operator bool() const {
+    return static_cast<const Self *>(this)->handle;
+  }
+};
+
+template <typename Self>
+bool operator==(const HandleBase<Self> &lhs, const HandleBase<Self> &rhs) {
+  return static_cast<const Self &>(lhs).handle ==
+         static_cast<const Self &>(rhs).handle;
+};
+
+struct InstanceData;
+
+using Instance = const InstanceData *;
+
+struct Adapter {
+  u32 index = u32(-1);
+};
+
+struct DeviceData;
+
+using Device = DeviceData *;
+
+struct QueueData;
+
+struct Queue : HandleBase<Queue> {
+  QueueData *handle = nullptr;
+};
+
+struct ObjectData;
+
+struct Semaphore : HandleBase<Semaphore> {
+  ObjectData *handle = nullptr;
+};
+
+struct AllocationData;
+
+struct Allocation : HandleBase<Allocation> {
+  AllocationData *handle = nullptr;
+};
+
+struct Buffer : HandleBase<Buffer> {
+  ObjectData *handle = nullptr;
+  Allocation allocation = {};
+};
+
+struct Image : HandleBase<Image> {
+  ObjectData *handle = nullptr;
+  Allocation allocation = {};
+};
+
+struct ImageView : HandleBase<ImageView> {
+  ObjectData *handle = nullptr;
+};
+
+struct Sampler : HandleBase<Sampler> {
+  ObjectData *handle = nullptr;
+};
+
+struct Pipeline : HandleBase<Pipeline> {
+  ObjectData *handle = nullptr;
+};
+
+struct Event : HandleBase<Event> {
+  ObjectData *handle = nullptr;
+};
+
+struct QueryPool : HandleBase<QueryPool> {
+  ObjectData *handle = nullptr;
+};
+
+struct CommandPoolHeader {
+  CommandPoolHeader *next = nullptr;
+  QueueFamily queue_family = {};
+};
+
+using CommandPool = CommandPoolHeader *;
+
+struct CommandBufferData;
+
+struct CommandBuffer : HandleBase<CommandBuffer> {
+  CommandBufferData *handle = nullptr;
+  Device device = {};
+};
+
+struct Surface : HandleBase<Surface> {
+  u32 handle = 0;
+};
+
+struct SwapChainData;
+
+using SwapChain = SwapChainData *;
+
+/// Text of all command buffers that have been submitted since the last call,
+/// in submission order. Objects are referred to by their debug names if they
+/// have them, and by their creation order otherwise.
+auto take_command_stream(NotNull<Arena *> arena, Device device) -> String8;
+
+} // namespace mock
+
+using namespace mock;
+
+} // namespace ren::rhi
+
+#endif // REN_RHI_MOCK
@@ -405,6 +405,7 @@ struct AdapterData {
   VkPhysicalDevice physical_device = nullptr;
   AdapterFeatures features;
   u32 queue_families[ENUM_SIZE<QueueFamily>] = {};
+  u32 timestamp_valid_bits[ENUM_SIZE<QueueFamily>] = {};
   VkPhysicalDeviceProperties properties;
   MemoryHeapProperties heap_properties[ENUM_SIZE<MemoryHeap>] = {};
   Span<VkExtensionProperties> extensions;
@@ -812,6 +813,13 @@ auto create_instance(NotNull<Arena *> arena,
       continue;
     }
 
+    for (usize i : range(ENUM_SIZE<QueueFamily>)) {
+      u32 qf = adapter.queue_families[i];
+      if (qf != QUEUE_FAMILY_UNAVAILABLE) {
+        adapter.timestamp_valid_bits[i] = queues[qf].timestampValidBits;
+      }
+    }
+
     if (adapter.properties.deviceType ==
         VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU) {
       adapter.heap_properties[(usize)MemoryHeap::Default] = {
@@ -1011,6 +1019,7 @@ auto create_device(NotNull<Arena *> arena, Instance instance,
       .runtimeDescriptorArray = true,
       .samplerFilterMinmax = true,
       .scalarBlockLayout = true,
+      .hostQueryReset = true,
       .timelineSemaphore = true,
       .bufferDeviceAddress = true,
   };
@@ -1497,8 +1506,12 @@ auto get_device_ptr(Device device, Buffer buffer) -> u64 {
   return device->vk.vkGetBufferDeviceAddress(device->handle, &address_info);
 }
 
-auto create_image(Device device, const ImageCreateInfo &create_info)
-    -> Result<Image> {
+namespace {
+
+auto get_vk_image_create_info(Device device,
+                              const ImageCreateInfo &create_info,
+                              u32 (&queue_families)[ENUM_SIZE<QueueFamily>])
+    -> VkImageCreateInfo {
   u32 width = create_info.width;
   u32 height = create_info.height;
   u32 depth = create_info.depth;
@@ -1519,7 +1532,7 @@ auto create_image(Device device, const ImageCreateInfo &create_info)
   u32 copy_qf = adapter.queue_families[(u32)QueueFamily::Transfer];
 
   u32 num_queue_families = 1;
-  u32 queue_families[ENUM_SIZE<QueueFamily>] = {gfx_qf};
+  queue_families[0] = gfx_qf;
   if (usage.is_any_set(ImageUsage::ShaderResource |
                        ImageUsage::UnorderedAccess | ImageUsage::TransferSrc |
                        ImageUsage::TransferDst) and
@@ -1535,7 +1548,7 @@ auto create_image(Device device, const ImageCreateInfo &create_info)
   if (create_info.cube_map) {
     flags |= VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
   }
-  VkImageCreateInfo image_info = {
+  return {
       .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
       .flags = flags,
       .imageType = image_type,
@@ -1551,10 +1564,29 @@ auto create_image(Device device, const ImageCreateInfo &create_info)
       .queueFamilyIndexCount = num_queue_families,
       .pQueueFamilyIndices = queue_families,
   };
+}
 
-  VmaAllocationCreateInfo alloc_info = {.usage = VMA_MEMORY_USAGE_AUTO};
+} // namespace
+
+auto create_image(Device device, const ImageCreateInfo &create_info)
+    -> Result<Image> {
+  u32 queue_families[ENUM_SIZE<QueueFamily>];
+  VkImageCreateInfo image_info =
+      get_vk_image_create_info(device, create_info, queue_families);
 
   Image image;
+  if (create_info.allocation) {
+    VkResult result = vmaCreateAliasingImage2(
+        device->allocator, create_info.allocation.handle,
+        create_info.allocation_offset, &image_info, &image.handle);
+    if (result) {
+      return vk_result_to_rhi_status(result);
+    }
+    return image;
+  }
+
+  VmaAllocationCreateInfo alloc_info = {.usage = VMA_MEMORY_USAGE_AUTO};
+
   VkResult result =
       vmaCreateImage(device->allocator, &image_info, &alloc_info, &image.handle,
                      &image.allocation.handle, nullptr);
@@ -1577,6 +1609,51 @@ auto get_allocation(Device, Image image) -> Allocation {
   return image.allocation;
 }
 
+auto get_memory_requirements(Device device, const ImageCreateInfo &create_info)
+    -> MemoryRequirements {
+  u32 queue_families[ENUM_SIZE<QueueFamily>];
+  VkImageCreateInfo image_info =
+      get_vk_image_create_info(device, create_info, queue_families);
+  VkDeviceImageMemoryRequirements requirements_info = {
+      .sType = VK_STRUCTURE_TYPE_DEVICE_IMAGE_MEMORY_REQUIREMENTS,
+      .pCreateInfo = &image_info,
+  };
+  VkMemoryRequirements2 requirements = {
+      .sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2,
+  };
+  device->vk.vkGetDeviceImageMemoryRequirements(
+      device->handle, &requirements_info, &requirements);
+  return {
+      .size = requirements.memoryRequirements.size,
+      .alignment = requirements.memoryRequirements.alignment,
+      .memory_type_mask = requirements.memoryRequirements.memoryTypeBits,
+  };
+}
+
+auto allocate_memory(Device device, const MemoryRequirements &requirements)
+    -> Result<Allocation> {
+  VkMemoryRequirements vk_requirements = {
+      .size = requirements.size,
+      .alignment = requirements.alignment,
+      .memoryTypeBits = requirements.memory_type_mask,
+  };
+  VmaAllocationCreateInfo alloc_info = {
+      .flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT,
+      .usage = VMA_MEMORY_USAGE_GPU_ONLY,
+  };
+  Allocation allocation;
+  VkResult result = vmaAllocateMemory(device->allocator, &vk_requirements,
+                                      &alloc_info, &allocation.handle, nullptr);
+  if (result) {
+    return vk_result_to_rhi_status(result);
+  }
+  return allocation;
+}
+
+void free_memory(Device device, Allocation allocation) {
+  vmaFreeMemory(device->allocator, allocation.handle);
+}
+
 ImageView create_image_view(Device device,
                             const ImageViewCreateInfo &create_info) {
   ren_assert(create_info.num_mips > 0);
@@ -2013,6 +2090,51 @@ void destroy_event(Device device, Event event) {
   device->vk.vkDestroyEvent(device->handle, event.handle, nullptr);
 }
 
+auto create_query_pool(Device device, const QueryPoolCreateInfo &create_info)
+    -> QueryPool {
+  VkQueryPoolCreateInfo pool_info = {
+      .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+      .queryType = VK_QUERY_TYPE_TIMESTAMP,
+      .queryCount = create_info.num_queries,
+  };
+  QueryPool pool;
+  VkResult result = device->vk.vkCreateQueryPool(device->handle, &pool_info,
+                                                 nullptr, &pool.handle);
+  VK_CHECK(result, "vkCreateQueryPool failed");
+  return pool;
+}
+
+void destroy_query_pool(Device device, QueryPool pool) {
+  device->vk.vkDestroyQueryPool(device->handle, pool.handle, nullptr);
+}
+
+void reset_queries(Device device, QueryPool pool, u32 first_query,
+                   u32 num_queries) {
+  device->vk.vkResetQueryPool(device->handle, pool.handle, first_query,
+                              num_queries);
+}
+
+bool get_timestamps(Device device, QueryPool pool, u32 first_query,
+                    Span<u64> timestamps) {
+  VkResult result = device->vk.vkGetQueryPoolResults(
+      device->handle, pool.handle, first_query, timestamps.m_size,
+      timestamps.size_bytes(), timestamps.m_data, sizeof(u64),
+      VK_QUERY_RESULT_64_BIT);
+  if (result == VK_NOT_READY) {
+    return false;
+  }
+  VK_CHECK(result, "vkGetQueryPoolResults failed");
+  return true;
+}
+
+auto get_timestamp_period(Device device, QueueFamily queue_family) -> float {
+  const AdapterData &adapter = get_adapter(device);
+  if (adapter.timestamp_valid_bits[(usize)queue_family] == 0) {
+    return 0.0f;
+  }
+  return adapter.properties.limits.timestampPeriod;
+}
+
 namespace vk {
 
 struct CommandPoolData {
@@ -2261,6 +2383,12 @@ void cmd_reset_event(CommandBuffer cmd, Event event, PipelineStageMask stages) {
   cmd.device->vk.vkCmdResetEvent2(cmd.handle, event.handle, to_vk(stages));
 }
 
+void cmd_write_timestamp(CommandBuffer cmd, QueryPool pool, u32 query) {
+  cmd.device->vk.vkCmdWriteTimestamp2(cmd.handle,
+                                      VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                                      pool.handle, query);
+}
+
 void cmd_copy_buffer(CommandBuffer cmd, const BufferCopyInfo &info) {
   VkBufferCopy region = {
       .srcOffset = info.src_offset,
@@ -1,5 +1,7 @@
 #pragma once
+#if !REN_RHI_MOCK
 #define REN_RHI_VULKAN 1
+#endif
 #if REN_RHI_VULKAN
 #include "ren/core/StdDef.hpp"
 #include "vma.hpp"
@@ -76,6 +78,10 @@ struct Event : HandleBase<Event> {
   VkEvent handle = nullptr;
 };
 
+struct QueryPool : HandleBase<QueryPool> {
+  VkQueryPool handle = nullptr;
+};
+
 struct CommandPoolHeader {
   CommandPoolHeader *next = nullptr;
   QueueFamily queue_family = {};
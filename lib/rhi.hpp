@@ -7,6 +7,7 @@
 #include "ren/core/String.hpp"
 #include "ren/ren.hpp"
 #include "ren/tiny_imageformat.h"
+#include "rhi-mock.hpp"
 #include "rhi-vk.hpp"
 
 #include <glm/vec2.hpp>
@@ -225,6 +226,10 @@ struct ImageCreateInfo {
   bool cube_map : 1 = false;
   u32 num_mips = 1;
   u32 num_layers = 1;
+  /// Optional: memory to place the image into instead of allocating its own.
+  /// The image doesn't own this memory.
+  Allocation allocation = {};
+  usize allocation_offset = 0;
 };
 
 auto create_image(Device device, const ImageCreateInfo &create_info)
@@ -236,6 +241,21 @@ void set_debug_name(Device device, Image image, String8 name);
 
 auto get_allocation(Device device, Image image) -> Allocation;
 
+struct MemoryRequirements {
+  usize size = 0;
+  usize alignment = 1;
+  u32 memory_type_mask = 0;
+};
+
+auto get_memory_requirements(Device device, const ImageCreateInfo &create_info)
+    -> MemoryRequirements;
+
+/// Allocate device memory that images can be placed into.
+auto allocate_memory(Device device, const MemoryRequirements &requirements)
+    -> Result<Allocation>;
+
+void free_memory(Device device, Allocation allocation);
+
 enum class ImageViewDimension {
   e1D,
   eArray1D,
@@ -579,6 +599,30 @@ auto create_event(Device device) -> Event;
 
 void destroy_event(Device device, Event event);
 
+struct QueryPoolCreateInfo {
+  u32 num_queries = 0;
+};
+
+/// Create a pool of timestamp queries. Queries must be reset before they are
+/// written.
+auto create_query_pool(Device device, const QueryPoolCreateInfo &create_info)
+    -> QueryPool;
+
+void destroy_query_pool(Device device, QueryPool pool);
+
+/// Reset queries on the host. Commands that write them must have completed.
+void reset_queries(Device device, QueryPool pool, u32 first_query,
+                   u32 num_queries);
+
+/// Read back timestamps without waiting. Returns false if some of them haven't
+/// been written yet.
+bool get_timestamps(Device device, QueryPool pool, u32 first_query,
+                    Span<u64> timestamps);
+
+/// Get the number of nanoseconds per timestamp tick, or 0 if queues from this
+/// family can't write timestamps.
+auto get_timestamp_period(Device device, QueueFamily queue_family) -> float;
+
 struct CommandPoolCreateInfo {
   QueueFamily queue_family = {};
 };
@@ -839,6 +883,9 @@ void cmd_wait_event(CommandBuffer cmd, Event event,
 
 void cmd_reset_event(CommandBuffer cmd, Event event, PipelineStageMask stages);
 
+/// Write a timestamp after all previous commands have completed.
+void cmd_write_timestamp(CommandBuffer cmd, QueryPool pool, u32 query);
+
 struct BufferCopyInfo {
   Buffer src = {};
   Buffer dst = {};
@@ -32,8 +32,10 @@ vec4 main(OpaqueVsOutput in) : SV_Target0 {
 
   vec3 normal = in.normal;
   if (OPAQUE_FEATURE_UV && OPAQUE_FEATURE_TS && !IsNull(material.normal_texture)) {
-    vec3 tex = Get(material.normal_texture).Sample(in.uv).xyz;
-    tex = 2.0f * tex - 1.0f;
+    // Normal maps are baked to two channel formats, reconstruct Z.
+    vec3 tex;
+    tex.xy = 2.0f * Get(material.normal_texture).Sample(in.uv).xy - 1.0f;
+    tex.z = sqrt(max(1.0f - dot(tex.xy, tex.xy), 0.0f));
     tex.xy *= material.normal_scale;
     vec3 tangent = in.tangent.xyz;
     float s = in.tangent.w;
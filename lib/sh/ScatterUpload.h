@@ -0,0 +1,20 @@
+#pragma once
+#include "Std.h"
+
+namespace ren::sh {
+
+static const uint SCATTER_UPLOAD_THREADS = 128;
+
+struct ScatterUploadArgs {
+  /// Destination element index for each source element. If null, elements
+  /// are written consecutively starting at base.
+  DevicePtr<uint> indices;
+  DevicePtr<uint> src;
+  DevicePtr<uint> dst;
+  uint base;
+  uint count;
+  /// Element size in words.
+  uint stride;
+};
+
+} // namespace ren::sh
@@ -0,0 +1,115 @@
+#include "ren/baking/mesh.hpp"
+#include "ren/core/Algorithm.hpp"
+#include "ren/core/Arena.hpp"
+
+#include <cstdlib>
+#include <fmt/base.h>
+#include <source_location>
+
+using namespace ren;
+
+namespace {
+
+void check(bool condition,
+           std::source_location sl = std::source_location::current()) {
+  if (!condition) {
+    fmt::println(stderr, "{}:{}: check failed", sl.file_name(), sl.line());
+    std::exit(EXIT_FAILURE);
+  }
+}
+
+// Chunked baking of a mesh whose triangle centroids are clustered so tightly
+// far away from the origin that chunk splits can't be represented used to
+// never terminate.
+void test_chunk_clustered_centroids() {
+  ScratchArena scratch;
+
+  constexpr usize NUM_TRIANGLES = 1024;
+  constexpr float ORIGIN = 1.0e6f;
+  // Smallest float step at ORIGIN.
+  constexpr float STEP = 0.0625f;
+
+  usize num_vertices = NUM_TRIANGLES * 3;
+  auto positions = Span<glm::vec3>::allocate(scratch, num_vertices);
+  auto normals = Span<glm::vec3>::allocate(scratch, num_vertices);
+  for (usize t : range(NUM_TRIANGLES)) {
+    // Most centroids are in the first histogram bin, so the split ends up
+    // right after it.
+    float x = t % 4 == 0 ? ORIGIN + STEP : ORIGIN;
+    positions[t * 3 + 0] = {x, 0.0f, 0.0f};
+    positions[t * 3 + 1] = {x, 0.01f, 0.0f};
+    positions[t * 3 + 2] = {x, 0.0f, 0.01f};
+    for (usize k : range(3)) {
+      normals[t * 3 + k] = {1.0f, 0.0f, 0.0f};
+    }
+  }
+
+  Blob blob = bake_mesh_to_memory(scratch,
+                                  {
+                                      .num_vertices = num_vertices,
+                                      .positions = positions.m_data,
+                                      .normals = normals.m_data,
+                                  },
+                                  {.memory_budget = 1});
+  check(blob.data and blob.size > 0);
+}
+
+// All normal cones of a flat grid are usable and have a half-angle close to
+// 0, and meshlets can't cover more area than their bounding sphere's cross
+// section.
+void test_meshlet_stats() {
+  ScratchArena scratch;
+
+  constexpr u32 GRID_SIZE = 32;
+  constexpr u32 NUM_VERTICES = (GRID_SIZE + 1) * (GRID_SIZE + 1);
+  auto positions = Span<glm::vec3>::allocate(scratch, NUM_VERTICES);
+  auto normals = Span<glm::vec3>::allocate(scratch, NUM_VERTICES);
+  for (u32 y : range(GRID_SIZE + 1)) {
+    for (u32 x : range(GRID_SIZE + 1)) {
+      positions[y * (GRID_SIZE + 1) + x] = {float(x), float(y), 0.0f};
+      normals[y * (GRID_SIZE + 1) + x] = {0.0f, 0.0f, 1.0f};
+    }
+  }
+  auto indices = Span<u32>::allocate(scratch, GRID_SIZE * GRID_SIZE * 6);
+  for (u32 y : range(GRID_SIZE)) {
+    for (u32 x : range(GRID_SIZE)) {
+      u32 v = y * (GRID_SIZE + 1) + x;
+      u32 quad[] = {
+          v, v + 1, v + GRID_SIZE + 2, v, v + GRID_SIZE + 2, v + GRID_SIZE + 1,
+      };
+      copy(Span<const u32>(quad), &indices[(y * GRID_SIZE + x) * 6]);
+    }
+  }
+  MeshInfo info = {
+      .num_vertices = NUM_VERTICES,
+      .positions = positions.m_data,
+      .normals = normals.m_data,
+      .indices = indices,
+  };
+
+  for (MeshletAlgorithm algorithm :
+       {MeshletAlgorithm::Greedy, MeshletAlgorithm::Spatial}) {
+    MeshletStats stats;
+    Blob blob = bake_mesh_to_memory(scratch, info,
+                                    {
+                                        .meshlet_algorithm = algorithm,
+                                        .stats = &stats,
+                                    });
+    check(blob.data and blob.size > 0);
+    check(stats.num_meshlets > 0);
+    check(stats.num_triangles >= GRID_SIZE * GRID_SIZE * 2);
+    check(stats.num_cones == stats.num_meshlets);
+    check(stats.cone_coverage == 1.0f);
+    check(stats.avg_cone_angle >= 0.0f and stats.avg_cone_angle < 1.0f);
+    check(stats.avg_sphere_tightness > 0.0f and
+          stats.avg_sphere_tightness <= 1.0f);
+  }
+}
+
+} // namespace
+
+int main() {
+  ScratchArena::init_for_thread();
+  test_chunk_clustered_centroids();
+  test_meshlet_stats();
+}